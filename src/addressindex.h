@@ -8,8 +8,11 @@
 
 #include "uint256.h"
 #include "amount.h"
+#include "compat/endian.h"
 #include "script/script.h"
 
+#include <string.h>
+
 struct CAddressUnspentKey {
     unsigned int type;
     uint160 hashBytes;
@@ -222,6 +225,39 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** Running totals of an address, maintained with the address index */
+struct CAddressSummary {
+    //! Sum of all received and spent amounts
+    CAmount nBalance;
+    //! Sum of all received amounts, including change
+    CAmount nReceived;
+    //! Number of transactions, which received or spent from the address
+    int64_t nTxCount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nBalance);
+        READWRITE(nReceived);
+        READWRITE(nTxCount);
+    }
+
+    CAddressSummary() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nBalance = 0;
+        nReceived = 0;
+        nTxCount = 0;
+    }
+
+    bool IsNull() const {
+        return nBalance == 0 && nReceived == 0 && nTxCount == 0;
+    }
+};
+
 struct CMempoolAddressDelta
 {
     int64_t time;
@@ -292,4 +328,55 @@ struct CMempoolAddressDeltaKeyCompare
     }
 };
 
+/** Orders hashes like their serialization, which is the order of their bytes rather than their numeric order */
+template <typename T>
+static inline int CompareHashBytes(const T& a, const T& b)
+{
+    return memcmp(a.begin(), b.begin(), a.size());
+}
+
+/** Orders keys of the address index like their serialization in LevelDB */
+struct CAddressIndexKeyCompare
+{
+    bool operator()(const CAddressIndexKey& a, const CAddressIndexKey& b) const {
+        if (a.type != b.type)
+            return a.type < b.type;
+        if (a.hashBytes != b.hashBytes)
+            return CompareHashBytes(a.hashBytes, b.hashBytes) < 0;
+        if (a.blockHeight != b.blockHeight)
+            return (uint32_t)a.blockHeight < (uint32_t)b.blockHeight;
+        if (a.txindex != b.txindex)
+            return a.txindex < b.txindex;
+        if (a.txhash != b.txhash)
+            return CompareHashBytes(a.txhash, b.txhash) < 0;
+        if (a.index != b.index)
+            // the output index is serialized little-endian
+            return be32toh(htole32((uint32_t)a.index)) < be32toh(htole32((uint32_t)b.index));
+        return a.spending < b.spending;
+    }
+};
+
+/** Orders keys of the address unspent index like their serialization in LevelDB */
+struct CAddressUnspentKeyCompare
+{
+    bool operator()(const CAddressUnspentKey& a, const CAddressUnspentKey& b) const {
+        if (a.type != b.type)
+            return a.type < b.type;
+        if (a.hashBytes != b.hashBytes)
+            return CompareHashBytes(a.hashBytes, b.hashBytes) < 0;
+        if (a.txhash != b.txhash)
+            return CompareHashBytes(a.txhash, b.txhash) < 0;
+        return be32toh(htole32((uint32_t)a.index)) < be32toh(htole32((uint32_t)b.index));
+    }
+};
+
+struct CAddressIndexIteratorKeyCompare
+{
+    bool operator()(const CAddressIndexIteratorKey& a, const CAddressIndexIteratorKey& b) const {
+        if (a.type != b.type)
+            return a.type < b.type;
+        return a.hashBytes < b.hashBytes;
+    }
+};
+
 #endif // BITCOIN_ADDRESSINDEX_H
\ No newline at end of file
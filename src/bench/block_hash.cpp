@@ -0,0 +1,72 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "primitives/block.h"
+#include "random.h"
+
+#include <vector>
+
+/* Number of headers hashed per iteration of the batch benchmarks */
+static const size_t HEADER_COUNT = 1000;
+
+static CBlockHeader RandomHeader()
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1600000000;
+    header.nBits = 0x1e0ffff0;
+    return header;
+}
+
+// Full HashQuark of a changed header
+static void BlockHeaderHash(benchmark::State& state)
+{
+    CBlockHeader header = RandomHeader();
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        header.GetHash();
+    }
+}
+
+// Repeated GetHash() of the same header
+static void BlockHeaderHashCached(benchmark::State& state)
+{
+    const CBlockHeader header = RandomHeader();
+    while (state.KeepRunning()) {
+        header.GetHash();
+    }
+}
+
+static void BlockHeaderHashBatch(benchmark::State& state, int nThreads)
+{
+    std::vector<CBlockHeader> vHeaders(HEADER_COUNT, RandomHeader());
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        vHeaders[i].nNonce = i;
+    }
+    std::vector<uint256> vHashes;
+    while (state.KeepRunning()) {
+        for (CBlockHeader& header : vHeaders) {
+            header.hashCache.Clear();
+        }
+        HashBlockHeaders(vHeaders, vHashes, nThreads);
+    }
+}
+
+static void BlockHeaderHashBatchSingleThread(benchmark::State& state)
+{
+    BlockHeaderHashBatch(state, 1);
+}
+
+static void BlockHeaderHashBatchAllCores(benchmark::State& state)
+{
+    BlockHeaderHashBatch(state, 0);
+}
+
+BENCHMARK(BlockHeaderHash);
+BENCHMARK(BlockHeaderHashCached);
+BENCHMARK(BlockHeaderHashBatchSingleThread);
+BENCHMARK(BlockHeaderHashBatchAllCores);
@@ -0,0 +1,168 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "arith_uint256.h"
+#include "tokencore/mdex.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+using namespace mastercore;
+
+// Compares the MetaDEx order book against the structures it replaced, a map
+// of rational prices to sets of orders, which was copied on every insert.
+static const int BOOK_ORDERS = 2000;
+static const int BOOK_PRICES = 250;
+static const int MATCH_FILLS = 20;
+
+typedef std::set<CMPMetaDEx, MetaDEx_compare> LegacySet;
+typedef std::map<rational_t, LegacySet> LegacyPrices;
+typedef std::map<uint32_t, LegacyPrices> LegacyProperties;
+
+static std::vector<CMPMetaDEx> CreateOrders()
+{
+    std::vector<CMPMetaDEx> orders;
+    orders.reserve(BOOK_ORDERS);
+
+    for (int i = 0; i < BOOK_ORDERS; ++i) {
+        int64_t amountForSale = 100000000 + (i % 7) * 3;
+        int64_t amountDesired = 50000000 + ((i * 7919) % BOOK_PRICES) * 1000001;
+        // every other order asks for a property, which is never offered
+        uint32_t propertyDesired = (i % 2 == 0) ? 3 : 5;
+        arith_uint256 txid = arith_uint256(i + 1);
+        orders.push_back(CMPMetaDEx("RiGQ12CCidStpSKmjdJMfzc2uE9JFD7epe", 1000 + i / 10, 4, amountForSale,
+                propertyDesired, amountDesired, ArithToUint256(txid), i % 10, 1));
+    }
+
+    return orders;
+}
+
+// The insertion, as it was done by MetaDEx_INSERT before
+static bool LegacyInsert(LegacyProperties& book, const CMPMetaDEx& order)
+{
+    LegacyPrices temp_prices;
+    LegacyPrices* p_prices = NULL;
+    LegacyProperties::iterator it = book.find(order.getProperty());
+    if (it != book.end()) p_prices = &(it->second);
+
+    LegacySet temp_indexes;
+    LegacySet* p_indexes = NULL;
+    if (p_prices) {
+        LegacyPrices::iterator itPrice = p_prices->find(order.unitPrice());
+        if (itPrice != p_prices->end()) p_indexes = &(itPrice->second);
+    }
+    if (!p_indexes) p_indexes = &temp_indexes;
+
+    if (!p_indexes->insert(order).second) return false;
+    if (!p_prices) p_prices = &temp_prices;
+
+    (*p_prices)[order.unitPrice()] = *p_indexes;
+    book[order.getProperty()] = *p_prices;
+
+    return true;
+}
+
+static void MetaDExInsertLegacy(benchmark::State& state)
+{
+    std::vector<CMPMetaDEx> orders = CreateOrders();
+
+    while (state.KeepRunning()) {
+        LegacyProperties book;
+        for (size_t i = 0; i < orders.size(); ++i) {
+            LegacyInsert(book, orders[i]);
+        }
+    }
+}
+
+static void MetaDExInsert(benchmark::State& state)
+{
+    std::vector<CMPMetaDEx> orders = CreateOrders();
+
+    while (state.KeepRunning()) {
+        md_PropertiesMap book;
+        for (size_t i = 0; i < orders.size(); ++i) {
+            book[orders[i].getProperty()].insert(orders[i]);
+        }
+    }
+}
+
+// Walks the book like x_Trade, takes the first matching orders, and puts them back
+static void MetaDExMatchLegacy(benchmark::State& state)
+{
+    std::vector<CMPMetaDEx> orders = CreateOrders();
+    LegacyProperties book;
+    for (size_t i = 0; i < orders.size(); ++i) {
+        LegacyInsert(book, orders[i]);
+    }
+
+    const CMPMetaDEx taker("RiGQ12CCidStpSKmjdJMfzc2uE9JFD7epe", 5000, 3, 100000000, 4, 60000000, uint256(), 0, 1);
+
+    while (state.KeepRunning()) {
+        std::vector<CMPMetaDEx> filled;
+        LegacyPrices& prices = book[taker.getDesProperty()];
+
+        for (LegacyPrices::iterator priceIt = prices.begin(); priceIt != prices.end(); ++priceIt) {
+            const rational_t sellersPrice = priceIt->first;
+            if (taker.inversePrice() < sellersPrice) continue;
+
+            LegacySet& offers = priceIt->second;
+            for (LegacySet::iterator offerIt = offers.begin(); offerIt != offers.end();) {
+                assert(offerIt->unitPrice() == sellersPrice);
+                if (offerIt->getDesProperty() != taker.getProperty()) {
+                    ++offerIt;
+                    continue;
+                }
+                filled.push_back(*offerIt);
+                offers.erase(offerIt++);
+                if (filled.size() == MATCH_FILLS) break;
+            }
+            if (filled.size() == MATCH_FILLS) break;
+        }
+
+        for (size_t i = 0; i < filled.size(); ++i) {
+            prices[filled[i].unitPrice()].insert(filled[i]);
+        }
+    }
+}
+
+static void MetaDExMatch(benchmark::State& state)
+{
+    std::vector<CMPMetaDEx> orders = CreateOrders();
+    md_PropertiesMap book;
+    for (size_t i = 0; i < orders.size(); ++i) {
+        book[orders[i].getProperty()].insert(orders[i]);
+    }
+
+    const CMPMetaDEx taker("RiGQ12CCidStpSKmjdJMfzc2uE9JFD7epe", 5000, 3, 100000000, 4, 60000000, uint256(), 0, 1);
+    const CMPMetaDExPrice buyersPrice = taker.inversePriceKey();
+
+    while (state.KeepRunning()) {
+        std::vector<CMPMetaDEx> filled;
+        CMPMetaDExBook& offers = book[taker.getDesProperty()];
+
+        for (CMPMetaDExBook::iterator offerIt = offers.begin(); offerIt != offers.end();) {
+            if (buyersPrice < offerIt.price()) break;
+            if (offerIt->getDesProperty() != taker.getProperty()) {
+                ++offerIt;
+                continue;
+            }
+            filled.push_back(*offerIt);
+            offerIt = offers.erase(offerIt);
+            if (filled.size() == MATCH_FILLS) break;
+        }
+
+        for (size_t i = 0; i < filled.size(); ++i) {
+            offers.insert(filled[i]);
+        }
+    }
+}
+
+BENCHMARK(MetaDExInsertLegacy);
+BENCHMARK(MetaDExInsert);
+BENCHMARK(MetaDExMatchLegacy);
+BENCHMARK(MetaDExMatch);
@@ -0,0 +1,352 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+
+#include <deque>
+#include <functional>
+
+#include <boost/thread.hpp>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+namespace {
+
+/** A read-only memory mapping of a block file. */
+class CMappedBlockFile
+{
+private:
+    const unsigned char* pbegin;
+    size_t nSize;
+#ifndef WIN32
+    void* pmap;
+#endif
+
+public:
+    CMappedBlockFile() : pbegin(nullptr), nSize(0)
+#ifndef WIN32
+        , pmap(MAP_FAILED)
+#endif
+    {
+    }
+
+    ~CMappedBlockFile()
+    {
+#ifndef WIN32
+        if (pmap != MAP_FAILED) munmap(pmap, nSize);
+#endif
+    }
+
+    bool Open(const fs::path& path)
+    {
+#ifdef WIN32
+        return false;
+#else
+        int fd = open(path.string().c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        nSize = st.st_size;
+        if (nSize == 0) {
+            // nothing to map, nor to import
+            close(fd);
+            return true;
+        }
+        pmap = mmap(nullptr, nSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (pmap == MAP_FAILED) return false;
+        madvise(pmap, nSize, MADV_SEQUENTIAL);
+        pbegin = static_cast<const unsigned char*>(pmap);
+        return true;
+#endif
+    }
+
+    const unsigned char* begin() const { return pbegin; }
+    const unsigned char* end() const { return pbegin + nSize; }
+};
+
+} // anon namespace
+
+CBlockImporter::CBlockImporter(int nThreads, size_t nMaxBufferedIn) :
+    nBatch(0),
+    nWorking(0),
+    fStop(false),
+    pbegin(nullptr),
+    pend(nullptr),
+    nNext(0),
+    nBuffered(0),
+    nMaxBuffered(nMaxBufferedIn)
+{
+    for (int i = 0; i < nThreads; ++i) {
+        vThreads.push_back(std::thread(&TraceThread<std::function<void()> >, "import",
+                std::function<void()>(std::bind(&CBlockImporter::ThreadWorker, this))));
+    }
+}
+
+CBlockImporter::~CBlockImporter()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fStop = true;
+    }
+    condWork.notify_all();
+    for (std::thread& thread : vThreads) {
+        thread.join();
+    }
+}
+
+void CBlockImporter::ThreadWorker()
+{
+    uint64_t nLastBatch = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condWork.wait(lock, [this, nLastBatch] { return fStop || nBatch != nLastBatch; });
+            if (fStop) return;
+            nLastBatch = nBatch;
+        }
+
+        ReadRecords();
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (--nWorking == 0) condDone.notify_all();
+        }
+    }
+}
+
+void CBlockImporter::ReadRecords()
+{
+    while (!fStop) {
+        const size_t nRecord = nNext++;
+        if (nRecord >= vRecords.size()) break;
+
+        Record& record = vRecords[nRecord];
+        try {
+            CMemoryReader reader(SER_DISK, CLIENT_VERSION, pbegin + record.nPos, pbegin + record.nPos + record.nSize);
+            std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+            reader >> *block;
+            record.hash = block->GetHash();
+            record.nRead = reader.GetPos();
+            record.block = block;
+        } catch (const std::exception& e) {
+            record.strError = e.what();
+        }
+    }
+}
+
+size_t CBlockImporter::SplitRecords(size_t nScanPos, std::vector<Record>& vBatch) const
+{
+    const unsigned char* pchMessageStart = reinterpret_cast<const unsigned char*>(Params().MessageStart());
+    const size_t nFileSize = pend - pbegin;
+
+    vBatch.clear();
+    while (vBatch.size() < IMPORT_BATCH_SIZE && nScanPos < nFileSize) {
+        // locate a header
+        const unsigned char* p = static_cast<const unsigned char*>(memchr(pbegin + nScanPos, pchMessageStart[0], nFileSize - nScanPos));
+        if (!p || (size_t)(pend - p) < MESSAGE_START_SIZE + sizeof(uint32_t)) {
+            // no valid block header found
+            return nFileSize;
+        }
+        const size_t nStart = p - pbegin;
+        nScanPos = nStart + 1;
+        if (memcmp(p, pchMessageStart, MESSAGE_START_SIZE))
+            continue;
+        // read size
+        const unsigned int nSize = ReadLE32(p + MESSAGE_START_SIZE);
+        const size_t nPos = nStart + MESSAGE_START_SIZE + sizeof(uint32_t);
+        if (nSize < 80 || nSize > MAX_BLOCK_SIZE_CURRENT || nSize > nFileSize - nPos)
+            continue;
+
+        vBatch.emplace_back(nStart, nPos, nSize);
+        nScanPos = nPos + nSize;
+    }
+    return nScanPos;
+}
+
+void CBlockImporter::StartBatch(std::vector<Record>& vBatch)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    assert(nWorking == 0);
+    vRecords.swap(vBatch);
+    nNext = 0;
+    nWorking = (int)vThreads.size();
+    ++nBatch;
+    condWork.notify_all();
+}
+
+void CBlockImporter::WaitBatch(std::vector<Record>& vBatch)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condDone.wait(lock, [this] { return nWorking == 0; });
+    vBatch.swap(vRecords);
+    vRecords.clear();
+}
+
+bool CBlockImporter::LoadFile(const fs::path& path, CDiskBlockPos* dbp)
+{
+    CMappedBlockFile file;
+    if (vThreads.empty() || !file.Open(path))
+        return false;
+
+    int64_t nStart = GetTimeMillis();
+    int nLoaded = 0;
+    pbegin = file.begin();
+    pend = file.end();
+
+    std::vector<Record> vBatch;
+    std::vector<Record> vNext;
+    size_t nScanPos = SplitRecords(0, vNext);
+    StartBatch(vNext);
+    try {
+        while (true) {
+            WaitBatch(vBatch);
+            if (vBatch.empty())
+                break;
+
+            // a block, which can't be deserialized, or is shorter than its
+            // record, moves the start of the next batch
+            for (size_t i = 0; i < vBatch.size(); i++) {
+                const Record& record = vBatch[i];
+                if (!record.block) {
+                    LogPrintf("%s : Deserialize or I/O error - %s\n", __func__, record.strError);
+                    nScanPos = record.nStart + 1;
+                    vBatch.erase(vBatch.begin() + i, vBatch.end());
+                    break;
+                }
+                if (record.nRead != record.nSize) {
+                    nScanPos = record.nPos + record.nRead;
+                    vBatch.erase(vBatch.begin() + i + 1, vBatch.end());
+                    break;
+                }
+            }
+
+            // deserialize the next batch, while this one is connected
+            nScanPos = SplitRecords(nScanPos, vNext);
+            StartBatch(vNext);
+
+            bool fError = false;
+            for (const Record& record : vBatch) {
+                boost::this_thread::interruption_point();
+                CDiskBlockPos pos;
+                if (dbp) pos = CDiskBlockPos(dbp->nFile, record.nPos);
+                if (!ProcessBlock(record.block, record.hash, record.nSize, dbp ? &pos : nullptr, nLoaded)) {
+                    fError = true;
+                    break;
+                }
+            }
+            if (fError) {
+                WaitBatch(vNext);
+                break;
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        WaitBatch(vNext);
+        AbortNode(std::string("System error: ") + e.what());
+    } catch (...) {
+        // the workers must be done with the file before it is unmapped
+        WaitBatch(vNext);
+        pbegin = pend = nullptr;
+        throw;
+    }
+    pbegin = pend = nullptr;
+
+    if (nLoaded > 0)
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    return true;
+}
+
+bool CBlockImporter::ProcessBlock(const std::shared_ptr<const CBlock>& block, const uint256& hash, unsigned int nSize, CDiskBlockPos* dbp, int& nLoaded)
+{
+    const uint256& hashGenesis = Params().GetConsensus().hashGenesisBlock;
+
+    bool fHaveParent;
+    bool fHaveData;
+    int nHeight = 0;
+    {
+        LOCK(cs_main);
+        fHaveParent = hash == hashGenesis || mapBlockIndex.count(block->hashPrevBlock);
+        BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+        fHaveData = mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA);
+        if (fHaveData) nHeight = mi->second->nHeight;
+    }
+
+    // detect out of order blocks, and keep them for later
+    if (!fHaveParent) {
+        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__,
+                hash.GetHex(), block->hashPrevBlock.GetHex());
+        Orphan orphan;
+        orphan.nSize = nSize;
+        if (dbp) orphan.pos = *dbp;
+        if (nBuffered + nSize <= nMaxBuffered) {
+            orphan.block = block;
+            nBuffered += nSize;
+        } else if (!dbp) {
+            // it can't be read again
+            return true;
+        }
+        mapUnknownParent.emplace(block->hashPrevBlock, orphan);
+        return true;
+    }
+
+    // process in case the block isn't known yet
+    if (!fHaveData) {
+        CValidationState state;
+        if (ProcessNewBlock(state, nullptr, block.get(), dbp, nullptr))
+            nLoaded++;
+        if (state.IsError())
+            return false;
+    } else if (hash != hashGenesis && nHeight % 1000 == 0) {
+        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), nHeight);
+    }
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, Orphan>::iterator, std::multimap<uint256, Orphan>::iterator> range = mapUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, Orphan>::iterator it = range.first;
+            std::shared_ptr<const CBlock> child = it->second.block;
+            CDiskBlockPos pos = it->second.pos;
+            if (child) {
+                nBuffered -= it->second.nSize;
+            } else {
+                std::shared_ptr<CBlock> blockRead = std::make_shared<CBlock>();
+                if (ReadBlockFromDisk(*blockRead, pos)) child = blockRead;
+            }
+            if (child) {
+                LogPrintf("%s: Processing out of order child %s of %s\n", __func__, child->GetHash().ToString(),
+                        head.ToString());
+                CValidationState dummy;
+                if (ProcessNewBlock(dummy, nullptr, child.get(), pos.IsNull() ? nullptr : &pos, nullptr)) {
+                    nLoaded++;
+                    queue.push_back(child->GetHash());
+                }
+            }
+            range.first++;
+            mapUnknownParent.erase(it);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_BLOCKIMPORT_H
+#define PIVX_BLOCKIMPORT_H
+
+#include "chain.h"
+#include "fs.h"
+#include "primitives/block.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Default for -importthreads, 0 = one thread per core
+static const int DEFAULT_IMPORT_THREADS = 0;
+//! Maximum number of threads deserializing blocks for -reindex and -loadblock
+static const int MAX_IMPORT_THREADS = 8;
+//! Default for -importbuffer, in MiB
+static const int64_t DEFAULT_IMPORT_BUFFER = 128;
+//! Number of blocks deserialized per batch
+static const size_t IMPORT_BATCH_SIZE = 256;
+
+/**
+ * Imports the block files of -reindex and -loadblock in a pipeline.
+ *
+ * A file is memory mapped and split into block records on the import thread.
+ * A pool of threads deserializes and hashes the next batch of records, while
+ * the import thread connects the current batch in file order.
+ *
+ * Blocks, which come before their parent, are kept in memory up to
+ * -importbuffer. Beyond that, only their position in the block files is kept,
+ * and they're read again, when their parent is connected.
+ */
+class CBlockImporter
+{
+private:
+    std::vector<std::thread> vThreads;
+    std::mutex mutex;
+    //! Signaled, when a batch is started, or the threads are stopped
+    std::condition_variable condWork;
+    //! Signaled, when a worker thread finished its part of a batch
+    std::condition_variable condDone;
+    //! Incremented for every batch
+    uint64_t nBatch;
+    //! Number of worker threads, which didn't finish the current batch yet
+    int nWorking;
+    std::atomic<bool> fStop;
+
+    void ThreadWorker();
+    void ReadRecords();
+
+protected:
+    struct Record {
+        //! Offsets of the message start and of the block in the file
+        size_t nStart;
+        size_t nPos;
+        unsigned int nSize;
+        //! Number of bytes deserialized
+        size_t nRead;
+        std::shared_ptr<CBlock> block;
+        //! Hash of the block, computed by the worker thread
+        uint256 hash;
+        std::string strError;
+
+        Record(size_t nStartIn, size_t nPosIn, unsigned int nSizeIn) : nStart(nStartIn), nPos(nPosIn), nSize(nSizeIn), nRead(0) {}
+    };
+
+    //! Block with an unknown parent, in memory or at its position in the block files
+    struct Orphan {
+        std::shared_ptr<const CBlock> block;
+        CDiskBlockPos pos;
+        unsigned int nSize;
+    };
+
+    //! The mapped file, and the batch of records being deserialized
+    const unsigned char* pbegin;
+    const unsigned char* pend;
+    std::vector<Record> vRecords;
+    //! Position of the next record to deserialize
+    std::atomic<size_t> nNext;
+
+    std::multimap<uint256, Orphan> mapUnknownParent;
+    //! Size of the orphans kept in memory
+    size_t nBuffered;
+    const size_t nMaxBuffered;
+
+    /** Splits the records of the next batch from nScanPos on, and returns the position after them. */
+    size_t SplitRecords(size_t nScanPos, std::vector<Record>& vBatch) const;
+    void StartBatch(std::vector<Record>& vBatch);
+    /** Waits until the workers deserialized the current batch, if any, and returns it. */
+    void WaitBatch(std::vector<Record>& vBatch);
+    /** Connects a block and its known children. Returns false on a fatal error. */
+    bool ProcessBlock(const std::shared_ptr<const CBlock>& block, const uint256& hash, unsigned int nSize, CDiskBlockPos* dbp, int& nLoaded);
+
+public:
+    /** Starts the worker threads. nMaxBufferedIn is in bytes. */
+    CBlockImporter(int nThreads, size_t nMaxBufferedIn);
+    /** Stops and joins the worker threads. */
+    ~CBlockImporter();
+
+    /**
+     * Imports the blocks of a file. dbp is the position of a file of the block
+     * directory with -reindex, whose blocks aren't written again. Returns false,
+     * if the file can't be mapped, and LoadExternalBlockFile has to be used.
+     */
+    bool LoadFile(const fs::path& path, CDiskBlockPos* dbp);
+};
+
+#endif // PIVX_BLOCKIMPORT_H
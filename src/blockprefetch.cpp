@@ -0,0 +1,94 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockprefetch.h"
+
+#include "chain.h"
+#include "main.h"
+#include "util.h"
+
+CBlockPrefetcher::CBlockPrefetcher(int nThreads, bool fUndoIn) :
+    nBatch(0),
+    nWorking(0),
+    fStop(false),
+    fUndo(fUndoIn),
+    nNext(0)
+{
+    for (int i = 0; i < nThreads; ++i) {
+        vThreads.push_back(std::thread(&TraceThread<std::function<void()> >, "prefetch",
+                std::function<void()>(std::bind(&CBlockPrefetcher::ThreadWorker, this))));
+    }
+}
+
+CBlockPrefetcher::~CBlockPrefetcher()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fStop = true;
+    }
+    condWork.notify_all();
+    for (std::thread& thread : vThreads) {
+        thread.join();
+    }
+}
+
+void CBlockPrefetcher::ThreadWorker()
+{
+    uint64_t nLastBatch = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condWork.wait(lock, [this, nLastBatch] { return fStop || nBatch != nLastBatch; });
+            if (fStop) return;
+            nLastBatch = nBatch;
+        }
+
+        ReadBlocks();
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (--nWorking == 0) condDone.notify_all();
+        }
+    }
+}
+
+void CBlockPrefetcher::ReadBlocks()
+{
+    while (!fStop) {
+        const size_t nPos = nNext++;
+        if (nPos >= vBlocks.size()) break;
+
+        Block& block = vBlocks[nPos];
+        block.fRead = ReadBlockFromDisk(block.block, block.pindex);
+        if (block.fRead && fUndo && block.pindex->pprev) {
+            const CDiskBlockPos pos = block.pindex->GetUndoPos();
+            block.fRead = !pos.IsNull() && UndoReadFromDisk(block.undo, pos, block.pindex->pprev->GetBlockHash());
+        }
+        if (block.fRead && fnProcess) fnProcess(nPos, block);
+    }
+}
+
+void CBlockPrefetcher::Start(const std::vector<const CBlockIndex*>& vIndexes, const ProcessFn& fnProcessIn)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    assert(nWorking == 0);
+    vBlocks.clear();
+    vBlocks.reserve(vIndexes.size());
+    for (const CBlockIndex* pindex : vIndexes) {
+        vBlocks.emplace_back(pindex);
+    }
+    fnProcess = fnProcessIn;
+    nNext = 0;
+    nWorking = (int)vThreads.size();
+    ++nBatch;
+    condWork.notify_all();
+}
+
+void CBlockPrefetcher::Wait(std::vector<Block>& vBlocksOut)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condDone.wait(lock, [this] { return nWorking == 0; });
+    vBlocksOut.swap(vBlocks);
+    vBlocks.clear();
+}
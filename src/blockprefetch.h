@@ -0,0 +1,84 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_BLOCKPREFETCH_H
+#define PIVX_BLOCKPREFETCH_H
+
+#include "coins.h"
+#include "primitives/block.h"
+#include "undo.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CBlockIndex;
+
+//! Maximum number of threads reading blocks ahead of a recalculation of the chain state
+static const int MAX_PREFETCH_THREADS = 8;
+//! Number of blocks read per batch
+static const size_t PREFETCH_BATCH_SIZE = 500;
+
+/**
+ * Reads blocks of the active chain, and optionally their undo data, ahead on a
+ * pool of threads, while the previous batch is processed in chain order.
+ *
+ * Used by the recalculations of the money supply and of the zerocoin database,
+ * which otherwise spend most of their time waiting for the disk. Parsing,
+ * which doesn't depend on the blocks before, can run on the workers as well.
+ */
+class CBlockPrefetcher
+{
+public:
+    struct Block {
+        const CBlockIndex* pindex;
+        CBlock block;
+        //! Only read, if the prefetcher was created with fUndo
+        CBlockUndo undo;
+        bool fRead;
+
+        explicit Block(const CBlockIndex* pindexIn) : pindex(pindexIn), fRead(false) {}
+    };
+
+    //! Run on a worker thread for every block read, with its position in the batch
+    typedef std::function<void(size_t nPos, const Block& block)> ProcessFn;
+
+private:
+    std::vector<std::thread> vThreads;
+    std::mutex mutex;
+    //! Signaled, when a batch is started, or the threads are stopped
+    std::condition_variable condWork;
+    //! Signaled, when a worker thread finished its part of a batch
+    std::condition_variable condDone;
+    //! Incremented for every batch
+    uint64_t nBatch;
+    //! Number of worker threads, which didn't finish the current batch yet
+    int nWorking;
+    std::atomic<bool> fStop;
+    const bool fUndo;
+
+    std::vector<Block> vBlocks;
+    ProcessFn fnProcess;
+    //! Position of the next block to read
+    std::atomic<size_t> nNext;
+
+    void ThreadWorker();
+    void ReadBlocks();
+
+public:
+    /** Starts the worker threads. */
+    CBlockPrefetcher(int nThreads, bool fUndoIn);
+    /** Stops and joins the worker threads. */
+    ~CBlockPrefetcher();
+
+    /** Starts reading a batch of blocks, fnProcessIn is optional. */
+    void Start(const std::vector<const CBlockIndex*>& vIndexes, const ProcessFn& fnProcessIn = ProcessFn());
+    /** Waits for the current batch, and moves its blocks to vBlocksOut. */
+    void Wait(std::vector<Block>& vBlocksOut);
+};
+
+#endif // PIVX_BLOCKPREFETCH_H
@@ -19,7 +19,7 @@ bool SignBlock(CBlock& block, const CKeyStore& keystore)
     CKeyID keyID;
     if (block.IsProofOfWork()) {
         bool fFoundID = false;
-        for (const CTxOut& txout :block.vtx[0].vout) {
+        for (const CTxOut& txout :block.vtx[0]->vout) {
             if (!txout.GetKeyIDFromUTXO(keyID))
                 continue;
             fFoundID = true;
@@ -28,12 +28,12 @@ bool SignBlock(CBlock& block, const CKeyStore& keystore)
         if (!fFoundID)
             return error("%s: failed to find key for PoW", __func__);
     } else {
-        if (block.vtx[1].vout.size() < 3)
+        if (block.vtx[1]->vout.size() < 3)
             return error("%s: invalid number of outputs for PoS", __func__);
 
         int keyIndex = 2;
 
-        if (!block.vtx[1].vout[keyIndex].GetKeyIDFromUTXO(keyID))
+        if (!block.vtx[1]->vout[keyIndex].GetKeyIDFromUTXO(keyID))
             return error("%s: failed to find key for PoS", __func__);
     }
 
@@ -57,20 +57,20 @@ bool CheckBlockSignature(const CBlock& block, const bool enableP2PKH)
      *  UTXO: The public key that signs must match the public key associated with the first utxo of the coinstake tx.
      */
     CPubKey pubkey;
-    bool fzPIVStake = block.vtx[1].vin[0].IsZerocoinSpend();
+    bool fzPIVStake = block.vtx[1]->vin[0].IsZerocoinSpend();
     if (fzPIVStake) {
-        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(block.vtx[1].vin[0]);
+        libzerocoin::CoinSpend spend = TxInToZerocoinSpend(block.vtx[1]->vin[0]);
         pubkey = spend.getPubKey();
     } else {
         txnouttype whichType;
         std::vector<valtype> vSolutions;
 
-        if (block.vtx[1].vout.size() < 3)
+        if (block.vtx[1]->vout.size() < 3)
             return false;
 
         int keyIndex = 2;
 
-        const CTxOut& txout = block.vtx[1].vout[keyIndex];
+        const CTxOut& txout = block.vtx[1]->vout[keyIndex];
 
         if (!Solver(txout.scriptPubKey, whichType, vSolutions))
             return false;
@@ -86,7 +86,7 @@ bool CheckBlockSignature(const CBlock& block, const bool enableP2PKH)
             valtype& vchPubKey = vSolutions[0];
             pubkey = CPubKey(vchPubKey);
         } else if (whichType == TX_PUBKEYHASH) {
-            const CTxIn& txin = block.vtx[1].vin[0];
+            const CTxIn& txin = block.vtx[1]->vin[0];
             // Check if the scriptSig is for a p2pk or a p2pkh
             if (txin.scriptSig.size() == 73) { // Sig size + DER signature size.
                 // If the input is for a p2pk and the output is a p2pkh.
@@ -99,7 +99,7 @@ bool CheckBlockSignature(const CBlock& block, const bool enableP2PKH)
             }
         } else if (whichType == TX_COLDSTAKE) {
             // pick the public key from the P2CS input
-            const CTxIn& txin = block.vtx[1].vin[0];
+            const CTxIn& txin = block.vtx[1]->vin[0];
             int start = 1 + (int) *txin.scriptSig.begin(); // skip sig
             start += 1 + (int) *(txin.scriptSig.begin()+start); // skip flag
             pubkey = CPubKey(txin.scriptSig.begin()+start+1, txin.scriptSig.end());
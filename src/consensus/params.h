@@ -144,12 +144,17 @@ struct Params {
 
     libzerocoin::ZerocoinParams* Zerocoin_Params(bool useModulusV1) const
     {
-        static CBigNum bnHexModulus = 0;
-        if (!bnHexModulus) bnHexModulus.SetHex(ZC_Modulus);
-        static libzerocoin::ZerocoinParams ZCParamsHex = libzerocoin::ZerocoinParams(bnHexModulus);
-        static CBigNum bnDecModulus = 0;
-        if (!bnDecModulus) bnDecModulus.SetDec(ZC_Modulus);
-        static libzerocoin::ZerocoinParams ZCParamsDec = libzerocoin::ZerocoinParams(bnDecModulus);
+        // the moduli are parsed within the initialization of the statics, which is thread-safe
+        static libzerocoin::ZerocoinParams ZCParamsHex = libzerocoin::ZerocoinParams([this] {
+            CBigNum bnHexModulus = 0;
+            bnHexModulus.SetHex(ZC_Modulus);
+            return bnHexModulus;
+        }());
+        static libzerocoin::ZerocoinParams ZCParamsDec = libzerocoin::ZerocoinParams([this] {
+            CBigNum bnDecModulus = 0;
+            bnDecModulus.SetDec(ZC_Modulus);
+            return bnDecModulus;
+        }());
         return (useModulusV1 ? &ZCParamsHex : &ZCParamsDec);
     }
 
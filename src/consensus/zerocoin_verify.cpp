@@ -4,6 +4,7 @@
 
 #include "zerocoin_verify.h"
 
+#include "blockprefetch.h"
 #include "chainparams.h"
 #include "consensus/consensus.h"
 #include "guiinterface.h"        // for ui_interface
@@ -190,6 +191,50 @@ bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const lib
     return true;
 }
 
+bool GetBlockSupplyChange(const CBlock& block, const CBlockUndo& blockUndo, CAmount& nChange)
+{
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size())
+        return false;
+
+    CAmount nValueIn = 0;
+    CAmount nValueOut = 0;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+            if (tx.HasZerocoinSpendInputs()) {
+                // zerocoin spends have no undo data, their nSequence is the denomination of the spent mint
+                for (const CTxIn& in : tx.vin) {
+                    if (in.IsZerocoinSpend() || in.IsZerocoinPublicSpend()) {
+                        nValueIn += in.nSequence * COIN;
+                        continue;
+                    }
+                    // other inputs aren't spent from the coins either, so they're looked up
+                    CTransaction txPrev;
+                    uint256 hashBlock;
+                    if (!GetTransaction(in.prevout.hash, txPrev, hashBlock, true) || in.prevout.n >= txPrev.vout.size())
+                        return error("%s : input %s of %s not found", __func__, in.prevout.ToString(), tx.GetHash().GetHex());
+                    nValueIn += txPrev.vout[in.prevout.n].nValue;
+                }
+            } else {
+                if (txundo.vprevout.size() != tx.vin.size())
+                    return false;
+                for (const Coin& coin : txundo.vprevout)
+                    nValueIn += coin.out.nValue;
+            }
+        }
+
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            if (j == 0 && tx.IsCoinStake())
+                continue;
+
+            nValueOut += tx.vout[j].nValue;
+        }
+    }
+    nChange = nValueOut - nValueIn;
+    return true;
+}
+
 bool RecalculatePIVSupply(int nHeightStart, bool fSkipZpiv)
 {
     AssertLockHeld(cs_main);
@@ -199,7 +244,6 @@ bool RecalculatePIVSupply(int nHeightStart, bool fSkipZpiv)
     if (nHeightStart > chainHeight)
         return false;
 
-    CBlockIndex* pindex = chainActive[nHeightStart];
     if (IsActivationHeight(nHeightStart, consensus, Consensus::UPGRADE_ZC))
         nMoneySupply = CAmount(5449796547496199);
 
@@ -209,74 +253,73 @@ bool RecalculatePIVSupply(int nHeightStart, bool fSkipZpiv)
         for (auto& denom : libzerocoin::zerocoinDenomList) mapZerocoinSupply.insert(std::make_pair(denom, 0));
     }
 
+    // The blocks and their undo data are read ahead on a pool of threads,
+    // while the previous batch is summed in chain order.
+    CBlockPrefetcher prefetcher(std::max(1, std::min(GetNumCores(), MAX_PREFETCH_THREADS)), true);
+    int nNextHeight = nHeightStart;
+    std::vector<const CBlockIndex*> vNext;
+    auto fillNext = [&]() {
+        vNext.clear();
+        while (vNext.size() < PREFETCH_BATCH_SIZE && nNextHeight <= chainHeight)
+            vNext.push_back(chainActive[nNextHeight++]);
+    };
+    fillNext();
+    prefetcher.Start(vNext);
+
     uiInterface.ShowProgress(_("Recalculating PIV supply..."), 0);
+    std::vector<CBlockPrefetcher::Block> vBlocks;
+    std::vector<const CBlockIndex*> vIndexes;
     while (true) {
-        if (pindex->nHeight % 1000 == 0) {
-            LogPrintf("%s : block %d...\n", __func__, pindex->nHeight);
-            int percent = std::max(1, std::min(99, (int)((double)((pindex->nHeight - nHeightStart) * 100) / (chainHeight - nHeightStart))));
-            uiInterface.ShowProgress(_("Recalculating PIV supply..."), percent);
-        }
-
-        CBlock block;
-        assert(ReadBlockFromDisk(block, pindex));
-
-        CAmount nValueIn = 0;
-        CAmount nValueOut = 0;
-        for (const CTransaction& tx : block.vtx) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                if (tx.IsCoinBase())
-                    break;
-
-                if (tx.vin[i].IsZerocoinSpend()) {
-                    nValueIn += tx.vin[i].nSequence * COIN;
-                    continue;
-                }
-
-                COutPoint prevout = tx.vin[i].prevout;
-                CTransaction txPrev;
-                uint256 hashBlock;
-                assert(GetTransaction(prevout.hash, txPrev, hashBlock, true));
-                nValueIn += txPrev.vout[prevout.n].nValue;
+        prefetcher.Wait(vBlocks);
+        if (vBlocks.empty())
+            break;
+        fillNext();
+        prefetcher.Start(vNext);
+
+        for (const CBlockPrefetcher::Block& item : vBlocks) {
+            CBlockIndex* pindex = chainActive[item.pindex->nHeight];
+            if (pindex->nHeight % 1000 == 0) {
+                LogPrintf("%s : block %d...\n", __func__, pindex->nHeight);
+                int percent = std::max(1, std::min(99, (int)((double)((pindex->nHeight - nHeightStart) * 100) / (chainHeight - nHeightStart))));
+                uiInterface.ShowProgress(_("Recalculating PIV supply..."), percent);
             }
 
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                if (i == 0 && tx.IsCoinStake())
-                    continue;
+            CAmount nChange;
+            if (!item.fRead)
+                return error("%s : failed to read block %d or its undo data", __func__, pindex->nHeight);
+            if (!GetBlockSupplyChange(item.block, item.undo, nChange))
+                return error("%s : block %d and undo data inconsistent", __func__, pindex->nHeight);
 
-                nValueOut += tx.vout[i].nValue;
-            }
-        }
+            // Rewrite money supply
+            nMoneySupply += nChange;
 
-        // Rewrite money supply
-        nMoneySupply += (nValueOut - nValueIn);
+            // Rewrite zpiv supply too
+            if (!fSkipZpiv && consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_ZC)) {
+                UpdateZPIVSupplyConnect(item.block, pindex, true);
+            }
 
-        // Rewrite zpiv supply too
-        if (!fSkipZpiv && consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_ZC)) {
-            UpdateZPIVSupplyConnect(block, pindex, true);
-        }
+            // Add fraudulent funds to the supply and remove any recovered funds.
+            if (pindex->nHeight == consensus.height_ZC_RecalcAccumulators) {
+                const CAmount nInvalidAmountFiltered = 268200*COIN;    //Amount of invalid coins filtered through exchanges, that should be considered valid
+                LogPrintf("%s : Original money supply=%s\n", __func__, FormatMoney(nMoneySupply));
 
-        // Add fraudulent funds to the supply and remove any recovered funds.
-        if (pindex->nHeight == consensus.height_ZC_RecalcAccumulators) {
-            const CAmount nInvalidAmountFiltered = 268200*COIN;    //Amount of invalid coins filtered through exchanges, that should be considered valid
-            LogPrintf("%s : Original money supply=%s\n", __func__, FormatMoney(nMoneySupply));
+                nMoneySupply += nInvalidAmountFiltered;
+                LogPrintf("%s : Adding filtered funds to supply + %s : supply=%s\n", __func__, FormatMoney(nInvalidAmountFiltered), FormatMoney(nMoneySupply));
 
-            nMoneySupply += nInvalidAmountFiltered;
-            LogPrintf("%s : Adding filtered funds to supply + %s : supply=%s\n", __func__, FormatMoney(nInvalidAmountFiltered), FormatMoney(nMoneySupply));
+                CAmount nLocked = GetInvalidUTXOValue();
+                nMoneySupply -= nLocked;
+                LogPrintf("%s : Removing locked from supply - %s : supply=%s\n", __func__, FormatMoney(nLocked), FormatMoney(nMoneySupply));
+            }
 
-            CAmount nLocked = GetInvalidUTXOValue();
-            nMoneySupply -= nLocked;
-            LogPrintf("%s : Removing locked from supply - %s : supply=%s\n", __func__, FormatMoney(nLocked), FormatMoney(nMoneySupply));
+            vIndexes.push_back(pindex);
         }
 
-        assert(pblocktree->WriteBlockIndex(CDiskBlockIndex(pindex)));
+        // one batch write per batch of blocks, instead of a write per block
+        assert(pblocktree->WriteBlockIndexes(vIndexes));
+        vIndexes.clear();
 
         // Stop if shutdown was requested
         if (ShutdownRequested()) return false;
-
-        if (pindex->nHeight < chainHeight)
-            pindex = chainActive.Next(pindex);
-        else
-            break;
     }
     uiInterface.ShowProgress("", 100);
     return true;
@@ -20,6 +20,12 @@ int CurrentPublicCoinSpendVersion();
 bool CheckPublicCoinSpendVersion(int version);
 bool ContextualCheckZerocoinSpend(const CTransaction& tx, const libzerocoin::CoinSpend* spend, int nHeight, const uint256& hashBlock);
 bool ContextualCheckZerocoinSpendNoSerialCheck(const CTransaction& tx, const libzerocoin::CoinSpend* spend, int nHeight, const uint256& hashBlock);
+/**
+ * Change of the PIV supply by a block, from the values of the spent outputs in its undo data.
+ * Zerocoin spends count their denomination. Other inputs of zerocoin spend transactions have
+ * no undo data, and are looked up with GetTransaction.
+ */
+bool GetBlockSupplyChange(const CBlock& block, const CBlockUndo& blockUndo, CAmount& nChange);
 bool RecalculatePIVSupply(int nHeightStart, bool fSkipZpiv = true);
 CAmount GetInvalidUTXOValue();
 
@@ -0,0 +1,175 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/chacha20.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <assert.h>
+#include <string.h>
+
+namespace {
+
+/** 2^3072 - 1103717, the largest 3072-bit safe prime number, is used as the modulus. */
+const uint32_t MAX_PRIME_DIFF = 1103717;
+
+} // anon namespace
+
+Num3072::Num3072()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) limbs[i] = 0;
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        limbs[i] = ReadLE32(data + 4 * i);
+    }
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    Num3072 tmp(*this);
+    if (tmp.IsOverflow()) tmp.FullReduce();
+    for (int i = 0; i < LIMBS; ++i) {
+        WriteLE32(out + 4 * i, tmp.limbs[i]);
+    }
+}
+
+/** Whether the number is at least the modulus. */
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= 0xffffffff - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; ++i) {
+        if (limbs[i] != 0xffffffff) return false;
+    }
+    return true;
+}
+
+/** Subtracts the modulus, by adding MAX_PRIME_DIFF and dropping the carry out of the top limb. */
+void Num3072::FullReduce()
+{
+    uint64_t carry = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS && carry; ++i) {
+        carry += limbs[i];
+        limbs[i] = (uint32_t)carry;
+        carry >>= LIMB_SIZE;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    // Schoolbook product into 2 * LIMBS limbs
+    uint32_t prod[2 * LIMBS];
+    memset(prod, 0, sizeof(prod));
+    for (int i = 0; i < LIMBS; ++i) {
+        uint64_t carry = 0;
+        const uint64_t x = limbs[i];
+        for (int j = 0; j < LIMBS; ++j) {
+            carry += x * a.limbs[j] + prod[i + j];
+            prod[i + j] = (uint32_t)carry;
+            carry >>= LIMB_SIZE;
+        }
+        prod[i + LIMBS] = (uint32_t)carry;
+    }
+
+    // 2^3072 = MAX_PRIME_DIFF (mod p), so the high half is folded into the low half
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        carry += (uint64_t)prod[LIMBS + i] * MAX_PRIME_DIFF + prod[i];
+        limbs[i] = (uint32_t)carry;
+        carry >>= LIMB_SIZE;
+    }
+
+    // The remaining carry is below 2^22, fold it again, which overflows at most once more
+    while (carry) {
+        carry *= MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && carry; ++i) {
+            carry += limbs[i];
+            limbs[i] = (uint32_t)carry;
+            carry >>= LIMB_SIZE;
+        }
+    }
+
+    if (IsOverflow()) FullReduce();
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Fermat: a^(p - 2), with a fixed window of 4 bits over the exponent
+    // p - 2 = 2^3072 - 1103719
+    uint32_t exponent[LIMBS];
+    for (int i = 0; i < LIMBS; ++i) exponent[i] = 0xffffffff;
+    exponent[0] = 0xffffffff - (MAX_PRIME_DIFF + 2) + 1;
+
+    Num3072 table[16];
+    table[1] = *this;
+    for (int i = 2; i < 16; ++i) {
+        table[i] = table[i - 1];
+        table[i].Multiply(*this);
+    }
+
+    Num3072 out;
+    for (int i = LIMBS * LIMB_SIZE / 4 - 1; i >= 0; --i) {
+        for (int j = 0; j < 4; ++j) out.Multiply(out);
+        const int window = (exponent[i / 8] >> (4 * (i % 8))) & 0xf;
+        if (window) out.Multiply(table[window]);
+    }
+    return out;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+
+    unsigned char tmp[Num3072::BYTE_SIZE];
+    ChaCha20(hash, sizeof(hash)).Output(tmp, sizeof(tmp));
+    return Num3072(tmp);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char* out) const
+{
+    Num3072 value = numerator;
+    value.Divide(denominator);
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    value.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out);
+}
@@ -0,0 +1,69 @@
+// Copyright (c) 2017-2020 The Bitcoin Core developers
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A 3072-bit number, modulo the prime 2^3072 - 1103717. */
+class Num3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+    static const int LIMBS = 96;
+    static const int LIMB_SIZE = 32;
+
+    uint32_t limbs[LIMBS];
+
+    /** Sets the number to one. */
+    Num3072();
+    /** Loads a little endian number of BYTE_SIZE bytes. */
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    Num3072 GetInverse() const;
+    /** Stores the fully reduced number as BYTE_SIZE little endian bytes. */
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+    bool IsOverflow() const;
+    void FullReduce();
+};
+
+/** A hash of a multiset, which can be updated element by element.
+ *
+ * Each element is hashed with SHA256, expanded to a 3072-bit number with
+ * ChaCha20, and multiplied into the numerator (Insert) or the denominator
+ * (Remove) modulo a 3072-bit prime. The result doesn't depend on the order of
+ * the updates, and unlike additive multiset hashes, it isn't open to
+ * generalized birthday attacks. See "Incremental Multiset Hash Functions and
+ * Their Application to Memory Integrity Checking" (Clarke et al.), and the
+ * MuHash3072 of Bitcoin Core.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    /** The hash of the empty set. */
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    MuHash3072& operator*=(const MuHash3072& mul);
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    /** Writes the 32 byte SHA256 of the set's 3072-bit value to out. */
+    void Finalize(unsigned char* out) const;
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -5,7 +5,9 @@
 #include "dbwrapper.h"
 
 #include "util.h"
+#include "utilstrencodings.h"
 
+#include <boost/algorithm/string.hpp>
 #include <boost/scoped_ptr.hpp>
 
 #include <leveldb/cache.h>
@@ -14,6 +16,10 @@
 #include <memenv.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <mutex>
+#include <set>
+
 
 static leveldb::Options GetOptions(size_t nCacheSize)
 {
@@ -31,15 +37,151 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
+namespace {
+
+struct RegisteredDB
+{
+    std::string strName;
+    leveldb::DB* pdb;
+    const CDBStats* stats;
+};
+
+std::mutex csRegisteredDBs;
+std::vector<RegisteredDB> vRegisteredDBs;
+
+//! Parses one -dbprofile option into the database name and its option values
+bool ParseDBProfile(const std::string& strProfile, std::string& strName, std::vector<std::pair<std::string, int64_t> >& vOptions, std::string& strError)
+{
+    static const std::set<std::string> setOptionNames = {
+        "writebuffer", "blockcache", "blocksize", "bloombits", "maxopenfiles", "maxfilesize", "compression"};
+
+    const size_t nColon = strProfile.find(':');
+    if (nColon == std::string::npos || nColon == 0) {
+        strError = strprintf("Invalid -dbprofile '%s', expecting <db>:<option>=<value>[,...]", strProfile);
+        return false;
+    }
+    strName = strProfile.substr(0, nColon);
+
+    std::vector<std::string> vItems;
+    boost::split(vItems, strProfile.substr(nColon + 1), boost::is_any_of(","));
+    for (const std::string& strItem : vItems) {
+        const size_t nEquals = strItem.find('=');
+        int64_t nValue;
+        if (nEquals == std::string::npos || !ParseInt64(strItem.substr(nEquals + 1), &nValue) || nValue < 0) {
+            strError = strprintf("Invalid -dbprofile option '%s' for %s, expecting <option>=<value>", strItem, strName);
+            return false;
+        }
+        const std::string strOption = strItem.substr(0, nEquals);
+        if (!setOptionNames.count(strOption)) {
+            strError = strprintf("Unknown -dbprofile option '%s' for %s", strOption, strName);
+            return false;
+        }
+        vOptions.emplace_back(strOption, nValue);
+    }
+    return true;
+}
+
+//! Sets an option, sizes are given in KiB
+void SetDBOption(leveldb::Options& options, const std::string& strOption, int64_t nValue)
+{
+    if (strOption == "writebuffer") {
+        options.write_buffer_size = std::max<int64_t>(nValue, 64) << 10;
+    } else if (strOption == "blockcache") {
+        delete options.block_cache;
+        options.block_cache = leveldb::NewLRUCache(nValue << 10);
+    } else if (strOption == "blocksize") {
+        options.block_size = std::max<int64_t>(nValue, 1) << 10;
+    } else if (strOption == "bloombits") {
+        delete options.filter_policy;
+        options.filter_policy = nValue ? leveldb::NewBloomFilterPolicy((int)nValue) : NULL;
+    } else if (strOption == "maxopenfiles") {
+        options.max_open_files = std::max<int64_t>(nValue, 16);
+    } else if (strOption == "maxfilesize") {
+        options.max_file_size = std::max<int64_t>(nValue, 64) << 10;
+    } else if (strOption == "compression") {
+        options.compression = nValue ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    }
+}
+
+}
+
+std::string GetDBName(const fs::path& path)
+{
+    const std::string strDataDir = GetDataDir().string();
+    std::string strName = path.string();
+    if (strName.compare(0, strDataDir.size(), strDataDir) == 0) {
+        strName.erase(0, strDataDir.size());
+        strName.erase(0, strName.find_first_not_of("/\\"));
+    }
+    return strName;
+}
+
+bool CheckDBProfiles(std::string& strError)
+{
+    for (const std::string& strProfile : mapMultiArgs["-dbprofile"]) {
+        std::string strName;
+        std::vector<std::pair<std::string, int64_t> > vOptions;
+        if (!ParseDBProfile(strProfile, strName, vOptions, strError))
+            return false;
+    }
+    return true;
+}
+
+void ApplyDBProfile(const std::string& strName, leveldb::Options& options)
+{
+    // options for all databases first, so that the options of a database override them
+    for (const bool fAll : {true, false}) {
+        for (const std::string& strProfile : mapMultiArgs["-dbprofile"]) {
+            std::string strProfileName, strError;
+            std::vector<std::pair<std::string, int64_t> > vOptions;
+            if (!ParseDBProfile(strProfile, strProfileName, vOptions, strError))
+                continue;
+            if (fAll ? strProfileName != "*" : strProfileName != strName)
+                continue;
+            for (const auto& option : vOptions) {
+                SetDBOption(options, option.first, option.second);
+                LogPrint(BCLog::LEVELDB, "%s: %s=%d for %s\n", __func__, option.first, option.second, strName);
+            }
+        }
+    }
+}
+
+void RegisterDB(const std::string& strName, leveldb::DB* pdb, const CDBStats* stats)
+{
+    std::lock_guard<std::mutex> lock(csRegisteredDBs);
+    vRegisteredDBs.push_back({strName, pdb, stats});
+}
+
+void UnregisterDB(leveldb::DB* pdb)
+{
+    std::lock_guard<std::mutex> lock(csRegisteredDBs);
+    for (auto it = vRegisteredDBs.begin(); it != vRegisteredDBs.end(); ++it) {
+        if (it->pdb == pdb) {
+            vRegisteredDBs.erase(it);
+            return;
+        }
+    }
+}
+
+void ForEachDB(const std::function<void(const std::string&, leveldb::DB*, const CDBStats*)>& f)
+{
+    std::lock_guard<std::mutex> lock(csRegisteredDBs);
+    for (const RegisteredDB& db : vRegisteredDBs) {
+        f(db.strName, db.pdb, db.stats);
+    }
+}
+
 CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe)
 {
     penv = NULL;
+    strName = GetDBName(path);
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
     options = GetOptions(nCacheSize);
     options.create_if_missing = true;
+    ApplyDBProfile(strName, options);
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
         options.env = penv;
@@ -55,10 +197,12 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    RegisterDB(strName, pdb, &stats);
 }
 
 CDBWrapper::~CDBWrapper()
 {
+    UnregisterDB(pdb);
     delete pdb;
     pdb = NULL;
     delete options.filter_policy;
@@ -71,7 +215,11 @@ CDBWrapper::~CDBWrapper()
 
 bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
+    const int64_t nTimeStart = GetTimeMicros();
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
+    stats.nWriteTime += GetTimeMicros() - nTimeStart;
+    ++stats.nBatches;
+    stats.nBatchBytes += batch.SizeEstimate();
     dbwrapper_private::HandleError(status);
     return true;
 }
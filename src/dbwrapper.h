@@ -13,6 +13,9 @@
 #include "version.h"
 
 
+#include <atomic>
+#include <functional>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -39,6 +42,38 @@ void HandleError(const leveldb::Status& status);
 
 };
 
+/** Cumulative counters of the reads and writes of a database, times in microseconds */
+struct CDBStats
+{
+    std::atomic<uint64_t> nReads{0};
+    std::atomic<int64_t> nReadTime{0};
+    std::atomic<uint64_t> nBatches{0};
+    std::atomic<uint64_t> nBatchBytes{0};
+    std::atomic<int64_t> nWriteTime{0};
+};
+
+/** Name of a database in -dbprofile and getdbstats: its path relative to the data directory */
+std::string GetDBName(const fs::path& path);
+
+/**
+ * Checks the -dbprofile options, which are given as
+ * <db>:<option>=<value>[,<option>=<value>...], where <db> is a database name or *.
+ */
+bool CheckDBProfiles(std::string& strError);
+
+/**
+ * Applies the -dbprofile options for a database on top of options. Options for *
+ * are applied first. A replaced block cache or filter policy is deleted.
+ */
+void ApplyDBProfile(const std::string& strName, leveldb::Options& options);
+
+/** Makes an open database visible to ForEachDB, stats may be NULL. */
+void RegisterDB(const std::string& strName, leveldb::DB* pdb, const CDBStats* stats);
+/** Removes a database from ForEachDB, before it is closed. */
+void UnregisterDB(leveldb::DB* pdb);
+/** Calls f for every open database, which can't be closed meanwhile. */
+void ForEachDB(const std::function<void(const std::string&, leveldb::DB*, const CDBStats*)>& f);
+
 
 /** Batch of changes queued to be written to a CDBWrapper */
 class CDBBatch
@@ -196,6 +231,12 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    //! name of the database, see GetDBName()
+    std::string strName;
+
+    //! read and write counters
+    mutable CDBStats stats;
+
 public:
     /**
      * @param[in] path        Location in the filesystem where leveldb data will be stored.
@@ -215,7 +256,10 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
+        const int64_t nTimeStart = GetTimeMicros();
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        stats.nReadTime += GetTimeMicros() - nTimeStart;
+        ++stats.nReads;
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -248,7 +292,10 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
+        const int64_t nTimeStart = GetTimeMicros();
         leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        stats.nReadTime += GetTimeMicros() - nTimeStart;
+        ++stats.nReads;
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -42,6 +42,8 @@
 #include "spork.h"
 #include "sporkdb.h"
 #include "txdb.h"
+#include "verifydb.h"
+#include "blockimport.h"
 #include "torcontrol.h"
 #include "guiinterface.h"
 #include "guiinterfaceutil.h"
@@ -258,6 +260,9 @@ void PrepareShutdown()
         fFeeEstimatesInitialized = false;
     }
 
+    // saves the progress of the background verification, before the block tree database is closed
+    g_blockverifier.Stop();
+
     {
         LOCK(cs_main);
         if (pcoinsTip != NULL) {
@@ -277,6 +282,8 @@ void PrepareShutdown()
         pcoinscatcher = NULL;
         delete pcoinsdbview;
         pcoinsdbview = NULL;
+        delete paddressindexcache;
+        paddressindexcache = NULL;
         delete pblocktree;
         pblocktree = NULL;
         delete zerocoinDB;
@@ -413,6 +420,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     strUsage += HelpMessageOpt("-blocksizenotify=<cmd>", _("Execute command when the best block changes and its size is over (%s in cmd is replaced by block hash, %d with the block size)"));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
+    strUsage += HelpMessageOpt("-verifybackground", strprintf(_("Check the -checkblocks blocks on a background thread after startup, instead of before. Unfinished checks resume after a restart (default: %u)"), DEFAULT_VERIFY_BACKGROUND));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), PIVX_CONF_FILENAME));
     if (mode == HMM_BITCOIND) {
 #if !defined(WIN32)
@@ -424,6 +432,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf(_("Specify location of debug log file: this can be an absolute path or a path relative to the data directory (default: %s)"), DEFAULT_DEBUGLOGFILE));
     strUsage += HelpMessageOpt("-disablesystemnotifications", strprintf(_("Disable OS notifications for incoming transactions (default: %u)"), 0));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dbprofile=<db>:<option>=<n>,...", _("Set LevelDB options of a database (chainstate, blocks/index, zerocoin, sporks, governance, tokens/<name>) or of all databases (*), can be specified multiple times. "
+        "Options are writebuffer, blockcache, blocksize and maxfilesize in KiB, bloombits, maxopenfiles and compression (0 or 1)"));
+    strUsage += HelpMessageOpt("-importbuffer=<n>", strprintf(_("Keep up to <n> MiB of blocks, which are imported before their parent, in memory (default: %d)"), DEFAULT_IMPORT_BUFFER));
+    strUsage += HelpMessageOpt("-importthreads=<n>", strprintf(_("Set the number of threads deserializing blocks for -reindex and -loadblock (0 = all cores, max: %d, default: %d)"), MAX_IMPORT_THREADS, DEFAULT_IMPORT_THREADS));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-maxreorg=<n>", strprintf(_("Set the Maximum reorg depth (default: %u)"), DEFAULT_MAX_REORG_DEPTH));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -548,6 +560,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-mnconflock=<n>", strprintf(_("Lock masternodes from masternode configuration file (default: %u)"), DEFAULT_MNCONFLOCK));
     strUsage += HelpMessageOpt("-masternodeprivkey=<n>", _("Set the masternode private key"));
     strUsage += HelpMessageOpt("-masternodeaddr=<n>", strprintf(_("Set external address:port to get to this masternode (example: %s)"), "128.127.106.235:28732"));
+    strUsage += HelpMessageOpt("-mnscorethreads=<n>", strprintf(_("Set the number of threads to calculate masternode scores, 0 or 1 = single threaded (default: %d)"), DEFAULT_MNSCORE_THREADS));
     strUsage += HelpMessageOpt("-budgetvotemode=<mode>", _("Change automatic finalized budget voting behavior. mode=auto: Vote for only exact finalized budget match to my generated budget. (string, default: auto)"));
 
     strUsage += HelpMessageGroup(_("Zerocoin options:"));
@@ -596,6 +609,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-tokentxcache", "The maximum number of transactions in the input transaction cache (default: 500000)");
     strUsage += HelpMessageOpt("-tokenprogressfrequency", "Time in seconds after which the initial scanning progress is reported (default: 30)");
     strUsage += HelpMessageOpt("-tokenseedblockfilter", "Set skipping of blocks without Token transactions during initial scan (default: 1)");
+    strUsage += HelpMessageOpt("-tokenscanthreads=<n>", "The number of threads to read blocks ahead during initial scan, 0 to read sequentially (default: number of cores, at most 8)");
     strUsage += HelpMessageOpt("-tokenlogfile", "The path of the log file (default: tokencore.log)");
     strUsage += HelpMessageOpt("-tokendebug=<category>", "Enable or disable log categories, can be \"all\" or \"none\"");
     strUsage += HelpMessageOpt("-autocommit", "Enable or disable broadcasting of transactions, when creating transactions (default: 1)");
@@ -606,7 +620,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-tokenactivationallowsender", "Whitelist senders of activations");
     strUsage += HelpMessageOpt("-disclaimer", "Explicitly show QT disclaimer on startup (default: 0)");
     strUsage += HelpMessageOpt("-tokenuiwalletscope", "Max. transactions to show in trade and transaction history (default: 65535)");
-    strUsage += HelpMessageOpt("-tokenshowblockconsensushash", "Calculate and log the consensus hash for the specified block");
+    strUsage += HelpMessageOpt("-tokenshowblockconsensushash", "Calculate and log the consensus hash and the state hash for the specified block");
 
     return strUsage;
 }
@@ -689,6 +703,11 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
 {
     util::ThreadRename("pivx-loadblk");
 
+    int nThreads = GetArg("-importthreads", DEFAULT_IMPORT_THREADS);
+    if (nThreads <= 0) nThreads = GetNumCores();
+    const int64_t nImportBuffer = std::max((int64_t)0, GetArg("-importbuffer", DEFAULT_IMPORT_BUFFER));
+    CBlockImporter importer(std::max(1, std::min(nThreads, MAX_IMPORT_THREADS)), nImportBuffer << 20);
+
     // -reindex
     if (fReindex) {
         CImportingNow imp;
@@ -697,11 +716,13 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
             CDiskBlockPos pos(nFile, 0);
             if (!fs::exists(GetBlockPosFilename(pos, "blk")))
                 break; // No block files left to reindex
-            FILE* file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
             LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(file, &pos);
+            if (!importer.LoadFile(GetBlockPosFilename(pos, "blk"), &pos)) {
+                FILE* file = OpenBlockFile(pos, true);
+                if (!file)
+                    break; // This error is logged in OpenBlockFile
+                LoadExternalBlockFile(file, &pos);
+            }
             nFile++;
         }
         pblocktree->WriteReindexing(false);
@@ -714,11 +735,12 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
     // hardcoded $DATADIR/bootstrap.dat
     fs::path pathBootstrap = GetDataDir() / "bootstrap.dat";
     if (fs::exists(pathBootstrap)) {
-        FILE* file = fsbridge::fopen(pathBootstrap, "rb");
-        if (file) {
-            CImportingNow imp;
-            fs::path pathBootstrapOld = GetDataDir() / "bootstrap.dat.old";
-            LogPrintf("Importing bootstrap.dat...\n");
+        CImportingNow imp;
+        fs::path pathBootstrapOld = GetDataDir() / "bootstrap.dat.old";
+        LogPrintf("Importing bootstrap.dat...\n");
+        if (importer.LoadFile(pathBootstrap, nullptr)) {
+            RenameOver(pathBootstrap, pathBootstrapOld);
+        } else if (FILE* file = fsbridge::fopen(pathBootstrap, "rb")) {
             LoadExternalBlockFile(file);
             RenameOver(pathBootstrap, pathBootstrapOld);
         } else {
@@ -728,10 +750,12 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
 
     // -loadblock=
     for (fs::path& path : vImportFiles) {
+        CImportingNow imp;
+        LogPrintf("Importing blocks file %s...\n", path.string());
+        if (importer.LoadFile(path, nullptr))
+            continue;
         FILE* file = fsbridge::fopen(path, "rb");
         if (file) {
-            CImportingNow imp;
-            LogPrintf("Importing blocks file %s...\n", path.string());
             LoadExternalBlockFile(file);
         } else {
             LogPrintf("Warning: Could not open blocks file %s\n", path.string());
@@ -1258,6 +1282,7 @@ bool AppInitMain()
     if (nScriptCheckThreads) {
         for (int i = 0; i < nScriptCheckThreads - 1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        threadGroup.create_thread(&ThreadStakeCheck);
     }
 
     if (mapArgs.count("-sporkkey")) // spork priv key
@@ -1550,6 +1575,11 @@ bool AppInitMain()
     // Create blocks directory if it doesn't already exist
     fs::create_directories(GetDataDir() / "blocks");
 
+    // LevelDB options
+    std::string strDBProfileError;
+    if (!CheckDBProfiles(strDBProfileError))
+        return UIError(strDBProfileError);
+
     // cache size calculations
     int64_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
@@ -1567,7 +1597,7 @@ bool AppInitMain()
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for governance database\n", nGovernanceDBCache * (1.0 / 1024 / 1024));
-    LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for in-memory UTXO set and address index cache\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
     while (!fLoaded && !ShutdownRequested()) {
@@ -1582,6 +1612,7 @@ bool AppInitMain()
                 delete pcoinsTip;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
+                delete paddressindexcache;
                 delete pblocktree;
                 delete zerocoinDB;
                 delete pSporkDB;
@@ -1592,6 +1623,7 @@ bool AppInitMain()
                 pSporkDB = new CSporkDB(0, false, false);
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
+                paddressindexcache = new CAddressIndexCache(pblocktree);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
@@ -1747,8 +1779,9 @@ bool AppInitMain()
                         }
                     }
 
-                    // Zerocoin must check at level 4
-                    if (!CVerifyDB().VerifyDB(pcoinsdbview, 4, GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
+                    // Zerocoin must check at level 4, in the background with -verifybackground
+                    if (!GetBoolArg("-verifybackground", DEFAULT_VERIFY_BACKGROUND) &&
+                            !CVerifyDB().VerifyDB(pcoinsdbview, 4, GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
                         strLoadError = _("Corrupted block database detected");
                         fVerifyingBlocks = false;
                         break;
@@ -2088,6 +2121,16 @@ bool AppInitMain()
     if (!connman.Start(scheduler, strNodeError, connOptions))
         return UIError(strNodeError);
 
+    // Resume the saved background verifications, and queue the startup check with -verifybackground
+    g_blockverifier.Start(fReindex);
+    if (!fReindex && GetBoolArg("-verifybackground", DEFAULT_VERIFY_BACKGROUND)) {
+        const int nCheckDepth = GetArg("-checkblocks", DEFAULT_CHECKBLOCKS);
+        const int nStartHeight = nCheckDepth > 0 ? chainActive.Height() - nCheckDepth + 1 : 1;
+        std::string strVerifyError;
+        if (!g_blockverifier.Queue(nStartHeight, -1, 4, strVerifyError))
+            LogPrintf("Background block verification not queued: %s\n", strVerifyError);
+    }
+
 #ifdef ENABLE_WALLET
     // Generate coins in the background
     if (pwalletMain)
@@ -52,18 +52,33 @@ CStakeKernel::CStakeKernel(const CBlockIndex* const pindexPrev, CStakeInput* sta
 // Return stake kernel hash
 uint256 CStakeKernel::GetHash() const
 {
-    CDataStream ss(stakeModifier);
-    ss << nTimeBlockFrom << stakeUniqueness << nTime;
+    CDataStream ss(GetPrefix());
+    ss << nTime;
     return Hash(ss.begin(), ss.end());
 }
 
-// Check that the kernel hash meets the target required
-bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
+// Return the kernel message without the time of the kernel block
+CDataStream CStakeKernel::GetPrefix() const
+{
+    CDataStream ss(stakeModifier);
+    ss << nTimeBlockFrom << stakeUniqueness;
+    return ss;
+}
+
+// Return the target, weighted by the stake value, that the kernel hash must meet
+arith_uint256 CStakeKernel::GetTarget() const
 {
-    // Get weighted target
     arith_uint256 bnTarget;
     bnTarget.SetCompact(nBits);
     bnTarget *= (arith_uint256(stakeValue) / 100);
+    return bnTarget;
+}
+
+// Check that the kernel hash meets the target required
+bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
+{
+    // Get weighted target
+    const arith_uint256& bnTarget = GetTarget();
 
     // Check PoS kernel hash
     const arith_uint256& hashProofOfStake = UintToArith256(GetHash());
@@ -83,6 +98,25 @@ bool CStakeKernel::CheckKernelHash(bool fSkipLog) const
     return res;
 }
 
+CStakeKernelPrefix::CStakeKernelPrefix(const CStakeKernel& kernel):
+    bnTarget(kernel.GetTarget())
+{
+    const CDataStream& ss = kernel.GetPrefix();
+    hasher.Write((const unsigned char*)&ss[0], ss.size());
+}
+
+// Return stake kernel hash for the time of the kernel block
+uint256 CStakeKernelPrefix::GetHash(int nTimeTx) const
+{
+    // the time is serialized as in CStakeKernel::GetHash
+    unsigned char buf[4];
+    WriteLE32(buf, (uint32_t)nTimeTx);
+
+    uint256 hash;
+    CHash256(hasher).Write(buf, sizeof(buf)).Finalize(hash.begin());
+    return hash;
+}
+
 
 /*
  * PoS Validation
@@ -107,7 +141,7 @@ bool LoadStakeInput(const CBlock& block, const CBlockIndex* pindexPrev, std::uni
         return error("called on non PoS block");
 
     // Construct the stakeinput object
-    const CTxIn& txin = block.vtx[1].vin[0];
+    const CTxIn& txin = block.vtx[1]->vin[0];
     stake = std::unique_ptr<CStakeInput>(new CPivStake());
 
     return stake->InitFromTxIn(txin);
@@ -139,53 +173,72 @@ bool Stake(const CBlockIndex* pindexPrev, CStakeInput* stakeInput, unsigned int
 }
 
 
-/*
- * CheckProofOfStake    Check if block has valid proof of stake
- *
- * @param[in]   block           block being verified
- * @param[out]  strError        string error (if any, else empty)
- * @param[in]   pindexPrev      index of the parent block
- *                              (if nullptr, it will be searched in mapBlockIndex)
- * @return      bool            true if the block has a valid proof of stake
- */
-bool CheckProofOfStake(const CBlock& block, std::string& strError, const CBlockIndex* pindexPrev)
+bool CStakeProofCheck::Init(const CBlock& block, const CBlockIndex* pindexPrev, std::string& strErrorRet)
 {
     const int nHeight = pindexPrev->nHeight + 1;
     // Initialize stake input
     std::unique_ptr<CStakeInput> stakeInput;
     if (!LoadStakeInput(block, pindexPrev, stakeInput)) {
-        strError = "stake input initialization failed";
+        strErrorRet = "stake input initialization failed";
         return false;
     }
 
     // Stake input contextual checks
     if (!stakeInput->ContextCheck(nHeight, block.nTime)) {
-        strError = "stake input failing contextual checks";
+        strErrorRet = "stake input failing contextual checks";
         return false;
     }
 
+    // Prevout of the coinstake, for the signature check
+    if (!stakeInput->GetTxOutFrom(stakePrevout)) {
+        strErrorRet = "unable to get stake prevout for coinstake";
+        return false;
+    }
+
+    kernel.reset(new CStakeKernel(pindexPrev, stakeInput.get(), block.nBits, block.nTime));
+    ptxCoinStake = block.vtx[1];
+    stakeValue = stakeInput->GetValue();
+    return true;
+}
+
+bool CStakeProofCheck::operator()()
+{
     // Verify Proof Of Stake
-    CStakeKernel stakeKernel(pindexPrev, stakeInput.get(), block.nBits, block.nTime);
-    if (!stakeKernel.CheckKernelHash()) {
+    if (!kernel->CheckKernelHash()) {
         strError = "kernel hash check fails";
         return false;
     }
 
     // Verify tx input signature
-    CTxOut stakePrevout;
-    if (!stakeInput->GetTxOutFrom(stakePrevout)) {
-        strError = "unable to get stake prevout for coinstake";
+    const CTxIn& txin = ptxCoinStake->vin[0];
+    ScriptError serror;
+    if (!VerifyScript(txin.scriptSig, stakePrevout.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
+             TransactionSignatureChecker(ptxCoinStake.get(), 0, stakeValue), &serror)) {
+        strError = strprintf("signature fails: %s", serror ? ScriptErrorString(serror) : "");
         return false;
     }
-    const CTransaction& tx = block.vtx[1];
-    const CTxIn& txin = tx.vin[0];
 
-    CAmount stakePrevoutValue = stakeInput->GetValue();
+    return true;
+}
 
-    ScriptError serror;
-    if (!VerifyScript(txin.scriptSig, stakePrevout.scriptPubKey, STANDARD_SCRIPT_VERIFY_FLAGS,
-             TransactionSignatureChecker(&tx, 0, stakePrevoutValue), &serror)) {
-        strError = strprintf("signature fails: %s", serror ? ScriptErrorString(serror) : "");
+
+/*
+ * CheckProofOfStake    Check if block has valid proof of stake
+ *
+ * @param[in]   block           block being verified
+ * @param[out]  strError        string error (if any, else empty)
+ * @param[in]   pindexPrev      index of the parent block
+ *                              (if nullptr, it will be searched in mapBlockIndex)
+ * @return      bool            true if the block has a valid proof of stake
+ */
+bool CheckProofOfStake(const CBlock& block, std::string& strError, const CBlockIndex* pindexPrev)
+{
+    CStakeProofCheck check;
+    if (!check.Init(block, pindexPrev, strError))
+        return false;
+
+    if (!check()) {
+        strError = check.GetError();
         return false;
     }
 
@@ -8,9 +8,13 @@
 #ifndef PIVX_KERNEL_H
 #define PIVX_KERNEL_H
 
+#include "arith_uint256.h"
+#include "hash.h"
 #include "main.h"
 #include "stakeinput.h"
 
+#include <memory>
+
 class CStakeKernel {
 public:
     /**
@@ -26,6 +30,12 @@ public:
     // Return stake kernel hash
     uint256 GetHash() const;
 
+    // Return the kernel message without the time of the kernel block
+    CDataStream GetPrefix() const;
+
+    // Return the target, weighted by the stake value, that the kernel hash must meet
+    arith_uint256 GetTarget() const;
+
     // Check that the kernel hash meets the target required
     bool CheckKernelHash(bool fSkipLog = false) const;
 
@@ -40,6 +50,65 @@ private:
     CAmount stakeValue{0};     // target multiplier
 };
 
+/**
+ * Stake kernel, with everything but the time of the kernel block hashed once.
+ *
+ * The stake modifier, the time of the block of the stake input and the
+ * uniqueness don't change while staking on top of a block, so checking another
+ * time slot only hashes the time.
+ */
+class CStakeKernelPrefix {
+public:
+    explicit CStakeKernelPrefix(const CStakeKernel& kernel);
+
+    // Return stake kernel hash for the time of the kernel block
+    uint256 GetHash(int nTimeTx) const;
+
+    // Check that the kernel hash for the time of the kernel block meets the target required
+    bool CheckKernelHash(int nTimeTx) const { return UintToArith256(GetHash(nTimeTx)) < bnTarget; }
+
+private:
+    CHash256 hasher;           // fed with the kernel prefix
+    arith_uint256 bnTarget;    // weighted target
+};
+
+/**
+ * Proof of stake of a block, with the stake input and the stake modifier
+ * looked up in the chain state.
+ *
+ * Init() needs cs_main, while the kernel hash and the coinstake signature are
+ * checked without it, so that the check can run on another thread, like a
+ * CScriptCheck. The check holds its own reference to the coinstake.
+ */
+class CStakeProofCheck {
+public:
+    CStakeProofCheck() {}
+
+    // Look up the stake input and the modifier of the block (requires cs_main)
+    bool Init(const CBlock& block, const CBlockIndex* pindexPrev, std::string& strErrorRet);
+
+    // Check the kernel hash and the signature of the coinstake
+    bool operator()();
+
+    void swap(CStakeProofCheck& check)
+    {
+        std::swap(kernel, check.kernel);
+        std::swap(ptxCoinStake, check.ptxCoinStake);
+        std::swap(stakePrevout, check.stakePrevout);
+        std::swap(stakeValue, check.stakeValue);
+        strError.swap(check.strError);
+    }
+
+    const std::string& GetError() const { return strError; }
+
+private:
+    std::unique_ptr<CStakeKernel> kernel;
+    CTransactionRef ptxCoinStake;
+    CTxOut stakePrevout;
+    CAmount stakeValue{0};
+    std::string strError;
+};
+
 /* PoS Validation */
 
 /*
@@ -87,10 +87,31 @@ static bool SelectBlockFromCandidates(
     return fSelected;
 }
 
+// Blocks, whose modifier GetOldModifier selected, by the block of the stake input.
+// The selection only depends on the active chain between the two blocks, so it
+// holds as long as the selected block stays in the active chain.
+struct OldModifierBlock {
+    const CBlockIndex* pindex;
+    int nHeight;
+    uint64_t nStakeModifier;
+};
+static const size_t MAX_OLD_MODIFIER_BLOCKS = 50000;
+static std::map<const CBlockIndex*, OldModifierBlock> mapOldModifierBlocks;
+static Mutex cs_oldModifierBlocks;
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
 bool GetOldModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier)
 {
+    {
+        LOCK(cs_oldModifierBlocks);
+        auto it = mapOldModifierBlocks.find(pindexFrom);
+        if (it != mapOldModifierBlocks.end() && chainActive[it->second.nHeight] == it->second.pindex) {
+            nStakeModifier = it->second.nStakeModifier;
+            return true;
+        }
+    }
+
     int64_t nStakeModifierTime = pindexFrom->GetBlockTime();
     const CBlockIndex* pindex = pindexFrom;
     CBlockIndex* pindexNext = chainActive[pindex->nHeight + 1];
@@ -106,6 +127,11 @@ bool GetOldModifier(const CBlockIndex* pindexFrom, uint64_t& nStakeModifier)
         pindexNext = chainActive[pindex->nHeight + 1];
     } while (nStakeModifierTime < pindexFrom->GetBlockTime() + OLD_MODIFIER_INTERVAL);
     nStakeModifier = pindex->GetStakeModifierV1();
+
+    LOCK(cs_oldModifierBlocks);
+    if (mapOldModifierBlocks.size() >= MAX_OLD_MODIFIER_BLOCKS)
+        mapOldModifierBlocks.clear();
+    mapOldModifierBlocks[pindexFrom] = {pindex, pindex->nHeight, nStakeModifier};
     return true;
 }
 
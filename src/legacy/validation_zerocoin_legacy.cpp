@@ -41,7 +41,7 @@ bool AcceptToMemoryPoolZerocoin(const CTransaction& tx, CAmount& nValueIn, int c
     return true;
 }
 
-bool DisconnectZerocoinTx(const CTransaction& tx, CAmount& nValueIn, CZerocoinDB* zerocoinDB)
+bool DisconnectZerocoinTx(const CTransaction& tx, CAmount& nValueIn, CZerocoinDB* zerocoinDB, bool fJustCheck)
 {
     /** UNDO ZEROCOIN DATABASING
          * note we only undo zerocoin databasing in the following statement, value to and from RPD
@@ -69,6 +69,10 @@ bool DisconnectZerocoinTx(const CTransaction& tx, CAmount& nValueIn, CZerocoinDB
                         nValueIn += spend.getDenomination() * COIN;
                     }
 
+                    // only the value is needed to check the block
+                    if (fJustCheck)
+                        continue;
+
                     if (!zerocoinDB->EraseCoinSpend(serial))
                         return error("failed to erase spent zerocoin in block");
 
@@ -84,7 +88,7 @@ bool DisconnectZerocoinTx(const CTransaction& tx, CAmount& nValueIn, CZerocoinDB
             }
         }
 
-        if (tx.HasZerocoinMintOutputs()) {
+        if (tx.HasZerocoinMintOutputs() && !fJustCheck) {
             //erase all zerocoinmints in this transaction
             for (const CTxOut &txout : tx.vout) {
                 if (txout.scriptPubKey.empty() || !txout.IsZerocoinMint())
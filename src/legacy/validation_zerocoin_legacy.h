@@ -11,7 +11,8 @@
 #include "validationinterface.h"
 
 bool AcceptToMemoryPoolZerocoin(const CTransaction& tx, CAmount& nValueIn, int chainHeight, CValidationState& state, const Consensus::Params& consensus);
-bool DisconnectZerocoinTx(const CTransaction& tx, CAmount& nValueIn, CZerocoinDB* zerocoinDB);
+/** Undoes the zerocoin databasing of a transaction, and adds its zerocoin spends to nValueIn. With fJustCheck, only the value is added. */
+bool DisconnectZerocoinTx(const CTransaction& tx, CAmount& nValueIn, CZerocoinDB* zerocoinDB, bool fJustCheck = false);
 void DataBaseAccChecksum(CBlockIndex* pindex, bool fWrite);
 
 #endif //VALIDATION_ZEROCOIN_LEGACY_H
@@ -50,6 +50,7 @@
 #include <governance/governance.h>
 
 class CBlockIndex;
+class CAddressIndexCache;
 class CBlockTreeDB;
 class CBudgetManager;
 class CZerocoinDB;
@@ -238,6 +239,8 @@ bool ProcessMessages(CNode* pfrom, CConnman& connman, std::atomic<bool>& interru
 bool SendMessages(CNode* pto, CConnman& connman, std::atomic<bool>& interrupt);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run the thread, which checks the proof of stake of new blocks */
+void ThreadStakeCheck();
 
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
@@ -276,7 +279,7 @@ void FlushStateToDisk();
 
 
 /** (try to) add transaction to memory pool **/
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransaction& tx, bool fLimitFree, bool* pfMissingInputs, bool fOverrideMempoolLimit = false, bool fRejectInsaneFee = false, bool ignoreFees = false);
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransactionRef& tx, bool fLimitFree, bool* pfMissingInputs, bool fOverrideMempoolLimit = false, bool fRejectInsaneFee = false, bool ignoreFees = false);
 
 int GetIXConfirmations(uint256 nTXHash);
 
@@ -381,11 +384,19 @@ bool GetAddressIndex(uint160 addressHash, int type,
                      int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+/** Reads a page of at most nLimit (0 = all) address index entries, beginning at keyStart */
+bool GetAddressIndex(const CAddressIndexKey& keyStart, int end, size_t nLimit,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
+/** Reads a page of at most nLimit (0 = all) unspent outputs of an address, beginning at keyStart */
+bool GetAddressUnspent(const CAddressUnspentKey& keyStart, size_t nLimit,
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+bool GetAddressSummary(uint160 addressHash, int type, CAddressSummary &summary);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
 
 /** Functions for validating blocks and updating the block tree */
@@ -420,6 +431,20 @@ bool AcceptBlock(const CBlock& block, CValidationState& state, CBlockIndex** pin
 bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, CBlockIndex** ppindex = NULL);
 
 
+/**
+ * Checks a block of the index at levels 0 to 2 of VerifyDB: reads it from disk, checks it
+ * and reads its undo data. Doesn't require cs_main, the block is returned for further checks.
+ */
+bool VerifyBlockData(CBlock& block, const CBlockIndex* pindex, int nCheckLevel, std::string& strError);
+/**
+ * Checks the last nCheckDepth blocks of the active chain at levels 3 and 4 of VerifyDB: disconnects
+ * them from a memory only copy of coinsview, and reconnects them. Unlike VerifyDB, the blocks are
+ * not checked at levels 0 to 2 again, they should be checked with VerifyBlockData. The blocks are only
+ * checked, without changing the money supply, the governance, the zerocoinDB or the wallet, so this may
+ * run on a live node. Requires cs_main.
+ */
+bool VerifyBlockCoins(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth, std::string& strError);
+
 /** RAII wrapper for VerifyDB: Verify consistency of the block and coin databases */
 class CVerifyDB
 {
@@ -447,6 +472,9 @@ extern CCoinsViewCache* pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB* pblocktree;
 
+/** Global variable that points to the cache of the address and spent indexes in the block tree */
+extern CAddressIndexCache* paddressindexcache;
+
 /** Global variable that points to the governance db (protected by cs_main) */
 extern CGovernance *governance;
 
@@ -19,6 +19,9 @@
 
 #include <boost/thread/thread.hpp>
 
+#include <algorithm>
+#include <thread>
+
 #define MN_WINNER_MINIMUM_AGE 8000    // Age in seconds. This should be > MASTERNODE_REMOVAL_SECONDS to avoid misconfigured new nodes in the list.
 
 /** Masternode manager */
@@ -34,11 +37,11 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const std::pair<int64_t, CTxIn>& t1,
-        const std::pair<int64_t, CTxIn>& t2) const
+struct CompareScoreEntry {
+    bool operator()(const CMasternodeScores::Entry& t1,
+        const CMasternodeScores::Entry& t2) const
     {
-        return t1.first < t2.first;
+        return t1.nCompactScore > t2.nCompactScore;
     }
 };
 
@@ -217,6 +220,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (it == mapMasternodes.end()) {
         LogPrint(BCLog::MASTERNODE, "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         mapMasternodes.emplace(mn.vin.prevout, std::make_shared<CMasternode>(mn));
+        ClearScoresCache();
         return true;
     }
 
@@ -277,6 +281,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
             }
 
             it = mapMasternodes.erase(it);
+            ClearScoresCache();
         } else {
             ++it;
         }
@@ -338,6 +343,7 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     mapMasternodes.clear();
+    ClearScoresCache();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -459,11 +465,11 @@ CMasternode* CMasternodeMan::Find(const CPubKey& pubKeyMasternode)
     return nullptr;
 }
 
-void CMasternodeMan::CheckSpentCollaterals(const std::vector<CTransaction>& vtx)
+void CMasternodeMan::CheckSpentCollaterals(const std::vector<CTransactionRef>& vtx)
 {
     LOCK(cs);
     for (const auto& tx : vtx) {
-        for (const auto& in : tx.vin) {
+        for (const auto& in : tx->vin) {
             auto it = mapMasternodes.find(in.prevout);
             if (it != mapMasternodes.end()) {
                 it->second->SetSpent();
@@ -522,11 +528,13 @@ const CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlock
     int nCountTenth = 0;
     uint256 nHigh;
     const uint256& hash = GetHashAtHeight(nBlockHeight - 101);
+    const MasternodeScoresRef scores = GetScores(hash);
     for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeLastPaid) {
         const CMasternode* pmn = Find(s.second.prevout);
         if (!pmn) break;
 
-        const uint256& n = pmn->CalculateScore(hash);
+        const auto itScore = scores->mapScores.find(pmn->vin.prevout);
+        const uint256& n = (itScore != scores->mapScores.end()) ? itScore->second : pmn->CalculateScore(hash);
         if (n > nHigh) {
             nHigh = n;
             pBestMasternode = pmn;
@@ -539,27 +547,18 @@ const CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlock
 
 const CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol) const
 {
-    int64_t score = 0;
-    const CMasternode* winner = nullptr;
     const uint256& hash = GetHashAtHeight(nBlockHeight - 1);
+    const MasternodeScoresRef scores = GetScores(hash);
 
-    // scan for winner
-    for (const auto& it : mapMasternodes) {
-        const MasternodeRef& mn = it.second;
+    // scan for winner, the first eligible Masternode has the highest score
+    for (const CMasternodeScores::Entry& entry : scores->vEntries) {
+        if (entry.nCompactScore <= 0) break;
+        const MasternodeRef& mn = entry.mn;
         if (mn->protocolVersion < minProtocol || !mn->IsEnabled()) continue;
-
-        // calculate the score for each Masternode
-        uint256 n = mn->CalculateScore(hash);
-        int64_t n2 = n.GetCompact(false);
-
-        // determine the winner
-        if (n2 > score) {
-            score = n2;
-            winner = mn.get();
-        }
+        return mn.get();
     }
 
-    return winner;
+    return nullptr;
 }
 
 std::vector<std::pair<MasternodeRef, int>> CMasternodeMan::GetMnScores(int nLast) const
@@ -570,17 +569,9 @@ std::vector<std::pair<MasternodeRef, int>> CMasternodeMan::GetMnScores(int nLast
 
     for (int nHeight = nChainHeight - nLast; nHeight < nChainHeight + 20; nHeight++) {
         const uint256& hash = GetHashAtHeight(nHeight - 101);
-        uint256 nHigh = UINT256_ZERO;
-        MasternodeRef pBestMasternode;
-        for (const auto& it : mapMasternodes) {
-            const uint256& n = it.second->CalculateScore(hash);
-            if (n > nHigh) {
-                nHigh = n;
-                pBestMasternode = it.second;
-            }
-        }
-        if (nHigh > UINT256_ZERO) {
-            ret.emplace_back(pBestMasternode, nHeight);
+        const CMasternodeScores::Entry* pBest = GetScores(hash)->GetBest();
+        if (pBest) {
+            ret.emplace_back(pBest->mn, nHeight);
         }
     }
     return ret;
@@ -588,7 +579,6 @@ std::vector<std::pair<MasternodeRef, int>> CMasternodeMan::GetMnScores(int nLast
 
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive) const
 {
-    std::vector<std::pair<int64_t, CTxIn> > vecMasternodeScores;
     int64_t nMasternode_Min_Age = MN_WINNER_MINIMUM_AGE;
     int64_t nMasternode_Age = 0;
 
@@ -596,9 +586,11 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
     // height outside range
     if (!hash) return -1;
 
-    // scan for winner
-    for (const auto& it : mapMasternodes) {
-        const MasternodeRef& mn = it.second;
+    // scan the Masternodes from the highest score, and count the eligible ones
+    int rank = 0;
+    const MasternodeScoresRef scores = GetScores(hash);
+    for (const CMasternodeScores::Entry& entry : scores->vEntries) {
+        const MasternodeRef& mn = entry.mn;
         if (mn->protocolVersion < minProtocol) {
             LogPrint(BCLog::MASTERNODE,"Skipping Masternode with obsolete version %d\n", mn->protocolVersion);
             continue;                                                       // Skip obsolete versions
@@ -614,18 +606,9 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
         if (fOnlyActive) {
             if (!mn->IsEnabled()) continue;
         }
-        uint256 n = mn->CalculateScore(hash);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(std::make_pair(n2, mn->vin));
-    }
 
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    for (PAIRTYPE(int64_t, CTxIn) & s : vecMasternodeScores) {
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (mn->vin.prevout == vin.prevout) {
             return rank;
         }
     }
@@ -641,22 +624,90 @@ std::vector<std::pair<int64_t, CMasternode>> CMasternodeMan::GetMasternodeRanks(
     if (!hash) return vecMasternodeScores;
     {
         LOCK(cs);
+        const MasternodeScoresRef scores = GetScores(hash);
         // scan for winner
-        for (const auto& it : mapMasternodes) {
-            const MasternodeRef& mn = it.second;
+        for (const CMasternodeScores::Entry& entry : scores->vEntries) {
+            const MasternodeRef& mn = entry.mn;
             if (!mn->IsEnabled()) {
                 vecMasternodeScores.emplace_back(9999, *mn);
                 continue;
             }
 
-            int64_t n2 = mn->CalculateScore(hash).GetCompact(false);
-            vecMasternodeScores.emplace_back(n2, *mn);
+            vecMasternodeScores.emplace_back(entry.nCompactScore, *mn);
         }
     }
     sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
     return vecMasternodeScores;
 }
 
+MasternodeScoresRef CMasternodeMan::GetScores(const uint256& hash) const
+{
+    LOCK(cs);
+
+    const auto itCached = mapScoresCache.find(hash);
+    if (itCached != mapScoresCache.end()) return itCached->second;
+
+    std::shared_ptr<CMasternodeScores> scores = std::make_shared<CMasternodeScores>();
+    std::vector<CMasternodeScores::Entry>& vEntries = scores->vEntries;
+    vEntries.reserve(mapMasternodes.size());
+    for (const auto& it : mapMasternodes) {
+        CMasternodeScores::Entry entry;
+        entry.mn = it.second;
+        entry.nCompactScore = 0;
+        vEntries.push_back(entry);
+    }
+
+    auto calculateScores = [&vEntries, &hash](size_t nBegin, size_t nEnd) {
+        for (size_t i = nBegin; i < nEnd; ++i) {
+            vEntries[i].score = vEntries[i].mn->CalculateScore(hash);
+            vEntries[i].nCompactScore = vEntries[i].score.GetCompact(false);
+        }
+    };
+
+    const size_t nThreads = std::max(1, (int)GetArg("-mnscorethreads", DEFAULT_MNSCORE_THREADS));
+    if (nThreads > 1 && vEntries.size() >= MIN_PARALLEL_MN_SCORES) {
+        const size_t nChunk = (vEntries.size() + nThreads - 1) / nThreads;
+        std::vector<std::thread> vThreads;
+        for (size_t nBegin = nChunk; nBegin < vEntries.size(); nBegin += nChunk) {
+            vThreads.emplace_back(calculateScores, nBegin, std::min(nBegin + nChunk, vEntries.size()));
+        }
+        calculateScores(0, nChunk);
+        for (std::thread& thread : vThreads) {
+            thread.join();
+        }
+    } else {
+        calculateScores(0, vEntries.size());
+    }
+
+    // the list is ordered by collateral, which remains the order of equal scores
+    std::stable_sort(vEntries.begin(), vEntries.end(), CompareScoreEntry());
+    for (const CMasternodeScores::Entry& entry : vEntries) {
+        scores->mapScores.emplace(entry.mn->vin.prevout, entry.score);
+    }
+
+    if (dqScoresCacheOrder.size() >= CACHED_MN_SCORES) {
+        mapScoresCache.erase(dqScoresCacheOrder.front());
+        dqScoresCacheOrder.pop_front();
+    }
+    mapScoresCache.emplace(hash, scores);
+    dqScoresCacheOrder.push_back(hash);
+
+    return scores;
+}
+
+const CMasternodeScores::Entry* CMasternodeScores::GetBest() const
+{
+    // the highest score is among the entries with the highest compact score
+    const Entry* pBest = nullptr;
+    for (const Entry& entry : vEntries) {
+        if (pBest && entry.nCompactScore != pBest->nCompactScore) break;
+        if (entry.score > (pBest ? pBest->score : UINT256_ZERO)) {
+            pBest = &entry;
+        }
+    }
+    return pBest;
+}
+
 void CMasternodeMan::ProcessMessage(CNode* pfrom, std::string& strCommand, CDataStream& vRecv)
 {
     if (fLiteMode) return; //disable all Masternode related functionality
@@ -800,6 +851,7 @@ void CMasternodeMan::Remove(const COutPoint& collateralOut)
     const auto it = mapMasternodes.find(collateralOut);
     if (it != mapMasternodes.end()) {
         mapMasternodes.erase(it);
+        ClearScoresCache();
     }
 }
 
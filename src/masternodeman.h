@@ -16,11 +16,19 @@
 #include "sync.h"
 #include "util.h"
 
+#include <deque>
+
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
 
 /** Maximum number of block hashes to cache */
 static const unsigned int CACHED_BLOCK_HASHES = 200;
+/** Maximum number of block hashes to cache the masternode scores for */
+static const unsigned int CACHED_MN_SCORES = 64;
+/** Default for -mnscorethreads, the number of threads to calculate masternode scores */
+static const int DEFAULT_MNSCORE_THREADS = 0;
+/** Minimum number of masternodes to calculate their scores in parallel */
+static const unsigned int MIN_PARALLEL_MN_SCORES = 256;
 
 class CMasternodeMan;
 class CActiveMasternode;
@@ -58,6 +66,32 @@ public:
 //
 typedef std::shared_ptr<CMasternode> MasternodeRef;
 
+/** Scores of all listed masternodes for one block hash.
+ *
+ * A score only depends on the block hash and the collateral of a masternode,
+ * so the table stays valid until the masternode list changes.
+ */
+class CMasternodeScores
+{
+public:
+    struct Entry {
+        MasternodeRef mn;
+        uint256 score;
+        //! Compact form of the score, which is used to rank masternodes
+        int64_t nCompactScore;
+    };
+
+    //! Entries ordered by descending compact score, and by collateral on ties
+    std::vector<Entry> vEntries;
+    //! Scores indexed by collateral outpoint
+    std::map<COutPoint, uint256> mapScores;
+
+    /** Returns the entry with the highest score, or nullptr, if no score is above zero. */
+    const Entry* GetBest() const;
+};
+
+typedef std::shared_ptr<const CMasternodeScores> MasternodeScoresRef;
+
 class CMasternodeMan
 {
 private:
@@ -82,6 +116,16 @@ private:
     // Memory Only. Cache last block hashes. Used to verify mn pings and winners.
     CyclingVector<uint256> cvLastBlockHashes;
 
+    // Memory Only. Masternode scores of recent block hashes, cleared when the list changes.
+    mutable std::map<uint256, MasternodeScoresRef> mapScoresCache;
+    // Memory Only. Block hashes of the cached scores, in the order they were added.
+    mutable std::deque<uint256> dqScoresCacheOrder;
+
+    /// Get the scores of all masternodes for a block hash, calculated once per hash
+    MasternodeScoresRef GetScores(const uint256& hash) const;
+    /// Drop the cached scores, when the masternode list changes
+    void ClearScoresCache() { mapScoresCache.clear(); dqScoresCacheOrder.clear(); }
+
 public:
     // Keep track of all broadcasts I've seen
     std::map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -98,6 +142,7 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action)
     {
         LOCK(cs);
+        if (ser_action.ForRead()) ClearScoresCache();
         READWRITE(mapMasternodes);
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
@@ -137,7 +182,7 @@ public:
     CMasternode* Find(const CPubKey& pubKeyMasternode);
 
     /// Check all transactions in a block, for spent masternode collateral outpoints (marking them as spent)
-    void CheckSpentCollaterals(const std::vector<CTransaction>& vtx);
+    void CheckSpentCollaterals(const std::vector<CTransactionRef>& vtx);
 
     /// Find an entry in the masternode list that is next to be paid
     const CMasternode* GetNextMasternodeInQueueForPayment(int nBlockHeight, bool fFilterSigTime, int& nCount) const;
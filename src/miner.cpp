@@ -35,8 +35,11 @@
 #include "zpivchain.h"
 
 
+#include <limits>
+#include <map>
+#include <set>
+
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple.hpp>
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -46,51 +49,15 @@
 
 //
 // Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
+// transactions in the memory pool. Transactions are selected as packages
+// with all of their in-mempool ancestors, which are not yet in the block,
+// by the fee rate of the whole package, so that a child paying for its
+// parent is considered together with the parent.
 //
-class COrphan
-{
-public:
-    const CTransaction* ptx;
-    std::set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
-
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
-    {
-    }
-};
 
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
-// We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
-class TxPriorityCompare
-{
-    bool byFee;
-
-public:
-    TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
-
-    bool operator()(const TxPriority& a, const TxPriority& b)
-    {
-        if (byFee) {
-            if (a.get<1>() == b.get<1>())
-                return a.get<0>() < b.get<0>();
-            return a.get<1>() < b.get<1>();
-        } else {
-            if (a.get<0>() == b.get<0>())
-                return a.get<1>() < b.get<1>();
-            return a.get<0>() < b.get<0>();
-        }
-    }
-};
-
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
     pblock->nTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
@@ -171,7 +138,7 @@ bool CreateCoinbaseTx(CBlock* pblock, const CScript& scriptPubKeyIn, CBlockIndex
         txNew.vout[0].nValue = GetBlockValue(pindexPrev->nHeight);
     }
 
-    pblock->vtx.emplace_back(txNew);
+    pblock->vtx.emplace_back(MakeTransactionRef(txNew));
     return true;
 }
 
@@ -197,258 +164,661 @@ bool SolveProofOfStake(CBlock* pblock, CBlockIndex* pindexPrev, CWallet* pwallet
     emptyTx.vin[0].scriptSig = CScript() << pindexPrev->nHeight + 1 << OP_0;
     emptyTx.vout.resize(1);
     emptyTx.vout[0].SetEmpty();
-    pblock->vtx.emplace_back(emptyTx);
-    pblock->vtx.emplace_back(txCoinStake);
+    pblock->vtx.emplace_back(MakeTransactionRef(emptyTx));
+    pblock->vtx.emplace_back(MakeTransactionRef(txCoinStake));
     return true;
 }
 
-CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake, std::vector<COutput>* availableCoins)
+namespace {
+
+/** A mempool transaction, together with its ancestors, which are not in the block yet */
+struct CTxPackage
 {
-    // Create new block
-    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
-    if (!pblocktemplate.get()) return nullptr;
-    CBlock* pblock = &pblocktemplate->block; // pointer for convenience
+    CTxMemPool::txiter iter;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpsWithAncestors;
+
+    explicit CTxPackage(CTxMemPool::txiter entry) :
+        iter(entry),
+        nSizeWithAncestors(entry->GetTxSize()),
+        nModFeesWithAncestors(entry->GetModifiedFee()),
+        nSigOpsWithAncestors(entry->GetSigOpCount())
+    {
+    }
 
-    // Tip
-    CBlockIndex* pindexPrev = GetChainTip();
-    if (!pindexPrev) return nullptr;
-    const int nHeight = pindexPrev->nHeight + 1;
+    void Add(const CTxMemPoolEntry& ancestor)
+    {
+        nSizeWithAncestors += ancestor.GetTxSize();
+        nModFeesWithAncestors += ancestor.GetModifiedFee();
+        nSigOpsWithAncestors += ancestor.GetSigOpCount();
+    }
 
-    // Make sure to create the correct block version
-    const Consensus::Params& consensus = Params().GetConsensus();
+    void Remove(const CTxMemPoolEntry& ancestor)
+    {
+        nSizeWithAncestors -= ancestor.GetTxSize();
+        nModFeesWithAncestors -= ancestor.GetModifiedFee();
+        nSigOpsWithAncestors -= ancestor.GetSigOpCount();
+    }
+};
 
-    //!> Block v7: Removes accumulator checkpoints
-    pblock->nVersion = CBlockHeader::CURRENT_VERSION;
-    // -regtest only: allow overriding block.nVersion with
-    // -blockversion=N to test forking scenarios
-    if (Params().IsRegTestNet()) {
-        pblock->nVersion = GetArg("-blockversion", pblock->nVersion);
+/** Sort packages by fee rate with ancestors in descending order */
+struct CompareTxPackageByAncestorFee
+{
+    bool operator()(const CTxPackage& a, const CTxPackage& b) const
+    {
+        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
+        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
+        if (f1 == f2) {
+            return b.iter->GetTx().GetHash() < a.iter->GetTx().GetHash();
+        }
+        return f1 > f2;
     }
+};
 
-    // Depending on the tip height, try to find a coinstake who solves the block or create a coinbase tx.
-    uint64_t elapsed;
-    if (!(fProofOfStake ? SolveProofOfStake(pblock, pindexPrev, pwallet, availableCoins, elapsed)
-                        : CreateCoinbaseTx(pblock, scriptPubKeyIn, pindexPrev))) {
-        LogPrintf("SolveProofOfStake returned in %dms\n", elapsed);
-        return nullptr;
+/**
+ * Transactions selected for the last block template, and the chain state and
+ * settings they were selected for.
+ *
+ * As long as the tip doesn't change, the selection stays valid: if the mempool
+ * didn't change either, it's reused as it is, and if transactions were only
+ * added, the new ones are added on top of it.
+ */
+struct CBlockTemplateCache
+{
+    bool fValid;
+    uint256 hashPrevBlock;
+    int nHeight;
+    bool fZerocoinMaintenance;
+    unsigned int nBlockMaxSize;
+    unsigned int nBlockPrioritySize;
+    unsigned int nBlockMinSize;
+    //! Mempool update counter at the time of the selection
+    unsigned int nTransactionsUpdated;
+    //! Whether transactions were left out for the size or sigop limit of the block
+    bool fLimited;
+    //! Whether non-final transactions were left out, which may become final with time
+    bool fNonFinal;
+
+    std::vector<CTransactionRef> vtx;
+    std::vector<CAmount> vTxFees;
+    std::vector<int64_t> vTxSigOps;
+    std::vector<CBigNum> vBlockSerials;
+    uint64_t nBlockSize;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+
+    CBlockTemplateCache() { SetNull(); }
+
+    void SetNull()
+    {
+        fValid = false;
+        vtx.clear();
+        vTxFees.clear();
+        vTxSigOps.clear();
+        vBlockSerials.clear();
     }
+};
 
-    pblocktemplate->vTxFees.push_back(-1);   // updated at end
-    pblocktemplate->vTxSigOps.push_back(-1); // updated at end
+//! Guarded by cs_main
+CBlockTemplateCache templateCache;
+
+/**
+ * Fills a block template with mempool transactions.
+ *
+ * Transactions are first selected by coin age priority, up to -blockprioritysize,
+ * and then by the fee rate of their ancestor packages. Requires cs_main and
+ * mempool.cs.
+ */
+class BlockAssembler
+{
+private:
+    typedef std::set<CTxPackage, CompareTxPackageByAncestorFee> setPackages_t;
+    typedef std::map<CTxMemPool::txiter, setPackages_t::iterator, CTxMemPool::CompareIteratorByHash> mapPackages_t;
+
+    CBlockTemplate* pblocktemplate;
+    CBlock* pblock;
+    const CBlockIndex* pindexPrev;
+    const Consensus::Params& consensus;
+    const int nHeight;
+    CCoinsViewCache view;
+
+    // Configuration
+    unsigned int nBlockMaxSize;
+    unsigned int nBlockPrioritySize;
+    unsigned int nBlockMinSize;
+    bool fZerocoinMaintenance;
+    bool fPrintPriority;
+
+    // Block state
+    size_t nFirstTx;
+    size_t nFirstTxFee;
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+    std::vector<CBigNum> vBlockSerials;
+    CTxMemPool::setEntries inBlock;
+    //! Transactions, which can't be included; their descendants can't be included either
+    CTxMemPool::setEntries setFailed;
+    bool fLimited;
+    bool fNonFinal;
+
+    // Candidates of the fee rate selection
+    setPackages_t setPackages;
+    mapPackages_t mapPackages;
+
+    bool IsCacheFor(const CBlockTemplateCache& cache) const;
+    void UseCachedTransactions();
+    bool ExtendCachedTransactions();
+    void ExcludeIneligible();
+    void AddPriorityTxs();
+    void InitPackages();
+    void AddPackageTxs();
+    void SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries) const;
+    bool TestTransaction(const CTransaction& tx, CCoinsViewCache& viewPackage, std::vector<CBigNum>& vSerials, CAmount& nTxFees, unsigned int& nTxSigOps) const;
+    bool AddPackage(const std::vector<CTxMemPool::txiter>& vPackage, const CFeeRate& feeRate, double dPriority);
+    void RemovePackage(CTxMemPool::txiter iter);
+    void UpdatePackagesForAdded(CTxMemPool::txiter iter);
+    void StoreCache();
+
+public:
+    BlockAssembler(CBlockTemplate* pblocktemplateIn, const CBlockIndex* pindexPrevIn);
 
+    /** Adds the mempool transactions to the block, and returns the sum of their fees. */
+    CAmount AddTransactions();
+};
+
+BlockAssembler::BlockAssembler(CBlockTemplate* pblocktemplateIn, const CBlockIndex* pindexPrevIn) :
+    pblocktemplate(pblocktemplateIn),
+    pblock(&pblocktemplateIn->block),
+    pindexPrev(pindexPrevIn),
+    consensus(Params().GetConsensus()),
+    nHeight(pindexPrevIn->nHeight + 1),
+    view(pcoinsTip),
+    nFirstTx(pblocktemplateIn->block.vtx.size()),
+    nFirstTxFee(pblocktemplateIn->vTxFees.size()),
+    nBlockSize(1000),
+    nBlockTx(0),
+    nBlockSigOps(100),
+    nFees(0),
+    fLimited(false),
+    fNonFinal(false)
+{
     // Largest block you're willing to create:
-    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+    nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
     // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
     unsigned int nBlockMaxSizeNetwork = MAX_BLOCK_SIZE_CURRENT;
     nBlockMaxSize = std::max((unsigned int)1000, std::min((nBlockMaxSizeNetwork - 1000), nBlockMaxSize));
 
     // How much of the block should be dedicated to high-priority transactions,
     // included regardless of the fees they pay
-    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
+    nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
     nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
 
     // Minimum block size you want to create; block will be filled with free transactions
     // until there are no more or the block reaches this size:
-    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
+    nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
     nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
 
-    // Collect memory pool transactions into the block
-    CAmount nFees = 0;
+    fZerocoinMaintenance = sporkManager.IsSporkActive(SPORK_16_ZEROCOIN_MAINTENANCE_MODE);
+    fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
+}
 
-    {
-        LOCK2(cs_main, mempool.cs);
-        CCoinsViewCache view(pcoinsTip);
-
-        // Priority order to process transactions
-        std::list<COrphan> vOrphan; // list memory doesn't move
-        std::map<uint256, std::vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
-
-        // This vector will be sorted into a priority queue:
-        std::vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight)){
+bool BlockAssembler::IsCacheFor(const CBlockTemplateCache& cache) const
+{
+    return cache.fValid &&
+           !cache.fNonFinal &&
+           cache.hashPrevBlock == pindexPrev->GetBlockHash() &&
+           cache.nHeight == nHeight &&
+           cache.fZerocoinMaintenance == fZerocoinMaintenance &&
+           cache.nBlockMaxSize == nBlockMaxSize &&
+           cache.nBlockPrioritySize == nBlockPrioritySize &&
+           cache.nBlockMinSize == nBlockMinSize;
+}
+
+void BlockAssembler::UseCachedTransactions()
+{
+    pblock->vtx.insert(pblock->vtx.end(), templateCache.vtx.begin(), templateCache.vtx.end());
+    pblocktemplate->vTxFees.insert(pblocktemplate->vTxFees.end(), templateCache.vTxFees.begin(), templateCache.vTxFees.end());
+    pblocktemplate->vTxSigOps.insert(pblocktemplate->vTxSigOps.end(), templateCache.vTxSigOps.begin(), templateCache.vTxSigOps.end());
+    vBlockSerials = templateCache.vBlockSerials;
+    nBlockSize = templateCache.nBlockSize;
+    nBlockTx = templateCache.vtx.size();
+    nBlockSigOps = templateCache.nBlockSigOps;
+    nFees = templateCache.nFees;
+}
+
+bool BlockAssembler::ExtendCachedTransactions()
+{
+    // A selection, which was cut by the size or sigop limit, may not be the best
+    // one anymore, when transactions were added
+    if (templateCache.fLimited) return false;
+
+    // The cached transactions were validated against the same chain state, and
+    // as long as they are still in the mempool, nothing in the mempool conflicts
+    // with them.
+    std::vector<CTxMemPool::txiter> vEntries;
+    vEntries.reserve(templateCache.vtx.size());
+    for (const CTransactionRef& tx : templateCache.vtx) {
+        CTxMemPool::txiter it = mempool.mapTx.find(tx->GetHash());
+        if (it == mempool.mapTx.end()) return false;
+        vEntries.push_back(it);
+    }
+
+    UseCachedTransactions();
+    for (size_t i = 0; i < vEntries.size(); ++i) {
+        UpdateCoins(*templateCache.vtx[i], view, nHeight);
+        inBlock.insert(vEntries[i]);
+    }
+    return true;
+}
+
+void BlockAssembler::ExcludeIneligible()
+{
+    for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
+        if (inBlock.count(it)) continue;
+        const CTransaction& tx = it->GetTx();
+        if (tx.IsCoinBase() || tx.IsCoinStake()) {
+            setFailed.insert(it);
+        } else if (!IsFinalTx(tx, nHeight)) {
+            setFailed.insert(it);
+            fNonFinal = true;
+        } else if (fZerocoinMaintenance && tx.ContainsZerocoins()) {
+            setFailed.insert(it);
+        }
+    }
+}
+
+void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries) const
+{
+    // Depth-first over the in-package parents, so that every transaction follows its parents
+    std::vector<std::pair<CTxMemPool::txiter, bool> > vStack;
+    CTxMemPool::setEntries setVisited;
+    for (const CTxMemPool::txiter& entry : package) {
+        vStack.emplace_back(entry, false);
+        while (!vStack.empty()) {
+            std::pair<CTxMemPool::txiter, bool> top = vStack.back();
+            vStack.pop_back();
+            if (top.second) {
+                sortedEntries.push_back(top.first);
                 continue;
             }
-            if(sporkManager.IsSporkActive(SPORK_16_ZEROCOIN_MAINTENANCE_MODE) && tx.ContainsZerocoins()){
-                continue;
+            if (!setVisited.insert(top.first).second) continue;
+            vStack.emplace_back(top.first, true);
+            for (const CTxMemPool::txiter& parent : mempool.GetMemPoolParents(top.first)) {
+                if (package.count(parent) && !setVisited.count(parent)) {
+                    vStack.emplace_back(parent, false);
+                }
             }
+        }
+    }
+}
 
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            bool hasZerocoinSpends = tx.HasZerocoinSpendInputs();
-            if (hasZerocoinSpends)
-                nTotalIn = tx.GetZerocoinSpent();
-
-            for (const CTxIn& txin : tx.vin) {
-                // Read prev transaction
-                if (!view.HaveCoin(txin.prevout)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
+bool BlockAssembler::TestTransaction(const CTransaction& tx, CCoinsViewCache& viewPackage, std::vector<CBigNum>& vSerials, CAmount& nTxFees, unsigned int& nTxSigOps) const
+{
+    if (!viewPackage.HaveInputs(tx))
+        return false;
 
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx.find(txin.prevout.hash)->GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
+    // zPIV check to not include duplicated serials in the same block.
+    if (!CheckForDuplicatedSerials(tx, consensus, vSerials))
+        return false;
 
-                const Coin& coin = view.AccessCoin(txin.prevout);
-                assert(hasZerocoinSpends || !coin.IsSpent());
+    nTxFees = viewPackage.GetValueIn(tx) - tx.GetValueOut();
+    nTxSigOps = GetLegacySigOpCount(tx) + GetP2SHSigOpCount(tx, viewPackage);
 
-                CAmount nValueIn = coin.out.GetValue();
-                nTotalIn += nValueIn;
+    // Note that flags: we don't want to set mempool/IsStandard()
+    // policy here, but we still have to ensure that the block we
+    // create only contains transactions that are valid in new blocks.
+    CValidationState state;
+    PrecomputedTransactionData precomTxData(tx);
+    if (!CheckInputs(tx, state, viewPackage, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, precomTxData))
+        return false;
 
-                int nConf = nHeight - coin.nHeight;
+    UpdateCoins(tx, viewPackage, nHeight);
+    return true;
+}
 
-                // zPIV spends can have very large priority, use non-overflowing safe functions
-                dPriority = double_safe_addition(dPriority, ((double)nValueIn * nConf));
+bool BlockAssembler::AddPackage(const std::vector<CTxMemPool::txiter>& vPackage, const CFeeRate& feeRate, double dPriority)
+{
+    CCoinsViewCache viewPackage(&view);
+    std::vector<CBigNum> vSerials(vBlockSerials);
+    std::vector<CAmount> vPackageFees;
+    std::vector<unsigned int> vPackageSigOps;
+    unsigned int nPackageSigOps = 0;
+
+    for (const CTxMemPool::txiter& it : vPackage) {
+        CAmount nTxFees;
+        unsigned int nTxSigOps;
+        if (!TestTransaction(it->GetTx(), viewPackage, vSerials, nTxFees, nTxSigOps)) {
+            setFailed.insert(it);
+            return false;
+        }
+        vPackageFees.push_back(nTxFees);
+        vPackageSigOps.push_back(nTxSigOps);
+        nPackageSigOps += nTxSigOps;
+    }
 
-            }
-            if (fMissingInputs) continue;
+    // Legacy limits on sigOps:
+    if (nBlockSigOps + nPackageSigOps >= MAX_BLOCK_SIGOPS_CURRENT) {
+        fLimited = true;
+        return false;
+    }
 
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
+    viewPackage.Flush();
+    vBlockSerials.swap(vSerials);
+
+    for (size_t i = 0; i < vPackage.size(); ++i) {
+        const CTransaction& tx = vPackage[i]->GetTx();
+        pblock->vtx.push_back(vPackage[i]->GetSharedTx());
+        pblocktemplate->vTxFees.push_back(vPackageFees[i]);
+        pblocktemplate->vTxSigOps.push_back(vPackageSigOps[i]);
+        nBlockSize += vPackage[i]->GetTxSize();
+        ++nBlockTx;
+        nBlockSigOps += vPackageSigOps[i];
+        nFees += vPackageFees[i];
+        inBlock.insert(vPackage[i]);
+
+        if (fPrintPriority) {
+            LogPrintf("priority %.1f fee %s txid %s\n",
+                dPriority, feeRate.ToString(), tx.GetHash().ToString());
+        }
+    }
 
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
+    for (const CTxMemPool::txiter& it : vPackage) {
+        UpdatePackagesForAdded(it);
+    }
+    return true;
+}
+
+void BlockAssembler::RemovePackage(CTxMemPool::txiter iter)
+{
+    mapPackages_t::iterator mi = mapPackages.find(iter);
+    if (mi != mapPackages.end()) {
+        setPackages.erase(mi->second);
+        mapPackages.erase(mi);
+    }
+}
 
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
+void BlockAssembler::UpdatePackagesForAdded(CTxMemPool::txiter iter)
+{
+    RemovePackage(iter);
+    if (mapPackages.empty()) return;
+
+    CTxMemPool::setEntries setDescendants;
+    mempool.CalculateDescendants(iter, setDescendants);
+    for (const CTxMemPool::txiter& desc : setDescendants) {
+        mapPackages_t::iterator mi = mapPackages.find(desc);
+        if (mi == mapPackages.end()) continue;
+        CTxPackage package = *mi->second;
+        package.Remove(*iter);
+        setPackages.erase(mi->second);
+        mi->second = setPackages.insert(package).first;
+    }
+}
 
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->GetTx()));
+void BlockAssembler::AddPriorityTxs()
+{
+    // How much of the block should be dedicated to high-priority transactions,
+    // included regardless of the fees they pay
+    if (nBlockPrioritySize == 0) return;
+
+    typedef std::pair<double, CTxMemPool::txiter> TxCoinAgePriority;
+    struct TxCoinAgePriorityCompare {
+        bool operator()(const TxCoinAgePriority& a, const TxCoinAgePriority& b) const
+        {
+            if (a.first == b.first)
+                return CTxMemPool::CompareIteratorByHash()(b.second, a.second);
+            return a.first < b.first;
+        }
+    } comparer;
+
+    std::vector<TxCoinAgePriority> vecPriority;
+    vecPriority.reserve(mempool.mapTx.size());
+    for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
+        if (setFailed.count(it)) continue;
+        double dPriority = it->GetPriority(nHeight);
+        CAmount dummy = 0;
+        mempool.ApplyDeltas(it->GetTx().GetHash(), dPriority, dummy);
+        vecPriority.emplace_back(dPriority, it);
+    }
+    std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+
+    // Transactions, which wait for an in-mempool parent
+    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> mapWaitPriority;
+
+    while (!vecPriority.empty()) {
+        // Take highest priority transaction off the priority queue:
+        const double dPriority = vecPriority.front().first;
+        const CTxMemPool::txiter it = vecPriority.front().second;
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        vecPriority.pop_back();
+
+        if (setFailed.count(it)) continue;
+
+        // Prioritise by fee once past the priority size or we run out of high-priority
+        // transactions:
+        const unsigned int nTxSize = it->GetTxSize();
+        if (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(dPriority)) break;
+
+        bool fWaiting = false;
+        bool fFailedParent = false;
+        for (const CTxMemPool::txiter& parent : mempool.GetMemPoolParents(it)) {
+            if (setFailed.count(parent)) {
+                fFailedParent = true;
+                break;
+            }
+            if (!inBlock.count(parent)) fWaiting = true;
+        }
+        if (fFailedParent) {
+            setFailed.insert(it);
+            continue;
+        }
+        if (fWaiting) {
+            mapWaitPriority.insert(std::make_pair(it, dPriority));
+            continue;
         }
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-        std::vector<CBigNum> vBlockSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
 
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS_CURRENT;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
+        // Size limits
+        if (nBlockSize + nTxSize >= nBlockMaxSize) {
+            fLimited = true;
+            continue;
+        }
 
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (!tx.HasZerocoinSpendInputs() && fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
+        if (!AddPackage(std::vector<CTxMemPool::txiter>(1, it), CFeeRate(it->GetModifiedFee(), nTxSize), dPriority))
+            continue;
 
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
+        // Add transactions that depend on this one to the priority queue
+        for (const CTxMemPool::txiter& child : mempool.GetMemPoolChildren(it)) {
+            std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator wi = mapWaitPriority.find(child);
+            if (wi != mapWaitPriority.end()) {
+                vecPriority.emplace_back(wi->second, wi->first);
+                std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
+                mapWaitPriority.erase(wi);
             }
+        }
+    }
+}
 
-            if (!view.HaveInputs(tx))
-                continue;
+void BlockAssembler::InitPackages()
+{
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
 
-            // zPIV check to not include duplicated serials in the same block.
-            if (!CheckForDuplicatedSerials(tx, consensus, vBlockSerials)) {
-                continue;
-            }
+    for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); ++it) {
+        if (inBlock.count(it) || setFailed.count(it)) continue;
 
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
+        CTxMemPool::setEntries setAncestors;
+        mempool.CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
 
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
+        CTxPackage package(it);
+        for (const CTxMemPool::txiter& ancestor : setAncestors) {
+            if (!inBlock.count(ancestor)) package.Add(*ancestor);
+        }
+        mapPackages.insert(std::make_pair(it, setPackages.insert(package).first));
+    }
+}
 
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
+void BlockAssembler::AddPackageTxs()
+{
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
 
-            CValidationState state;
-            PrecomputedTransactionData precomTxData(tx);
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, precomTxData))
-                continue;
+    InitPackages();
 
-            UpdateCoins(tx, view, nHeight);
+    while (!setPackages.empty()) {
+        const CTxPackage package = *setPackages.begin();
+        RemovePackage(package.iter);
 
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
+        if (setFailed.count(package.iter)) continue;
 
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
+        // Size limits
+        if (nBlockSize + package.nSizeWithAncestors >= nBlockMaxSize ||
+            nBlockSigOps + package.nSigOpsWithAncestors >= MAX_BLOCK_SIGOPS_CURRENT) {
+            fLimited = true;
+            continue;
+        }
 
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                for (COrphan* porphan : mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
+        // Skip free transactions if we're past the minimum block size:
+        const CFeeRate feeRate(package.nModFeesWithAncestors, package.nSizeWithAncestors);
+        if (!package.iter->GetTx().HasZerocoinSpendInputs() && feeRate < ::minRelayTxFee &&
+            nBlockSize + package.nSizeWithAncestors >= nBlockMinSize) {
+            if (nBlockMinSize > 0) fLimited = true;
+            continue;
+        }
+
+        CTxMemPool::setEntries setAncestors;
+        mempool.CalculateMemPoolAncestors(*package.iter, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+
+        CTxMemPool::setEntries setPackage;
+        setPackage.insert(package.iter);
+        bool fFailedAncestor = false;
+        for (const CTxMemPool::txiter& ancestor : setAncestors) {
+            if (inBlock.count(ancestor)) continue;
+            if (setFailed.count(ancestor)) {
+                fFailedAncestor = true;
+                break;
             }
+            setPackage.insert(ancestor);
+        }
+        if (fFailedAncestor) {
+            setFailed.insert(package.iter);
+            continue;
         }
 
+        std::vector<CTxMemPool::txiter> vPackage;
+        vPackage.reserve(setPackage.size());
+        SortForBlock(setPackage, vPackage);
+
+        // If a transaction of the package is invalid, only it and its descendants
+        // are excluded, and its ancestors remain candidates by themselves.
+        AddPackage(vPackage, feeRate, package.iter->GetPriority(nHeight));
+    }
+}
+
+void BlockAssembler::StoreCache()
+{
+    templateCache.SetNull();
+    templateCache.fValid = true;
+    templateCache.hashPrevBlock = pindexPrev->GetBlockHash();
+    templateCache.nHeight = nHeight;
+    templateCache.fZerocoinMaintenance = fZerocoinMaintenance;
+    templateCache.nBlockMaxSize = nBlockMaxSize;
+    templateCache.nBlockPrioritySize = nBlockPrioritySize;
+    templateCache.nBlockMinSize = nBlockMinSize;
+    templateCache.nTransactionsUpdated = mempool.GetTransactionsUpdated();
+    templateCache.fLimited = fLimited;
+    templateCache.fNonFinal = fNonFinal;
+    templateCache.vtx.assign(pblock->vtx.begin() + nFirstTx, pblock->vtx.end());
+    templateCache.vTxFees.assign(pblocktemplate->vTxFees.begin() + nFirstTxFee, pblocktemplate->vTxFees.end());
+    templateCache.vTxSigOps.assign(pblocktemplate->vTxSigOps.begin() + nFirstTxFee, pblocktemplate->vTxSigOps.end());
+    templateCache.vBlockSerials = vBlockSerials;
+    templateCache.nBlockSize = nBlockSize;
+    templateCache.nBlockSigOps = nBlockSigOps;
+    templateCache.nFees = nFees;
+}
+
+CAmount BlockAssembler::AddTransactions()
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+
+    const int64_t nTimeStart = GetTimeMicros();
+    const char* strSelection = "full";
+
+    if (IsCacheFor(templateCache) && templateCache.nTransactionsUpdated == mempool.GetTransactionsUpdated()) {
+        UseCachedTransactions();
+        strSelection = "cached";
+    } else {
+        if (IsCacheFor(templateCache) && ExtendCachedTransactions()) {
+            // New transactions are only selected by fee rate; the coin age
+            // priority area is filled again with the next block.
+            strSelection = "extended";
+            ExcludeIneligible();
+        } else {
+            ExcludeIneligible();
+            AddPriorityTxs();
+        }
+        AddPackageTxs();
+        StoreCache();
+    }
+
+    nLastBlockTx = nBlockTx;
+    nLastBlockSize = nBlockSize;
+    LogPrintf("%s : total size %u\n", __func__, nBlockSize);
+    LogPrint(BCLog::BENCH, "%s : %s selection of %u txs from %u in mempool: %.2fms\n", __func__,
+            strSelection, nBlockTx, mempool.mapTx.size(), 0.001 * (GetTimeMicros() - nTimeStart));
+
+    return nFees;
+}
+
+} // anon namespace
+
+CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet, bool fProofOfStake, std::vector<COutput>* availableCoins)
+{
+    // Create new block
+    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
+    if (!pblocktemplate.get()) return nullptr;
+    CBlock* pblock = &pblocktemplate->block; // pointer for convenience
+
+    // Tip
+    CBlockIndex* pindexPrev = GetChainTip();
+    if (!pindexPrev) return nullptr;
+
+    //!> Block v7: Removes accumulator checkpoints
+    pblock->nVersion = CBlockHeader::CURRENT_VERSION;
+    // -regtest only: allow overriding block.nVersion with
+    // -blockversion=N to test forking scenarios
+    if (Params().IsRegTestNet()) {
+        pblock->nVersion = GetArg("-blockversion", pblock->nVersion);
+    }
+
+    // Depending on the tip height, try to find a coinstake who solves the block or create a coinbase tx.
+    uint64_t elapsed;
+    if (!(fProofOfStake ? SolveProofOfStake(pblock, pindexPrev, pwallet, availableCoins, elapsed)
+                        : CreateCoinbaseTx(pblock, scriptPubKeyIn, pindexPrev))) {
+        LogPrintf("SolveProofOfStake returned in %dms\n", elapsed);
+        return nullptr;
+    }
+
+    pblocktemplate->vTxFees.push_back(-1);   // updated at end
+    pblocktemplate->vTxSigOps.push_back(-1); // updated at end
+
+    // Collect memory pool transactions into the block
+    CAmount nFees = 0;
+
+    {
+        LOCK2(cs_main, mempool.cs);
+        nFees = BlockAssembler(pblocktemplate.get(), pindexPrev).AddTransactions();
+
         if (!fProofOfStake) {
             // Coinbase can get the fees.
-            pblock->vtx[0].vout[0].nValue += nFees;
+            CMutableTransaction txCoinbase(*pblock->vtx[0]);
+            txCoinbase.vout[0].nValue += nFees;
+            pblock->vtx[0] = MakeTransactionRef(txCoinbase);
             pblocktemplate->vTxFees[0] = -nFees;
         }
 
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
-        LogPrintf("%s : total size %u\n", __func__, nBlockSize);
-
         // Fill in header
         pblock->hashPrevBlock = pindexPrev->GetBlockHash();
         if (!fProofOfStake)
@@ -456,7 +826,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         pblock->nBits = GetNextWorkRequired(pindexPrev, pblock);
         pblock->nNonce = 0;
 
-        pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(pblock->vtx[0]);
+        pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(*pblock->vtx[0]);
 
         if (fProofOfStake) {
             pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
@@ -470,6 +840,7 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         CValidationState state;
         if (!TestBlockValidity(state, *pblock, pindexPrev, false, false)) {
             LogPrintf("CreateNewBlock() : TestBlockValidity failed\n");
+            templateCache.SetNull();
             mempool.clear();
             return nullptr;
         }
@@ -487,11 +858,11 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
     }
     ++nExtraNonce;
     unsigned int nHeight = pindexPrev->nHeight + 1; // Height first in coinbase required for block.version=2
-    CMutableTransaction txCoinbase(pblock->vtx[0]);
+    CMutableTransaction txCoinbase(*pblock->vtx[0]);
     txCoinbase.vin[0].scriptSig = (CScript() << nHeight << CScriptNum(nExtraNonce)) + COINBASE_FLAGS;
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
-    pblock->vtx[0] = txCoinbase;
+    pblock->vtx[0] = MakeTransactionRef(txCoinbase);
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
 
@@ -13,9 +13,92 @@
 #include "utilstrencodings.h"
 #include "util.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+
+//! Minimum number of headers hashed by a thread of HashBlockHeaders()
+static const size_t MIN_HEADERS_PER_THREAD = 64;
+
+CBlockHeaderHashCache& CBlockHeaderHashCache::operator=(const CBlockHeaderHashCache& other)
+{
+    if (this == &other)
+        return *this;
+    // copy under the lock of the other cache first, so that the two locks are never held at once
+    bool fValidOther;
+    unsigned char vchHeaderOther[HASHED_SIZE];
+    uint256 hashOther;
+    {
+        std::lock_guard<std::mutex> lock(other.cs);
+        fValidOther = other.fValid;
+        memcpy(vchHeaderOther, other.vchHeader, HASHED_SIZE);
+        hashOther = other.hash;
+    }
+    std::lock_guard<std::mutex> lock(cs);
+    fValid = fValidOther;
+    memcpy(vchHeader, vchHeaderOther, HASHED_SIZE);
+    hash = hashOther;
+    return *this;
+}
+
+bool CBlockHeaderHashCache::Get(const unsigned char* pheader, uint256& hashOut) const
+{
+    std::lock_guard<std::mutex> lock(cs);
+    if (!fValid || memcmp(pheader, vchHeader, HASHED_SIZE) != 0)
+        return false;
+    hashOut = hash;
+    return true;
+}
+
+void CBlockHeaderHashCache::Set(const unsigned char* pheader, const uint256& hashIn)
+{
+    std::lock_guard<std::mutex> lock(cs);
+    memcpy(vchHeader, pheader, HASHED_SIZE);
+    hash = hashIn;
+    fValid = true;
+}
+
+void CBlockHeaderHashCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(cs);
+    fValid = false;
+}
+
 uint256 CBlockHeader::GetHash() const
 {
-    return HashQuark(BEGIN(nVersion), END(nNonce));
+    static_assert(offsetof(CBlockHeader, nNonce) + sizeof(nNonce) - offsetof(CBlockHeader, nVersion) == CBlockHeaderHashCache::HASHED_SIZE,
+        "the hashed header fields must be contiguous");
+
+    // the fields are public, so the cache is checked against the header bytes rather than cleared by each change
+    uint256 hash;
+    if (hashCache.Get((const unsigned char*)BEGIN(nVersion), hash))
+        return hash;
+    hash = HashQuark(BEGIN(nVersion), END(nNonce));
+    hashCache.Set((const unsigned char*)BEGIN(nVersion), hash);
+    return hash;
+}
+
+void HashBlockHeaders(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashes, int nThreads)
+{
+    if (nThreads <= 0)
+        nThreads = GetNumCores();
+    const size_t nPerThread = std::max(MIN_HEADERS_PER_THREAD, (vHeaders.size() + nThreads - 1) / nThreads);
+    vHashes.resize(vHeaders.size());
+
+    // the first part is hashed by the calling thread, each thread writes its own part of vHashes
+    std::vector<std::thread> vThreads;
+    for (size_t nBegin = nPerThread; nBegin < vHeaders.size(); nBegin += nPerThread) {
+        const size_t nEnd = std::min(nBegin + nPerThread, vHeaders.size());
+        vThreads.emplace_back([&vHeaders, &vHashes, nBegin, nEnd] {
+            for (size_t i = nBegin; i < nEnd; i++)
+                vHashes[i] = vHeaders[i].GetHash();
+        });
+    }
+    for (size_t i = 0; i < std::min(nPerThread, vHeaders.size()); i++)
+        vHashes[i] = vHeaders[i].GetHash();
+    for (std::thread& thread : vThreads)
+        thread.join();
 }
 
 std::string CBlock::ToString() const
@@ -30,7 +113,7 @@ std::string CBlock::ToString() const
         vtx.size());
     for (unsigned int i = 0; i < vtx.size(); i++)
     {
-        s << "  " << vtx[i].ToString() << "\n";
+        s << "  " << vtx[i]->ToString() << "\n";
     }
     return s.str();
 }
@@ -12,6 +12,36 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <mutex>
+
+/**
+ * The last hash of a block header, and the header bytes it was computed from,
+ * so that a changed header is hashed again. It may be read and written by
+ * several threads at once, and copies keep the cached hash.
+ */
+class CBlockHeaderHashCache
+{
+public:
+    //! Number of header bytes hashed by CBlockHeader::GetHash(), from nVersion to nNonce
+    static const size_t HASHED_SIZE = 80;
+
+private:
+    mutable std::mutex cs;
+    bool fValid;
+    unsigned char vchHeader[HASHED_SIZE];
+    uint256 hash;
+
+public:
+    CBlockHeaderHashCache() : fValid(false) {}
+    CBlockHeaderHashCache(const CBlockHeaderHashCache& other) : fValid(false) { *this = other; }
+    CBlockHeaderHashCache& operator=(const CBlockHeaderHashCache& other);
+
+    //! Returns the cached hash if it was computed from the given header bytes
+    bool Get(const unsigned char* pheader, uint256& hashOut) const;
+    void Set(const unsigned char* pheader, const uint256& hashIn);
+    void Clear();
+};
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -32,6 +62,9 @@ public:
     uint32_t nNonce;
     uint256 nAccumulatorCheckpoint;             // only for version 4, 5 and 6.
 
+    // memory only
+    mutable CBlockHeaderHashCache hashCache;
+
     CBlockHeader()
     {
         SetNull();
@@ -61,6 +94,7 @@ public:
         nBits = 0;
         nNonce = 0;
         nAccumulatorCheckpoint.SetNull();
+        hashCache.Clear();
     }
 
     bool IsNull() const
@@ -68,6 +102,7 @@ public:
         return (nBits == 0);
     }
 
+    /** Returns the hash of the header, which is only computed again after the header changed. */
     uint256 GetHash() const;
 
     int64_t GetBlockTime() const
@@ -81,7 +116,7 @@ class CBlock : public CBlockHeader
 {
 public:
     // network and disk
-    std::vector<CTransaction> vtx;
+    std::vector<CTransactionRef> vtx;
 
     // ppcoin: block signature - signed by one of the coin base txout[N]'s owner
     std::vector<unsigned char> vchBlockSig;
@@ -106,7 +141,7 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action) {
         READWRITE(*(CBlockHeader*)this);
         READWRITE(vtx);
-	if(vtx.size() > 1 && vtx[1].IsCoinStake())
+	if(vtx.size() > 1 && vtx[1]->IsCoinStake())
 		READWRITE(vchBlockSig);
     }
 
@@ -134,7 +169,7 @@ public:
 
     bool IsProofOfStake() const
     {
-        return (vtx.size() > 1 && vtx[1].IsCoinStake());
+        return (vtx.size() > 1 && vtx[1]->IsCoinStake());
     }
 
     bool IsProofOfWork() const
@@ -146,6 +181,13 @@ public:
     void print() const;
 };
 
+/**
+ * Computes the hashes of many headers at once, split over nThreads threads
+ * (0 = one per core). vHashes[i] is the hash of vHeaders[i].
+ */
+void HashBlockHeaders(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashes, int nThreads = 0);
+
+
 
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
@@ -14,6 +14,7 @@
 #include "uint256.h"
 
 #include <list>
+#include <memory>
 
 class CTransaction;
 
@@ -244,6 +245,12 @@ public:
     /** Convert a CMutableTransaction into a CTransaction. */
     CTransaction(const CMutableTransaction &tx);
 
+    /** Deserialize a CTransaction, used by the serialization of CTransactionRef. */
+    template <typename Stream>
+    CTransaction(deserialize_type, Stream& s) : CTransaction() {
+        Unserialize(s);
+    }
+
     CTransaction& operator=(const CTransaction& tx);
 
     ADD_SERIALIZE_METHODS;
@@ -344,4 +351,12 @@ struct CMutableTransaction
     std::string ToString() const;
 };
 
+/**
+ * Immutable transaction, which is shared between blocks, the mempool and the
+ * validation interface, instead of being copied.
+ */
+typedef std::shared_ptr<const CTransaction> CTransactionRef;
+static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
+template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
+
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
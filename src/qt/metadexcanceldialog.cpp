@@ -99,15 +99,12 @@ void MetaDExCancelDialog::UpdateAddressSelector()
     ui->fromCombo->clear();
 
     for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-        md_PricesMap & prices = my_it->second;
-        for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-            md_Set & indexes = (it->second);
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                CMPMetaDEx obj = *it;
-                if(IsMyAddress(obj.getAddr())) { // this address is ours and has an active MetaDEx trade
-                    int idx = ui->fromCombo->findText(QString::fromStdString(obj.getAddr())); // avoid adding duplicates
-                    if (idx == -1) ui->fromCombo->addItem(QString::fromStdString(obj.getAddr()));
-                }
+        const CMPMetaDExBook& book = my_it->second;
+        for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+            const CMPMetaDEx& obj = *it;
+            if(IsMyAddress(obj.getAddr())) { // this address is ours and has an active MetaDEx trade
+                int idx = ui->fromCombo->findText(QString::fromStdString(obj.getAddr())); // avoid adding duplicates
+                if (idx == -1) ui->fromCombo->addItem(QString::fromStdString(obj.getAddr()));
             }
         }
     }
@@ -152,37 +149,34 @@ void MetaDExCancelDialog::UpdateCancelCombo()
     LOCK(cs_tally);
 
     for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-        md_PricesMap & prices = my_it->second;
-        for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-            md_Set & indexes = it->second;
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                CMPMetaDEx obj = *it;
-                if(senderAddress == obj.getAddr()) {
-                    // for "cancel all":
-                    if (isMainEcosystemProperty(obj.getProperty())) fMainEcosystem = true;
-                    if (isTestEcosystemProperty(obj.getProperty())) fTestEcosystem = true;
-
-                    bool isBuy = false; // sell or buy? (from UI perspective)
-                    if ((obj.getProperty() == TOKEN_PROPERTY_MSC) || (obj.getProperty() == TOKEN_PROPERTY_TMSC)) isBuy = true;
-                    string sellToken = getPropertyName(obj.getProperty()).c_str();
-                    string desiredToken = getPropertyName(obj.getDesProperty()).c_str();
-                    string sellId = strprintf("%d", obj.getProperty());
-                    string desiredId = strprintf("%d", obj.getDesProperty());
-                    if(sellToken.size()>30) sellToken=sellToken.substr(0,30)+"...";
-                    sellToken += " (#" + sellId + ")";
-                    if(desiredToken.size()>30) desiredToken=desiredToken.substr(0,30)+"...";
-                    desiredToken += " (#" + desiredId + ")";
-                    string comboStr = "Cancel all orders ";
-                    if (isBuy) { comboStr += "buying " + desiredToken; } else { comboStr += "selling " + sellToken; }
-                    string dataStr = sellId + "/" + desiredId;
-                    if (ui->radioCancelPrice->isChecked()) { // append price if needed
-                        comboStr += " priced at " + StripTrailingZeros(obj.displayUnitPrice());
-                        if ((obj.getProperty() == TOKEN_PROPERTY_MSC) || (obj.getDesProperty() == TOKEN_PROPERTY_MSC)) { comboStr += " OMN/SPT"; } else { comboStr += " TOMN/SPT"; }
-                        dataStr += ":" + obj.displayUnitPrice();
-                    }
-                    int index = ui->cancelCombo->findText(QString::fromStdString(comboStr));
-                    if ( index == -1 ) { ui->cancelCombo->addItem(QString::fromStdString(comboStr),QString::fromStdString(dataStr)); }
+        const CMPMetaDExBook& book = my_it->second;
+        for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+            const CMPMetaDEx& obj = *it;
+            if(senderAddress == obj.getAddr()) {
+                // for "cancel all":
+                if (isMainEcosystemProperty(obj.getProperty())) fMainEcosystem = true;
+                if (isTestEcosystemProperty(obj.getProperty())) fTestEcosystem = true;
+
+                bool isBuy = false; // sell or buy? (from UI perspective)
+                if ((obj.getProperty() == TOKEN_PROPERTY_MSC) || (obj.getProperty() == TOKEN_PROPERTY_TMSC)) isBuy = true;
+                string sellToken = getPropertyName(obj.getProperty()).c_str();
+                string desiredToken = getPropertyName(obj.getDesProperty()).c_str();
+                string sellId = strprintf("%d", obj.getProperty());
+                string desiredId = strprintf("%d", obj.getDesProperty());
+                if(sellToken.size()>30) sellToken=sellToken.substr(0,30)+"...";
+                sellToken += " (#" + sellId + ")";
+                if(desiredToken.size()>30) desiredToken=desiredToken.substr(0,30)+"...";
+                desiredToken += " (#" + desiredId + ")";
+                string comboStr = "Cancel all orders ";
+                if (isBuy) { comboStr += "buying " + desiredToken; } else { comboStr += "selling " + sellToken; }
+                string dataStr = sellId + "/" + desiredId;
+                if (ui->radioCancelPrice->isChecked()) { // append price if needed
+                    comboStr += " priced at " + StripTrailingZeros(obj.displayUnitPrice());
+                    if ((obj.getProperty() == TOKEN_PROPERTY_MSC) || (obj.getDesProperty() == TOKEN_PROPERTY_MSC)) { comboStr += " OMN/SPT"; } else { comboStr += " TOMN/SPT"; }
+                    dataStr += ":" + obj.displayUnitPrice();
                 }
+                int index = ui->cancelCombo->findText(QString::fromStdString(comboStr));
+                if ( index == -1 ) { ui->cancelCombo->addItem(QString::fromStdString(comboStr),QString::fromStdString(dataStr)); }
             }
         }
     }
@@ -303,19 +297,15 @@ void MetaDExCancelDialog::SendCancelTransaction()
 
         for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
             if (my_it->first != propertyIdForSale) { continue; } // move along, this isn't the prop you're looking for
-            md_PricesMap & prices = my_it->second;
-            for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-                md_Set & indexes = it->second;
-                for (md_Set::iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                    CMPMetaDEx obj = *it;
-                    if (obj.displayUnitPrice() == priceStr) {
-                        amountForSale = obj.getAmountForSale();
-                        amountDesired = obj.getAmountDesired();
-                        matched = true;
-                        break;
-                    }
+            const CMPMetaDExBook& book = my_it->second;
+            for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+                const CMPMetaDEx& obj = *it;
+                if (obj.displayUnitPrice() == priceStr) {
+                    amountForSale = obj.getAmountForSale();
+                    amountDesired = obj.getAmountDesired();
+                    matched = true;
+                    break;
                 }
-                if (matched) break;
             }
             if (matched) break;
         }
@@ -350,34 +350,33 @@ void MetaDExDialog::UpdateOffers()
 
     for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
         if ((my_it->first != GetPropForSale())) continue; // not the property we're looking for, don't waste any more work
-        md_PricesMap & prices = my_it->second;
-        for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) { // loop through the sell prices for the property
-            std::string unitPriceStr;
-            bool includesMe = false;
-            md_Set & indexes = (it->second);
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end(); ++it) { // multiple sell offers can exist at the same price, sum them for the UI
-                const CMPMetaDEx& obj = *it;
-                if ((obj.getDesProperty() != GetPropDesired())) continue; // not the property we're interested in
-                if (IsMyAddress(obj.getAddr())) includesMe = true;
-                std::string strAvail;
-                if (divisSale) {
-                    strAvail = FormatDivisibleShortMP(obj.getAmountRemaining());
-                } else {
-                    strAvail = FormatIndivisibleMP(obj.getAmountRemaining());
-                }
-                std::string strDesired;
-                if (divisDes) {
-                    strDesired = FormatDivisibleShortMP(obj.getAmountToFill());
-                } else {
-                    strDesired = FormatIndivisibleMP(obj.getAmountToFill());
-                }
-                std::string priceStr = StripTrailingZeros(obj.displayFullUnitPrice());
-                if (priceStr.length() > 10) {
-                    priceStr.resize(10); // keep price in UI managable
-                    priceStr += "...";
-                }
-                AddRow(includesMe, obj.getHash().GetHex(), obj.getAddr(), priceStr, strAvail, strDesired);
+        const CMPMetaDExBook& book = my_it->second;
+        CMPMetaDExPrice levelPrice;
+        bool includesMe = false;
+        for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) { // loop through the sell offers by price for the property
+            if (it == book.begin() || it.price() != levelPrice) includesMe = false; // multiple sell offers can exist at the same price
+            levelPrice = it.price();
+            const CMPMetaDEx& obj = *it;
+            if ((obj.getDesProperty() != GetPropDesired())) continue; // not the property we're interested in
+            if (IsMyAddress(obj.getAddr())) includesMe = true;
+            std::string strAvail;
+            if (divisSale) {
+                strAvail = FormatDivisibleShortMP(obj.getAmountRemaining());
+            } else {
+                strAvail = FormatIndivisibleMP(obj.getAmountRemaining());
+            }
+            std::string strDesired;
+            if (divisDes) {
+                strDesired = FormatDivisibleShortMP(obj.getAmountToFill());
+            } else {
+                strDesired = FormatIndivisibleMP(obj.getAmountToFill());
+            }
+            std::string priceStr = StripTrailingZeros(obj.displayFullUnitPrice());
+            if (priceStr.length() > 10) {
+                priceStr.resize(10); // keep price in UI managable
+                priceStr += "...";
             }
+            AddRow(includesMe, obj.getHash().GetHex(), obj.getAddr(), priceStr, strAvail, strDesired);
         }
     }
 }
@@ -9,6 +9,7 @@
 #include "checkpoints.h"
 #include "clientversion.h"
 #include "consensus/upgrades.h"
+#include "dbwrapper.h"
 #include "kernel.h"
 #include "main.h"
 #include "masternode-budget.h"
@@ -20,6 +21,7 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "utilstrencodings.h"
+#include "verifydb.h"
 #include "hash.h"
 #include "wallet/wallet.h"
 #include "zpiv/zpivmodule.h"
@@ -30,6 +32,7 @@
 #include <stdint.h>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <univalue.h>
 #include <mutex>
 #include <numeric>
@@ -122,7 +125,8 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
     result.push_back(Pair("acc_checkpoint", block.nAccumulatorCheckpoint.GetHex()));
     UniValue txs(UniValue::VARR);
-    for (const CTransaction& tx : block.vtx) {
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
         if (txDetails) {
             UniValue objTx(UniValue::VOBJ);
             TxToJSON(tx, UINT256_ZERO, objTx);
@@ -731,6 +735,132 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+//! Per-level file count and size from leveldb.sstables, and compaction totals from leveldb.stats
+static UniValue DBLevelsToJSON(leveldb::DB* pdb)
+{
+    static const int nLevels = 7;
+    std::vector<int64_t> vFiles(nLevels, 0), vBytes(nLevels, 0);
+    std::vector<double> vTime(nLevels, 0), vRead(nLevels, 0), vWrite(nLevels, 0);
+
+    std::string strTables;
+    if (pdb->GetProperty("leveldb.sstables", &strTables)) {
+        std::istringstream ss(strTables);
+        std::string strLine;
+        int nLevel = -1;
+        while (std::getline(ss, strLine)) {
+            int n;
+            unsigned long long nNumber, nSize;
+            if (sscanf(strLine.c_str(), "--- level %d ---", &n) == 1) {
+                nLevel = n;
+            } else if (nLevel >= 0 && nLevel < nLevels && sscanf(strLine.c_str(), " %llu:%llu", &nNumber, &nSize) == 2) {
+                vFiles[nLevel]++;
+                vBytes[nLevel] += nSize;
+            }
+        }
+    }
+
+    std::string strStats;
+    if (pdb->GetProperty("leveldb.stats", &strStats)) {
+        std::istringstream ss(strStats);
+        std::string strLine;
+        while (std::getline(ss, strLine)) {
+            int nLevel, nFiles;
+            double dSize, dTime, dRead, dWrite;
+            if (sscanf(strLine.c_str(), "%d %d %lf %lf %lf %lf", &nLevel, &nFiles, &dSize, &dTime, &dRead, &dWrite) == 6 &&
+                    nLevel >= 0 && nLevel < nLevels) {
+                vTime[nLevel] = dTime;
+                vRead[nLevel] = dRead;
+                vWrite[nLevel] = dWrite;
+            }
+        }
+    }
+
+    UniValue levels(UniValue::VARR);
+    for (int i = 0; i < nLevels; i++) {
+        UniValue level(UniValue::VOBJ);
+        level.push_back(Pair("level", i));
+        level.push_back(Pair("files", vFiles[i]));
+        level.push_back(Pair("bytes", vBytes[i]));
+        level.push_back(Pair("compaction_time", vTime[i]));
+        level.push_back(Pair("compaction_read_mb", vRead[i]));
+        level.push_back(Pair("compaction_write_mb", vWrite[i]));
+        levels.push_back(level);
+    }
+    return levels;
+}
+
+UniValue getdbstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getdbstats ( \"name\" )\n"
+            "\nReturns LevelDB statistics of the open databases.\n"
+
+            "\nArguments:\n"
+            "1. \"name\"     (string, optional) Only return the database with this name, like chainstate or blocks/index\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                  (object) The database, by its path in the data directory\n"
+            "    \"memory_usage\": n,       (numeric) Approximate memory used by LevelDB, in bytes\n"
+            "    \"reads\": n,              (numeric) Number of reads since startup\n"
+            "    \"read_time\": x.xxx,      (numeric) Total time of the reads in seconds\n"
+            "    \"batches\": n,            (numeric) Number of written batches since startup\n"
+            "    \"batch_bytes\": n,        (numeric) Estimated size of the written batches in bytes\n"
+            "    \"write_time\": x.xxx,     (numeric) Total time of the batch writes in seconds\n"
+            "    \"compaction_time\": n,    (numeric) Total time of the compactions in seconds\n"
+            "    \"levels\": [              (array) Files and compactions per level\n"
+            "      {\n"
+            "        \"level\": n,\n"
+            "        \"files\": n,            (numeric) Number of table files\n"
+            "        \"bytes\": n,            (numeric) Size of the table files\n"
+            "        \"compaction_time\": n,  (numeric) Time of the compactions into the level in seconds\n"
+            "        \"compaction_read_mb\": n,  (numeric) Megabytes read by the compactions\n"
+            "        \"compaction_write_mb\": n  (numeric) Megabytes written by the compactions\n"
+            "      }, ...\n"
+            "    ],\n"
+            "    \"stats\": \"str\"           (string) The leveldb.stats property\n"
+            "  }, ...\n"
+            "}\n"
+            "\nThe tokencore databases have no read and write counters.\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getdbstats", "") + HelpExampleCli("getdbstats", "\"chainstate\"") +
+            HelpExampleRpc("getdbstats", "\"chainstate\""));
+
+    const std::string strFilter = request.params.size() > 0 ? request.params[0].get_str() : "";
+
+    UniValue ret(UniValue::VOBJ);
+    ForEachDB([&](const std::string& strName, leveldb::DB* pdb, const CDBStats* stats) {
+        if (!strFilter.empty() && strName != strFilter) return;
+
+        UniValue obj(UniValue::VOBJ);
+        std::string strValue;
+        if (pdb->GetProperty("leveldb.approximate-memory-usage", &strValue))
+            obj.push_back(Pair("memory_usage", atoi64(strValue)));
+        if (stats) {
+            obj.push_back(Pair("reads", (uint64_t)stats->nReads));
+            obj.push_back(Pair("read_time", stats->nReadTime * 0.000001));
+            obj.push_back(Pair("batches", (uint64_t)stats->nBatches));
+            obj.push_back(Pair("batch_bytes", (uint64_t)stats->nBatchBytes));
+            obj.push_back(Pair("write_time", stats->nWriteTime * 0.000001));
+        }
+        const UniValue levels = DBLevelsToJSON(pdb);
+        double dCompactionTime = 0;
+        for (size_t i = 0; i < levels.size(); i++)
+            dCompactionTime += find_value(levels[i], "compaction_time").get_real();
+        obj.push_back(Pair("compaction_time", dCompactionTime));
+        obj.push_back(Pair("levels", levels));
+        if (pdb->GetProperty("leveldb.stats", &strValue))
+            obj.push_back(Pair("stats", strValue));
+        ret.push_back(Pair(strName, obj));
+    });
+
+    if (!strFilter.empty() && ret.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Database not found: " + strFilter);
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -841,6 +971,101 @@ UniValue verifychain(const JSONRPCRequest& request)
     return fVerified;
 }
 
+static UniValue VerifyJobToJSON(const CVerifyJob& job)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("startheight", job.nStartHeight));
+    obj.push_back(Pair("endheight", job.nEndHeight));
+    obj.push_back(Pair("checklevel", job.nCheckLevel));
+    obj.push_back(Pair("nextheight", job.nNextHeight));
+    const int nBlocks = job.nEndHeight - job.nStartHeight + 1;
+    obj.push_back(Pair("progress", nBlocks > 0 ? std::min(1.0, (double)(job.nNextHeight - job.nStartHeight) / nBlocks) : 1.0));
+    return obj;
+}
+
+UniValue getverifychaininfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getverifychaininfo\n"
+            "\nReturns the progress of the background block verification (see startverifychain and -verifybackground).\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"jobs\": [                (array) Unfinished verifications, the first one is running\n"
+            "    {\n"
+            "      \"startheight\": n,    (numeric) First block of the range\n"
+            "      \"endheight\": n,      (numeric) Last block of the range\n"
+            "      \"checklevel\": n,     (numeric) Thoroughness of the verification\n"
+            "      \"nextheight\": n,     (numeric) Next block to check\n"
+            "      \"progress\": x.xxx    (numeric) Verified fraction of the range\n"
+            "    }, ...\n"
+            "  ],\n"
+            "  \"finished\": n,           (numeric) Number of verifications finished since startup\n"
+            "  \"last\": {                (object, optional) The last finished verification\n"
+            "    \"startheight\": n,\n"
+            "    \"endheight\": n,\n"
+            "    \"checklevel\": n,\n"
+            "    \"verified\": true|false,  (boolean) Whether no error was found\n"
+            "    \"error\": \"str\"         (string, optional) The error found\n"
+            "  }\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getverifychaininfo", "") + HelpExampleRpc("getverifychaininfo", ""));
+
+    const CVerifyStatus status = g_blockverifier.GetStatus();
+
+    UniValue ret(UniValue::VOBJ);
+    UniValue jobs(UniValue::VARR);
+    for (const CVerifyJob& job : status.vJobs)
+        jobs.push_back(VerifyJobToJSON(job));
+    ret.push_back(Pair("jobs", jobs));
+    ret.push_back(Pair("finished", status.nFinished));
+    if (status.nFinished > 0) {
+        UniValue last(UniValue::VOBJ);
+        last.push_back(Pair("startheight", status.lastJob.nStartHeight));
+        last.push_back(Pair("endheight", status.lastJob.nEndHeight));
+        last.push_back(Pair("checklevel", status.lastJob.nCheckLevel));
+        last.push_back(Pair("verified", !status.fLastFailed));
+        if (status.fLastFailed)
+            last.push_back(Pair("error", status.strLastError));
+        ret.push_back(Pair("last", last));
+    }
+    return ret;
+}
+
+UniValue startverifychain(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "startverifychain startheight ( endheight checklevel )\n"
+            "\nQueues the verification of a range of blocks of the active chain on a background thread.\n"
+            "The progress is reported by getverifychaininfo, and saved across restarts.\n"
+
+            "\nArguments:\n"
+            "1. startheight   (numeric, required) The first block to check\n"
+            "2. endheight     (numeric, optional, default=-1) The last block to check, -1 for the tip\n"
+            "3. checklevel    (numeric, optional, default=4) 0: read the blocks, 1: check the blocks, 2: read the undo data,\n"
+            "                 3 and 4: disconnect and reconnect the last -checkblocks blocks, if the range ends at the tip\n"
+
+            "\nResult:\n"
+            "true             (boolean) The verification is queued\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("startverifychain", "1000") + HelpExampleCli("startverifychain", "1000 2000 2") +
+            HelpExampleRpc("startverifychain", "1000, -1, 4"));
+
+    const int nStartHeight = request.params[0].get_int();
+    const int nEndHeight = request.params.size() > 1 ? request.params[1].get_int() : -1;
+    const int nCheckLevel = request.params.size() > 2 ? request.params[2].get_int() : 4;
+
+    std::string strError;
+    if (!g_blockverifier.Queue(nStartHeight, nEndHeight, nCheckLevel, strError))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strError);
+    return true;
+}
+
 /** Implementation of IsSuperMajority with better feedback */
 static UniValue SoftForkMajorityDesc(int version, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
@@ -1342,7 +1567,8 @@ UniValue getserials(const JSONRPCRequest& request) {
                 throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
         // loop through each tx in the block
-        for (const CTransaction& tx : block.vtx) {
+        for (const CTransactionRef& ptx : block.vtx) {
+            const CTransaction& tx = *ptx;
             std::string txid = tx.GetHash().GetHex();
             // collect the destination (first output) if fVerbose
             std::string spentTo = "";
@@ -1502,7 +1728,8 @@ UniValue getblockindexstats(const JSONRPCRequest& request) {
         nTxCount = block.IsProofOfStake() ? nTxCount + ntx - 2 : nTxCount + ntx - 1;
 
         // loop through each tx in block and save size and fee
-        for (const CTransaction& tx : block.vtx) {
+        for (const CTransactionRef& ptx : block.vtx) {
+            const CTransaction& tx = *ptx;
             if (tx.IsCoinBase() || (tx.IsCoinStake() && !tx.HasZerocoinSpendInputs()))
                 continue;
 
@@ -121,6 +121,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"importpubkey", 2},
         {"verifychain", 0},
         {"verifychain", 1},
+        {"startverifychain", 0},
+        {"startverifychain", 1},
+        {"startverifychain", 2},
         {"keypoolrefill", 0},
         {"getrawmempool", 0},
         {"estimatefee", 0},
@@ -175,6 +178,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"getfeeinfo", 0},
         {"getaddressutxos", 1},
         {"getaddressutxos", 2},
+        {"getaddresstxids", 1},
 
         /* Token Core - data retrieval calls */
         { "gettokentradehistoryforaddress", 1 },
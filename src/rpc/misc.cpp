@@ -97,6 +97,44 @@ bool getAddressFromIndex(const int &type, const uint160 &hash, std::string &addr
     return true;
 }
 
+/** Encodes the index key, at which the next page of a paged address RPC begins */
+template <typename Key>
+static std::string EncodeAddressCursor(const Key& key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key;
+    return HexStr(ss.begin(), ss.end());
+}
+
+/** Decodes a cursor, and returns the position of its address in addresses */
+template <typename Key>
+static size_t DecodeAddressCursor(const UniValue& cursor, const std::vector<std::pair<uint160, int> >& addresses, Key& key)
+{
+    CDataStream ss(ParseHexV(cursor, "cursor"), SER_DISK, CLIENT_VERSION);
+    try {
+        ss >> key;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    for (size_t i = 0; i < addresses.size(); i++) {
+        if (addresses[i].first == key.hashBytes && addresses[i].second == (int)key.type)
+            return i;
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor does not belong to the address");
+}
+
+static size_t GetPageLimit(const UniValue& options)
+{
+    if (!options.isObject())
+        return 0;
+    UniValue limit = find_value(options.get_obj(), "limit");
+    if (limit.isNull())
+        return 0;
+    if (!limit.isNum() || limit.get_int() <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "limit must be a positive number");
+    return limit.get_int();
+}
+
 
 UniValue getaddressdeltas(const JSONRPCRequest& request)
 {
@@ -241,6 +279,8 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
             "{\n"
             "  \"balance\"  (string) The current balance in satoshis\n"
             "  \"received\"  (string) The total number of satoshis received (including change)\n"
+            "  \"immature\"  (string) The number of satoshis of immature stakes\n"
+            "  \"txcount\"  (numeric) The number of transactions, which received or spent from the address\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
@@ -253,33 +293,38 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address 4");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    CAmount balance = 0;
+    CAmount received = 0;
+    CAmount immature = 0;
+    int64_t txcount = 0;
+
+    // Only the stakes of the last blocks can be immature
+    const int maturity = 6;
+    const int nHeight = chainActive.Height();
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+        CAddressSummary summary;
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressSummary((*it).first, (*it).second, summary) ||
+                !GetAddressIndex((*it).first, (*it).second, addressIndex, std::max(1, nHeight - maturity + 1), std::max(1, nHeight))) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-    }
 
-    CAmount balance = 0;
-    CAmount received = 0;
-    CAmount immature = 0;
+        balance += summary.nBalance;
+        received += summary.nReceived;
+        txcount += summary.nTxCount;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator itIndex=addressIndex.begin(); itIndex!=addressIndex.end(); itIndex++) {
+            if (itIndex->first.txindex == 1)
+                immature += itIndex->second; //immature stake outputs
         }
-        balance += it->second;
-
-        int maturity = 6;
-        if (it->first.txindex == 1 && ((chainActive.Height() - it->first.blockHeight) < maturity))
-            immature += it->second; //immature stake outputs
     }
 
     UniValue result(UniValue::VOBJ);
     result.pushKV("balance", balance);
     result.pushKV("received", received);
     result.pushKV("immature", immature);
+    result.pushKV("txcount", txcount);
 
     return result;
 }
@@ -298,6 +343,8 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
             "      ,...\n"
             "    ],\n"
             "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"limit\"  (number, optional) Return at most limit outputs per call, in index order\n"
+            "  \"cursor\"  (string, optional) The cursor of the previous page, to continue with\n"
             "}\n"
             "\nResult\n"
             "[\n"
@@ -310,6 +357,13 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
             "    \"satoshis\"  (number) The number of satoshis of the output\n"
             "  }\n"
             "]\n"
+            "\nResult (with limit or chainInfo)\n"
+            "{\n"
+            "  \"utxos\"  (array) The outputs as above\n"
+            "  \"cursor\"  (string) Only with limit, the cursor of the next page, or null after the last page\n"
+            "  \"hash\"  (string) Only with chainInfo, the hash of the chain tip\n"
+            "  \"height\"  (number) Only with chainInfo, the height of the chain tip\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -327,6 +381,7 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
             includeChainInfo = chainInfo.get_bool();
         }
     }
+    const size_t nLimit = GetPageLimit(request.params[2]);
 
     std::vector<std::pair<uint160, int> > addresses;
 
@@ -335,14 +390,37 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
     }
 
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    UniValue cursor(UniValue::VNULL);
+
+    if (nLimit > 0) {
+        // Pages go through the addresses in the given order, and one more output tells where the next page begins
+        size_t nAddress = 0;
+        CAddressUnspentKey keyStart(addresses[0].second, addresses[0].first, UINT256_ZERO, 0);
+        UniValue cursorIn = find_value(request.params[2].get_obj(), "cursor");
+        if (!cursorIn.isNull()) {
+            nAddress = DecodeAddressCursor(cursorIn, addresses, keyStart);
+        }
+        for (size_t i = nAddress; i < addresses.size() && unspentOutputs.size() <= nLimit; i++) {
+            if (i != nAddress) {
+                keyStart = CAddressUnspentKey(addresses[i].second, addresses[i].first, UINT256_ZERO, 0);
+            }
+            if (!GetAddressUnspent(keyStart, nLimit + 1 - unspentOutputs.size(), unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+        }
+        if (unspentOutputs.size() > nLimit) {
+            cursor = EncodeAddressCursor(unspentOutputs.back().first);
+            unspentOutputs.pop_back();
+        }
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
         }
-    }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+    }
 
     UniValue utxos(UniValue::VARR);
 
@@ -362,13 +440,18 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
         utxos.push_back(output);
     }
 
-    if (includeChainInfo) {
+    if (includeChainInfo || nLimit > 0) {
         UniValue result(UniValue::VOBJ);
         result.pushKV("utxos", utxos);
+        if (nLimit > 0) {
+            result.pushKV("cursor", cursor);
+        }
 
-        LOCK(cs_main);
-        result.pushKV("hash", chainActive.Tip()->GetBlockHash().GetHex());
-        result.pushKV("height", (int)chainActive.Height());
+        if (includeChainInfo) {
+            LOCK(cs_main);
+            result.pushKV("hash", chainActive.Tip()->GetBlockHash().GetHex());
+            result.pushKV("height", (int)chainActive.Height());
+        }
         return result;
     } else {
         return utxos;
@@ -568,7 +651,7 @@ UniValue getspentinfo(const JSONRPCRequest& request)
 
 UniValue getaddresstxids(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 1)
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
         throw std::runtime_error(
             "getaddresstxids\n"
             "\nReturns the txids for an address(es) (requires addressindex to be enabled).\n"
@@ -582,11 +665,20 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
             "}\n"
+            "{\n"
+            "  \"limit\" (number, optional) Read at most limit index entries per call, and return their txids in index order\n"
+            "  \"cursor\" (string, optional) The cursor of the previous page, to continue with\n"
+            "}\n"
             "\nResult:\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nResult (with limit):\n"
+            "{\n"
+            "  \"txids\"  (array) The transaction ids as above\n"
+            "  \"cursor\"  (string) The cursor of the next page, or null after the last page\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -598,29 +690,66 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    // The range is given next to the addresses, and may also be given with the options
     int start = 0;
     int end = 0;
-    if (request.params[0].isObject()) {
-        UniValue startValue = find_value(request.params[0].get_obj(), "start");
-        UniValue endValue = find_value(request.params[0].get_obj(), "end");
-        if (startValue.isNum() && endValue.isNum()) {
-            start = startValue.get_int();
-            end = endValue.get_int();
+    for (size_t i = 0; i < 2; i++) {
+        if (request.params[i].isObject()) {
+            UniValue startValue = find_value(request.params[i].get_obj(), "start");
+            UniValue endValue = find_value(request.params[i].get_obj(), "end");
+            if (startValue.isNum() && endValue.isNum()) {
+                start = startValue.get_int();
+                end = endValue.get_int();
+            }
         }
     }
+    const size_t nLimit = GetPageLimit(request.params[1]);
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    UniValue cursor(UniValue::VNULL);
+
+    if (nLimit > 0) {
+        // Pages go through the addresses in the given order, and one more entry tells where the next page begins
+        const bool fRange = start > 0 && end > 0;
+        size_t nAddress = 0;
+        CAddressIndexKey keyStart(addresses[0].second, addresses[0].first, fRange ? start : 0, 0, UINT256_ZERO, 0, false);
+        UniValue cursorIn = find_value(request.params[1].get_obj(), "cursor");
+        if (!cursorIn.isNull()) {
+            nAddress = DecodeAddressCursor(cursorIn, addresses, keyStart);
+        }
+        for (size_t i = nAddress; i < addresses.size() && addressIndex.size() <= nLimit; i++) {
+            if (i != nAddress) {
+                keyStart = CAddressIndexKey(addresses[i].second, addresses[i].first, fRange ? start : 0, 0, UINT256_ZERO, 0, false);
             }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+            if (!GetAddressIndex(keyStart, fRange ? end : 0, nLimit + 1 - addressIndex.size(), addressIndex)) {
                 throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
             }
         }
+        if (addressIndex.size() > nLimit) {
+            // Begin the next page with the first entry of its transaction, unless the transaction fills the page
+            size_t nNext = nLimit;
+            while (nNext > 0 && addressIndex[nNext - 1].first.txhash == addressIndex[nNext].first.txhash &&
+                    addressIndex[nNext - 1].first.hashBytes == addressIndex[nNext].first.hashBytes) {
+                nNext--;
+            }
+            if (nNext == 0) {
+                nNext = nLimit;
+            }
+            cursor = EncodeAddressCursor(addressIndex[nNext].first);
+            addressIndex.resize(nNext);
+        }
+    } else {
+        for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (start > 0 && end > 0) {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            } else {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            }
+        }
     }
 
     std::set<std::pair<int, std::string> > txids;
@@ -630,7 +759,7 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
         int height = it->first.blockHeight;
         std::string txid = it->first.txhash.GetHex();
 
-        if (addresses.size() > 1) {
+        if (addresses.size() > 1 && nLimit == 0) {
             txids.insert(std::make_pair(height, txid));
         } else {
             if (txids.insert(std::make_pair(height, txid)).second) {
@@ -639,12 +768,19 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
         }
     }
 
-    if (addresses.size() > 1) {
+    if (addresses.size() > 1 && nLimit == 0) {
         for (std::set<std::pair<int, std::string> >::const_iterator it=txids.begin(); it!=txids.end(); it++) {
             result.push_back(it->second);
         }
     }
 
+    if (nLimit > 0) {
+        UniValue page(UniValue::VOBJ);
+        page.pushKV("txids", result);
+        page.pushKV("cursor", cursor);
+        return page;
+    }
+
     return result;
 }
 
@@ -1371,6 +1507,10 @@ UniValue getstakingstatus(const JSONRPCRequest& request)
             "  \"lastattempt_hash\": xxx            (hex string) hash of the block on top of which the last stake attempt was made\n"
             "  \"lastattempt_coins\": n             (numeric) number of stakeable coins available during last stake attempt\n"
             "  \"lastattempt_tries\": n             (numeric) number of stakeable coins checked during last stake attempt\n"
+            "  \"lastattempt_ms\": n                (numeric) duration of the kernel search of the last stake attempt, in milliseconds\n"
+            "  \"kernel_hashrate\": n               (numeric) kernel hashes per second, over all stake attempts\n"
+            "  \"kernel_searches\": n               (numeric) number of kernel searches\n"
+            "  \"missed_slots\": n                  (numeric) number of kernel searches, which ended after their time slot\n"
             "}\n"
 
             "\nExamples:\n" +
@@ -1401,6 +1541,10 @@ UniValue getstakingstatus(const JSONRPCRequest& request)
             obj.push_back(Pair("lastattempt_hash", ss->GetLastHash().GetHex()));
             obj.push_back(Pair("lastattempt_coins", ss->GetLastCoins()));
             obj.push_back(Pair("lastattempt_tries", ss->GetLastTries()));
+            obj.push_back(Pair("lastattempt_ms", ss->GetLastSearchMicros() / 1000.0));
+            obj.push_back(Pair("kernel_hashrate", ss->GetHashesPerSecond()));
+            obj.push_back(Pair("kernel_searches", ss->GetSearches()));
+            obj.push_back(Pair("missed_slots", ss->GetMissedSlots()));
         }
         return obj;
     }
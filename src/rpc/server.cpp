@@ -308,6 +308,7 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "getblockhash", &getblockhash, true },
         {"blockchain", "getblockheader", &getblockheader, false },
         {"blockchain", "getchaintips", &getchaintips, true },
+        {"blockchain", "getdbstats", &getdbstats, true },
         {"blockchain", "getdifficulty", &getdifficulty, true },
         {"blockchain", "getfeeinfo", &getfeeinfo, true },
         {"blockchain", "getmempoolinfo", &getmempoolinfo, true },
@@ -317,6 +318,8 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true },
         {"blockchain", "invalidateblock", &invalidateblock, true },
         {"blockchain", "reconsiderblock", &reconsiderblock, true },
+        {"blockchain", "getverifychaininfo", &getverifychaininfo, true },
+        {"blockchain", "startverifychain", &startverifychain, true },
         {"blockchain", "verifychain", &verifychain, true },
 
         {"blockchain", "issuanceinfo", &issuanceinfo, true },
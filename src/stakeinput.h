@@ -44,6 +44,7 @@ public:
 
     bool InitFromTxIn(const CTxIn& txin) override;
     bool SetPrevout(CTransaction txPrev, unsigned int n);
+    void SetIndexFrom(CBlockIndex* pindex) { pindexFrom = pindex; }
 
     CBlockIndex* GetIndexFrom() override;
     bool GetTxFrom(CTransaction& tx) const override;
@@ -365,6 +365,45 @@ private:
     size_t nPos;
 };
 
+/** Minimal stream for deserializing from a byte range, which it doesn't own or copy
+ *
+ * The range must outlive the reader, like a memory mapped file.
+ */
+class CMemoryReader
+{
+private:
+    const int nType;
+    const int nVersion;
+    const unsigned char* pbegin;
+    const unsigned char* pend;
+    const unsigned char* pcur;
+
+public:
+    CMemoryReader(int nTypeIn, int nVersionIn, const unsigned char* pbeginIn, const unsigned char* pendIn) :
+        nType(nTypeIn), nVersion(nVersionIn), pbegin(pbeginIn), pend(pendIn), pcur(pbeginIn) {}
+
+    void read(char* pch, size_t nSize)
+    {
+        if (nSize > (size_t)(pend - pcur))
+            throw std::ios_base::failure("CMemoryReader::read() : end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+    }
+    template<typename T>
+    CMemoryReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+    int GetVersion() const { return nVersion; }
+    int GetType() const { return nType; }
+    //! Number of bytes read so far
+    size_t GetPos() const { return pcur - pbegin; }
+    size_t size() const { return pend - pcur; }
+    bool empty() const { return pcur == pend; }
+};
+
 class CDataStream : public CBaseDataStream<CSerializeData>
 {
 public:
@@ -0,0 +1,338 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "random.h"
+#include "txdb.h"
+#include "test/test_pivx.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(address_index_cache)
+{
+    CAddressIndexCache cache(pblocktree);
+    const uint160 addressHash(std::vector<unsigned char>(20, 0x1f));
+    const uint256 txid = InsecureRand256();
+    const uint256 txidSpend = InsecureRand256();
+
+    // Output 256 is stored before output 1, as output indexes are serialized little-endian
+    CAddressIndexKey key1(1, addressHash, 10, 1, txid, 256, false);
+    CAddressIndexKey key2(1, addressHash, 11, 1, txidSpend, 0, true);
+    CAddressIndexKey key3(1, addressHash, 10, 1, txid, 1, false);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vStored = {{key1, 5}, {key2, -5}};
+    BOOST_CHECK(pblocktree->WriteAddressIndex(vStored));
+    BOOST_CHECK(cache.WriteAddressIndex({{key3, 7}}));
+    BOOST_CHECK(cache.EraseAddressIndex({{key2, -5}}));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vCached;
+    BOOST_CHECK(cache.ReadAddressIndex(addressHash, 1, vCached));
+    BOOST_CHECK_EQUAL(vCached.size(), 2);
+    BOOST_CHECK(vCached[0].first.index == 256 && vCached[0].second == 5);
+    BOOST_CHECK(vCached[1].first.index == 1 && vCached[1].second == 7);
+
+    // The range of heights applies to the pending changes too
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vRange;
+    BOOST_CHECK(cache.ReadAddressIndex(addressHash, 1, vRange, 11, 11));
+    BOOST_CHECK(vRange.empty());
+
+    CAddressUnspentKey unspent1(1, addressHash, txid, 256);
+    CAddressUnspentKey unspent2(1, addressHash, txid, 1);
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex({{unspent1, CAddressUnspentValue(5, CScript(), 10)}}));
+    BOOST_CHECK(cache.UpdateAddressUnspentIndex({{unspent1, CAddressUnspentValue()}, {unspent2, CAddressUnspentValue(7, CScript(), 10)}}));
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    BOOST_CHECK(cache.ReadAddressUnspentIndex(addressHash, 1, vUnspent));
+    BOOST_CHECK_EQUAL(vUnspent.size(), 1);
+    BOOST_CHECK(vUnspent[0].first.index == 1 && vUnspent[0].second.satoshis == 7);
+
+    CSpentIndexKey spentKey(txid, 1);
+    CSpentIndexValue spentValue;
+    BOOST_CHECK(cache.UpdateSpentIndex({{spentKey, CSpentIndexValue(txidSpend, 0, 11, 7, 1, addressHash)}}));
+    BOOST_CHECK(cache.ReadSpentIndex(spentKey, spentValue));
+    BOOST_CHECK(spentValue.txid == txidSpend);
+    BOOST_CHECK(!pblocktree->ReadSpentIndex(spentKey, spentValue));
+
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 5);
+    BOOST_CHECK(cache.DynamicMemoryUsage() > 0);
+
+    // After the flush, the database returns what the cache returned
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 0);
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vFlushed;
+    BOOST_CHECK(pblocktree->ReadAddressIndex(addressHash, 1, vFlushed));
+    BOOST_CHECK_EQUAL(vFlushed.size(), vCached.size());
+    for (size_t i = 0; i < vFlushed.size() && i < vCached.size(); i++) {
+        BOOST_CHECK(vFlushed[i].first.index == vCached[i].first.index);
+        BOOST_CHECK_EQUAL(vFlushed[i].second, vCached[i].second);
+    }
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentFlushed;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(addressHash, 1, vUnspentFlushed));
+    BOOST_CHECK_EQUAL(vUnspentFlushed.size(), 1);
+    BOOST_CHECK(pblocktree->ReadSpentIndex(spentKey, spentValue));
+}
+
+/** A txid, whose first (least significant) byte is nFirst and whose last (most significant) byte is nLast */
+static uint256 MakeTxid(unsigned char nFirst, unsigned char nLast)
+{
+    std::vector<unsigned char> vch(32, 0);
+    vch.front() = nFirst;
+    vch.back() = nLast;
+    return uint256(vch);
+}
+
+BOOST_AUTO_TEST_CASE(address_index_key_order)
+{
+    CAddressIndexCache cache(pblocktree);
+    const uint160 addressHash(std::vector<unsigned char>(20, 0x5b));
+
+    // txidA is stored before txidB in LevelDB, but it is the larger number
+    const uint256 txidA = MakeTxid(0x01, 0xff);
+    const uint256 txidB = MakeTxid(0x02, 0x00);
+    BOOST_CHECK(txidB < txidA);
+    BOOST_CHECK(CAddressIndexKeyCompare()(CAddressIndexKey(1, addressHash, 10, 1, txidA, 0, false),
+                                          CAddressIndexKey(1, addressHash, 10, 1, txidB, 0, false)));
+    BOOST_CHECK(CAddressUnspentKeyCompare()(CAddressUnspentKey(1, addressHash, txidA, 0),
+                                            CAddressUnspentKey(1, addressHash, txidB, 0)));
+
+    // The pending entries are merged with the stored ones in the order of the database
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex({{CAddressUnspentKey(1, addressHash, txidB, 0), CAddressUnspentValue(2, CScript(), 10)}}));
+    BOOST_CHECK(cache.UpdateAddressUnspentIndex({{CAddressUnspentKey(1, addressHash, txidA, 0), CAddressUnspentValue(1, CScript(), 10)}}));
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vCached;
+    BOOST_CHECK(cache.ReadAddressUnspentIndex(addressHash, 1, vCached));
+    BOOST_CHECK(cache.Flush());
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vFlushed;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(addressHash, 1, vFlushed));
+    BOOST_CHECK_EQUAL(vCached.size(), 2);
+    BOOST_CHECK_EQUAL(vFlushed.size(), 2);
+    for (size_t i = 0; i < vCached.size() && i < vFlushed.size(); i++) {
+        BOOST_CHECK(vCached[i].first.txhash == vFlushed[i].first.txhash);
+        BOOST_CHECK_EQUAL(vCached[i].second.satoshis, vFlushed[i].second.satoshis);
+    }
+    BOOST_CHECK(vFlushed.front().first.txhash == txidA);
+}
+
+BOOST_AUTO_TEST_CASE(address_index_pages)
+{
+    CAddressIndexCache cache(pblocktree);
+    const uint160 addressHash(std::vector<unsigned char>(20, 0x2e));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vStored;
+    for (int nHeight = 1; nHeight <= 6; nHeight++)
+        vStored.emplace_back(CAddressIndexKey(1, addressHash, nHeight, 1, InsecureRand256(), 0, false), nHeight);
+    BOOST_CHECK(pblocktree->WriteAddressIndex(vStored));
+
+    // Erase the stored entries of heights 2 and 3, and add one at height 4
+    BOOST_CHECK(cache.EraseAddressIndex({vStored[1], vStored[2]}));
+    BOOST_CHECK(cache.WriteAddressIndex({{CAddressIndexKey(1, addressHash, 4, 2, InsecureRand256(), 0, false), 10}}));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAll;
+    BOOST_CHECK(cache.ReadAddressIndex(addressHash, 1, vAll));
+    BOOST_CHECK_EQUAL(vAll.size(), 5);
+
+    // Pages of two entries, as read by the RPCs with one more entry, which begins the next page
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vPaged;
+    CAddressIndexKey keyStart(1, addressHash, 0, 0, UINT256_ZERO, 0, false);
+    while (true) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > vPage;
+        BOOST_CHECK(cache.ReadAddressIndex(keyStart, 0, 3, vPage));
+        BOOST_CHECK(vPage.size() <= 3);
+        if (vPage.size() < 3) {
+            vPaged.insert(vPaged.end(), vPage.begin(), vPage.end());
+            break;
+        }
+        vPaged.insert(vPaged.end(), vPage.begin(), vPage.begin() + 2);
+        keyStart = vPage[2].first;
+    }
+    BOOST_CHECK_EQUAL(vPaged.size(), vAll.size());
+    for (size_t i = 0; i < vPaged.size() && i < vAll.size(); i++) {
+        BOOST_CHECK(vPaged[i].first.txhash == vAll[i].first.txhash);
+        BOOST_CHECK_EQUAL(vPaged[i].second, vAll[i].second);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(address_unspent_pages)
+{
+    CAddressIndexCache cache(pblocktree);
+    const uint160 addressHash(std::vector<unsigned char>(20, 0x6a));
+
+    // The byte order of the txids is the reverse of their numeric order
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vStored;
+    for (unsigned char n = 1; n <= 6; n++)
+        vStored.emplace_back(CAddressUnspentKey(1, addressHash, MakeTxid(n, 0xff - n), 0), CAddressUnspentValue(n, CScript(), 10));
+    BOOST_CHECK(pblocktree->UpdateAddressUnspentIndex(vStored));
+
+    // Spend the stored outputs 2 and 5, and add outputs before, between and after the stored ones
+    BOOST_CHECK(cache.UpdateAddressUnspentIndex({
+        {vStored[1].first, CAddressUnspentValue()},
+        {vStored[4].first, CAddressUnspentValue()},
+        {CAddressUnspentKey(1, addressHash, MakeTxid(0, 0xff), 0), CAddressUnspentValue(10, CScript(), 11)},
+        {CAddressUnspentKey(1, addressHash, MakeTxid(3, 0xfc), 1), CAddressUnspentValue(11, CScript(), 11)},
+        {CAddressUnspentKey(1, addressHash, MakeTxid(7, 0xf8), 0), CAddressUnspentValue(12, CScript(), 11)}}));
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAll;
+    BOOST_CHECK(cache.ReadAddressUnspentIndex(addressHash, 1, vAll));
+    BOOST_CHECK_EQUAL(vAll.size(), 7);
+
+    // Pages of one to three outputs, as read by getaddressutxos with one more output, which begins the next page
+    for (size_t nLimit = 1; nLimit <= 3; nLimit++) {
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vPaged;
+        CAddressUnspentKey keyStart(1, addressHash, UINT256_ZERO, 0);
+        while (true) {
+            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vPage;
+            BOOST_CHECK(cache.ReadAddressUnspentIndex(keyStart, nLimit + 1, vPage));
+            BOOST_CHECK(vPage.size() <= nLimit + 1);
+            if (vPage.size() <= nLimit) {
+                vPaged.insert(vPaged.end(), vPage.begin(), vPage.end());
+                break;
+            }
+            vPaged.insert(vPaged.end(), vPage.begin(), vPage.begin() + nLimit);
+            keyStart = vPage[nLimit].first;
+        }
+        BOOST_CHECK_EQUAL(vPaged.size(), vAll.size());
+        for (size_t i = 0; i < vPaged.size() && i < vAll.size(); i++) {
+            BOOST_CHECK(vPaged[i].first.txhash == vAll[i].first.txhash);
+            BOOST_CHECK_EQUAL(vPaged[i].first.index, vAll[i].first.index);
+        }
+    }
+
+    // The outputs are in the order of the database
+    BOOST_CHECK(cache.Flush());
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vFlushed;
+    BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(addressHash, 1, vFlushed));
+    BOOST_CHECK_EQUAL(vFlushed.size(), vAll.size());
+    for (size_t i = 0; i < vFlushed.size() && i < vAll.size(); i++) {
+        BOOST_CHECK(vFlushed[i].first.txhash == vAll[i].first.txhash);
+        BOOST_CHECK_EQUAL(vFlushed[i].second.satoshis, vAll[i].second.satoshis);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(address_summary)
+{
+    CAddressIndexCache cache(pblocktree);
+    const uint160 addressHash(std::vector<unsigned char>(20, 0x3d));
+    const uint256 txid1 = InsecureRand256();
+    const uint256 txid2 = InsecureRand256();
+
+    // Two outputs of one transaction, and a spend of one of them
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock1 = {
+        {CAddressIndexKey(1, addressHash, 1, 1, txid1, 0, false), 5},
+        {CAddressIndexKey(1, addressHash, 1, 1, txid1, 1, false), 7}};
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock2 = {
+        {CAddressIndexKey(1, addressHash, 2, 1, txid2, 0, true), -5}};
+    BOOST_CHECK(cache.WriteAddressIndex(vBlock1));
+    BOOST_CHECK(cache.WriteAddressIndex(vBlock2));
+
+    CAddressSummary summary;
+    BOOST_CHECK(cache.ReadAddressSummary(addressHash, 1, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, 7);
+    BOOST_CHECK_EQUAL(summary.nReceived, 12);
+    BOOST_CHECK_EQUAL(summary.nTxCount, 2);
+
+    // Disconnecting the spend restores the summary
+    BOOST_CHECK(cache.EraseAddressIndex(vBlock2));
+    BOOST_CHECK(cache.ReadAddressSummary(addressHash, 1, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, 12);
+    BOOST_CHECK_EQUAL(summary.nTxCount, 1);
+
+    // Summaries built from the stored index match the maintained ones
+    BOOST_CHECK(cache.WriteAddressIndex(vBlock2));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(pblocktree->BuildAddressSummaries());
+    CAddressSummary built;
+    BOOST_CHECK(pblocktree->ReadAddressSummary(addressHash, 1, built));
+    BOOST_CHECK_EQUAL(built.nBalance, 7);
+    BOOST_CHECK_EQUAL(built.nReceived, 12);
+    BOOST_CHECK_EQUAL(built.nTxCount, 2);
+}
+
+BOOST_AUTO_TEST_CASE(address_summary_reconnect)
+{
+    CAddressIndexCache cache(pblocktree);
+    const uint160 addressHash(std::vector<unsigned char>(20, 0x4c));
+    const uint256 txid1 = InsecureRand256();
+    const uint256 txid2 = InsecureRand256();
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock1 = {
+        {CAddressIndexKey(1, addressHash, 1, 1, txid1, 0, false), 9}};
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock2 = {
+        {CAddressIndexKey(1, addressHash, 2, 1, txid2, 0, true), -9},
+        {CAddressIndexKey(1, addressHash, 2, 1, txid2, 1, false), 4}};
+    BOOST_CHECK(cache.WriteAddressIndex(vBlock1));
+    BOOST_CHECK(cache.WriteAddressIndex(vBlock2));
+    BOOST_CHECK(cache.Flush());
+
+    CAddressSummary expected;
+    BOOST_CHECK(cache.ReadAddressSummary(addressHash, 1, expected));
+    BOOST_CHECK_EQUAL(expected.nBalance, 4);
+    BOOST_CHECK_EQUAL(expected.nReceived, 13);
+    BOOST_CHECK_EQUAL(expected.nTxCount, 2);
+
+    // Disconnecting and reconnecting the tip leaves the summary unchanged, before and after a flush
+    CAddressSummary summary;
+    BOOST_CHECK(cache.EraseAddressIndex(vBlock2));
+    BOOST_CHECK(cache.ReadAddressSummary(addressHash, 1, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, 9);
+    BOOST_CHECK(cache.WriteAddressIndex(vBlock2));
+    BOOST_CHECK(cache.ReadAddressSummary(addressHash, 1, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, expected.nBalance);
+    BOOST_CHECK_EQUAL(summary.nReceived, expected.nReceived);
+    BOOST_CHECK_EQUAL(summary.nTxCount, expected.nTxCount);
+    BOOST_CHECK(cache.EraseAddressIndex(vBlock2));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(cache.WriteAddressIndex(vBlock2));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(cache.ReadAddressSummary(addressHash, 1, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, expected.nBalance);
+    BOOST_CHECK_EQUAL(summary.nReceived, expected.nReceived);
+    BOOST_CHECK_EQUAL(summary.nTxCount, expected.nTxCount);
+
+    // Blocks connected again after a crash, which flushed the index but not the chainstate,
+    // and blocks disconnected twice, are not counted twice
+    BOOST_CHECK(cache.WriteAddressIndex(vBlock2));
+    BOOST_CHECK(cache.ReadAddressSummary(addressHash, 1, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, expected.nBalance);
+    BOOST_CHECK_EQUAL(summary.nReceived, expected.nReceived);
+    BOOST_CHECK_EQUAL(summary.nTxCount, expected.nTxCount);
+    BOOST_CHECK(cache.EraseAddressIndex(vBlock2));
+    BOOST_CHECK(cache.EraseAddressIndex(vBlock2));
+    BOOST_CHECK(cache.ReadAddressSummary(addressHash, 1, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, 9);
+    BOOST_CHECK_EQUAL(summary.nReceived, 9);
+    BOOST_CHECK_EQUAL(summary.nTxCount, 1);
+
+    // After a restart, the flushed blocks are still recognized when they are connected again
+    BOOST_CHECK(cache.WriteAddressIndex(vBlock2));
+    BOOST_CHECK(cache.Flush());
+    int nHeight = 0;
+    BOOST_CHECK(pblocktree->ReadAddressIndexHeight(nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 2);
+    CAddressIndexCache cacheRestarted(pblocktree);
+    BOOST_CHECK(cacheRestarted.WriteAddressIndex(vBlock2));
+    BOOST_CHECK(cacheRestarted.ReadAddressSummary(addressHash, 1, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, expected.nBalance);
+    BOOST_CHECK_EQUAL(summary.nReceived, expected.nReceived);
+    BOOST_CHECK_EQUAL(summary.nTxCount, expected.nTxCount);
+
+    // Blocks above the flushed ones are counted without reading the index
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vBlock3 = {
+        {CAddressIndexKey(1, addressHash, 3, 1, InsecureRand256(), 0, false), 6}};
+    BOOST_CHECK(cacheRestarted.WriteAddressIndex(vBlock3));
+    BOOST_CHECK(cacheRestarted.ReadAddressSummary(addressHash, 1, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, expected.nBalance + 6);
+    BOOST_CHECK_EQUAL(summary.nTxCount, expected.nTxCount + 1);
+    BOOST_CHECK(cacheRestarted.Flush());
+    BOOST_CHECK(pblocktree->ReadAddressIndexHeight(nHeight));
+    BOOST_CHECK_EQUAL(nHeight, 3);
+    BOOST_CHECK(pblocktree->ReadAddressSummary(addressHash, 1, summary));
+    BOOST_CHECK_EQUAL(summary.nBalance, expected.nBalance + 6);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,186 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
+#include "test/test_pivx.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+class CBlockImporterTest : public CBlockImporter
+{
+public:
+    using CBlockImporter::Record;
+
+    CBlockImporterTest(int nThreads, size_t nMaxBufferedIn) : CBlockImporter(nThreads, nMaxBufferedIn) {}
+
+    void SetFile(const std::vector<unsigned char>& vFile)
+    {
+        pbegin = vFile.data();
+        pend = vFile.data() + vFile.size();
+    }
+
+    size_t SplitRecords(size_t nScanPos, std::vector<Record>& vBatch) const
+    {
+        return CBlockImporter::SplitRecords(nScanPos, vBatch);
+    }
+
+    void DeserializeRecords(std::vector<Record>& vBatch)
+    {
+        StartBatch(vBatch);
+        WaitBatch(vBatch);
+    }
+
+    bool ProcessBlock(const CBlock& block, CDiskBlockPos* dbp)
+    {
+        int nLoaded = 0;
+        std::shared_ptr<const CBlock> pblock = std::make_shared<const CBlock>(block);
+        return CBlockImporter::ProcessBlock(pblock, block.GetHash(), GetSerializeSize(block, SER_DISK, CLIENT_VERSION), dbp, nLoaded);
+    }
+
+    void AddOrphan(const uint256& hashParent, const CBlock& block)
+    {
+        Orphan orphan;
+        orphan.block = std::make_shared<const CBlock>(block);
+        orphan.nSize = GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        nBuffered += orphan.nSize;
+        mapUnknownParent.emplace(hashParent, orphan);
+    }
+
+    std::multimap<uint256, Orphan>& GetOrphans() { return mapUnknownParent; }
+    size_t GetBuffered() const { return nBuffered; }
+};
+
+/** Appends a record of the block files: message start, size and data */
+static void AppendRecord(std::vector<unsigned char>& vFile, const std::vector<unsigned char>& vData, unsigned int nSize)
+{
+    const CMessageHeader::MessageStartChars& pchMessageStart = Params().MessageStart();
+    vFile.insert(vFile.end(), pchMessageStart, pchMessageStart + MESSAGE_START_SIZE);
+    for (int i = 0; i < 4; i++)
+        vFile.push_back((nSize >> (8 * i)) & 0xff);
+    vFile.insert(vFile.end(), vData.begin(), vData.end());
+}
+
+static std::vector<unsigned char> SerializeBlock(const CBlock& block)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(split_records)
+{
+    const std::vector<unsigned char> vBlock = SerializeBlock(Params().GenesisBlock());
+    const CMessageHeader::MessageStartChars& pchMessageStart = Params().MessageStart();
+
+    std::vector<unsigned char> vFile = {0x01, 0x02, 0x03};
+    // a bad message start
+    vFile.push_back(pchMessageStart[0]);
+    vFile.insert(vFile.end(), {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00});
+    const size_t nStart1 = vFile.size();
+    AppendRecord(vFile, vBlock, vBlock.size());
+    // a size below the header size
+    AppendRecord(vFile, std::vector<unsigned char>(10, 0x00), 10);
+    const size_t nStart2 = vFile.size();
+    AppendRecord(vFile, vBlock, vBlock.size());
+    // a record truncated by the end of the file
+    AppendRecord(vFile, std::vector<unsigned char>(vBlock.begin(), vBlock.begin() + vBlock.size() / 2), vBlock.size());
+
+    CBlockImporterTest importer(0, 0);
+    importer.SetFile(vFile);
+    std::vector<CBlockImporterTest::Record> vBatch;
+    BOOST_CHECK_EQUAL(importer.SplitRecords(0, vBatch), vFile.size());
+    BOOST_CHECK_EQUAL(vBatch.size(), 2);
+    BOOST_CHECK_EQUAL(vBatch[0].nStart, nStart1);
+    BOOST_CHECK_EQUAL(vBatch[0].nPos, nStart1 + MESSAGE_START_SIZE + 4);
+    BOOST_CHECK_EQUAL(vBatch[0].nSize, vBlock.size());
+    BOOST_CHECK_EQUAL(vBatch[1].nStart, nStart2);
+
+    // nothing is left at the end of the file
+    BOOST_CHECK_EQUAL(importer.SplitRecords(vFile.size(), vBatch), vFile.size());
+    BOOST_CHECK(vBatch.empty());
+}
+
+BOOST_AUTO_TEST_CASE(batches)
+{
+    const CBlock& genesis = Params().GenesisBlock();
+    const std::vector<unsigned char> vBlock = SerializeBlock(genesis);
+
+    std::vector<unsigned char> vFile;
+    for (size_t i = 0; i < IMPORT_BATCH_SIZE + 2; i++)
+        AppendRecord(vFile, vBlock, vBlock.size());
+    const size_t nStartLast = vFile.size();
+    // a record, which is too short for its block
+    AppendRecord(vFile, std::vector<unsigned char>(vBlock.begin(), vBlock.begin() + 90), 90);
+
+    CBlockImporterTest importer(2, 0);
+    importer.SetFile(vFile);
+    std::vector<CBlockImporterTest::Record> vBatch;
+    const size_t nScanPos = importer.SplitRecords(0, vBatch);
+    BOOST_CHECK_EQUAL(vBatch.size(), IMPORT_BATCH_SIZE);
+    BOOST_CHECK_EQUAL(nScanPos, IMPORT_BATCH_SIZE * (MESSAGE_START_SIZE + 4 + vBlock.size()));
+
+    // the last batch is cut off by the end of the file
+    BOOST_CHECK_EQUAL(importer.SplitRecords(nScanPos, vBatch), vFile.size());
+    BOOST_CHECK_EQUAL(vBatch.size(), 3);
+    BOOST_CHECK_EQUAL(vBatch[2].nStart, nStartLast);
+
+    importer.DeserializeRecords(vBatch);
+    BOOST_CHECK_EQUAL(vBatch.size(), 3);
+    for (size_t i = 0; i < 2; i++) {
+        BOOST_CHECK(vBatch[i].block);
+        BOOST_CHECK(vBatch[i].hash == genesis.GetHash());
+        BOOST_CHECK_EQUAL(vBatch[i].nRead, vBlock.size());
+    }
+    BOOST_CHECK(!vBatch[2].block);
+    BOOST_CHECK(!vBatch[2].strError.empty());
+}
+
+BOOST_AUTO_TEST_CASE(orphan_buffer)
+{
+    const CBlock& genesis = Params().GenesisBlock();
+    const size_t nSize = GetSerializeSize(genesis, SER_DISK, CLIENT_VERSION);
+    CBlockImporterTest importer(0, nSize);
+
+    // the first orphan fits in the buffer
+    CBlock orphan1 = genesis;
+    orphan1.hashPrevBlock = GetRandHash();
+    BOOST_CHECK(importer.ProcessBlock(orphan1, nullptr));
+    BOOST_CHECK_EQUAL(importer.GetOrphans().size(), 1);
+    BOOST_CHECK(importer.GetOrphans().begin()->second.block);
+    BOOST_CHECK_EQUAL(importer.GetBuffered(), nSize);
+
+    // beyond the buffer, orphans, which can't be read again, are dropped
+    CBlock orphan2 = genesis;
+    orphan2.hashPrevBlock = GetRandHash();
+    BOOST_CHECK(importer.ProcessBlock(orphan2, nullptr));
+    BOOST_CHECK_EQUAL(importer.GetOrphans().size(), 1);
+
+    // and the others keep only their position
+    CBlock orphan3 = genesis;
+    orphan3.hashPrevBlock = GetRandHash();
+    CDiskBlockPos pos(0, 1234);
+    BOOST_CHECK(importer.ProcessBlock(orphan3, &pos));
+    BOOST_CHECK_EQUAL(importer.GetOrphans().size(), 2);
+    auto it = importer.GetOrphans().find(orphan3.hashPrevBlock);
+    BOOST_CHECK(it != importer.GetOrphans().end() && !it->second.block && it->second.pos == pos);
+    BOOST_CHECK_EQUAL(importer.GetBuffered(), nSize);
+
+    // a known parent releases its buffered children
+    CBlockImporterTest importerRelease(0, nSize);
+    importerRelease.AddOrphan(genesis.GetHash(), genesis);
+    BOOST_CHECK_EQUAL(importerRelease.GetBuffered(), nSize);
+    BOOST_CHECK(importerRelease.ProcessBlock(genesis, nullptr));
+    BOOST_CHECK(importerRelease.GetOrphans().empty());
+    BOOST_CHECK_EQUAL(importerRelease.GetBuffered(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include "crypto/aes.h"
 #include "crypto/rfc6979_hmac_sha256.h"
 #include "crypto/chacha20.h"
+#include "crypto/muhash.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
@@ -13,6 +14,7 @@
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
 #include "random.h"
+#include "uint256.h"
 #include "utilstrencodings.h"
 #include "test/test_pivx.h"
 
@@ -451,6 +453,46 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector)
                  "fab78c9");
 }
 
+static MuHash3072 FromInt(unsigned char i)
+{
+    unsigned char tmp[32] = {i, 0};
+    return MuHash3072().Insert(tmp, 32);
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    uint256 out;
+    uint256 outEmpty;
+    MuHash3072().Finalize(outEmpty.begin());
+
+    // Test vector from Bitcoin Core
+    MuHash3072 acc = FromInt(0);
+    acc *= FromInt(1);
+    acc /= FromInt(2);
+    acc.Finalize(out.begin());
+    BOOST_CHECK(out == uint256S("10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863"));
+
+    // The order of the elements doesn't matter
+    uint256 out2;
+    MuHash3072 acc2 = FromInt(2);
+    acc2 *= FromInt(0);
+    acc2 *= FromInt(1);
+    acc2 /= FromInt(2);
+    acc2 /= FromInt(2);
+    acc2.Finalize(out2.begin());
+    BOOST_CHECK(out == out2);
+
+    // Removing every element results in the empty set
+    unsigned char data[3] = {'a', 'b', 'c'};
+    MuHash3072 acc3;
+    acc3.Insert(data, sizeof(data));
+    acc3.Finalize(out.begin());
+    BOOST_CHECK(out != outEmpty);
+    acc3.Remove(data, sizeof(data));
+    acc3.Finalize(out.begin());
+    BOOST_CHECK(out == outEmpty);
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests)
 {
     FastRandomContext ctx;
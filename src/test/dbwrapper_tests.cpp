@@ -113,4 +113,50 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+// Test -dbprofile checks and the statistics of open databases
+BOOST_AUTO_TEST_CASE(dbwrapper_profile_stats)
+{
+    std::string strError;
+    mapMultiArgs["-dbprofile"] = {"*:bloombits=0", "chainstate:writebuffer=1024,blocksize=16,compression=1"};
+    BOOST_CHECK(CheckDBProfiles(strError));
+    mapMultiArgs["-dbprofile"] = {"chainstate:writebuffer"};
+    BOOST_CHECK(!CheckDBProfiles(strError));
+    mapMultiArgs["-dbprofile"] = {"chainstate:unknown=1"};
+    BOOST_CHECK(!CheckDBProfiles(strError));
+    mapMultiArgs["-dbprofile"] = {"*:bloombits=12,maxopenfiles=100"};
+    BOOST_CHECK(CheckDBProfiles(strError));
+
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    {
+        CDBWrapper dbw(ph, (1 << 20), true, false);
+        char key = 'k';
+        uint256 in = GetRandHash();
+        uint256 res;
+        BOOST_CHECK(dbw.Write(key, in));
+        BOOST_CHECK(dbw.Read(key, res));
+        BOOST_CHECK(!dbw.Read('x', res));
+
+        int nFound = 0;
+        ForEachDB([&](const std::string& strName, leveldb::DB* pdb, const CDBStats* stats) {
+            if (strName != GetDBName(ph)) return;
+            nFound++;
+            BOOST_CHECK(stats != nullptr);
+            BOOST_CHECK_EQUAL(stats->nReads, 2U);
+            BOOST_CHECK_EQUAL(stats->nBatches, 1U);
+            BOOST_CHECK(stats->nBatchBytes > 0);
+            std::string strStats;
+            BOOST_CHECK(pdb->GetProperty("leveldb.stats", &strStats));
+        });
+        BOOST_CHECK_EQUAL(nFound, 1);
+    }
+    mapMultiArgs.erase("-dbprofile");
+
+    // closed databases are gone
+    int nFound = 0;
+    ForEachDB([&](const std::string& strName, leveldb::DB* pdb, const CDBStats* stats) {
+        if (strName == GetDBName(ph)) nFound++;
+    });
+    BOOST_CHECK_EQUAL(nFound, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,9 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_pivx.h"
 
+#include <thread>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -144,4 +147,77 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(block_header_hash_cache)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1600000000;
+    header.nBits = 0x1e0ffff0;
+
+    // the cached hash follows changes of the header
+    for (uint32_t nNonce = 0; nNonce < 20; nNonce++) {
+        header.nNonce = nNonce;
+        const uint256 hash = header.GetHash();
+        BOOST_CHECK(hash == HashQuark(BEGIN(header.nVersion), END(header.nNonce)));
+        BOOST_CHECK(hash == header.GetHash());
+    }
+    header.nTime++;
+    BOOST_CHECK(header.GetHash() == HashQuark(BEGIN(header.nVersion), END(header.nNonce)));
+
+    // copies keep the hash of their own fields
+    CBlock block(header);
+    BOOST_CHECK(block.GetHash() == header.GetHash());
+    block.hashMerkleRoot = GetRandHash();
+    BOOST_CHECK(block.GetHash() != header.GetHash());
+    block.SetNull();
+    BOOST_CHECK(block.GetHash() == HashQuark(BEGIN(block.nVersion), END(block.nNonce)));
+
+    // a shared header is hashed by several threads at once
+    const CBlockHeader shared = header;
+    const uint256 expected = HashQuark(BEGIN(header.nVersion), END(header.nNonce));
+    std::vector<uint256> vHashes(4);
+    std::vector<std::thread> vThreads;
+    for (size_t i = 0; i < vHashes.size(); i++) {
+        vThreads.emplace_back([&shared, &vHashes, i] {
+            for (int n = 0; n < 100; n++)
+                vHashes[i] = shared.GetHash();
+        });
+    }
+    for (std::thread& thread : vThreads)
+        thread.join();
+    for (const uint256& hash : vHashes)
+        BOOST_CHECK(hash == expected);
+}
+
+BOOST_AUTO_TEST_CASE(block_header_hash_batch)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = GetRandHash();
+    header.hashMerkleRoot = GetRandHash();
+    header.nTime = 1600000000;
+    header.nBits = 0x1e0ffff0;
+
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<uint256> vExpected;
+    for (uint32_t nNonce = 0; nNonce < 200; nNonce++) {
+        header.nNonce = nNonce;
+        vHeaders.push_back(header);
+        vExpected.push_back(HashQuark(BEGIN(header.nVersion), END(header.nNonce)));
+    }
+
+    // batches hash as single headers, on any number of threads
+    for (int nThreads : {1, 4, 0}) {
+        std::vector<uint256> vHashes;
+        HashBlockHeaders(vHeaders, vHashes, nThreads);
+        BOOST_CHECK_EQUAL(vHashes.size(), vHeaders.size());
+        for (size_t i = 0; i < vHeaders.size() && i < vHashes.size(); i++) {
+            BOOST_CHECK(vHashes[i] == vExpected[i]);
+            BOOST_CHECK(vHeaders[i].GetHash() == vExpected[i]);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
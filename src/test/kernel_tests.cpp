@@ -0,0 +1,73 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "kernel.h"
+#include "stakeinput.h"
+#include "test/test_pivx.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace
+{
+/** Stake input with a fixed value, uniqueness and block. */
+class CFixedStakeInput : public CStakeInput
+{
+private:
+    CAmount nValue;
+    COutPoint prevout;
+
+public:
+    CFixedStakeInput(CBlockIndex* pindexFromIn, CAmount nValueIn, const COutPoint& prevoutIn)
+        : nValue(nValueIn), prevout(prevoutIn)
+    {
+        pindexFrom = pindexFromIn;
+    }
+
+    bool InitFromTxIn(const CTxIn& txin) override { return false; }
+    CBlockIndex* GetIndexFrom() override { return pindexFrom; }
+    bool CreateTxIn(CWallet* pwallet, CTxIn& txIn, uint256 hashTxOut = UINT256_ZERO) override { return false; }
+    bool GetTxFrom(CTransaction& tx) const override { return false; }
+    bool GetTxOutFrom(CTxOut& out) const override { return false; }
+    CAmount GetValue() override { return nValue; }
+    bool CreateTxOuts(CWallet* pwallet, std::vector<CTxOut>& vout, CAmount nTotal, const bool onlyP2PK) override { return false; }
+    bool IsZPIV() const override { return false; }
+    bool ContextCheck(int nHeight, uint32_t nTime) override { return true; }
+
+    CDataStream GetUniqueness() const override
+    {
+        CDataStream ss(SER_GETHASH, 0);
+        ss << prevout.n << prevout.hash;
+        return ss;
+    }
+};
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(kernel_prefix_hash)
+{
+    CBlockIndex indexFrom;
+    indexFrom.nHeight = 100;
+    indexFrom.nTime = 1600000000;
+
+    // the parent of the kernel block uses the v2 stake modifier
+    CBlockIndex indexPrev;
+    indexPrev.nHeight = Params().GetConsensus().vUpgrades[Consensus::UPGRADE_V4_0].nActivationHeight;
+    indexPrev.SetStakeModifier(uint256S("9c2b5d7a0a1b2c3d4e5f60718293a4b5c6d7e8f90112233445566778899aabb"));
+
+    const unsigned int nBits = 0x1e0fffff;
+    for (int i = 0; i < 4; ++i) {
+        CFixedStakeInput stakeInput(&indexFrom, (i + 1) * 1000 * COIN, COutPoint(InsecureRand256(), i));
+        CStakeKernelPrefix prefix(CStakeKernel(&indexPrev, &stakeInput, nBits, indexFrom.nTime));
+
+        for (int nTimeTx = 1600001000; nTimeTx < 1600001000 + 16 * 15; nTimeTx += 15) {
+            CStakeKernel kernel(&indexPrev, &stakeInput, nBits, nTimeTx);
+            BOOST_CHECK(prefix.GetHash(nTimeTx) == kernel.GetHash());
+            BOOST_CHECK_EQUAL(prefix.CheckKernelHash(nTimeTx), kernel.CheckKernelHash(true));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
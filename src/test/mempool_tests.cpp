@@ -54,7 +54,7 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
 
 
     CTxMemPool testPool(CFeeRate(0));
-    std::list<CTransaction> removed;
+    std::list<CTransactionRef> removed;
 
     // Nothing in pool, remove should do nothing:
     testPool.remove(txParent, removed, true);
@@ -280,7 +280,7 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     BOOST_CHECK_EQUAL(pool.size(), 10);
 
     // Now try removing tx10 and verify the sort order returns to normal
-    std::list<CTransaction> removed;
+    std::list<CTransactionRef> removed;
     pool.remove(pool.mapTx.find(tx10.GetHash())->GetTx(), removed, true);
     CheckSort<1>(pool, snapshotOrder);
 
@@ -443,8 +443,8 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     pool.addUnchecked(tx5.GetHash(), entry.Fee(1000LL).FromTx(tx5, &pool));
     pool.addUnchecked(tx7.GetHash(), entry.Fee(9000LL).FromTx(tx7, &pool));
 
-    std::vector<CTransaction> vtx;
-    std::list<CTransaction> conflicts;
+    std::vector<CTransactionRef> vtx;
+    std::list<CTransactionRef> conflicts;
     SetMockTime(42);
     SetMockTime(42 + CTxMemPool::ROLLING_FEE_HALFLIFE);
     BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), maxFeeRateRemoved.GetFeePerK() + 1000);
@@ -473,4 +473,52 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolSharedTxTest)
+{
+    // The mempool, the removed list and the block share the transactions
+    TestMemPoolEntryHelper entry;
+    CTxMemPool pool(CFeeRate(0));
+
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vin[0].prevout.hash = GetRandHash();
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    // tx2 and tx3 spend the same input
+    CMutableTransaction tx2 = tx1;
+    tx2.vin[0].prevout.hash = GetRandHash();
+    CMutableTransaction tx3 = tx2;
+    tx3.vout[0].nValue = 9 * COIN;
+
+    pool.addUnchecked(tx1.GetHash(), entry.FromTx(tx1));
+    pool.addUnchecked(tx2.GetHash(), entry.FromTx(tx2));
+    CTransactionRef ptx1 = pool.get(tx1.GetHash());
+    CTransactionRef ptx2 = pool.get(tx2.GetHash());
+    BOOST_CHECK(ptx1 && ptx2);
+    BOOST_CHECK(ptx1 == pool.mapTx.find(tx1.GetHash())->GetSharedTx());
+    BOOST_CHECK(!pool.get(tx3.GetHash()));
+
+    // tx1 and tx3 are mined
+    CBlock block;
+    block.vtx.push_back(ptx1);
+    block.vtx.push_back(MakeTransactionRef(tx3));
+    std::list<CTransactionRef> conflicts;
+    pool.removeForBlock(block.vtx, 1, conflicts);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(conflicts.size(), 1);
+    BOOST_CHECK(conflicts.front() == ptx2);
+    BOOST_CHECK_EQUAL(ptx1.use_count(), 2);
+
+    // Deserialization allocates each transaction of a block once
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    CBlock block2;
+    ss >> block2;
+    BOOST_CHECK_EQUAL(block2.vtx.size(), 2);
+    BOOST_CHECK(block2.vtx[0]->GetHash() == ptx1->GetHash());
+    BOOST_CHECK_EQUAL(block2.vtx[0].use_count(), 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
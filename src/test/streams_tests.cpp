@@ -71,4 +71,25 @@ BOOST_AUTO_TEST_CASE(streams_vector_writer)
     vch.clear();
 }
 
+BOOST_AUTO_TEST_CASE(streams_memory_reader)
+{
+    const unsigned char bytes[] = { 1, 2, 3, 4, 5, 6 };
+
+    CMemoryReader reader(SER_NETWORK, INIT_PROTO_VERSION, bytes, bytes + sizeof(bytes));
+    unsigned char a;
+    uint32_t b;
+    reader >> a >> b;
+    BOOST_CHECK_EQUAL(a, 1);
+    BOOST_CHECK_EQUAL(b, 0x05040302U);
+    BOOST_CHECK_EQUAL(reader.GetPos(), 5U);
+    BOOST_CHECK_EQUAL(reader.size(), 1U);
+
+    // reading past the end fails, and doesn't move the position
+    BOOST_CHECK_THROW(reader >> b, std::ios_base::failure);
+    BOOST_CHECK_EQUAL(reader.GetPos(), 5U);
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, 6);
+    BOOST_CHECK(reader.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
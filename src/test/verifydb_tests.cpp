@@ -0,0 +1,93 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+#include "txdb.h"
+#include "utiltime.h"
+#include "verifydb.h"
+#include "test/test_pivx.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(verifydb_tests, TestingSetup)
+
+/** Waits until the verifier finished nJobs jobs */
+static bool WaitForJobs(CBlockVerifier& verifier, int nJobs)
+{
+    for (int i = 0; i < 1000; i++) {
+        if (verifier.GetStatus().nFinished >= nJobs)
+            return true;
+        MilliSleep(10);
+    }
+    return false;
+}
+
+BOOST_AUTO_TEST_CASE(verify_jobs_persistence)
+{
+    CVerifyJob job(10, 200, 3, true);
+    job.nNextHeight = 75;
+    std::vector<CVerifyJob> vJobs = {job, CVerifyJob(1, 5, 1, false)};
+    BOOST_CHECK(pblocktree->WriteVerifyJobs(vJobs));
+
+    std::vector<CVerifyJob> vRead;
+    BOOST_CHECK(pblocktree->ReadVerifyJobs(vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), 2);
+    BOOST_CHECK_EQUAL(vRead[0].nStartHeight, 10);
+    BOOST_CHECK_EQUAL(vRead[0].nEndHeight, 200);
+    BOOST_CHECK_EQUAL(vRead[0].nCheckLevel, 3);
+    BOOST_CHECK(vRead[0].fTip);
+    BOOST_CHECK_EQUAL(vRead[0].nNextHeight, 75);
+    BOOST_CHECK_EQUAL(vRead[1].nNextHeight, 1);
+    BOOST_CHECK(!vRead[1].fTip);
+
+    // An empty list is erased
+    BOOST_CHECK(pblocktree->WriteVerifyJobs(std::vector<CVerifyJob>()));
+    vRead.clear();
+    BOOST_CHECK(!pblocktree->ReadVerifyJobs(vRead));
+    BOOST_CHECK(vRead.empty());
+
+    // Starting with fWipe drops the saved jobs
+    BOOST_CHECK(pblocktree->WriteVerifyJobs(vJobs));
+    CBlockVerifier verifier;
+    verifier.Start(true);
+    BOOST_CHECK(verifier.GetStatus().vJobs.empty());
+    verifier.Stop();
+    BOOST_CHECK(!pblocktree->ReadVerifyJobs(vRead));
+}
+
+BOOST_AUTO_TEST_CASE(verify_jobs_resume)
+{
+    // Two jobs past the tip of a chain with the genesis block only, the second one stopped midway
+    CVerifyJob jobTip(1, 1, 4, true);
+    CVerifyJob jobPastTip(1, 50, 2, false);
+    jobPastTip.nNextHeight = 20;
+    BOOST_CHECK(pblocktree->WriteVerifyJobs({jobTip, jobPastTip}));
+
+    CBlockVerifier verifier;
+    verifier.Start(false);
+    BOOST_CHECK(WaitForJobs(verifier, 2));
+    verifier.Stop();
+
+    // Both ended at the tip, the second one resumed at its saved height
+    CVerifyStatus status = verifier.GetStatus();
+    BOOST_CHECK_EQUAL(status.nFinished, 2);
+    BOOST_CHECK(!status.fLastFailed);
+    BOOST_CHECK_EQUAL(status.lastJob.nNextHeight, 20);
+    BOOST_CHECK_EQUAL(status.lastJob.nEndHeight, 19);
+    BOOST_CHECK(status.vJobs.empty());
+
+    // Finished jobs are not saved
+    std::vector<CVerifyJob> vRead;
+    BOOST_CHECK(!pblocktree->ReadVerifyJobs(vRead));
+
+    // Levels 3 and 4 of a chain with the genesis block only have nothing to disconnect
+    std::string strError;
+    LOCK(cs_main);
+    BOOST_CHECK(VerifyBlockCoins(pcoinsTip, 4, 0, strError));
+    BOOST_CHECK(strError.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
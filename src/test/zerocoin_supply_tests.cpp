@@ -0,0 +1,130 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "consensus/zerocoin_verify.h"
+#include "main.h"
+#include "random.h"
+#include "txmempool.h"
+#include "undo.h"
+#include "test/test_pivx.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(zerocoin_supply_tests, TestingSetup)
+
+/** The supply change of a block, as RecalculatePIVSupply computed it serially, with a lookup per input */
+static CAmount SerialSupplyChange(const CBlock& block)
+{
+    CAmount nValueIn = 0;
+    CAmount nValueOut = 0;
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            if (tx.IsCoinBase())
+                break;
+
+            if (tx.vin[i].IsZerocoinSpend()) {
+                nValueIn += tx.vin[i].nSequence * COIN;
+                continue;
+            }
+
+            COutPoint prevout = tx.vin[i].prevout;
+            CTransaction txPrev;
+            uint256 hashBlock;
+            BOOST_REQUIRE(GetTransaction(prevout.hash, txPrev, hashBlock, true));
+            nValueIn += txPrev.vout[prevout.n].nValue;
+        }
+
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            if (i == 0 && tx.IsCoinStake())
+                continue;
+
+            nValueOut += tx.vout[i].nValue;
+        }
+    }
+    return nValueOut - nValueIn;
+}
+
+BOOST_AUTO_TEST_CASE(block_supply_change)
+{
+    TestMemPoolEntryHelper entry;
+    CBlock block;
+    CBlockUndo blockUndo;
+
+    // Previous transactions are looked up in the mempool by the serial computation
+    auto spend = [&](CMutableTransaction& tx, CTxUndo* txundo, CAmount nValue) {
+        CMutableTransaction txPrev;
+        txPrev.vin.resize(1);
+        txPrev.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        txPrev.vout.resize(2);
+        txPrev.vout[1].nValue = nValue;
+        mempool.addUnchecked(txPrev.GetHash(), entry.FromTx(txPrev));
+        tx.vin.emplace_back(COutPoint(txPrev.GetHash(), 1));
+        if (txundo)
+            txundo->vprevout.emplace_back(txPrev.vout[1], 1, false, false);
+    };
+    auto spendZerocoin = [](CMutableTransaction& tx, opcodetype opcode, int nDenom) {
+        CTxIn in;
+        if (opcode == OP_ZEROCOINPUBLICSPEND)
+            in.prevout = COutPoint(GetRandHash(), 0);
+        in.scriptSig = CScript() << opcode;
+        in.nSequence = nDenom;
+        tx.vin.push_back(in);
+    };
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 0;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    CMutableTransaction coinstake;
+    blockUndo.vtxundo.emplace_back();
+    spend(coinstake, &blockUndo.vtxundo.back(), 100 * COIN);
+    coinstake.vout.resize(2);
+    coinstake.vout[0].SetEmpty();
+    coinstake.vout[1].nValue = 103 * COIN;
+    block.vtx.push_back(MakeTransactionRef(coinstake));
+
+    CMutableTransaction tx;
+    blockUndo.vtxundo.emplace_back();
+    spend(tx, &blockUndo.vtxundo.back(), 5 * COIN);
+    spend(tx, &blockUndo.vtxundo.back(), 7 * COIN);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 11 * COIN;
+    block.vtx.push_back(MakeTransactionRef(tx));
+
+    // A zerocoin spend, with a normal input, which has no undo data
+    CMutableTransaction txZerocoin;
+    blockUndo.vtxundo.emplace_back();
+    spendZerocoin(txZerocoin, OP_ZEROCOINSPEND, 10);
+    spend(txZerocoin, nullptr, 2 * COIN);
+    txZerocoin.vout.resize(1);
+    txZerocoin.vout[0].nValue = 12 * COIN;
+    block.vtx.push_back(MakeTransactionRef(txZerocoin));
+
+    CAmount nChange;
+    BOOST_CHECK(GetBlockSupplyChange(block, blockUndo, nChange));
+    BOOST_CHECK_EQUAL(nChange, SerialSupplyChange(block));
+    BOOST_CHECK_EQUAL(nChange, 2 * COIN);
+
+    // A public spend counts its denomination, which the serial computation took from the spent mint
+    CMutableTransaction txPublic;
+    blockUndo.vtxundo.emplace_back();
+    spendZerocoin(txPublic, OP_ZEROCOINPUBLICSPEND, 5);
+    txPublic.vout.resize(1);
+    txPublic.vout[0].nValue = 5 * COIN;
+    block.vtx.push_back(MakeTransactionRef(txPublic));
+    BOOST_CHECK(GetBlockSupplyChange(block, blockUndo, nChange));
+    BOOST_CHECK_EQUAL(nChange, 2 * COIN);
+
+    // Undo data, which doesn't match the block
+    blockUndo.vtxundo.pop_back();
+    BOOST_CHECK(!GetBlockSupplyChange(block, blockUndo, nChange));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
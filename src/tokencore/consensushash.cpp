@@ -16,15 +16,21 @@
 #include "arith_uint256.h"
 #include "uint256.h"
 
+#include <assert.h>
 #include <stdint.h>
 #include <algorithm>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <openssl/sha.h>
 
 namespace mastercore
 {
+//! Incrementally maintained commitment to the token state
+CMPStateHash mp_state_hash;
+
 bool ShouldConsensusHashBlock(int block) {
     if (msc_debug_consensus_hash_every_block) {
         return true;
@@ -161,13 +167,15 @@ uint256 GetConsensusHash()
     // Balances - loop through the tally map, updating the sha context with the data from each balance and tally type
     // Placeholders:  "address|propertyid|balance|selloffer_reserve|accept_reserve|metadex_reserve"
     // Sort alphabetically first
-    std::map<std::string, CMPTally> tallyMapSorted;
+    std::vector<std::pair<std::string, CMPTally*> > vecTallySorted;
+    vecTallySorted.reserve(mp_tally_map.size());
     for (std::unordered_map<std::string, CMPTally>::iterator uoit = mp_tally_map.begin(); uoit != mp_tally_map.end(); ++uoit) {
-        tallyMapSorted.insert(std::make_pair(uoit->first,uoit->second));
+        vecTallySorted.push_back(std::make_pair(uoit->first, &(uoit->second)));
     }
-    for (std::map<std::string, CMPTally>::iterator my_it = tallyMapSorted.begin(); my_it != tallyMapSorted.end(); ++my_it) {
+    std::sort(vecTallySorted.begin(), vecTallySorted.end());
+    for (std::vector<std::pair<std::string, CMPTally*> >::iterator my_it = vecTallySorted.begin(); my_it != vecTallySorted.end(); ++my_it) {
         const std::string& address = my_it->first;
-        CMPTally& tally = my_it->second;
+        CMPTally& tally = *(my_it->second);
         tally.init();
         uint32_t propertyId = 0;
         while (0 != (propertyId = (tally.next()))) {
@@ -217,14 +225,11 @@ uint256 GetConsensusHash()
     // Placeholders: "txid|address|propertyidforsale|amountforsale|propertyiddesired|amountdesired|amountremaining"
     std::vector<std::pair<arith_uint256, std::string> > vecMetaDExTrades;
     for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-        const md_PricesMap& prices = my_it->second;
-        for (md_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it) {
-            const md_Set& indexes = it->second;
-            for (md_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                const CMPMetaDEx& obj = *it;
-                std::string dataStr = GenerateConsensusString(obj);
-                vecMetaDExTrades.push_back(std::make_pair(arith_uint256(obj.getHash().ToString()), dataStr));
-            }
+        const CMPMetaDExBook& book = my_it->second;
+        for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+            const CMPMetaDEx& obj = *it;
+            std::string dataStr = GenerateConsensusString(obj);
+            vecMetaDExTrades.push_back(std::make_pair(arith_uint256(obj.getHash().ToString()), dataStr));
         }
     }
     std::sort (vecMetaDExTrades.begin(), vecMetaDExTrades.end());
@@ -288,14 +293,11 @@ uint256 GetMetaDExHash(const uint32_t propertyId)
     std::vector<std::pair<arith_uint256, std::string> > vecMetaDExTrades;
     for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
         if (propertyId == 0 || propertyId == my_it->first) {
-            const md_PricesMap& prices = my_it->second;
-            for (md_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it) {
-                const md_Set& indexes = it->second;
-                for (md_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                    const CMPMetaDEx& obj = *it;
-                    std::string dataStr = GenerateConsensusString(obj);
-                    vecMetaDExTrades.push_back(std::make_pair(arith_uint256(obj.getHash().ToString()), dataStr));
-                }
+            const CMPMetaDExBook& book = my_it->second;
+            for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+                const CMPMetaDEx& obj = *it;
+                std::string dataStr = GenerateConsensusString(obj);
+                vecMetaDExTrades.push_back(std::make_pair(arith_uint256(obj.getHash().ToString()), dataStr));
             }
         }
     }
@@ -319,18 +321,14 @@ uint256 GetBalancesHash(const uint32_t hashPropertyId)
 
     LOCK(cs_tally);
 
-    std::map<std::string, CMPTally> tallyMapSorted;
-    for (std::unordered_map<std::string, CMPTally>::iterator uoit = mp_tally_map.begin(); uoit != mp_tally_map.end(); ++uoit) {
-        tallyMapSorted.insert(std::make_pair(uoit->first,uoit->second));
-    }
-    for (std::map<std::string, CMPTally>::iterator my_it = tallyMapSorted.begin(); my_it != tallyMapSorted.end(); ++my_it) {
-        const std::string& address = my_it->first;
-        CMPTally& tally = my_it->second;
-        tally.init();
-        uint32_t propertyId = 0;
-        while (0 != (propertyId = (tally.next()))) {
-            if (propertyId != hashPropertyId) continue;
-            std::string dataStr = GenerateConsensusString(tally, address, propertyId);
+    // Holders are sorted alphabetically, and only holders have non-empty balances
+    const CMPHolderIndex::HolderSet* pholders = mp_holder_index.getHolders(hashPropertyId);
+    if (pholders) {
+        for (CMPHolderIndex::HolderSet::const_iterator it = pholders->begin(); it != pholders->end(); ++it) {
+            const std::string& address = *it;
+            const CMPTally* ptally = getTally(address);
+            assert(ptally != NULL);
+            std::string dataStr = GenerateConsensusString(*ptally, address, hashPropertyId);
             if (dataStr.empty()) continue;
             if (msc_debug_consensus_hash) PrintToLog("Adding data to balances hash: %s\n", dataStr);
             SHA256_Update(&shaCtx, dataStr.c_str(), dataStr.length());
@@ -343,4 +341,174 @@ uint256 GetBalancesHash(const uint32_t hashPropertyId)
     return balancesHash;
 }
 
+void CMPStateHash::Add(Section section, uint32_t propertyId, const std::string& entry)
+{
+    if (entry.empty()) return;
+
+    const unsigned char* data = (const unsigned char*) entry.c_str();
+    Accumulator& property = mapProperties[section][propertyId];
+    property.hash.Insert(data, entry.length());
+    ++property.nEntries;
+    sections[section].hash.Insert(data, entry.length());
+    ++sections[section].nEntries;
+}
+
+void CMPStateHash::Remove(Section section, uint32_t propertyId, const std::string& entry)
+{
+    if (entry.empty()) return;
+
+    // an entry of a property without entries was never added, and removing it would corrupt the state
+    PropertyMap::iterator it = mapProperties[section].find(propertyId);
+    if (it == mapProperties[section].end()) {
+        PrintToLog("%s(): ERROR: removing an entry of property %d, which has no entries in section %d\n", __func__, propertyId, section);
+        return;
+    }
+
+    const unsigned char* data = (const unsigned char*) entry.c_str();
+    it->second.hash.Remove(data, entry.length());
+    if (--it->second.nEntries == 0) {
+        mapProperties[section].erase(it);
+    }
+    sections[section].hash.Remove(data, entry.length());
+    --sections[section].nEntries;
+}
+
+void CMPStateHash::AddMetaDEx(const CMPMetaDEx& tradeObj)
+{
+    Add(METADEX_TRADES, tradeObj.getProperty(), GenerateConsensusString(tradeObj));
+}
+
+void CMPStateHash::RemoveMetaDEx(const CMPMetaDEx& tradeObj)
+{
+    Remove(METADEX_TRADES, tradeObj.getProperty(), GenerateConsensusString(tradeObj));
+}
+
+void CMPStateHash::AddOffer(const CMPOffer& offerObj, const std::string& address)
+{
+    Add(DEX_OFFERS, offerObj.getProperty(), GenerateConsensusString(offerObj, address));
+}
+
+void CMPStateHash::RemoveOffer(const CMPOffer& offerObj, const std::string& address)
+{
+    Remove(DEX_OFFERS, offerObj.getProperty(), GenerateConsensusString(offerObj, address));
+}
+
+uint256 CMPStateHash::GetSectionHash(Section section, uint32_t propertyId) const
+{
+    uint256 sectionHash;
+    if (propertyId == 0) {
+        sections[section].hash.Finalize(sectionHash.begin());
+        return sectionHash;
+    }
+
+    PropertyMap::const_iterator it = mapProperties[section].find(propertyId);
+    if (it != mapProperties[section].end()) {
+        it->second.hash.Finalize(sectionHash.begin());
+    } else {
+        MuHash3072().Finalize(sectionHash.begin());
+    }
+
+    return sectionHash;
+}
+
+uint256 CMPStateHash::GetHash() const
+{
+    SHA256_CTX shaCtx;
+    SHA256_Init(&shaCtx);
+
+    for (int section = 0; section < SECTION_COUNT; ++section) {
+        uint256 sectionHash = GetSectionHash(static_cast<Section>(section));
+        SHA256_Update(&shaCtx, sectionHash.begin(), sectionHash.size());
+    }
+
+    uint256 stateHash;
+    SHA256_Final((unsigned char*)&stateHash, &shaCtx);
+
+    return stateHash;
+}
+
+void CMPStateHash::Clear(Section section)
+{
+    mapProperties[section].clear();
+    sections[section] = Accumulator();
+}
+
+void CMPStateHash::Clear()
+{
+    for (int section = 0; section < SECTION_COUNT; ++section) {
+        Clear(static_cast<Section>(section));
+    }
+}
+
+/**
+ * Obtains the incrementally maintained commitment to the token state.
+ *
+ * Balances, DEx sell offers and MetaDEx trades are taken from the maintained
+ * commitment, while the few DEx accepts and open crowdsales, which are kept
+ * in sorted maps, are hashed on demand.
+ * Property issuers are not covered, use GetConsensusHash() for a full hash.
+ */
+uint256 GetStateHash()
+{
+    LOCK(cs_tally);
+
+    SHA256_CTX shaCtx;
+    SHA256_Init(&shaCtx);
+
+    uint256 committedHash = mp_state_hash.GetHash();
+    SHA256_Update(&shaCtx, committedHash.begin(), committedHash.size());
+
+    for (AcceptMap::const_iterator it = my_accepts.begin(); it != my_accepts.end(); ++it) {
+        const std::string& acceptCombo = it->first;
+        std::string buyer = acceptCombo.substr((acceptCombo.find("+") + 1), (acceptCombo.size()-(acceptCombo.find("+") + 1)));
+        std::string dataStr = GenerateConsensusString(it->second, buyer);
+        SHA256_Update(&shaCtx, dataStr.c_str(), dataStr.length());
+    }
+
+    for (CrowdMap::const_iterator it = my_crowds.begin(); it != my_crowds.end(); ++it) {
+        std::string dataStr = GenerateConsensusString(it->second);
+        SHA256_Update(&shaCtx, dataStr.c_str(), dataStr.length());
+    }
+
+    uint256 stateHash;
+    SHA256_Final((unsigned char*)&stateHash, &shaCtx);
+    if (msc_debug_consensus_hash) PrintToLog("Current state hash: %s\n", stateHash.GetHex());
+
+    return stateHash;
+}
+
+/**
+ * Rebuilds the commitment to balances, DEx sell offers and MetaDEx trades
+ * from the whole state, to cross-check the incrementally maintained one.
+ */
+CMPStateHash RebuildStateHash()
+{
+    LOCK(cs_tally);
+
+    CMPStateHash stateHash;
+    for (std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
+        CMPTally& tally = it->second;
+        tally.init();
+        uint32_t propertyId = 0;
+        while (0 != (propertyId = (tally.next()))) {
+            stateHash.Add(CMPStateHash::BALANCES, propertyId, GenerateConsensusString(tally, it->first, propertyId));
+        }
+    }
+
+    for (OfferMap::const_iterator it = my_offers.begin(); it != my_offers.end(); ++it) {
+        const std::string& combo = it->first;
+        std::string seller = combo.substr(0, combo.size() - 2);
+        stateHash.AddOffer(it->second, seller);
+    }
+
+    for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
+        const CMPMetaDExBook& book = my_it->second;
+        for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+            stateHash.AddMetaDEx(*it);
+        }
+    }
+
+    return stateHash;
+}
+
 } // namespace mastercore
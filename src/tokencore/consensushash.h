@@ -1,10 +1,96 @@
 #ifndef TOKENCORE_CONSENSUSHASH_H
 #define TOKENCORE_CONSENSUSHASH_H
 
+#include "crypto/muhash.h"
 #include "uint256.h"
 
+#include <stdint.h>
+#include <map>
+#include <string>
+
+class CMPMetaDEx;
+class CMPOffer;
+class CMPTally;
+
 namespace mastercore
 {
+/** Incrementally maintained commitment to the token state.
+ *
+ * Every entry is committed to by its consensus string, as an element of a
+ * MuHash3072 multiset hash per section and property. The result doesn't
+ * depend on the order of the entries, so single entries can be added and
+ * removed, whenever the state changes, without rehashing the whole state.
+ *
+ * The commitment is not compatible with the legacy consensus hash, which is
+ * still available via GetConsensusHash().
+ */
+class CMPStateHash
+{
+public:
+    //! State sections, which are maintained incrementally
+    enum Section {
+        BALANCES = 0,
+        DEX_OFFERS = 1,
+        METADEX_TRADES = 2,
+        SECTION_COUNT
+    };
+
+private:
+    struct Accumulator {
+        MuHash3072 hash;
+        //! Number of entries, to drop properties without entries
+        int64_t nEntries;
+
+        Accumulator() : nEntries(0) {}
+    };
+
+    typedef std::map<uint32_t, Accumulator> PropertyMap;
+
+    //! Entries per section and property
+    PropertyMap mapProperties[SECTION_COUNT];
+    //! Entries per section
+    Accumulator sections[SECTION_COUNT];
+
+public:
+    /** Adds an entry, empty entries are ignored. */
+    void Add(Section section, uint32_t propertyId, const std::string& entry);
+
+    /** Removes an entry, empty entries are ignored. */
+    void Remove(Section section, uint32_t propertyId, const std::string& entry);
+
+    /** Adds or removes an open MetaDEx trade. */
+    void AddMetaDEx(const CMPMetaDEx& tradeObj);
+    void RemoveMetaDEx(const CMPMetaDEx& tradeObj);
+
+    /** Adds or removes a DEx sell offer. */
+    void AddOffer(const CMPOffer& offerObj, const std::string& address);
+    void RemoveOffer(const CMPOffer& offerObj, const std::string& address);
+
+    /** Returns the commitment to a section, optionally limited to a single property. */
+    uint256 GetSectionHash(Section section, uint32_t propertyId = 0) const;
+
+    /** Returns the commitment to all sections. */
+    uint256 GetHash() const;
+
+    /** Removes all entries of a section. */
+    void Clear(Section section);
+
+    /** Removes all entries. */
+    void Clear();
+};
+
+//! Incrementally maintained commitment to the token state
+extern CMPStateHash mp_state_hash;
+
+/** Generates a consensus string for hashing based on a tally object. */
+std::string GenerateConsensusString(const CMPTally& tallyObj, const std::string& address, const uint32_t propertyId);
+
+/** Obtains the incrementally maintained commitment to the token state. */
+uint256 GetStateHash();
+
+/** Rebuilds the commitment to the token state from scratch, for cross-checks. */
+CMPStateHash RebuildStateHash();
+
 /** Checks if a given block should be consensus hashed. */
 bool ShouldConsensusHashBlock(int block);
 
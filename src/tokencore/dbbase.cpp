@@ -2,9 +2,12 @@
 
 #include "tokencore/log.h"
 
+#include "dbwrapper.h"
 #include "util.h"
 
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/write_batch.h"
 
 #include <boost/filesystem/path.hpp>
@@ -23,7 +26,11 @@ leveldb::Status CDBBase::Open(const boost::filesystem::path& path, bool fWipe)
     TryCreateDirectory(path);
     if (msc_debug_persistence) PrintToLog("Opening LevelDB in %s\n", path.string());
 
-    return leveldb::DB::Open(options, path.string(), &pdb);
+    const std::string strName = GetDBName(path);
+    ApplyDBProfile(strName, options);
+    leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
+    if (status.ok()) RegisterDB(strName, pdb, NULL);
+    return status;
 }
 
 /**
@@ -59,9 +66,15 @@ void CDBBase::Clear()
 void CDBBase::Close()
 {
     if (pdb) {
+        UnregisterDB(pdb);
         delete pdb;
         pdb = NULL;
     }
+    // set by -dbprofile
+    delete options.filter_policy;
+    options.filter_policy = NULL;
+    delete options.block_cache;
+    options.block_cache = NULL;
 }
 
 
@@ -12,9 +12,14 @@
 #include "tokencore/sp.h"
 #include "tokencore/sto.h"
 
+#include "crypto/common.h"
 #include "main.h"
 
 #include "leveldb/db.h"
+#include "leveldb/iterator.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+#include "leveldb/write_batch.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
@@ -31,10 +36,107 @@ using namespace mastercore;
 
 std::map<uint32_t, int64_t> distributionThresholds;
 
+//! Prefix of the fee cache entries, which are ordered by property and block
+static const char CACHE_ENTRY_PREFIX = 'C';
+//! Prefix of the secondary keys, which order fee cache entries by block
+static const char CACHE_BLOCK_PREFIX = 'B';
+//! Prefix of the secondary keys, which order fee distributions by property and block
+static const char HISTORY_PROPERTY_PREFIX = 'P';
+//! Prefix of the secondary keys, which order fee distributions by block
+static const char HISTORY_BLOCK_PREFIX = 'B';
+//! Length of the keys, which are formed by a prefix and two big-endian numbers
+static const size_t SHORT_KEY_SIZE = 9;
+//! Length of the keys, which are formed by a prefix and three big-endian numbers
+static const size_t LONG_KEY_SIZE = 13;
+
+static void AppendBE32(std::string& str, uint32_t n)
+{
+    unsigned char buf[4];
+    WriteBE32(buf, n);
+    str.append(reinterpret_cast<const char*>(buf), sizeof(buf));
+}
+
+static uint32_t ReadKeyBE32(const leveldb::Slice& key, size_t pos)
+{
+    return ReadBE32(reinterpret_cast<const unsigned char*>(key.data() + pos));
+}
+
+/** Returns the prefix of the fee cache entries of a property. */
+static std::string CacheEntryPrefix(uint32_t propertyId)
+{
+    std::string key(1, CACHE_ENTRY_PREFIX);
+    AppendBE32(key, propertyId);
+    return key;
+}
+
+/** Returns the key of a fee cache entry, formed by the big-endian property identifier and block height. */
+static std::string CacheEntryKey(uint32_t propertyId, int block)
+{
+    std::string key = CacheEntryPrefix(propertyId);
+    AppendBE32(key, block);
+    return key;
+}
+
+/** Returns the secondary key of a fee cache entry, formed by the big-endian block height and property identifier. */
+static std::string CacheBlockKey(int block, uint32_t propertyId)
+{
+    std::string key(1, CACHE_BLOCK_PREFIX);
+    AppendBE32(key, block);
+    AppendBE32(key, propertyId);
+    return key;
+}
+
+/** Returns the prefix of the secondary keys of the fee distributions of a property. */
+static std::string HistoryPropertyPrefix(uint32_t propertyId)
+{
+    std::string key(1, HISTORY_PROPERTY_PREFIX);
+    AppendBE32(key, propertyId);
+    return key;
+}
+
+/** Returns the secondary key of a fee distribution, formed by the big-endian property identifier, block height and identifier. */
+static std::string HistoryPropertyKey(uint32_t propertyId, int block, int id)
+{
+    std::string key = HistoryPropertyPrefix(propertyId);
+    AppendBE32(key, block);
+    AppendBE32(key, id);
+    return key;
+}
+
+/** Returns the secondary key of a fee distribution, formed by the big-endian block height and identifier. */
+static std::string HistoryBlockKey(int block, int id)
+{
+    std::string key(1, HISTORY_BLOCK_PREFIX);
+    AppendBE32(key, block);
+    AppendBE32(key, id);
+    return key;
+}
+
+/** Returns true, if the key is formed by digits only, as the keys of fee distributions and legacy fee cache entries. */
+static bool IsNumericKey(const std::string& key)
+{
+    return !key.empty() && key.find_first_not_of("0123456789") == std::string::npos;
+}
+
+/** Parses the block and property of a fee distribution, stored as "block:property:total:recipients". */
+static bool ParseDistribution(const std::string& strValue, int& block, uint32_t& propertyId)
+{
+    std::vector<std::string> vFeeHistoryDetail;
+    boost::split(vFeeHistoryDetail, strValue, boost::is_any_of(":"), boost::token_compress_on);
+    if (4 != vFeeHistoryDetail.size()) {
+        PrintToLog("ERROR: vFeeHistoryDetail has unexpected number of elements: %d !\n", vFeeHistoryDetail.size());
+        return false; // bad data
+    }
+    block = boost::lexical_cast<int>(vFeeHistoryDetail[0]);
+    propertyId = boost::lexical_cast<uint32_t>(vFeeHistoryDetail[1]);
+    return true;
+}
+
 CTokenFeeCache::CTokenFeeCache(const boost::filesystem::path& path, bool fWipe)
 {
     leveldb::Status status = Open(path, fWipe);
     PrintToConsole("Loading fee cache database: %s\n", status.ToString());
+    if (status.ok()) LoadMostRecentItems();
 }
 
 CTokenFeeCache::~CTokenFeeCache()
@@ -62,46 +164,65 @@ void CTokenFeeCache::UpdateDistributionThresholds(uint32_t propertyId)
 // Gets the current amount of the fee cache for a property
 int64_t CTokenFeeCache::GetCachedAmount(const uint32_t &propertyId)
 {
-    assert(pdb);
-    // Get the fee history, set is sorted by block so last entry is most recent
-    std::set<feeCacheItem> sCacheHistoryItems = GetCacheHistory(propertyId);
-    if (!sCacheHistoryItems.empty()) {
-        std::set<feeCacheItem>::iterator endIt = sCacheHistoryItems.end();
-        --endIt;
-        feeCacheItem mostRecentItem = *endIt;
-        return mostRecentItem.second;
+    LOCK(cs_items);
+    std::map<uint32_t, feeCacheItem>::const_iterator it = mostRecentItems.find(propertyId);
+    if (it != mostRecentItems.end()) {
+        return it->second.second;
     } else {
         return 0; // property has never generated a fee
     }
 }
 
+// Loads the most recent cache entry of every property
+void CTokenFeeCache::LoadMostRecentItems()
+{
+    assert(pdb);
+    std::map<uint32_t, feeCacheItem> items;
+
+    const std::string prefix(1, CACHE_ENTRY_PREFIX);
+    leveldb::Iterator* it = NewIterator();
+    for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+        if (it->key().size() != SHORT_KEY_SIZE) continue;
+        uint32_t propertyId = ReadKeyBE32(it->key(), 1);
+        int block = ReadKeyBE32(it->key(), 5);
+        int64_t amount = boost::lexical_cast<int64_t>(it->value().ToString());
+        // entries of a property are ordered by block, so the last one is the most recent
+        items[propertyId] = std::make_pair(block, amount);
+    }
+    delete it;
+
+    LOCK(cs_items);
+    mostRecentItems.swap(items);
+}
+
+// Replaces the cache entry of a property for a block
+void CTokenFeeCache::WriteCacheItem(const uint32_t &propertyId, int block, int64_t amount)
+{
+    assert(pdb);
+    leveldb::WriteBatch batch;
+    batch.Put(CacheEntryKey(propertyId, block), strprintf("%d", amount));
+    batch.Put(CacheBlockKey(block, propertyId), "");
+    leveldb::Status status = pdb->Write(writeoptions, &batch);
+    assert(status.ok());
+    ++nWritten;
+
+    LOCK(cs_items);
+    std::map<uint32_t, feeCacheItem>::iterator it = mostRecentItems.find(propertyId);
+    if (it == mostRecentItems.end() || it->second.first <= block) {
+        mostRecentItems[propertyId] = std::make_pair(block, amount);
+    }
+}
+
 // Zeros a property in the fee cache
 void CTokenFeeCache::ClearCache(const uint32_t &propertyId, int block)
 {
     if (msc_debug_fees) PrintToLog("ClearCache starting (block %d, property ID %d)...\n", block, propertyId);
-    const std::string key = strprintf("%010d", propertyId);
-    std::set<feeCacheItem> sCacheHistoryItems = GetCacheHistory(propertyId);
-    if (msc_debug_fees) PrintToLog("   Iterating cache history (%d items)...\n",sCacheHistoryItems.size());
-    std::string newValue;
-    if (!sCacheHistoryItems.empty()) {
-        for (std::set<feeCacheItem>::iterator it = sCacheHistoryItems.begin(); it != sCacheHistoryItems.end(); it++) {
-            feeCacheItem tempItem = *it;
-            if (tempItem.first == block) continue;
-            if (!newValue.empty()) newValue += ",";
-            newValue += strprintf("%d:%d", tempItem.first, tempItem.second);
-            if (msc_debug_fees) PrintToLog("      Readding entry: block %d amount %d\n", tempItem.first, tempItem.second);
-        }
-        if (!newValue.empty()) newValue += ",";
-    }
     if (msc_debug_fees) PrintToLog("   Adding zero valued entry: block %d\n", block);
-    newValue += strprintf("%d:%d", block, 0);
-    leveldb::Status status = pdb->Put(writeoptions, key, newValue);
-    assert(status.ok());
-    ++nWritten;
+    WriteCacheItem(propertyId, block, 0);
 
     PruneCache(propertyId, block);
 
-    if (msc_debug_fees) PrintToLog("Cleared cache for property %d block %d [%s]\n", propertyId, block, status.ToString());
+    if (msc_debug_fees) PrintToLog("Cleared cache for property %d block %d\n", propertyId, block);
 }
 
 // Adds a fee to the cache (eg on a completed trade)
@@ -127,26 +248,10 @@ void CTokenFeeCache::AddFee(const uint32_t &propertyId, int block, const int64_t
     int64_t newCachedAmount = currentCachedAmount + amount;
 
     if (msc_debug_fees) PrintToLog("   New cached amount %d\n", newCachedAmount);
-    const std::string key = strprintf("%010d", propertyId);
-    std::set<feeCacheItem> sCacheHistoryItems = GetCacheHistory(propertyId);
-    if (msc_debug_fees) PrintToLog("   Iterating cache history (%d items)...\n",sCacheHistoryItems.size());
-    std::string newValue;
-    if (!sCacheHistoryItems.empty()) {
-        for (std::set<feeCacheItem>::iterator it = sCacheHistoryItems.begin(); it != sCacheHistoryItems.end(); it++) {
-            feeCacheItem tempItem = *it;
-            if (tempItem.first == block) continue; // this is an older entry for the same block, discard it
-            if (!newValue.empty()) newValue += ",";
-            newValue += strprintf("%d:%d", tempItem.first, tempItem.second);
-            if (msc_debug_fees) PrintToLog("      Readding entry: block %d amount %d\n", tempItem.first, tempItem.second);
-        }
-        if (!newValue.empty()) newValue += ",";
-    }
+    // an older entry for the same block is replaced
     if (msc_debug_fees) PrintToLog("   Adding requested entry: block %d new amount %d\n", block, newCachedAmount);
-    newValue += strprintf("%d:%d", block, newCachedAmount);
-    leveldb::Status status = pdb->Put(writeoptions, key, newValue);
-    assert(status.ok());
-    ++nWritten;
-    if (msc_debug_fees) PrintToLog("AddFee completed for property %d (new=%s [%s])\n", propertyId, newValue, status.ToString());
+    WriteCacheItem(propertyId, block, newCachedAmount);
+    if (msc_debug_fees) PrintToLog("AddFee completed for property %d (new=%d)\n", propertyId, newCachedAmount);
 
     // Call for pruning (we only prune when we update a record)
     PruneCache(propertyId, block);
@@ -161,28 +266,42 @@ void CTokenFeeCache::AddFee(const uint32_t &propertyId, int block, const int64_t
 void CTokenFeeCache::RollBackCache(int block)
 {
     assert(pdb);
-    for (uint8_t ecosystem = 1; ecosystem <= 2; ecosystem++) {
-        uint32_t startPropertyId = (ecosystem == 1) ? 1 : TEST_ECO_PROPERTY_1;
-        for (uint32_t propertyId = startPropertyId; propertyId < mastercore::pDbSpInfo->peekNextSPID(ecosystem); propertyId++) {
-            const std::string key = strprintf("%010d", propertyId);
-            std::set<feeCacheItem> sCacheHistoryItems = GetCacheHistory(propertyId);
-            if (!sCacheHistoryItems.empty()) {
-                std::set<feeCacheItem>::iterator mostRecentIt = sCacheHistoryItems.end();
-                std::string newValue;
-                --mostRecentIt;
-                feeCacheItem mostRecentItem = *mostRecentIt;
-                if (mostRecentItem.first < block) continue; // all entries are unaffected by this rollback, nothing to do
-                for (std::set<feeCacheItem>::iterator it = sCacheHistoryItems.begin(); it != sCacheHistoryItems.end(); it++) {
-                    feeCacheItem tempItem = *it;
-                    if (tempItem.first >= block) continue; // discard this entry
-                    if (!newValue.empty()) newValue += ",";
-                    newValue += strprintf("%d:%d", tempItem.first, tempItem.second);
-                }
-                leveldb::Status status = pdb->Put(writeoptions, key, newValue);
-                assert(status.ok());
-                PrintToLog("Rolling back fee cache for property %d, new=%s [%s])\n", propertyId, newValue, status.ToString());
+
+    std::set<uint32_t> sProperties;
+    leveldb::WriteBatch batch;
+
+    std::string startKey(1, CACHE_BLOCK_PREFIX);
+    AppendBE32(startKey, block);
+    const std::string prefix(1, CACHE_BLOCK_PREFIX);
+
+    leveldb::Iterator* it = NewIterator();
+    for (it->Seek(startKey); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+        if (it->key().size() != SHORT_KEY_SIZE) continue;
+        int entryBlock = ReadKeyBE32(it->key(), 1);
+        uint32_t propertyId = ReadKeyBE32(it->key(), 5);
+        batch.Delete(CacheEntryKey(propertyId, entryBlock));
+        batch.Delete(it->key());
+        sProperties.insert(propertyId);
+    }
+    delete it;
+
+    if (sProperties.empty()) return; // all entries are unaffected by this rollback, nothing to do
+
+    leveldb::Status status = pdb->Write(writeoptions, &batch);
+    assert(status.ok());
+
+    for (std::set<uint32_t>::iterator it = sProperties.begin(); it != sProperties.end(); ++it) {
+        const uint32_t propertyId = *it;
+        std::set<feeCacheItem> sCacheHistoryItems = GetCacheHistory(propertyId);
+        {
+            LOCK(cs_items);
+            if (sCacheHistoryItems.empty()) {
+                mostRecentItems.erase(propertyId);
+            } else {
+                mostRecentItems[propertyId] = *sCacheHistoryItems.rbegin();
             }
         }
+        PrintToLog("Rolling back fee cache for property %d, new=%d [%s])\n", propertyId, GetCachedAmount(propertyId), status.ToString());
     }
 }
 
@@ -245,43 +364,34 @@ void CTokenFeeCache::PruneCache(const uint32_t &propertyId, int block)
 
     int pruneBlock = block - MAX_STATE_HISTORY;
     if (msc_debug_fees) PrintToLog("Removing entries prior to block %d...\n", pruneBlock);
-    const std::string key = strprintf("%010d", propertyId);
-    std::set<feeCacheItem> sCacheHistoryItems = GetCacheHistory(propertyId);
-    if (msc_debug_fees) PrintToLog("   Iterating cache history (%d items)...\n",sCacheHistoryItems.size());
-    if (!sCacheHistoryItems.empty()) {
-        std::set<feeCacheItem>::iterator startIt = sCacheHistoryItems.begin();
-        feeCacheItem firstItem = *startIt;
-        if (firstItem.first >= pruneBlock) {
-            if (msc_debug_fees) PrintToLog("Endingg PruneCache - no matured entries found.\n");
-            return; // all entries are above supplied block value, nothing to do
-        }
-        std::string newValue;
-        for (std::set<feeCacheItem>::iterator it = sCacheHistoryItems.begin(); it != sCacheHistoryItems.end(); it++) {
-            feeCacheItem tempItem = *it;
-            if (tempItem.first < pruneBlock) {
-                if (msc_debug_fees) {
-                    PrintToLog("      Skipping matured entry: block %d amount %d\n", tempItem.first, tempItem.second);
-                    continue; // discard this entry
-                }
-            }
-            if (!newValue.empty()) newValue += ",";
-            newValue += strprintf("%d:%d", tempItem.first, tempItem.second);
-            if (msc_debug_fees) PrintToLog("      Readding immature entry: block %d amount %d\n", tempItem.first, tempItem.second);
-        }
-        // make sure the pruned cache isn't completely empty, if it is, prune down to just the most recent entry
-        if (newValue.empty()) {
-            std::set<feeCacheItem>::iterator mostRecentIt = sCacheHistoryItems.end();
-            --mostRecentIt;
-            feeCacheItem mostRecentItem = *mostRecentIt;
-            newValue = strprintf("%d:%d", mostRecentItem.first, mostRecentItem.second);
-            if (msc_debug_fees) PrintToLog("   All entries matured and pruned - readding most recent entry: block %d amount %d\n", mostRecentItem.first, mostRecentItem.second);
-        }
-        leveldb::Status status = pdb->Put(writeoptions, key, newValue);
-        assert(status.ok());
-        if (msc_debug_fees) PrintToLog("PruneCache completed for property %d (new=%s [%s])\n", propertyId, newValue, status.ToString());
-    } else {
-        return; // nothing to do
+
+    std::vector<int> vMaturedBlocks;
+    const std::string prefix = CacheEntryPrefix(propertyId);
+    leveldb::Iterator* it = NewIterator();
+    for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+        if (it->key().size() != SHORT_KEY_SIZE) continue;
+        int entryBlock = ReadKeyBE32(it->key(), 5);
+        if (entryBlock >= pruneBlock) break; // entries are ordered by block
+        vMaturedBlocks.push_back(entryBlock);
+    }
+    delete it;
+
+    // the most recent matured entry is still in effect at the prune block, so it is kept
+    if (vMaturedBlocks.size() < 2) {
+        if (msc_debug_fees) PrintToLog("Ending PruneCache - no matured entries found.\n");
+        return;
+    }
+    vMaturedBlocks.pop_back();
+
+    leveldb::WriteBatch batch;
+    for (std::vector<int>::const_iterator it = vMaturedBlocks.begin(); it != vMaturedBlocks.end(); ++it) {
+        if (msc_debug_fees) PrintToLog("      Removing matured entry: block %d\n", *it);
+        batch.Delete(CacheEntryKey(propertyId, *it));
+        batch.Delete(CacheBlockKey(*it, propertyId));
     }
+    leveldb::Status status = pdb->Write(writeoptions, &batch);
+    assert(status.ok());
+    if (msc_debug_fees) PrintToLog("PruneCache completed for property %d (removed %d entries [%s])\n", propertyId, vMaturedBlocks.size(), status.ToString());
 }
 
 // Show Fee Cache DB statistics
@@ -294,50 +404,102 @@ void CTokenFeeCache::printStats()
 void CTokenFeeCache::printAll()
 {
     int count = 0;
+    const std::string prefix(1, CACHE_ENTRY_PREFIX);
     leveldb::Iterator* it = NewIterator();
-    for(it->SeekToFirst(); it->Valid(); it->Next()) {
+    for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+        if (it->key().size() != SHORT_KEY_SIZE) continue;
         ++count;
-        PrintToConsole("entry #%8d= %s:%s\n", count, it->key().ToString(), it->value().ToString());
+        PrintToConsole("entry #%8d= %d:%d:%s\n", count, ReadKeyBE32(it->key(), 1), ReadKeyBE32(it->key(), 5), it->value().ToString());
     }
     delete it;
 }
 
+// Deletes all entries of the database, and the in-memory cache
+void CTokenFeeCache::Clear()
+{
+    CDBBase::Clear();
+    LOCK(cs_items);
+    mostRecentItems.clear();
+}
+
+/**
+ * Converts the cache entries of previous versions, which were stored as list of
+ * "block:amount" pairs under the zero-padded property identifier, into one entry
+ * per property and block, and adds the secondary keys.
+ *
+ * @return True, if the entries were converted
+ */
+bool CTokenFeeCache::buildIndexes()
+{
+    if (!pdb) return false;
+
+    PrintToConsole("Indexing fee cache database by property and block..\n");
+
+    unsigned int n = 0;
+    leveldb::WriteBatch batch;
+    leveldb::Iterator* it = NewIterator();
+
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        const std::string strKey = it->key().ToString();
+        if (!IsNumericKey(strKey)) continue;
+        uint32_t propertyId = boost::lexical_cast<uint32_t>(strKey);
+
+        const std::string strValue = it->value().ToString();
+        std::vector<std::string> vCacheHistoryItems;
+        boost::split(vCacheHistoryItems, strValue, boost::is_any_of(","), boost::token_compress_on);
+        for (std::vector<std::string>::iterator itItem = vCacheHistoryItems.begin(); itItem != vCacheHistoryItems.end(); ++itItem) {
+            std::vector<std::string> vCacheHistoryItem;
+            boost::split(vCacheHistoryItem, *itItem, boost::is_any_of(":"), boost::token_compress_on);
+            if (2 != vCacheHistoryItem.size()) continue;
+            int cacheItemBlock = boost::lexical_cast<int>(vCacheHistoryItem[0]);
+            int64_t cacheItemAmount = boost::lexical_cast<int64_t>(vCacheHistoryItem[1]);
+            batch.Put(CacheEntryKey(propertyId, cacheItemBlock), strprintf("%d", cacheItemAmount));
+            batch.Put(CacheBlockKey(cacheItemBlock, propertyId), "");
+            ++n;
+        }
+        batch.Delete(it->key());
+    }
+
+    delete it;
+
+    leveldb::Status status = pdb->Write(syncoptions, &batch);
+    if (!status.ok()) {
+        PrintToLog("%s(): ERROR: failed to index database: %s\n", __func__, status.ToString());
+        return false;
+    }
+
+    PrintToLog("%s(): converted %d cache entries\n", __func__, n);
+
+    LoadMostRecentItems();
+
+    return true;
+}
+
 // Return a set containing fee cache history items
 std::set<feeCacheItem> CTokenFeeCache::GetCacheHistory(const uint32_t &propertyId)
 {
     assert(pdb);
 
-    const std::string key = strprintf("%010d", propertyId);
-
     std::set<feeCacheItem> sCacheHistoryItems;
-    std::string strValue;
-    leveldb::Status status = pdb->Get(readoptions, key, &strValue);
-    if (status.IsNotFound()) {
-        return sCacheHistoryItems; // no cache, return empty set
-    }
-    assert(status.ok());
-    std::vector<std::string> vCacheHistoryItems;
-    boost::split(vCacheHistoryItems, strValue, boost::is_any_of(","), boost::token_compress_on);
-    for (std::vector<std::string>::iterator it = vCacheHistoryItems.begin(); it != vCacheHistoryItems.end(); ++it) {
-        std::vector<std::string> vCacheHistoryItem;
-        boost::split(vCacheHistoryItem, *it, boost::is_any_of(":"), boost::token_compress_on);
-        if (2 != vCacheHistoryItem.size()) {
-            PrintToConsole("ERROR: vCacheHistoryItem has unexpected number of elements: %d (raw %s)!\n", vCacheHistoryItem.size(), *it);
-            printAll();
-            continue;
-        }
-        int64_t cacheItemBlock = boost::lexical_cast<int64_t>(vCacheHistoryItem[0]);
-        int64_t cacheItemAmount = boost::lexical_cast<int64_t>(vCacheHistoryItem[1]);
+    const std::string prefix = CacheEntryPrefix(propertyId);
+    leveldb::Iterator* it = NewIterator();
+    for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+        if (it->key().size() != SHORT_KEY_SIZE) continue;
+        int cacheItemBlock = ReadKeyBE32(it->key(), 5);
+        int64_t cacheItemAmount = boost::lexical_cast<int64_t>(it->value().ToString());
         sCacheHistoryItems.insert(std::make_pair(cacheItemBlock, cacheItemAmount));
+        ++nRead;
     }
+    delete it;
 
     return sCacheHistoryItems;
 }
 
-CTokenFeeHistory::CTokenFeeHistory(const boost::filesystem::path& path, bool fWipe)
+CTokenFeeHistory::CTokenFeeHistory(const boost::filesystem::path& path, bool fWipe) : nRecords(0)
 {
     leveldb::Status status = Open(path, fWipe);
     PrintToConsole("Loading fee history database: %s\n", status.ToString());
+    if (status.ok()) LoadRecordCount();
 }
 
 CTokenFeeHistory::~CTokenFeeHistory()
@@ -357,6 +519,7 @@ void CTokenFeeHistory::printAll()
     int count = 0;
     leveldb::Iterator* it = NewIterator();
     for(it->SeekToFirst(); it->Valid(); it->Next()) {
+        if (!IsNumericKey(it->key().ToString())) continue; // secondary key
         ++count;
         PrintToConsole("entry #%8d= %s-%s\n", count, it->key().ToString(), it->value().ToString());
         PrintToLog("entry #%8d= %s-%s\n", count, it->key().ToString(), it->value().ToString());
@@ -367,14 +530,85 @@ void CTokenFeeHistory::printAll()
 // Count Fee History DB records
 int CTokenFeeHistory::CountRecords()
 {
-    // No faster way to count than to iterate - "There is no way to implement Count more efficiently inside leveldb than outside."
-    int count = 0;
+    return nRecords;
+}
+
+/**
+ * Loads the number of fee distributions.
+ *
+ * Distributions are numbered consecutively, and rollbacks only remove the most
+ * recent ones, so the highest identifier, which is part of the last secondary
+ * key ordered by block, is the number of distributions.
+ */
+void CTokenFeeHistory::LoadRecordCount()
+{
+    assert(pdb);
+    nRecords = 0;
+
     leveldb::Iterator* it = NewIterator();
-    for(it->SeekToFirst(); it->Valid(); it->Next()) {
-        ++count;
+    // seek to the first key after the block index, and step back
+    it->Seek(std::string(1, HISTORY_BLOCK_PREFIX + 1));
+    if (it->Valid()) {
+        it->Prev();
+    } else {
+        it->SeekToLast();
+    }
+    if (it->Valid() && it->key().size() == SHORT_KEY_SIZE && it->key()[0] == HISTORY_BLOCK_PREFIX) {
+        nRecords = ReadKeyBE32(it->key(), 5);
     }
     delete it;
-    return count;
+}
+
+// Deletes all entries of the database
+void CTokenFeeHistory::Clear()
+{
+    CDBBase::Clear();
+    nRecords = 0;
+}
+
+/**
+ * Adds the secondary keys, which order fee distributions by property and block,
+ * and by block, for every fee distribution.
+ *
+ * Used to upgrade databases of previous versions, which lack the secondary keys.
+ *
+ * @return True, if the secondary keys were added
+ */
+bool CTokenFeeHistory::buildIndexes()
+{
+    if (!pdb) return false;
+
+    PrintToConsole("Indexing fee history database by property and block..\n");
+
+    unsigned int n = 0;
+    leveldb::WriteBatch batch;
+    leveldb::Iterator* it = NewIterator();
+
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        const std::string strKey = it->key().ToString();
+        if (!IsNumericKey(strKey)) continue; // secondary key
+        int block = 0;
+        uint32_t propertyId = 0;
+        if (!ParseDistribution(it->value().ToString(), block, propertyId)) continue;
+        int id = boost::lexical_cast<int>(strKey);
+        batch.Put(HistoryPropertyKey(propertyId, block, id), "");
+        batch.Put(HistoryBlockKey(block, id), "");
+        ++n;
+    }
+
+    delete it;
+
+    leveldb::Status status = pdb->Write(syncoptions, &batch);
+    if (!status.ok()) {
+        PrintToLog("%s(): ERROR: failed to index database: %s\n", __func__, status.ToString());
+        return false;
+    }
+
+    PrintToLog("%s(): added secondary keys for %d fee distributions\n", __func__, n);
+
+    LoadRecordCount();
+
+    return true;
 }
 
 // Roll back history in event of reorg, block is inclusive
@@ -382,24 +616,41 @@ void CTokenFeeHistory::RollBackHistory(int block)
 {
     assert(pdb);
 
-    std::set<int> sDistributions;
+    unsigned int n = 0;
+    leveldb::WriteBatch batch;
+
+    std::string startKey(1, HISTORY_BLOCK_PREFIX);
+    AppendBE32(startKey, block);
+    const std::string prefix(1, HISTORY_BLOCK_PREFIX);
+
     leveldb::Iterator* it = NewIterator();
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        std::string strValue = it->value().ToString();
-        std::string strKey = it->key().ToString();
-        std::vector<std::string> vFeeHistoryDetail;
-        boost::split(vFeeHistoryDetail, strValue, boost::is_any_of(":"), boost::token_compress_on);
-        if (4 != vFeeHistoryDetail.size()) {
-            PrintToLog("ERROR: vFeeHistoryDetail has unexpected number of elements: %d !\n", vFeeHistoryDetail.size());
-            continue; // bad data
-        }
-        int feeBlock = boost::lexical_cast<int>(vFeeHistoryDetail[0]);
-        if (feeBlock >= block) {
-            PrintToLog("%s() deleting from fee history DB: %s %s\n", __FUNCTION__, strKey, strValue);
-            pdb->Delete(writeoptions, strKey);
+    for (it->Seek(startKey); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+        if (it->key().size() != SHORT_KEY_SIZE) continue;
+        int feeBlock = ReadKeyBE32(it->key(), 1);
+        int id = ReadKeyBE32(it->key(), 5);
+        const std::string strKey = strprintf("%d", id);
+        std::string strValue;
+        int recordBlock = 0;
+        uint32_t propertyId = 0;
+        leveldb::Status status = pdb->Get(readoptions, strKey, &strValue);
+        if (status.ok() && ParseDistribution(strValue, recordBlock, propertyId)) {
+            batch.Delete(HistoryPropertyKey(propertyId, feeBlock, id));
         }
+        PrintToLog("%s() deleting from fee history DB: %s %s\n", __FUNCTION__, strKey, strValue);
+        batch.Delete(strKey);
+        batch.Delete(it->key());
+        ++n;
     }
     delete it;
+
+    if (n == 0) return;
+
+    leveldb::Status status = pdb->Write(writeoptions, &batch);
+    if (!status.ok()) {
+        PrintToLog("%s(): ERROR: failed to roll back fee history: %s\n", __func__, status.ToString());
+    }
+
+    LoadRecordCount();
 }
 
 // Retrieve fee distributions for a property
@@ -408,22 +659,11 @@ std::set<int> CTokenFeeHistory::GetDistributionsForProperty(const uint32_t &prop
     assert(pdb);
 
     std::set<int> sDistributions;
+    const std::string prefix = HistoryPropertyPrefix(propertyId);
     leveldb::Iterator* it = NewIterator();
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        std::string strValue = it->value().ToString();
-        std::vector<std::string> vFeeHistoryDetail;
-        boost::split(vFeeHistoryDetail, strValue, boost::is_any_of(":"), boost::token_compress_on);
-        if (4 != vFeeHistoryDetail.size()) {
-            PrintToConsole("ERROR: vFeeHistoryDetail has unexpected number of elements: %d !\n", vFeeHistoryDetail.size());
-            printAll();
-            continue; // bad data
-        }
-        uint32_t prop = boost::lexical_cast<uint32_t>(vFeeHistoryDetail[1]);
-        if (prop == propertyId) {
-            std::string key = it->key().ToString();
-            int id = boost::lexical_cast<int>(key);
-            sDistributions.insert(id);
-        }
+    for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+        if (it->key().size() != LONG_KEY_SIZE) continue;
+        sDistributions.insert(ReadKeyBE32(it->key(), 9));
     }
     delete it;
     return sDistributions;
@@ -496,8 +736,8 @@ void CTokenFeeHistory::RecordFeeDistribution(const uint32_t &propertyId, int blo
 {
     assert(pdb);
 
-    int count = CountRecords() + 1;
-    std::string key = strprintf("%d", count);
+    int id = nRecords + 1;
+    std::string key = strprintf("%d", id);
     std::string feeRecipientsStr;
 
     if (!feeRecipients.empty()) {
@@ -511,7 +751,15 @@ void CTokenFeeHistory::RecordFeeDistribution(const uint32_t &propertyId, int blo
     }
 
     std::string value = strprintf("%d:%d:%d:%s", block, propertyId, total, feeRecipientsStr);
-    leveldb::Status status = pdb->Put(writeoptions, key, value);
+    leveldb::WriteBatch batch;
+    batch.Put(key, value);
+    batch.Put(HistoryPropertyKey(propertyId, block, id), "");
+    batch.Put(HistoryBlockKey(block, id), "");
+    leveldb::Status status = pdb->Write(writeoptions, &batch);
+    if (status.ok()) {
+        nRecords = id;
+        ++nWritten;
+    }
     if (msc_debug_fees) PrintToLog("Added fee distribution to feeCacheHistory - key=%s value=%s [%s]\n", key, value, status.ToString());
 }
 
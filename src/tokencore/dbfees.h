@@ -4,9 +4,12 @@
 #include "tokencore/dbbase.h"
 #include "tokencore/log.h"
 
+#include "sync.h"
+
 #include <boost/filesystem.hpp>
 
 #include <stdint.h>
+#include <map>
 #include <set>
 #include <string>
 #include <utility>
@@ -15,9 +18,24 @@ typedef std::pair<int, int64_t> feeCacheItem;
 typedef std::pair<std::string, int64_t> feeHistoryItem;
 
 /** LevelDB based storage for the MetaDEx fee cache.
+ *
+ * Cache entries are stored per property and block, with keys ordered by property
+ * and block, and indexed by block, so pruning and rollbacks are range deletes.
+ * The most recent entry of every property is kept in memory.
  */
 class CTokenFeeCache : public CDBBase
 {
+private:
+    //! Guards the most recent cache entries, which are also read by RPC calls
+    Mutex cs_items;
+    //! Most recent cache entry of every property
+    std::map<uint32_t, feeCacheItem> mostRecentItems;
+
+    /** Loads the most recent cache entry of every property */
+    void LoadMostRecentItems();
+    /** Replaces the cache entry of a property for a block */
+    void WriteCacheItem(const uint32_t &propertyId, int block, int64_t amount);
+
 public:
     CTokenFeeCache(const boost::filesystem::path& path, bool fWipe);
     virtual ~CTokenFeeCache();
@@ -26,6 +44,10 @@ public:
     void printStats();
     /** Show Fee Cache DB records */
     void printAll();
+    /** Deletes all entries of the database, and the in-memory cache */
+    void Clear();
+    /** Converts cache entries of previous versions, which were stored as one list per property */
+    bool buildIndexes();
 
     /** Sets the distribution thresholds to total tokens for a property / TOKEN_FEE_THRESHOLD */
     void UpdateDistributionThresholds(uint32_t propertyId);
@@ -49,10 +71,19 @@ public:
     void DistributeCache(const uint32_t &propertyId, int block);
 };
 
-/** LevelDB based storage for the MetaDEx fee distributions.
+/** LevelDB based storage for the MetaDEx fee distributions. Distributions are listed with key "id".
+ *
+ * Distributions are additionally indexed by property and block, and by block.
  */
 class CTokenFeeHistory : public CDBBase
 {
+private:
+    //! Number of fee distributions, which is also the highest identifier
+    int nRecords;
+
+    /** Loads the number of fee distributions */
+    void LoadRecordCount();
+
 public:
     CTokenFeeHistory(const boost::filesystem::path& path, bool fWipe);
     virtual ~CTokenFeeHistory();
@@ -61,6 +92,10 @@ public:
     void printStats();
     /** Show Fee History DB records */
     void printAll();
+    /** Deletes all entries of the database */
+    void Clear();
+    /** Adds the secondary keys for every fee distribution */
+    bool buildIndexes();
 
     /** Roll back history in event of reorg */
     void RollBackHistory(int block);
@@ -85,7 +85,7 @@ std::string CMPSPInfo::Entry::getIssuer(int block) const
     return _issuer;
 }
 
-CMPSPInfo::CMPSPInfo(const boost::filesystem::path& path, bool fWipe)
+CMPSPInfo::CMPSPInfo(const boost::filesystem::path& path, bool fWipe) : ticker_cache_generation(0)
 {
     leveldb::Status status = Open(path, fWipe);
     PrintToConsole("Loading smart property database: %s\n", status.ToString());
@@ -125,6 +125,11 @@ void CMPSPInfo::Clear()
 {
     // wipe database via parent class
     CDBBase::Clear();
+    {
+        LOCK(cs_ticker_cache);
+        ticker_cache.clear();
+        ++ticker_cache_generation;
+    }
     // reset "next property identifiers"
     init();
 }
@@ -267,6 +272,12 @@ uint32_t CMPSPInfo::putSP(uint8_t ecosystem, const Entry& info)
 
     leveldb::Status status = pdb->Write(syncoptions, &batch);
 
+    {
+        LOCK(cs_ticker_cache);
+        ticker_cache.erase(info.ticker);
+        ++ticker_cache_generation;
+    }
+
     if (!status.ok()) {
         PrintToLog("%s(): ERROR for SP %d: %s\n", __func__, propertyId, status.ToString());
     }
@@ -358,7 +369,36 @@ uint32_t CMPSPInfo::findSPByTX(const uint256& txid) const
     return propertyId;
 }
 
+/**
+ * Looks up the property identifier of a ticker.
+ *
+ * Results, including unknown tickers, are cached in memory, and the cache is
+ * invalidated, whenever the ticker index changes.
+ */
 uint32_t CMPSPInfo::findSPByTicker(const std::string& ticker) const
+{
+    uint64_t generation;
+    {
+        LOCK(cs_ticker_cache);
+        std::unordered_map<std::string, uint32_t>::const_iterator it = ticker_cache.find(ticker);
+        if (it != ticker_cache.end()) {
+            return it->second;
+        }
+        generation = ticker_cache_generation;
+    }
+
+    uint32_t propertyId = findSPByTickerInDB(ticker);
+
+    // don't cache the result, if the index changed in the meantime
+    LOCK(cs_ticker_cache);
+    if (generation == ticker_cache_generation) {
+        ticker_cache[ticker] = propertyId;
+    }
+
+    return propertyId;
+}
+
+uint32_t CMPSPInfo::findSPByTickerInDB(const std::string& ticker) const
 {
     uint32_t propertyId = 0;
 
@@ -463,6 +503,13 @@ int64_t CMPSPInfo::popBlock(const uint256& block_hash)
 
     leveldb::Status status = pdb->Write(syncoptions, &commitBatch);
 
+    {
+        // ticker index entries of rolled back properties may have been removed
+        LOCK(cs_ticker_cache);
+        ticker_cache.clear();
+        ++ticker_cache_generation;
+    }
+
     if (!status.ok()) {
         PrintToLog("%s(): ERROR: %s\n", __func__, status.ToString());
         return -4;
@@ -6,6 +6,7 @@
 #include "tokencore/tokencore.h"
 
 #include "serialize.h"
+#include "sync.h"
 #include "uint256.h"
 
 #include <boost/filesystem/path.hpp>
@@ -14,6 +15,7 @@
 
 #include <map>
 #include <string>
+#include <unordered_map>
 
 /** LevelDB based storage for currencies, smart properties and tokens.
  *
@@ -153,6 +155,15 @@ private:
     uint32_t next_spid;
     uint32_t next_test_spid;
 
+    //! Guards the ticker cache
+    mutable Mutex cs_ticker_cache;
+    //! Cache of the ticker index, including tickers without property
+    mutable std::unordered_map<std::string, uint32_t> ticker_cache;
+    //! Incremented, whenever the ticker cache is invalidated
+    uint64_t ticker_cache_generation;
+
+    uint32_t findSPByTickerInDB(const std::string& ticker) const;
+
 public:
     CMPSPInfo(const boost::filesystem::path& path, bool fWipe);
     virtual ~CMPSPInfo();
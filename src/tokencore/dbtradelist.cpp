@@ -5,6 +5,7 @@
 #include "tokencore/sp.h"
 
 #include "amount.h"
+#include "crypto/common.h"
 #include "uint256.h"
 #include "utilstrencodings.h"
 #include "tinyformat.h"
@@ -14,6 +15,7 @@
 #include "leveldb/iterator.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
+#include "leveldb/write_batch.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem/path.hpp>
@@ -22,13 +24,134 @@
 #include <stddef.h>
 
 #include <algorithm>
-#include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
 using mastercore::isPropertyDivisible;
 
+//! Prefix of the secondary keys, which order trades of an address by block height
+static const char ADDRESS_INDEX_PREFIX = 'A';
+//! Prefix of the secondary keys, which order matches of a pair by block height
+static const char PAIR_INDEX_PREFIX = 'P';
+//! Prefix of the secondary keys, which order all records by block height
+static const char BLOCK_INDEX_PREFIX = 'B';
+//! Length of the block index key prefix, including the block height
+static const size_t BLOCK_INDEX_PREFIX_SIZE = 5;
+
+static void AppendBE32(std::string& str, uint32_t n)
+{
+    unsigned char buf[4];
+    WriteBE32(buf, n);
+    str.append(reinterpret_cast<const char*>(buf), sizeof(buf));
+}
+
+/**
+ * Returns the prefix of the secondary keys of an address.
+ *
+ * Addresses never contain ":", so the separator ensures that the prefix of an
+ * address doesn't match the keys of another address, which starts with it.
+ */
+static std::string AddressIndexPrefix(const std::string& address)
+{
+    return std::string(1, ADDRESS_INDEX_PREFIX) + address + ":";
+}
+
+/**
+ * Returns the secondary key of a new trade, formed by the address prefix, the
+ * big-endian block height, the big-endian position in the block and the txid.
+ */
+static std::string AddressIndexKey(const std::string& address, int nBlock, int nBlockIndex, const std::string& key)
+{
+    std::string indexKey = AddressIndexPrefix(address);
+    AppendBE32(indexKey, nBlock);
+    AppendBE32(indexKey, nBlockIndex);
+    indexKey.append(key);
+    return indexKey;
+}
+
+/**
+ * Returns the prefix of the secondary keys of a pair.
+ *
+ * The property identifiers are ordered, so both sides of a pair share one prefix.
+ */
+static std::string PairIndexPrefix(uint32_t propertyIdA, uint32_t propertyIdB)
+{
+    std::string indexKey(1, PAIR_INDEX_PREFIX);
+    AppendBE32(indexKey, std::min(propertyIdA, propertyIdB));
+    AppendBE32(indexKey, std::max(propertyIdA, propertyIdB));
+    return indexKey;
+}
+
+/**
+ * Returns the secondary key of a matched trade, formed by the pair prefix, the
+ * big-endian block height and the primary key "txid1+txid2".
+ */
+static std::string PairIndexKey(uint32_t propertyIdA, uint32_t propertyIdB, int nBlock, const std::string& key)
+{
+    std::string indexKey = PairIndexPrefix(propertyIdA, propertyIdB);
+    AppendBE32(indexKey, nBlock);
+    indexKey.append(key);
+    return indexKey;
+}
+
+/**
+ * Returns the secondary key of a record, formed by the prefix, the big-endian
+ * block height and the primary key, which is used to roll back records.
+ */
+static std::string BlockIndexKey(int nBlock, const std::string& key = "")
+{
+    std::string indexKey(1, BLOCK_INDEX_PREFIX);
+    AppendBE32(indexKey, nBlock);
+    indexKey.append(key);
+    return indexKey;
+}
+
+/** Checks, whether the key is a secondary key. The value of secondary keys is empty. */
+static bool IsIndexKey(const leveldb::Slice& key)
+{
+    if (key.empty()) return false;
+    return key[0] == ADDRESS_INDEX_PREFIX || key[0] == PAIR_INDEX_PREFIX || key[0] == BLOCK_INDEX_PREFIX;
+}
+
+/**
+ * Returns the secondary keys of a trade record.
+ *
+ * New trades are indexed by address and block, matched trades by pair and block.
+ */
+static std::vector<std::string> GetIndexKeys(const std::string& key, const std::string& value)
+{
+    std::vector<std::string> vKeys;
+    std::vector<std::string> vstr;
+    boost::split(vstr, value, boost::is_any_of(":"), boost::token_compress_on);
+
+    if (129 == key.size() && 8 == vstr.size()) {
+        uint32_t prop1 = boost::lexical_cast<uint32_t>(vstr[2]);
+        uint32_t prop2 = boost::lexical_cast<uint32_t>(vstr[3]);
+        int block = atoi(vstr[6]);
+        vKeys.push_back(PairIndexKey(prop1, prop2, block, key));
+        vKeys.push_back(BlockIndexKey(block, key));
+    }
+    if (64 == key.size() && 5 == vstr.size()) {
+        int block = atoi(vstr[3]);
+        int blockIndex = atoi(vstr[4]);
+        vKeys.push_back(AddressIndexKey(vstr[0], block, blockIndex, key));
+        vKeys.push_back(BlockIndexKey(block, key));
+    }
+
+    return vKeys;
+}
+
+/** Adds a trade record and its secondary keys to the batch. */
+static void PutTradeRecord(leveldb::WriteBatch& batch, const std::string& key, const std::string& value)
+{
+    batch.Put(key, value);
+    std::vector<std::string> vKeys = GetIndexKeys(key, value);
+    for (std::vector<std::string>::const_iterator it = vKeys.begin(); it != vKeys.end(); ++it) {
+        batch.Put(*it, "");
+    }
+}
+
 CMPTradeList::CMPTradeList(const boost::filesystem::path& path, bool fWipe)
 {
     leveldb::Status status = Open(path, fWipe);
@@ -45,7 +168,9 @@ void CMPTradeList::recordMatchedTrade(const uint256& txid1, const uint256& txid2
     if (!pdb) return;
     const std::string key = txid1.ToString() + "+" + txid2.ToString();
     const std::string value = strprintf("%s:%s:%u:%u:%lu:%lu:%d:%d", address1, address2, prop1, prop2, amount1, amount2, blockNum, fee);
-    leveldb::Status status = pdb->Put(writeoptions, key, value);
+    leveldb::WriteBatch batch;
+    PutTradeRecord(batch, key, value);
+    leveldb::Status status = pdb->Write(writeoptions, &batch);
     ++nWritten;
     if (msc_debug_tradedb) PrintToLog("%s: %s\n", __func__, status.ToString());
 }
@@ -54,7 +179,9 @@ void CMPTradeList::recordNewTrade(const uint256& txid, const std::string& addres
 {
     if (!pdb) return;
     std::string strValue = strprintf("%s:%d:%d:%d:%d", address, propertyIdForSale, propertyIdDesired, blockNum, blockIndex);
-    leveldb::Status status = pdb->Put(writeoptions, txid.ToString(), strValue);
+    leveldb::WriteBatch batch;
+    PutTradeRecord(batch, txid.ToString(), strValue);
+    leveldb::Status status = pdb->Write(writeoptions, &batch);
     ++nWritten;
     if (msc_debug_tradedb) PrintToLog("%s: %s\n", __func__, status.ToString());
 }
@@ -62,38 +189,84 @@ void CMPTradeList::recordNewTrade(const uint256& txid, const std::string& addres
 /**
  * This function deletes records of trades above/equal to a specific block from the trade database.
  *
+ * The records are obtained with a range seek over the block index, and removed
+ * together with their secondary keys in one batch.
+ *
  * Returns the number of records changed.
  */
 int CMPTradeList::deleteAboveBlock(int blockNum)
 {
-    leveldb::Slice skey, svalue;
-    unsigned int count = 0;
-    std::vector<std::string> vstr;
-    int block = 0;
+    if (!pdb) return 0;
+
     unsigned int n_found = 0;
+    leveldb::WriteBatch batch;
     leveldb::Iterator* it = NewIterator();
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        skey = it->key();
-        svalue = it->value();
-        ++count;
-        std::string strvalue = it->value().ToString();
-        boost::split(vstr, strvalue, boost::is_any_of(":"), boost::token_compress_on);
-        if (7 == vstr.size()) block = atoi(vstr[6]); // trade matches have 7 tokens, key is txid+txid, only care about block
-        if (5 == vstr.size()) block = atoi(vstr[3]); // trades have 5 tokens, key is txid, only care about block
-        if (block >= blockNum) {
-            ++n_found;
-            PrintToLog("%s() DELETING FROM TRADEDB: %s=%s\n", __func__, skey.ToString(), svalue.ToString());
-            pdb->Delete(writeoptions, skey);
+    for (it->Seek(BlockIndexKey(blockNum)); it->Valid() && it->key()[0] == BLOCK_INDEX_PREFIX; it->Next()) {
+        std::string key(it->key().data() + BLOCK_INDEX_PREFIX_SIZE, it->key().size() - BLOCK_INDEX_PREFIX_SIZE);
+        std::string strValue;
+        batch.Delete(it->key());
+        if (!pdb->Get(readoptions, key, &strValue).ok()) continue;
+        ++nRead;
+        ++n_found;
+        PrintToLog("%s() DELETING FROM TRADEDB: %s=%s\n", __func__, key, strValue);
+        batch.Delete(key);
+        std::vector<std::string> vKeys = GetIndexKeys(key, strValue);
+        for (std::vector<std::string>::const_iterator kit = vKeys.begin(); kit != vKeys.end(); ++kit) {
+            batch.Delete(*kit);
         }
     }
-    
+
     delete it;
 
+    leveldb::Status status = pdb->Write(writeoptions, &batch);
+    if (!status.ok()) {
+        PrintToLog("%s(): ERROR: failed to delete records: %s\n", __func__, status.ToString());
+    }
+
     PrintToLog("%s(%d); tradedb n_found= %d\n", __func__, blockNum, n_found);
 
     return n_found;
 }
 
+/**
+ * Adds the secondary keys for every trade record.
+ *
+ * Used to upgrade databases, which were created before trades were indexed.
+ *
+ * @return True, if the secondary keys were added
+ */
+bool CMPTradeList::buildIndexes()
+{
+    if (!pdb) return false;
+
+    PrintToConsole("Indexing trades database..\n");
+
+    unsigned int n = 0;
+    leveldb::WriteBatch batch;
+    leveldb::Iterator* it = NewIterator();
+
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        if (IsIndexKey(it->key())) continue;
+        std::vector<std::string> vKeys = GetIndexKeys(it->key().ToString(), it->value().ToString());
+        for (std::vector<std::string>::const_iterator kit = vKeys.begin(); kit != vKeys.end(); ++kit) {
+            batch.Put(*kit, "");
+            ++n;
+        }
+    }
+
+    delete it;
+
+    leveldb::Status status = pdb->Write(syncoptions, &batch);
+    if (!status.ok()) {
+        PrintToLog("%s(): ERROR: failed to index database: %s\n", __func__, status.ToString());
+        return false;
+    }
+
+    PrintToLog("%s(): added %d secondary keys\n", __func__, n);
+
+    return true;
+}
+
 void CMPTradeList::printStats()
 {
     PrintToLog("CMPTradeList stats: tWritten= %d , tRead= %d\n", nWritten, nRead);
@@ -106,6 +279,7 @@ void CMPTradeList::printAll()
     leveldb::Iterator* it = NewIterator();
 
     for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        if (IsIndexKey(it->key())) continue;
         skey = it->key();
         svalue = it->value();
         ++count;
@@ -201,63 +375,67 @@ bool CMPTradeList::getMatchingTrades(const uint256& txid, uint32_t propertyId, U
 
 // obtains a vector of txids where the supplied address participated in a trade (needed for gettradehistory_MP)
 // optional property ID parameter will filter on propertyId transacted if supplied
-// sorted by block then index
+// sorted by block then index, as given by the order of the address index
 void CMPTradeList::getTradesForAddress(const std::string& address, std::vector<uint256>& vecTransactions, uint32_t propertyIdFilter)
 {
     if (!pdb) return;
 
-    std::map<std::string, uint256> mapTrades;
+    const std::string prefix = AddressIndexPrefix(address);
+    const size_t nKeyOffset = prefix.size() + 8;
     leveldb::Iterator* it = NewIterator();
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        std::string strKey = it->key().ToString();
-        std::string strValue = it->value().ToString();
-        std::vector<std::string> vecValues;
-        if (strKey.size() != 64) continue; // only interested in trades
-        uint256 txid = uint256S(strKey);
-        size_t addressMatch = strValue.find(address);
-        if (addressMatch == std::string::npos) continue;
-        boost::split(vecValues, strValue, boost::is_any_of(":"), boost::token_compress_on);
-        if (vecValues.size() != 5) {
-            PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
-            continue;
+    for (it->Seek(prefix); it->Valid() && it->key().starts_with(prefix); it->Next()) {
+        if (it->key().size() != nKeyOffset + 64) continue;
+        std::string strKey(it->key().data() + nKeyOffset, 64);
+        if (propertyIdFilter != 0) {
+            std::string strValue;
+            if (!pdb->Get(readoptions, strKey, &strValue).ok()) continue;
+            ++nRead;
+            std::vector<std::string> vecValues;
+            boost::split(vecValues, strValue, boost::is_any_of(":"), boost::token_compress_on);
+            if (vecValues.size() != 5) {
+                PrintToLog("TRADEDB error - unexpected number of tokens in value (%s)\n", strValue);
+                continue;
+            }
+            uint32_t propertyIdForSale = boost::lexical_cast<uint32_t>(vecValues[1]);
+            uint32_t propertyIdDesired = boost::lexical_cast<uint32_t>(vecValues[2]);
+            if (propertyIdFilter != propertyIdForSale && propertyIdFilter != propertyIdDesired) continue;
         }
-        uint32_t propertyIdForSale = boost::lexical_cast<uint32_t>(vecValues[1]);
-        uint32_t propertyIdDesired = boost::lexical_cast<uint32_t>(vecValues[2]);
-        int64_t blockNum = boost::lexical_cast<uint32_t>(vecValues[3]);
-        int64_t txIndex = boost::lexical_cast<uint32_t>(vecValues[4]);
-        if (propertyIdFilter != 0 && propertyIdFilter != propertyIdForSale && propertyIdFilter != propertyIdDesired) continue;
-        std::string sortKey = strprintf("%06d%010d", blockNum, txIndex);
-        mapTrades.insert(std::make_pair(sortKey, txid));
+        vecTransactions.push_back(uint256S(strKey));
     }
     delete it;
-
-    for (std::map<std::string, uint256>::iterator it = mapTrades.begin(); it != mapTrades.end(); it++) {
-        vecTransactions.push_back(it->second);
-    }
-}
-
-static bool CompareTradePair(const std::pair<int64_t, UniValue>& firstJSONObj, const std::pair<int64_t, UniValue>& secondJSONObj)
-{
-    return firstJSONObj.first > secondJSONObj.first;
 }
 
 // obtains an array of matching trades with pricing and volume details for a pair sorted by blocknumber
+// the pair index is seeked in reverse, so only the most recent trades, up to count, are read
 void CMPTradeList::getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyIdSideB, UniValue& responseArray, uint64_t count)
 {
     if (!pdb) return;
-    leveldb::Iterator* it = NewIterator();
-    std::vector<std::pair<int64_t, UniValue> > vecResponse;
+    const std::string prefix = PairIndexPrefix(propertyIdSideA, propertyIdSideB);
+    const size_t nKeyOffset = prefix.size() + 4;
+    std::vector<UniValue> vecResponse;
     bool propertyIdSideAIsDivisible = isPropertyDivisible(propertyIdSideA);
     bool propertyIdSideBIsDivisible = isPropertyDivisible(propertyIdSideB);
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        std::string strKey = it->key().ToString();
-        std::string strValue = it->value().ToString();
+
+    // primary keys are hex encoded, so every key of the pair is ordered before this one
+    leveldb::Iterator* it = NewIterator();
+    it->Seek(prefix + std::string(5, '\xff'));
+    if (it->Valid()) {
+        it->Prev();
+    } else {
+        it->SeekToLast();
+    }
+
+    for (; it->Valid() && it->key().starts_with(prefix); it->Prev()) {
+        if (it->key().size() != nKeyOffset + 129) continue;
+        std::string strKey(it->key().data() + nKeyOffset, 129);
+        std::string strValue;
+        if (!pdb->Get(readoptions, strKey, &strValue).ok()) continue;
+        ++nRead;
         std::vector<std::string> vecKeys;
         std::vector<std::string> vecValues;
         uint256 sellerTxid, matchingTxid;
         std::string sellerAddress, matchingAddress;
         int64_t amountReceived = 0, amountSold = 0;
-        if (strKey.size() != 129) continue; // only interested in matches
         boost::split(vecKeys, strKey, boost::is_any_of("+"), boost::token_compress_on);
         boost::split(vecValues, strValue, boost::is_any_of(":"), boost::token_compress_on);
         if (vecKeys.size() != 2 || vecValues.size() != 8) {
@@ -311,26 +489,16 @@ void CMPTradeList::getTradesForPair(uint32_t propertyIdSideA, uint32_t propertyI
         }
         trade.push_back(Pair("matchingtxid", matchingTxid.GetHex()));
         trade.push_back(Pair("matchingaddress", matchingAddress));
-        vecResponse.push_back(std::make_pair(blockNum, trade));
+        vecResponse.push_back(trade);
+        if (vecResponse.size() >= count) break;
     }
 
-    // sort the response most recent first before adding to the array
-    std::sort(vecResponse.begin(), vecResponse.end(), CompareTradePair);
-    uint64_t processed = 0;
-    for (std::vector<std::pair<int64_t, UniValue> >::iterator it = vecResponse.begin(); it != vecResponse.end(); ++it) {
-        responseArray.push_back(it->second);
-        processed++;
-        if (processed >= count) break;
-    }
+    delete it;
 
-    std::vector<UniValue> responseArrayValues = responseArray.getValues();
-    std::reverse(responseArrayValues.begin(), responseArrayValues.end());
-    responseArray.clear();
-    for (std::vector<UniValue>::iterator it = responseArrayValues.begin(); it != responseArrayValues.end(); ++it) {
-        responseArray.push_back(*it);
+    // the trades were collected most recent first, but are returned in ascending order
+    for (std::vector<UniValue>::reverse_iterator rit = vecResponse.rbegin(); rit != vecResponse.rend(); ++rit) {
+        responseArray.push_back(*rit);
     }
-
-    delete it;
 }
 
 int CMPTradeList::getMPTradeCountTotal()
@@ -338,6 +506,7 @@ int CMPTradeList::getMPTradeCountTotal()
     int count = 0;
     leveldb::Iterator* it = NewIterator();
     for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        if (IsIndexKey(it->key())) continue;
         ++count;
     }
     delete it;
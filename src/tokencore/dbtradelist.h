@@ -15,6 +15,9 @@
 #include <vector>
 
 /** LevelDB based storage for the MetaDEx trade history. Trades are listed with key "txid1+txid2".
+ *
+ * New trades are additionally indexed by address, matched trades by property pair,
+ * and all records by block height, with secondary keys ordered by block.
  */
 class CMPTradeList : public CDBBase
 {
@@ -25,6 +28,8 @@ public:
     void recordMatchedTrade(const uint256& txid1, const uint256& txid2, const std::string& address1, const std::string& address2, uint32_t prop1, uint32_t prop2, int64_t amount1, int64_t amount2, int blockNum, int64_t fee);
     void recordNewTrade(const uint256& txid, const std::string& address, uint32_t propertyIdForSale, uint32_t propertyIdDesired, int blockNum, int blockIndex);
     int deleteAboveBlock(int blockNum);
+    /** Adds the secondary keys for every trade record. */
+    bool buildIndexes();
     bool exists(const uint256 &txid);
     void printStats();
     void printAll();
@@ -11,6 +11,7 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "crypto/common.h"
 #include "main.h"
 #include "sync.h"
 #include "tinyformat.h"
@@ -21,6 +22,7 @@
 #include "leveldb/iterator.h"
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
+#include "leveldb/write_batch.h"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/exception/to_string.hpp>
@@ -44,6 +46,47 @@ using mastercore::GetBlockIndex;
 using mastercore::isNonMainNet;
 using mastercore::pDbTransaction;
 
+//! Prefix of the secondary keys, which order records by block height
+static const char BLOCK_INDEX_PREFIX = 'B';
+//! Length of the secondary key prefix, including the block height
+static const size_t BLOCK_INDEX_PREFIX_SIZE = 5;
+
+/**
+ * Returns the secondary key of a record.
+ *
+ * The key is formed by the prefix, the big-endian block height and the
+ * primary key, so records of a block range can be obtained with a single
+ * range seek. The value of secondary keys is empty.
+ */
+static std::string BlockIndexKey(int nBlock, const std::string& key = "")
+{
+    unsigned char height[4];
+    WriteBE32(height, nBlock);
+
+    std::string indexKey(1, BLOCK_INDEX_PREFIX);
+    indexKey.append((const char*) height, sizeof(height));
+    indexKey.append(key);
+
+    return indexKey;
+}
+
+/**
+ * Extracts block height and primary key from a secondary key.
+ *
+ * @return False, if the key is not a secondary key
+ */
+static bool ParseBlockIndexKey(const leveldb::Slice& indexKey, int& nBlock, std::string& key)
+{
+    if (indexKey.size() < BLOCK_INDEX_PREFIX_SIZE || indexKey[0] != BLOCK_INDEX_PREFIX) {
+        return false;
+    }
+
+    nBlock = ReadBE32((const unsigned char*) indexKey.data() + 1);
+    key.assign(indexKey.data() + BLOCK_INDEX_PREFIX_SIZE, indexKey.size() - BLOCK_INDEX_PREFIX_SIZE);
+
+    return true;
+}
+
 CMPTxList::CMPTxList(const boost::filesystem::path& path, bool fWipe)
 {
     leveldb::Status status = Open(path, fWipe);
@@ -70,7 +113,10 @@ void CMPTxList::recordTX(const uint256 &txid, bool fValid, int nBlock, unsigned
     PrintToLog("%s(%s, valid=%s, block= %d, type= %d, value= %lu)\n",
             __func__, txid.ToString(), fValid ? "YES" : "NO", nBlock, type, nValue);
 
-    status = pdb->Put(writeoptions, key, value);
+    leveldb::WriteBatch batch;
+    batch.Put(key, value);
+    batch.Put(BlockIndexKey(nBlock, key), "");
+    status = pdb->Write(writeoptions, &batch);
     ++nWritten;
 }
 
@@ -112,15 +158,18 @@ void CMPTxList::recordPaymentTX(const uint256& txid, bool fValid, int nBlock, un
     const std::string value = strprintf("%u:%d:%u:%lu", fValid ? 1 : 0, nBlock, type, numberOfPayments);
     leveldb::Status status;
     PrintToLog("DEXPAYDEBUG : Writing master record %s(%s, valid=%s, block= %d, type= %d, number of payments= %lu)\n", __func__, txid.ToString(), fValid ? "YES" : "NO", nBlock, type, numberOfPayments);
-    status = pdb->Put(writeoptions, key, value);
+    leveldb::WriteBatch batch;
+    batch.Put(key, value);
+    batch.Put(BlockIndexKey(nBlock, key), "");
 
     // Step 4 - Write sub-record with payment details
     const std::string txidStr = txid.ToString();
     const std::string subKey = STR_PAYMENT_SUBKEY_TXID_PAYMENT_COMBO(txidStr, paymentNumber);
     const std::string subValue = strprintf("%d:%s:%s:%d:%lu", vout, buyer, seller, propertyId, nValue);
-    leveldb::Status subStatus;
     PrintToLog("DEXPAYDEBUG : Writing sub-record %s with value %s\n", subKey, subValue);
-    subStatus = pdb->Put(writeoptions, subKey, subValue);
+    batch.Put(subKey, subValue);
+    batch.Put(BlockIndexKey(nBlock, subKey), "");
+    status = pdb->Write(writeoptions, &batch);
 }
 
 void CMPTxList::recordMetaDExCancelTX(const uint256& txidMaster, const uint256& txidSub, bool fValid, int nBlock, unsigned int propertyId, uint64_t nValue)
@@ -154,27 +203,39 @@ void CMPTxList::recordMetaDExCancelTX(const uint256& txidMaster, const uint256&
     const std::string key = txidMasterStr;
     const std::string value = strprintf("%u:%d:%u:%lu", fValid ? 1 : 0, nBlock, type, refNumber);
     PrintToLog("METADEXCANCELDEBUG : Writing master record %s(%s, valid=%s, block= %d, type= %d, number of affected transactions= %d)\n", __func__, txidMaster.ToString(), fValid ? "YES" : "NO", nBlock, type, refNumber);
-    status = pdb->Put(writeoptions, key, value);
+    leveldb::WriteBatch batch;
+    batch.Put(key, value);
+    batch.Put(BlockIndexKey(nBlock, key), "");
 
     // Step 4 - Write sub-record with cancel details
     const std::string txidStr = txidMaster.ToString() + "-C";
     const std::string subKey = STR_REF_SUBKEY_TXID_REF_COMBO(txidStr, refNumber);
     const std::string subValue = strprintf("%s:%d:%lu", txidSub.ToString(), propertyId, nValue);
     PrintToLog("METADEXCANCELDEBUG : Writing sub-record %s with value %s\n", subKey, subValue);
-    status = pdb->Put(writeoptions, subKey, subValue);
+    batch.Put(subKey, subValue);
+    batch.Put(BlockIndexKey(nBlock, subKey), "");
+    status = pdb->Write(writeoptions, &batch);
     if (msc_debug_txdb) PrintToLog("%s(): store: %s=%s, status: %s\n", __func__, subKey, subValue, status.ToString());
 }
 
 
 /**
  * Records a "send all" sub record.
+ *
+ * The sub record is indexed by the block height of the "send all"
+ * transaction, so it's removed together with it in case of a reorg.
  */
-void CMPTxList::recordSendAllSubRecord(const uint256& txid, int subRecordNumber, uint32_t propertyId, int64_t nValue)
+void CMPTxList::recordSendAllSubRecord(const uint256& txid, int nBlock, int subRecordNumber, uint32_t propertyId, int64_t nValue)
 {
+    if (!pdb) return;
+
     std::string strKey = strprintf("%s-%d", txid.ToString(), subRecordNumber);
     std::string strValue = strprintf("%d:%d", propertyId, nValue);
 
-    leveldb::Status status = pdb->Put(writeoptions, strKey, strValue);
+    leveldb::WriteBatch batch;
+    batch.Put(strKey, strValue);
+    batch.Put(BlockIndexKey(nBlock, strKey), "");
+    leveldb::Status status = pdb->Write(writeoptions, &batch);
     ++nWritten;
     if (msc_debug_txdb) PrintToLog("%s(): store: %s=%s, status: %s\n", __func__, strKey, strValue, status.ToString());
 }
@@ -316,21 +377,16 @@ int CMPTxList::getMPTransactionCountTotal()
 int CMPTxList::getMPTransactionCountBlock(int block)
 {
     int count = 0;
-    leveldb::Slice skey, svalue;
+    int blockCurrent = 0;
+    std::string key;
+    const std::string indexKeyFirst = BlockIndexKey(block);
     leveldb::Iterator* it = NewIterator();
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        skey = it->key();
-        svalue = it->value();
-        if (skey.ToString().length() == 64) {
-            std::string strValue = svalue.ToString();
-            std::vector<std::string> vstr;
-            boost::split(vstr, strValue, boost::is_any_of(":"), boost::token_compress_on);
-            if (4 == vstr.size()) {
-                if (atoi(vstr[1]) == block) {
-                    ++count;
-                }
-            }
-        }
+
+    for (it->Seek(indexKeyFirst); it->Valid(); it->Next()) {
+        if (!ParseBlockIndexKey(it->key(), blockCurrent, key) || blockCurrent != block) break;
+        if (key.length() == 64) {
+            ++count;
+        } //extra entries for cancels and purchases are more than 64 chars long
     }
     delete it;
     return count;
@@ -340,23 +396,15 @@ int CMPTxList::getMPTransactionCountBlock(int block)
 int CMPTxList::GetTokenTxsInBlockRange(int blockFirst, int blockLast, std::set<uint256>& retTxs)
 {
     int count = 0;
+    int blockCurrent = 0;
+    std::string key;
     leveldb::Iterator* it = NewIterator();
-    
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        const leveldb::Slice& sKey = it->key();
-        const leveldb::Slice& sValue = it->value();
-
-        if (sKey.ToString().length() == 64) {
-            const std::string& strValue = sValue.ToString();
-            std::vector<std::string> vStr;
-            boost::split(vStr, strValue, boost::is_any_of(":"), boost::token_compress_on);
-            if (4 == vStr.size()) {
-                int blockCurrent = atoi(vStr[1]);
-                if (blockCurrent >= blockFirst && blockCurrent <= blockLast) {
-                    retTxs.insert(uint256S(sKey.ToString()));                    
-                    ++count;
-                }
-            }
+
+    for (it->Seek(BlockIndexKey(blockFirst)); it->Valid(); it->Next()) {
+        if (!ParseBlockIndexKey(it->key(), blockCurrent, key) || blockCurrent > blockLast) break;
+        if (key.length() == 64) {
+            retTxs.insert(uint256S(key));
+            ++count;
         }
     }
 
@@ -399,6 +447,56 @@ int CMPTxList::setDBVersion()
     return getDBVersion();
 }
 
+/**
+ * Adds the secondary keys, which order records by block height, for every
+ * record with a block height.
+ *
+ * Used to upgrade databases of version 7, which lack the secondary keys.
+ *
+ * @return True, if the secondary keys were added
+ */
+bool CMPTxList::buildBlockIndex()
+{
+    if (!pdb) return false;
+
+    PrintToConsole("Indexing tx meta-info database by block..\n");
+
+    unsigned int n = 0;
+    leveldb::WriteBatch batch;
+    leveldb::Iterator* it = NewIterator();
+
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        if (it->key().starts_with(leveldb::Slice(&BLOCK_INDEX_PREFIX, 1))) continue;
+        std::string strValue = it->value().ToString();
+        std::vector<std::string> vstr;
+        boost::split(vstr, strValue, boost::is_any_of(":"), boost::token_compress_on);
+        std::string strKey = it->key().ToString();
+        if (4 != vstr.size()) {
+            // sub records are associated with the block of their master record,
+            // which is either "txid" or, for MetaDEx cancels, "txid-C"
+            if (strKey.size() <= 64) continue;
+            std::string strMasterKey = strKey.substr(0, strKey.compare(64, 2, "-C") == 0 ? 66 : 64);
+            if (strMasterKey == strKey || !pdb->Get(readoptions, strMasterKey, &strValue).ok()) continue;
+            boost::split(vstr, strValue, boost::is_any_of(":"), boost::token_compress_on);
+            if (4 != vstr.size()) continue;
+        }
+        batch.Put(BlockIndexKey(atoi(vstr[1]), strKey), "");
+        ++n;
+    }
+
+    delete it;
+
+    leveldb::Status status = pdb->Write(syncoptions, &batch);
+    if (!status.ok()) {
+        PrintToLog("%s(): ERROR: failed to index database: %s\n", __func__, status.ToString());
+        return false;
+    }
+
+    PrintToLog("%s(): added %d secondary keys\n", __func__, n);
+
+    return true;
+}
+
 bool CMPTxList::exists(const uint256 &txid)
 {
     if (!pdb) return false;
@@ -479,17 +577,14 @@ std::set<int> CMPTxList::GetSeedBlocks(int startHeight, int endHeight)
 
     if (!pdb) return setSeedBlocks;
 
+    int block = 0;
+    std::string key;
     leveldb::Iterator* it = NewIterator();
 
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        std::string itData = it->value().ToString();
-        std::vector<std::string> vstr;
-        boost::split(vstr, itData, boost::is_any_of(":"), boost::token_compress_on);
-        if (4 != vstr.size()) continue; // unexpected number of tokens
-        int block = atoi(vstr[1]);
-        if (block >= startHeight && block <= endHeight) {
-            setSeedBlocks.insert(block);
-        }
+    // seek to the first record of each block, skipping further records of the same block
+    for (it->Seek(BlockIndexKey(startHeight)); it->Valid(); it->Seek(BlockIndexKey(block + 1))) {
+        if (!ParseBlockIndexKey(it->key(), block, key) || block > endHeight) break;
+        setSeedBlocks.insert(block);
     }
 
     delete it;
@@ -728,15 +823,17 @@ bool CMPTxList::CheckForFreezeTxs(int blockHeight)
 {
     assert(pdb);
 
+    int block = 0;
+    std::string key;
     leveldb::Iterator* it = NewIterator();
 
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        std::string itData = it->value().ToString();
+    for (it->Seek(BlockIndexKey(blockHeight)); it->Valid(); it->Next()) {
+        if (!ParseBlockIndexKey(it->key(), block, key)) break;
+        std::string itData;
+        if (!pdb->Get(readoptions, key, &itData).ok()) continue;
         std::vector<std::string> vstr;
         boost::split(vstr, itData, boost::is_any_of(":"), boost::token_compress_on);
         if (4 != vstr.size()) continue;
-        int block = atoi(vstr[1]);
-        if (block < blockHeight) continue;
         uint16_t txtype = atoi(vstr[2]);
         if (txtype == TOKEN_TYPE_FREEZE_PROPERTY_TOKENS || txtype == TOKEN_TYPE_UNFREEZE_PROPERTY_TOKENS ||
                 txtype == TOKEN_TYPE_ENABLE_FREEZING || txtype == TOKEN_TYPE_DISABLE_FREEZING) {
@@ -775,40 +872,29 @@ void CMPTxList::printAll()
 // pass in bDeleteFound = true to erase each entry found within the block range
 bool CMPTxList::isMPinBlockRange(int starting_block, int ending_block, bool bDeleteFound)
 {
-    leveldb::Slice skey, svalue;
-    unsigned int count = 0;
-    std::vector<std::string> vstr;
-    int block;
+    int block = 0;
+    std::string key;
     unsigned int n_found = 0;
+    leveldb::WriteBatch batch;
 
     leveldb::Iterator* it = NewIterator();
 
-    for (it->SeekToFirst(); it->Valid(); it->Next()) {
-        skey = it->key();
-        svalue = it->value();
-
-        ++count;
-
-        std::string strvalue = it->value().ToString();
+    for (it->Seek(BlockIndexKey(starting_block)); it->Valid(); it->Next()) {
+        if (!ParseBlockIndexKey(it->key(), block, key) || block > ending_block) break;
 
-        // parse the string returned, find the validity flag/bit & other parameters
-        boost::split(vstr, strvalue, boost::is_any_of(":"), boost::token_compress_on);
-
-        // only care about the block number/height here
-        if (2 <= vstr.size()) {
-            block = atoi(vstr[1]);
-
-            if ((starting_block <= block) && (block <= ending_block)) {
-                ++n_found;
-                PrintToLog("%s() DELETING: %s=%s\n", __func__, skey.ToString(), svalue.ToString());
-                if (bDeleteFound) pdb->Delete(writeoptions, skey);
-            }
+        ++n_found;
+        PrintToLog("%s() DELETING: %s (block %d)\n", __func__, key, block);
+        if (bDeleteFound) {
+            batch.Delete(key);
+            batch.Delete(it->key());
         }
     }
 
+    if (bDeleteFound) pdb->Write(writeoptions, &batch);
+
     PrintToLog("%s(%d, %d); n_found= %d\n", __func__, starting_block, ending_block, n_found);
 
     delete it;
 
     return (n_found);
-}
\ No newline at end of file
+}
@@ -13,6 +13,9 @@
 #include <string>
 
 /** LevelDB based storage for transactions, with txid as key and validity bit, and other data as value.
+ *
+ * Records associated with a block are additionally indexed by block height,
+ * so block range queries don't require to iterate over the whole database.
  */
 class CMPTxList : public CDBBase
 {
@@ -24,7 +27,7 @@ public:
     void recordPaymentTX(const uint256& txid, bool fValid, int nBlock, unsigned int vout, unsigned int propertyId, uint64_t nValue, std::string buyer, std::string seller);
     void recordMetaDExCancelTX(const uint256 &txidMaster, const uint256& txidSub, bool fValid, int nBlock, unsigned int propertyId, uint64_t nValue);
     /** Records a "send all" sub record. */
-    void recordSendAllSubRecord(const uint256& txid, int subRecordNumber, uint32_t propertyId, int64_t nvalue);
+    void recordSendAllSubRecord(const uint256& txid, int nBlock, int subRecordNumber, uint32_t propertyId, int64_t nvalue);
 
     std::string getKeyValue(std::string key);
     uint256 findMetaDExCancel(const uint256 txid);
@@ -41,6 +44,8 @@ public:
 
     int getDBVersion();
     int setDBVersion();
+    /** Adds the secondary keys, which order records by block height. */
+    bool buildBlockIndex();
 
     bool exists(const uint256& txid);
     bool getTX(const uint256& txid, std::string& value);
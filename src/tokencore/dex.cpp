@@ -6,6 +6,7 @@
 
 #include "tokencore/dex.h"
 
+#include "tokencore/consensushash.h"
 #include "tokencore/convert.h"
 #include "tokencore/dbtxlist.h"
 #include "tokencore/errors.h"
@@ -257,6 +258,7 @@ int DEx_offerCreate(const std::string& addressSeller, uint32_t propertyId, int64
 
         CMPOffer sellOffer(block, amountOffered, propertyId, amountDesired, minAcceptFee, paymentWindow, txid);
         my_offers.insert(std::make_pair(key, sellOffer));
+        mp_state_hash.AddOffer(sellOffer, addressSeller);
 
         rc = 0;
     }
@@ -288,6 +290,7 @@ int DEx_offerDestroy(const std::string& addressSeller, uint32_t propertyId)
     // delete the offer
     const std::string key = STR_SELLOFFER_ADDR_PROP_COMBO(addressSeller, propertyId);
     OfferMap::iterator it = my_offers.find(key);
+    mp_state_hash.RemoveOffer(it->second, addressSeller);
     my_offers.erase(it);
 
     if (msc_debug_dex) PrintToLog("%s(%s|%s)\n", __func__, addressSeller, key);
@@ -537,7 +540,7 @@ int DEx_payment(const uint256& txid, unsigned int vout, const std::string& addre
     pDbSpInfo->getSP(propertyId, royaltiesSP);
     int64_t royaltiesAmount = 0;
 
-    std::string royaltiesReceiver = IsUsernameValid(royaltiesSP.royalties_receiver) ? GetUsernameAddress(royaltiesSP.royalties_receiver) : royaltiesSP.royalties_receiver;
+    std::string royaltiesReceiver = IsUsernameValid(royaltiesSP.royalties_receiver) ? GetUsernameAddress(royaltiesSP.royalties_receiver, block) : royaltiesSP.royalties_receiver;
 
     if (royaltiesSP.royalties_percentage > 0) {
         royaltiesAmount = amountDesired * royaltiesSP.royalties_percentage / 100;
@@ -64,6 +64,8 @@ bool msc_debug_consensus_hash_every_block = 0;
 bool msc_debug_alerts             = 1;
 //! Print consensus hashes for each transaction when parsing
 bool msc_debug_consensus_hash_every_transaction = 0;
+//! Cross-check the state hash against the legacy consensus hash and a rebuilt commitment
+bool msc_debug_consensus_hash_crosscheck = 0;
 //! Debug fees
 bool msc_debug_fees               = 1;
 
@@ -261,6 +263,7 @@ void InitDebugLogLevels()
         if (*it == "consensus_hash_every_block") msc_debug_consensus_hash_every_block = true;
         if (*it == "alerts") msc_debug_alerts = true;
         if (*it == "consensus_hash_every_transaction") msc_debug_consensus_hash_every_transaction = true;
+        if (*it == "consensus_hash_crosscheck") msc_debug_consensus_hash_crosscheck = true;
         if (*it == "fees") msc_debug_fees = true;
         if (*it == "none" || *it == "all") {
             bool allDebugState = false;
@@ -297,6 +300,7 @@ void InitDebugLogLevels()
             msc_debug_consensus_hash_every_block = allDebugState;
             msc_debug_alerts = allDebugState;
             msc_debug_consensus_hash_every_transaction = allDebugState;
+            msc_debug_consensus_hash_crosscheck = allDebugState;
             msc_debug_fees = allDebugState;
         }
     }
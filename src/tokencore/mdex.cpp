@@ -1,5 +1,6 @@
 #include "tokencore/mdex.h"
 
+#include "tokencore/consensushash.h"
 #include "tokencore/dbfees.h"
 #include "tokencore/dbtradelist.h"
 #include "tokencore/dbtxlist.h"
@@ -27,11 +28,13 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <deque>
 #include <fstream>
 #include <limits>
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 typedef boost::multiprecision::cpp_dec_float_100 dec_float;
 typedef boost::multiprecision::checked_int128_t int128_t;
@@ -44,22 +47,13 @@ using namespace mastercore;
 //! Global map for price and order data
 md_PropertiesMap mastercore::metadex;
 
-md_PricesMap* mastercore::get_Prices(uint32_t prop)
+CMPMetaDExBook* mastercore::get_Book(uint32_t prop)
 {
     md_PropertiesMap::iterator it = metadex.find(prop);
 
     if (it != metadex.end()) return &(it->second);
 
-    return (md_PricesMap*) NULL;
-}
-
-md_Set* mastercore::get_Indexes(md_PricesMap* p, rational_t price)
-{
-    md_PricesMap::iterator it = p->find(price);
-
-    if (it != p->end()) return &(it->second);
-
-    return (md_Set*) NULL;
+    return (CMPMetaDExBook*) NULL;
 }
 
 enum MatchReturnType
@@ -144,195 +138,197 @@ static MatchReturnType x_Trade(CMPMetaDEx* const pnew)
     if (msc_debug_metadex1) PrintToLog("%s(%s: prop=%d, desprop=%d, desprice= %s);newo: %s\n",
         __FUNCTION__, pnew->getAddr(), propertyForSale, propertyDesired, xToString(pnew->inversePrice()), pnew->ToString());
 
-    md_PricesMap* const ppriceMap = get_Prices(propertyDesired);
+    CMPMetaDExBook* const pbook = get_Book(propertyDesired);
 
     // nothing for the desired property exists in the market, sorry!
-    if (!ppriceMap) {
+    if (!pbook) {
         PrintToLog("%s()=%d:%s NOT FOUND ON THE MARKET\n", __FUNCTION__, NewReturn, getTradeReturnType(NewReturn));
         return NewReturn;
     }
 
-    // within the desired property map (given one property) iterate over the items looking at prices
-    for (md_PricesMap::iterator priceIt = ppriceMap->begin(); priceIt != ppriceMap->end(); ++priceIt) { // check all prices
-        const rational_t sellersPrice = priceIt->first;
+    const CMPMetaDExPrice buyersPrice = pnew->inversePriceKey();
+    CMPMetaDExPrice levelPrice;
 
-        if (msc_debug_metadex2) PrintToLog("comparing prices: desprice %s needs to be GREATER THAN OR EQUAL TO %s\n",
-            xToString(pnew->inversePrice()), xToString(sellersPrice));
+    // within the desired property book iterate over the offers by price, and by age at the same price
+    CMPMetaDExBook::iterator offerIt = pbook->begin();
+    while (offerIt != pbook->end()) {
+        const CMPMetaDExPrice sellersPrice = offerIt.price();
+
+        if (msc_debug_metadex2 && (offerIt == pbook->begin() || sellersPrice != levelPrice)) PrintToLog("comparing prices: desprice %s needs to be GREATER THAN OR EQUAL TO %s\n",
+            xToString(pnew->inversePrice()), xToString(sellersPrice.toRational()));
+        levelPrice = sellersPrice;
 
         // Is the desired price check satisfied? The buyer's inverse price must be larger than that of the seller.
-        if (pnew->inversePrice() < sellersPrice) {
-            continue;
+        // Price levels are sorted, so none of the remaining offers can satisfy it either.
+        if (buyersPrice < sellersPrice) {
+            break;
         }
 
-        md_Set* const pofferSet = &(priceIt->second);
-
-        // at good (single) price level and property iterate over offers looking at all parameters to find the match
-        md_Set::iterator offerIt = pofferSet->begin();
-        while (offerIt != pofferSet->end()) { // specific price, check all properties
-            const CMPMetaDEx* const pold = &(*offerIt);
-            assert(pold->unitPrice() == sellersPrice);
+        CMPMetaDEx* const pold = &(*offerIt);
 
-            if (msc_debug_metadex1) PrintToLog("Looking at existing: %s (its prop= %d, its des prop= %d) = %s\n",
-                xToString(sellersPrice), pold->getProperty(), pold->getDesProperty(), pold->ToString());
+        if (msc_debug_metadex1) PrintToLog("Looking at existing: %s (its prop= %d, its des prop= %d) = %s\n",
+            xToString(sellersPrice.toRational()), pold->getProperty(), pold->getDesProperty(), pold->ToString());
 
-            // does the desired property match?
-            if (pold->getDesProperty() != propertyForSale) {
-                ++offerIt;
-                continue;
-            }
+        // does the desired property match?
+        if (pold->getDesProperty() != propertyForSale) {
+            ++offerIt;
+            continue;
+        }
 
-            if (msc_debug_metadex1) PrintToLog("MATCH FOUND, Trade: %s = %s\n", xToString(sellersPrice), pold->ToString());
+        if (msc_debug_metadex1) PrintToLog("MATCH FOUND, Trade: %s = %s\n", xToString(sellersPrice.toRational()), pold->ToString());
 
-            // match found, execute trade now!
-            const int64_t seller_amountForSale = pold->getAmountRemaining();
-            const int64_t buyer_amountOffered = pnew->getAmountRemaining();
+        // match found, execute trade now!
+        const int64_t seller_amountForSale = pold->getAmountRemaining();
+        const int64_t buyer_amountOffered = pnew->getAmountRemaining();
 
-            if (msc_debug_metadex1) PrintToLog("$$ trading using price: %s; seller: forsale=%d, desired=%d, remaining=%d, buyer amount offered=%d\n",
-                xToString(sellersPrice), pold->getAmountForSale(), pold->getAmountDesired(), pold->getAmountRemaining(), pnew->getAmountRemaining());
-            if (msc_debug_metadex1) PrintToLog("$$ old: %s\n", pold->ToString());
-            if (msc_debug_metadex1) PrintToLog("$$ new: %s\n", pnew->ToString());
+        if (msc_debug_metadex1) PrintToLog("$$ trading using price: %s; seller: forsale=%d, desired=%d, remaining=%d, buyer amount offered=%d\n",
+            xToString(sellersPrice.toRational()), pold->getAmountForSale(), pold->getAmountDesired(), pold->getAmountRemaining(), pnew->getAmountRemaining());
+        if (msc_debug_metadex1) PrintToLog("$$ old: %s\n", pold->ToString());
+        if (msc_debug_metadex1) PrintToLog("$$ new: %s\n", pnew->ToString());
 
-            ///////////////////////////
+        ///////////////////////////
 
-            // preconditions
-            assert(0 < pold->getAmountRemaining());
-            assert(0 < pnew->getAmountRemaining());
-            assert(pnew->getProperty() != pnew->getDesProperty());
-            assert(pnew->getProperty() == pold->getDesProperty());
-            assert(pold->getProperty() == pnew->getDesProperty());
-            assert(pold->unitPrice() <= pnew->inversePrice());
-            assert(pnew->unitPrice() <= pold->inversePrice());
+        // preconditions
+        assert(0 < pold->getAmountRemaining());
+        assert(0 < pnew->getAmountRemaining());
+        assert(pnew->getProperty() != pnew->getDesProperty());
+        assert(pnew->getProperty() == pold->getDesProperty());
+        assert(pold->getProperty() == pnew->getDesProperty());
+        assert(sellersPrice == pold->unitPriceKey());
+        assert(sellersPrice <= buyersPrice);
+        assert(pnew->unitPriceKey() <= pold->inversePriceKey());
 
-            ///////////////////////////
+        ///////////////////////////
 
-            // First determine how many representable (indivisible) tokens Alice can
-            // purchase from Bob, using Bob's unit price
-            // This implies rounding down, since rounding up is impossible, and would
-            // require more tokens than Alice has
-            arith_uint256 iCouldBuy = (ConvertTo256(pnew->getAmountRemaining()) * ConvertTo256(pold->getAmountForSale())) / ConvertTo256(pold->getAmountDesired());
+        // First determine how many representable (indivisible) tokens Alice can
+        // purchase from Bob, using Bob's unit price
+        // This implies rounding down, since rounding up is impossible, and would
+        // require more tokens than Alice has
+        arith_uint256 iCouldBuy = (ConvertTo256(pnew->getAmountRemaining()) * ConvertTo256(pold->getAmountForSale())) / ConvertTo256(pold->getAmountDesired());
 
-            int64_t nCouldBuy = 0;
-            if (iCouldBuy < ConvertTo256(pold->getAmountRemaining())) {
-                nCouldBuy = ConvertTo64(iCouldBuy);
-            } else {
-                nCouldBuy = pold->getAmountRemaining();
-            }
+        int64_t nCouldBuy = 0;
+        if (iCouldBuy < ConvertTo256(pold->getAmountRemaining())) {
+            nCouldBuy = ConvertTo64(iCouldBuy);
+        } else {
+            nCouldBuy = pold->getAmountRemaining();
+        }
 
-            if (nCouldBuy == 0) {
-                if (msc_debug_metadex1) PrintToLog(
-                        "-- buyer has not enough tokens for sale to purchase one unit!\n");
-                ++offerIt;
-                continue;
-            }
+        if (nCouldBuy == 0) {
+            if (msc_debug_metadex1) PrintToLog(
+                    "-- buyer has not enough tokens for sale to purchase one unit!\n");
+            ++offerIt;
+            continue;
+        }
 
-            // If the amount Alice would have to pay to buy Bob's tokens at his price
-            // is fractional, always round UP the amount Alice has to pay
-            // This will always be better for Bob. Rounding in the other direction
-            // will always be impossible, because ot would violate Bob's accepted price
-            arith_uint256 iWouldPay = DivideAndRoundUp((ConvertTo256(nCouldBuy) * ConvertTo256(pold->getAmountDesired())), ConvertTo256(pold->getAmountForSale()));
-            int64_t nWouldPay = ConvertTo64(iWouldPay);
-
-            // If the resulting adjusted unit price is higher than Alice' price, the
-            // orders shall not execute, and no representable fill is made
-            const rational_t xEffectivePrice(nWouldPay, nCouldBuy);
-
-            if (xEffectivePrice > pnew->inversePrice()) {
-                if (msc_debug_metadex1) PrintToLog(
-                        "-- effective price is too expensive: %s\n", xToString(xEffectivePrice));
-                ++offerIt;
-                continue;
-            }
+        // If the amount Alice would have to pay to buy Bob's tokens at his price
+        // is fractional, always round UP the amount Alice has to pay
+        // This will always be better for Bob. Rounding in the other direction
+        // will always be impossible, because ot would violate Bob's accepted price
+        arith_uint256 iWouldPay = DivideAndRoundUp((ConvertTo256(nCouldBuy) * ConvertTo256(pold->getAmountDesired())), ConvertTo256(pold->getAmountForSale()));
+        int64_t nWouldPay = ConvertTo64(iWouldPay);
+
+        // If the resulting adjusted unit price is higher than Alice' price, the
+        // orders shall not execute, and no representable fill is made
+        const CMPMetaDExPrice xEffectivePrice(nWouldPay, nCouldBuy);
+
+        if (xEffectivePrice > buyersPrice) {
+            if (msc_debug_metadex1) PrintToLog(
+                    "-- effective price is too expensive: %s\n", xToString(xEffectivePrice.toRational()));
+            ++offerIt;
+            continue;
+        }
 
-            const int64_t buyer_amountGot = nCouldBuy;
-            const int64_t seller_amountGot = nWouldPay;
-            const int64_t buyer_amountLeft = pnew->getAmountRemaining() - seller_amountGot;
-            const int64_t seller_amountLeft = pold->getAmountRemaining() - buyer_amountGot;
+        const int64_t buyer_amountGot = nCouldBuy;
+        const int64_t seller_amountGot = nWouldPay;
+        const int64_t buyer_amountLeft = pnew->getAmountRemaining() - seller_amountGot;
+        const int64_t seller_amountLeft = pold->getAmountRemaining() - buyer_amountGot;
 
-            if (msc_debug_metadex1) PrintToLog("$$ buyer_got= %d, seller_got= %d, seller_left_for_sale= %d, buyer_still_for_sale= %d\n",
-                buyer_amountGot, seller_amountGot, seller_amountLeft, buyer_amountLeft);
+        if (msc_debug_metadex1) PrintToLog("$$ buyer_got= %d, seller_got= %d, seller_left_for_sale= %d, buyer_still_for_sale= %d\n",
+            buyer_amountGot, seller_amountGot, seller_amountLeft, buyer_amountLeft);
 
-            ///////////////////////////
+        ///////////////////////////
 
-            // postconditions
-            assert(xEffectivePrice >= pold->unitPrice());
-            assert(xEffectivePrice <= pnew->inversePrice());
-            assert(0 <= seller_amountLeft);
-            assert(0 <= buyer_amountLeft);
-            assert(seller_amountForSale == seller_amountLeft + buyer_amountGot);
-            assert(buyer_amountOffered == buyer_amountLeft + seller_amountGot);
+        // postconditions
+        assert(xEffectivePrice >= sellersPrice);
+        assert(xEffectivePrice <= buyersPrice);
+        assert(0 <= seller_amountLeft);
+        assert(0 <= buyer_amountLeft);
+        assert(seller_amountForSale == seller_amountLeft + buyer_amountGot);
+        assert(buyer_amountOffered == buyer_amountLeft + seller_amountGot);
 
-            ///////////////////////////
+        ///////////////////////////
 
-            int64_t buyer_amountGotAfterFee = buyer_amountGot;
-            int64_t tradingFee = 0;
+        int64_t buyer_amountGotAfterFee = buyer_amountGot;
+        int64_t tradingFee = 0;
 
-            // strip a 0.05% fee from non-TOKEN pairs if fees are activated
-            if (IsFeatureActivated(FEATURE_FEES, pnew->getBlock())) {
-                if (pold->getProperty() > TOKEN_PROPERTY_TMSC && pold->getDesProperty() > TOKEN_PROPERTY_TMSC) {
-                    int64_t feeDivider = 2000; // 0.05%
-                    tradingFee = buyer_amountGot / feeDivider;
+        // strip a 0.05% fee from non-TOKEN pairs if fees are activated
+        if (IsFeatureActivated(FEATURE_FEES, pnew->getBlock())) {
+            if (pold->getProperty() > TOKEN_PROPERTY_TMSC && pold->getDesProperty() > TOKEN_PROPERTY_TMSC) {
+                int64_t feeDivider = 2000; // 0.05%
+                tradingFee = buyer_amountGot / feeDivider;
 
-                    // subtract the fee from the amount the seller will receive
-                    buyer_amountGotAfterFee = buyer_amountGot - tradingFee;
+                // subtract the fee from the amount the seller will receive
+                buyer_amountGotAfterFee = buyer_amountGot - tradingFee;
 
-                    // add the fee to the fee cache
-                    pDbFeeCache->AddFee(pnew->getDesProperty(), pnew->getBlock(), tradingFee);
-                } else {
-                    if (msc_debug_fees) PrintToLog("Skipping fee reduction for trade match %s:%s as one of the properties is Token\n", pold->getHash().GetHex(), pnew->getHash().GetHex());
-                }
+                // add the fee to the fee cache
+                pDbFeeCache->AddFee(pnew->getDesProperty(), pnew->getBlock(), tradingFee);
+            } else {
+                if (msc_debug_fees) PrintToLog("Skipping fee reduction for trade match %s:%s as one of the properties is Token\n", pold->getHash().GetHex(), pnew->getHash().GetHex());
             }
+        }
 
-            // transfer the payment property from buyer to seller
-            assert(update_tally_map(pnew->getAddr(), pnew->getProperty(), -seller_amountGot, BALANCE));
-            assert(update_tally_map(pold->getAddr(), pold->getDesProperty(), seller_amountGot, BALANCE));
-
-            // transfer the market (the one being sold) property from seller to buyer
-            assert(update_tally_map(pold->getAddr(), pold->getProperty(), -buyer_amountGot, METADEX_RESERVE));
-            assert(update_tally_map(pnew->getAddr(), pnew->getDesProperty(), buyer_amountGotAfterFee, BALANCE));
+        // transfer the payment property from buyer to seller
+        assert(update_tally_map(pnew->getAddr(), pnew->getProperty(), -seller_amountGot, BALANCE));
+        assert(update_tally_map(pold->getAddr(), pold->getDesProperty(), seller_amountGot, BALANCE));
 
-            NewReturn = TRADED;
+        // transfer the market (the one being sold) property from seller to buyer
+        assert(update_tally_map(pold->getAddr(), pold->getProperty(), -buyer_amountGot, METADEX_RESERVE));
+        assert(update_tally_map(pnew->getAddr(), pnew->getDesProperty(), buyer_amountGotAfterFee, BALANCE));
 
-            CMPMetaDEx seller_replacement = *pold; // < can be moved into last if block
-            seller_replacement.setAmountRemaining(seller_amountLeft, "seller_replacement");
+        NewReturn = TRADED;
 
-            pnew->setAmountRemaining(buyer_amountLeft, "buyer");
+        CMPMetaDEx seller_replacement = *pold; // < can be moved into last if block
+        seller_replacement.setAmountRemaining(seller_amountLeft, "seller_replacement");
 
-            if (0 < buyer_amountLeft) {
-                NewReturn = TRADED_MOREINBUYER;
-            }
+        pnew->setAmountRemaining(buyer_amountLeft, "buyer");
 
-            if (0 == buyer_amountLeft) {
-                bBuyerSatisfied = true;
-            }
+        if (0 < buyer_amountLeft) {
+            NewReturn = TRADED_MOREINBUYER;
+        }
 
-            if (0 < seller_amountLeft) {
-                NewReturn = TRADED_MOREINSELLER;
-            }
+        if (0 == buyer_amountLeft) {
+            bBuyerSatisfied = true;
+        }
 
-            if (msc_debug_metadex1) PrintToLog("==== TRADED !!! %u=%s\n", NewReturn, getTradeReturnType(NewReturn));
+        if (0 < seller_amountLeft) {
+            NewReturn = TRADED_MOREINSELLER;
+        }
 
-            // record the trade in MPTradeList
-            pDbTradeList->recordMatchedTrade(pold->getHash(), pnew->getHash(), // < might just pass pold, pnew
-                pold->getAddr(), pnew->getAddr(), pold->getDesProperty(), pnew->getDesProperty(), seller_amountGot, buyer_amountGotAfterFee, pnew->getBlock(), tradingFee);
+        if (msc_debug_metadex1) PrintToLog("==== TRADED !!! %u=%s\n", NewReturn, getTradeReturnType(NewReturn));
 
-            if (msc_debug_metadex1) PrintToLog("++ erased old: %s\n", offerIt->ToString());
-            // erase the old seller element
-            pofferSet->erase(offerIt++);
+        // record the trade in MPTradeList
+        pDbTradeList->recordMatchedTrade(pold->getHash(), pnew->getHash(), // < might just pass pold, pnew
+            pold->getAddr(), pnew->getAddr(), pold->getDesProperty(), pnew->getDesProperty(), seller_amountGot, buyer_amountGotAfterFee, pnew->getBlock(), tradingFee);
 
-            // insert the updated one in place of the old
-            if (0 < seller_replacement.getAmountRemaining()) {
-                PrintToLog("++ inserting seller_replacement: %s\n", seller_replacement.ToString());
-                pofferSet->insert(seller_replacement);
-            }
+        if (msc_debug_metadex1) PrintToLog("++ erased old: %s\n", offerIt->ToString());
+        // erase the old seller element
+        mp_state_hash.RemoveMetaDEx(*offerIt);
 
-            if (bBuyerSatisfied) {
-                assert(buyer_amountLeft == 0);
-                break;
-            }
-        } // specific price, check all properties
+        // the updated one takes the place of the old, and keeps its position in the queue
+        if (0 < seller_replacement.getAmountRemaining()) {
+            PrintToLog("++ inserting seller_replacement: %s\n", seller_replacement.ToString());
+            *offerIt = seller_replacement;
+            mp_state_hash.AddMetaDEx(seller_replacement);
+            ++offerIt;
+        } else {
+            offerIt = pbook->erase(offerIt);
+        }
 
-        if (bBuyerSatisfied) break;
-    } // check all prices
+        if (bBuyerSatisfied) {
+            assert(buyer_amountLeft == 0);
+            break;
+        }
+    } // check all offers
 
     PrintToLog("%s()=%d:%s\n", __FUNCTION__, NewReturn, getTradeReturnType(NewReturn));
 
@@ -401,6 +397,16 @@ rational_t CMPMetaDEx::inversePrice() const
     return inversePrice;
 }
 
+CMPMetaDExPrice CMPMetaDEx::unitPriceKey() const
+{
+    return CMPMetaDExPrice(amount_desired, amount_forsale);
+}
+
+CMPMetaDExPrice CMPMetaDEx::inversePriceKey() const
+{
+    return CMPMetaDExPrice(amount_forsale, amount_desired);
+}
+
 int64_t CMPMetaDEx::getAmountToFill() const
 {
     // round up to ensure that the amount we present will actually result in buying all available tokens
@@ -456,37 +462,197 @@ bool MetaDEx_compare::operator()(const CMPMetaDEx &lhs, const CMPMetaDEx &rhs) c
     else return lhs.getBlock() < rhs.getBlock();
 }
 
-bool mastercore::MetaDEx_INSERT(const CMPMetaDEx& objMetaDEx)
+/** Returns the greatest common divisor of two numbers. */
+static uint64_t GreatestCommonDivisor(uint64_t a, uint64_t b)
+{
+    while (b != 0) {
+        uint64_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+/** Compares the 128 bit products a * b and c * d. */
+static bool IsProductLess(uint64_t a, uint64_t b, uint64_t c, uint64_t d)
+{
+#ifdef __SIZEOF_INT128__
+    return (unsigned __int128) a * b < (unsigned __int128) c * d;
+#else
+    arith_uint256 lhs = arith_uint256(a) * arith_uint256(b);
+    arith_uint256 rhs = arith_uint256(c) * arith_uint256(d);
+    return lhs < rhs;
+#endif
+}
+
+/**
+ * Creates a price, reduced to lowest terms.
+ *
+ * Like rational_t, a zero denominator results in a price of zero.
+ */
+CMPMetaDExPrice::CMPMetaDExPrice(int64_t numerator, int64_t denominator) : num(0), den(1)
+{
+    assert(numerator >= 0 && denominator >= 0);
+
+    if (numerator == 0 || denominator == 0) return;
+
+    uint64_t divisor = GreatestCommonDivisor(numerator, denominator);
+    num = static_cast<uint64_t>(numerator) / divisor;
+    den = static_cast<uint64_t>(denominator) / divisor;
+}
+
+rational_t CMPMetaDExPrice::toRational() const
+{
+    return rational_t(int128_t(num), int128_t(den));
+}
+
+bool CMPMetaDExPrice::operator<(const CMPMetaDExPrice& rhs) const
+{
+    // both denominators are positive: a/b < c/d <=> a*d < c*b
+    return IsProductLess(num, rhs.den, rhs.num, den);
+}
+
+size_t CMPMetaDExBook::lowerBound(const CMPMetaDExPrice& price) const
+{
+    size_t first = 0;
+    size_t count = levels.size();
+
+    while (count > 0) {
+        size_t step = count / 2;
+        if (levelAt(first + step).price < price) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+
+    return first;
+}
+
+CMPMetaDExBook::iterator CMPMetaDExBook::find(const CMPMetaDExPrice& price)
+{
+    size_t rank = lowerBound(price);
+    if (rank == levels.size() || levelAt(rank).price != price) {
+        return end();
+    }
+
+    return iterator(this, rank);
+}
+
+/**
+ * Inserts an order into the queue of its price level.
+ *
+ * Orders usually arrive in block order, so the position is searched from the
+ * back of the queue, and new orders are appended in constant time.
+ */
+bool CMPMetaDExBook::insert(const CMPMetaDEx& order)
+{
+    const CMPMetaDExPrice price = order.unitPriceKey();
+    size_t rank = lowerBound(price);
+
+    if (rank == levels.size() || levelAt(rank).price != price) {
+        Level level;
+        level.price = price;
+        level.head = NO_NODE;
+        level.tail = NO_NODE;
+        level.count = 0;
+        // levels of lower prices, i.e. lower ranks, are behind the new one
+        levels.insert(levels.end() - rank, level);
+    }
+
+    Level& level = levelAt(rank);
+    MetaDEx_compare isBefore;
+
+    // find the last order, which isn't after the new one
+    uint32_t prev = level.tail;
+    while (prev != NO_NODE && isBefore(order, nodes[prev].order)) {
+        prev = nodes[prev].prev;
+    }
+
+    // an order of the same block and position already exists
+    if (prev != NO_NODE && !isBefore(nodes[prev].order, order)) {
+        return false;
+    }
+
+    uint32_t node;
+    if (!freeNodes.empty()) {
+        node = freeNodes.back();
+        freeNodes.pop_back();
+        nodes[node].order = order;
+    } else {
+        assert(nodes.size() < NO_NODE);
+        node = nodes.size();
+        Node newNode;
+        newNode.order = order;
+        nodes.push_back(newNode);
+    }
+
+    uint32_t next = (prev == NO_NODE) ? level.head : nodes[prev].next;
+    nodes[node].prev = prev;
+    nodes[node].next = next;
+
+    if (prev == NO_NODE) level.head = node;
+    else nodes[prev].next = node;
+
+    if (next == NO_NODE) level.tail = node;
+    else nodes[next].prev = node;
+
+    ++level.count;
+    ++nOrders;
+
+    return true;
+}
+
+/**
+ * Removes an order from its queue, and the level, if it becomes empty.
+ */
+CMPMetaDExBook::iterator CMPMetaDExBook::erase(iterator it)
 {
-    // Create an empty price map (to use in case price map for this property does not already exist)
-    md_PricesMap temp_prices;
-    // Attempt to obtain the price map for the property
-    md_PricesMap *p_prices = get_Prices(objMetaDEx.getProperty());
+    assert(it.book == this && it.node != NO_NODE);
+
+    iterator next = it;
+    ++next;
 
-    // Create an empty set of metadex objects (to use in case no set currently exists at this price)
-    md_Set temp_indexes;
-    md_Set *p_indexes = NULL;
+    Level& level = levelAt(it.level);
+    Node& node = nodes[it.node];
 
-    // Prepare for return code
-    std::pair <md_Set::iterator, bool> ret;
+    if (node.prev == NO_NODE) level.head = node.next;
+    else nodes[node.prev].next = node.next;
 
-    // Attempt to obtain a set of metadex objects for this price from the price map
-    if (p_prices) p_indexes = get_Indexes(p_prices, objMetaDEx.unitPrice());
-    // See if the set was populated, if not no set exists at this price level, use the empty set that we created earlier
-    if (!p_indexes) p_indexes = &temp_indexes;
+    if (node.next == NO_NODE) level.tail = node.prev;
+    else nodes[node.next].prev = node.prev;
 
-    // Attempt to insert the metadex object into the set
-    ret = p_indexes->insert(objMetaDEx);
-    if (false == ret.second) return false;
+    node.order = CMPMetaDEx();
+    node.prev = NO_NODE;
+    node.next = NO_NODE;
+    freeNodes.push_back(it.node);
 
-    // If a prices map did not exist for this property, set p_prices to the temp empty price map
-    if (!p_prices) p_prices = &temp_prices;
+    --nOrders;
 
-    // Update the prices map with the new set at this price
-    (*p_prices)[objMetaDEx.unitPrice()] = *p_indexes;
+    if (--level.count == 0) {
+        levels.erase(levels.end() - 1 - it.level);
+        // the next order is on the following level, whose rank is now one less
+        --next.level;
+    }
+
+    return next;
+}
 
-    // Set the metadex map for the property to the updated (or new if it didn't exist) price map
-    metadex[objMetaDEx.getProperty()] = *p_prices;
+void CMPMetaDExBook::clear()
+{
+    levels.clear();
+    nodes.clear();
+    freeNodes.clear();
+    nOrders = 0;
+}
+
+bool mastercore::MetaDEx_INSERT(const CMPMetaDEx& objMetaDEx)
+{
+    // Attempt to insert the metadex object into the book of the property, which is created, if it doesn't exist
+    if (!metadex[objMetaDEx.getProperty()].insert(objMetaDEx)) return false;
+
+    mp_state_hash.AddMetaDEx(objMetaDEx);
 
     return true;
 }
@@ -531,49 +697,44 @@ int mastercore::MetaDEx_CANCEL_AT_PRICE(const uint256& txid, unsigned int block,
 {
     int rc = METADEX_ERROR -20;
     CMPMetaDEx mdex(sender_addr, 0, prop, amount, property_desired, amount_desired, uint256(), 0, CMPTransaction::CANCEL_AT_PRICE);
-    md_PricesMap* prices = get_Prices(prop);
+    CMPMetaDExBook* book = get_Book(prop);
     const CMPMetaDEx* p_mdex = NULL;
 
     if (msc_debug_metadex1) PrintToLog("%s():%s\n", __FUNCTION__, mdex.ToString());
 
     if (msc_debug_metadex2) MetaDEx_debug_print();
 
-    if (!prices) {
+    if (!book) {
         PrintToLog("%s() NOTHING FOUND for %s\n", __FUNCTION__, mdex.ToString());
         return rc -1;
     }
 
-    // within the desired property map (given one property) iterate over the items
-    for (md_PricesMap::iterator my_it = prices->begin(); my_it != prices->end(); ++my_it) {
-        rational_t sellers_price = my_it->first;
-
-        if (mdex.unitPrice() != sellers_price) continue;
+    // within the desired property book only the offers at the given price are considered
+    const CMPMetaDExPrice price = mdex.unitPriceKey();
 
-        md_Set* indexes = &(my_it->second);
+    for (CMPMetaDExBook::iterator iitt = book->find(price); iitt != book->end() && iitt.price() == price;) {
+        p_mdex = &(*iitt);
 
-        for (md_Set::iterator iitt = indexes->begin(); iitt != indexes->end();) {
-            p_mdex = &(*iitt);
+        if (msc_debug_metadex3) PrintToLog("%s(): %s\n", __FUNCTION__, p_mdex->ToString());
 
-            if (msc_debug_metadex3) PrintToLog("%s(): %s\n", __FUNCTION__, p_mdex->ToString());
-
-            if ((p_mdex->getDesProperty() != property_desired) || (p_mdex->getAddr() != sender_addr)) {
-                ++iitt;
-                continue;
-            }
+        if ((p_mdex->getDesProperty() != property_desired) || (p_mdex->getAddr() != sender_addr)) {
+            ++iitt;
+            continue;
+        }
 
-            rc = 0;
-            PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, p_mdex->ToString());
+        rc = 0;
+        PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, p_mdex->ToString());
 
-            // move from reserve to main
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
+        // move from reserve to main
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
 
-            // record the cancellation
-            bool bValid = true;
-            pDbTransactionList->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
+        // record the cancellation
+        bool bValid = true;
+        pDbTransactionList->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
 
-            indexes->erase(iitt++);
-        }
+        mp_state_hash.RemoveMetaDEx(*iitt);
+        iitt = book->erase(iitt);
     }
 
     if (msc_debug_metadex2) MetaDEx_debug_print();
@@ -584,45 +745,42 @@ int mastercore::MetaDEx_CANCEL_AT_PRICE(const uint256& txid, unsigned int block,
 int mastercore::MetaDEx_CANCEL_ALL_FOR_PAIR(const uint256& txid, unsigned int block, const std::string& sender_addr, uint32_t prop, uint32_t property_desired)
 {
     int rc = METADEX_ERROR -30;
-    md_PricesMap* prices = get_Prices(prop);
+    CMPMetaDExBook* book = get_Book(prop);
     const CMPMetaDEx* p_mdex = NULL;
 
     PrintToLog("%s(%d,%d)\n", __FUNCTION__, prop, property_desired);
 
     if (msc_debug_metadex3) MetaDEx_debug_print();
 
-    if (!prices) {
+    if (!book) {
         PrintToLog("%s() NOTHING FOUND\n", __FUNCTION__);
         return rc -1;
     }
 
-    // within the desired property map (given one property) iterate over the items
-    for (md_PricesMap::iterator my_it = prices->begin(); my_it != prices->end(); ++my_it) {
-        md_Set* indexes = &(my_it->second);
+    // within the desired property book iterate over the items
+    for (CMPMetaDExBook::iterator iitt = book->begin(); iitt != book->end();) {
+        p_mdex = &(*iitt);
 
-        for (md_Set::iterator iitt = indexes->begin(); iitt != indexes->end();) {
-            p_mdex = &(*iitt);
+        if (msc_debug_metadex3) PrintToLog("%s(): %s\n", __FUNCTION__, p_mdex->ToString());
 
-            if (msc_debug_metadex3) PrintToLog("%s(): %s\n", __FUNCTION__, p_mdex->ToString());
+        if ((p_mdex->getDesProperty() != property_desired) || (p_mdex->getAddr() != sender_addr)) {
+            ++iitt;
+            continue;
+        }
 
-            if ((p_mdex->getDesProperty() != property_desired) || (p_mdex->getAddr() != sender_addr)) {
-                ++iitt;
-                continue;
-            }
+        rc = 0;
+        PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, p_mdex->ToString());
 
-            rc = 0;
-            PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, p_mdex->ToString());
+        // move from reserve to main
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
+        assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
 
-            // move from reserve to main
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), -p_mdex->getAmountRemaining(), METADEX_RESERVE));
-            assert(update_tally_map(p_mdex->getAddr(), p_mdex->getProperty(), p_mdex->getAmountRemaining(), BALANCE));
+        // record the cancellation
+        bool bValid = true;
+        pDbTransactionList->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
 
-            // record the cancellation
-            bool bValid = true;
-            pDbTransactionList->recordMetaDExCancelTX(txid, p_mdex->getHash(), bValid, block, p_mdex->getProperty(), p_mdex->getAmountRemaining());
-
-            indexes->erase(iitt++);
-        }
+        mp_state_hash.RemoveMetaDEx(*iitt);
+        iitt = book->erase(iitt);
     }
 
     if (msc_debug_metadex3) MetaDEx_debug_print();
@@ -651,35 +809,35 @@ int mastercore::MetaDEx_CANCEL_EVERYTHING(const uint256& txid, unsigned int bloc
         if (isTestEcosystemProperty(ecosystem) && !isTestEcosystemProperty(prop)) continue;
 
         PrintToLog(" ## property: %u\n", prop);
-        md_PricesMap& prices = my_it->second;
+        CMPMetaDExBook& book = my_it->second;
+        CMPMetaDExPrice levelPrice;
 
-        for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-            rational_t price = it->first;
-            md_Set& indexes = it->second;
+        for (CMPMetaDExBook::iterator it = book.begin(); it != book.end();) {
+            rational_t price = it.price().toRational();
 
-            PrintToLog("  # Price Level: %s\n", xToString(price));
+            if (it == book.begin() || it.price() != levelPrice) PrintToLog("  # Price Level: %s\n", xToString(price));
+            levelPrice = it.price();
 
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end();) {
-                PrintToLog("%s= %s\n", xToString(price), it->ToString());
+            PrintToLog("%s= %s\n", xToString(price), it->ToString());
 
-                if (it->getAddr() != sender_addr) {
-                    ++it;
-                    continue;
-                }
+            if (it->getAddr() != sender_addr) {
+                ++it;
+                continue;
+            }
 
-                rc = 0;
-                PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, it->ToString());
+            rc = 0;
+            PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, it->ToString());
 
-                // move from reserve to balance
-                assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
-                assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
+            // move from reserve to balance
+            assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
+            assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
 
-                // record the cancellation
-                bool bValid = true;
-                pDbTransactionList->recordMetaDExCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountRemaining());
+            // record the cancellation
+            bool bValid = true;
+            pDbTransactionList->recordMetaDExCancelTX(txid, it->getHash(), bValid, block, it->getProperty(), it->getAmountRemaining());
 
-                indexes.erase(it++);
-            }
+            mp_state_hash.RemoveMetaDEx(*it);
+            it = book.erase(it);
         }
     }
     PrintToLog(">>>>>>\n");
@@ -697,17 +855,17 @@ int mastercore::MetaDEx_SHUTDOWN_ALLPAIR()
     int rc = 0;
     PrintToLog("%s()\n", __FUNCTION__);
     for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-        md_PricesMap& prices = my_it->second;
-        for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-            md_Set& indexes = it->second;
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end();) {
-                if (it->getDesProperty() > TOKEN_PROPERTY_TMSC && it->getProperty() > TOKEN_PROPERTY_TMSC) { // no OMN/TOMN side to the trade
-                    PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, it->ToString());
-                    // move from reserve to balance
-                    assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
-                    assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
-                    indexes.erase(it++);
-                }
+        CMPMetaDExBook& book = my_it->second;
+        for (CMPMetaDExBook::iterator it = book.begin(); it != book.end();) {
+            if (it->getDesProperty() > TOKEN_PROPERTY_TMSC && it->getProperty() > TOKEN_PROPERTY_TMSC) { // no OMN/TOMN side to the trade
+                PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, it->ToString());
+                // move from reserve to balance
+                assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
+                assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
+                mp_state_hash.RemoveMetaDEx(*it);
+                it = book.erase(it);
+            } else {
+                ++it;
             }
         }
     }
@@ -722,16 +880,14 @@ int mastercore::MetaDEx_SHUTDOWN()
     int rc = 0;
     PrintToLog("%s()\n", __FUNCTION__);
     for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-        md_PricesMap& prices = my_it->second;
-        for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-            md_Set& indexes = it->second;
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end();) {
-                PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, it->ToString());
-                // move from reserve to balance
-                assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
-                assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
-                indexes.erase(it++);
-            }
+        CMPMetaDExBook& book = my_it->second;
+        for (CMPMetaDExBook::iterator it = book.begin(); it != book.end();) {
+            PrintToLog("%s(): REMOVING %s\n", __FUNCTION__, it->ToString());
+            // move from reserve to balance
+            assert(update_tally_map(it->getAddr(), it->getProperty(), -it->getAmountRemaining(), METADEX_RESERVE));
+            assert(update_tally_map(it->getAddr(), it->getProperty(), it->getAmountRemaining(), BALANCE));
+            mp_state_hash.RemoveMetaDEx(*it);
+            it = book.erase(it);
         }
     }
     return rc;
@@ -743,13 +899,9 @@ bool mastercore::MetaDEx_isOpen(const uint256& txid, uint32_t propertyIdForSale)
 {
     for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
         if (propertyIdForSale != 0 && propertyIdForSale != my_it->first) continue;
-        md_PricesMap & prices = my_it->second;
-        for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-            md_Set & indexes = (it->second);
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                CMPMetaDEx obj = *it;
-                if( obj.getHash().GetHex() == txid.GetHex() ) return true;
-            }
+        const CMPMetaDExBook& book = my_it->second;
+        for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+            if (it->getHash() == txid) return true;
         }
     }
     return false;
@@ -814,20 +966,18 @@ void mastercore::MetaDEx_debug_print(bool bShowPriceLevel, bool bDisplay)
         uint32_t prop = my_it->first;
 
         PrintToLog(" ## property: %u\n", prop);
-        md_PricesMap& prices = my_it->second;
-
-        for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-            rational_t price = it->first;
-            md_Set& indexes = it->second;
+        const CMPMetaDExBook& book = my_it->second;
+        CMPMetaDExPrice levelPrice;
 
-            if (bShowPriceLevel) PrintToLog("  # Price Level: %s\n", xToString(price));
+        for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+            rational_t price = it.price().toRational();
+            const CMPMetaDEx& obj = *it;
 
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                const CMPMetaDEx& obj = *it;
+            if (bShowPriceLevel && (it == book.begin() || it.price() != levelPrice)) PrintToLog("  # Price Level: %s\n", xToString(price));
+            levelPrice = it.price();
 
-                if (bDisplay) PrintToConsole("%s= %s\n", xToString(price), obj.ToString());
-                else PrintToLog("%s= %s\n", xToString(price), obj.ToString());
-            }
+            if (bDisplay) PrintToConsole("%s= %s\n", xToString(price), obj.ToString());
+            else PrintToLog("%s= %s\n", xToString(price), obj.ToString());
         }
     }
     PrintToLog(">>>\n");
@@ -840,12 +990,9 @@ void mastercore::MetaDEx_debug_print(bool bShowPriceLevel, bool bDisplay)
 const CMPMetaDEx* mastercore::MetaDEx_RetrieveTrade(const uint256& txid)
 {
     for (md_PropertiesMap::iterator propIter = metadex.begin(); propIter != metadex.end(); ++propIter) {
-        md_PricesMap & prices = propIter->second;
-        for (md_PricesMap::iterator pricesIter = prices.begin(); pricesIter != prices.end(); ++pricesIter) {
-            md_Set & indexes = pricesIter->second;
-            for (md_Set::iterator tradesIter = indexes.begin(); tradesIter != indexes.end(); ++tradesIter) {
-                if (txid == (*tradesIter).getHash()) return &(*tradesIter);
-            }
+        const CMPMetaDExBook& book = propIter->second;
+        for (CMPMetaDExBook::const_iterator tradesIter = book.begin(); tradesIter != book.end(); ++tradesIter) {
+            if (txid == (*tradesIter).getHash()) return &(*tradesIter);
         }
     }
     return (CMPMetaDEx*) NULL;
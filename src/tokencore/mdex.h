@@ -3,6 +3,7 @@
 
 #include "tokencore/tx.h"
 
+#include "serialize.h"
 #include "uint256.h"
 
 #include <boost/lexical_cast.hpp>
@@ -14,10 +15,12 @@
 
 #include <stdint.h>
 
+#include <deque>
 #include <fstream>
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 typedef boost::rational<boost::multiprecision::checked_int128_t> rational_t;
 
@@ -32,6 +35,38 @@ typedef boost::rational<boost::multiprecision::checked_int128_t> rational_t;
 /** Converts price to string. */
 std::string xToString(const rational_t& value);
 
+/** Exact unit price of a MetaDEx order, as normalized integer fraction.
+ *
+ * Prices are reduced to lowest terms, so equal prices have equal keys, and
+ * they are ordered by cross multiplication with 128 bit products. The order
+ * is the same as the one of rational_t, but without its overhead.
+ */
+class CMPMetaDExPrice
+{
+private:
+    uint64_t num;
+    uint64_t den;
+
+public:
+    CMPMetaDExPrice() : num(0), den(1) {}
+
+    /** Creates the price numerator/denominator, which is zero, if the denominator is zero. */
+    CMPMetaDExPrice(int64_t numerator, int64_t denominator);
+
+    uint64_t getNumerator() const { return num; }
+    uint64_t getDenominator() const { return den; }
+
+    /** Converts the price into a rational number, e.g. for display. */
+    rational_t toRational() const;
+
+    bool operator==(const CMPMetaDExPrice& rhs) const { return num == rhs.num && den == rhs.den; }
+    bool operator!=(const CMPMetaDExPrice& rhs) const { return !(*this == rhs); }
+    bool operator<(const CMPMetaDExPrice& rhs) const;
+    bool operator>(const CMPMetaDExPrice& rhs) const { return rhs < *this; }
+    bool operator<=(const CMPMetaDExPrice& rhs) const { return !(rhs < *this); }
+    bool operator>=(const CMPMetaDExPrice& rhs) const { return !(*this < rhs); }
+};
+
 /** A trade on the distributed exchange.
  */
 class CMPMetaDEx
@@ -89,11 +124,32 @@ public:
         desired_property(tx.desired_property), amount_desired(tx.desired_value), amount_remaining(tx.nValue),
         subaction(tx.subaction), addr(tx.sender) {}
 
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(block);
+        READWRITE(txid);
+        READWRITE(idx);
+        READWRITE(property);
+        READWRITE(amount_forsale);
+        READWRITE(desired_property);
+        READWRITE(amount_desired);
+        READWRITE(amount_remaining);
+        READWRITE(subaction);
+        READWRITE(addr);
+    }
+
     std::string ToString() const;
 
     rational_t unitPrice() const;
     rational_t inversePrice() const;
 
+    /** Returns the unit price as exact integer key, used by the order book. */
+    CMPMetaDExPrice unitPriceKey() const;
+    /** Returns the inverse price as exact integer key, used for matching. */
+    CMPMetaDExPrice inversePriceKey() const;
+
     /** Used for display of unit prices to 8 decimal places at UI layer. */
     std::string displayUnitPrice() const;
     /** Used for display of unit prices with 50 decimal places at RPC layer. */
@@ -102,6 +158,134 @@ public:
     void saveOffer(std::ofstream& file, SHA256_CTX* shaCtx) const;
 };
 
+/** Order book of the MetaDEx orders, which sell one property.
+ *
+ * Price levels are kept in a contiguous vector, sorted by descending unit
+ * price, so levels at the best prices, where orders are filled and usually
+ * added, are at the back, and can be removed or added without moving the
+ * others. The orders of a level form an intrusive FIFO queue, sorted by block
+ * and position within the block, and are stored in a node pool, so pointers
+ * to orders remain valid, until the order is erased.
+ *
+ * The iteration order is by price, then by block and position, which is the
+ * order the matching engine and the cancellations rely on.
+ */
+class CMPMetaDExBook
+{
+private:
+    //! Index of no node
+    static const uint32_t NO_NODE = 0xffffffff;
+
+    struct Node
+    {
+        CMPMetaDEx order;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    struct Level
+    {
+        CMPMetaDExPrice price;
+        uint32_t head;
+        uint32_t tail;
+        uint32_t count;
+    };
+
+    //! Price levels, sorted by descending price, never empty
+    std::vector<Level> levels;
+    //! Pool of nodes, which are linked into the queues of the levels
+    std::deque<Node> nodes;
+    //! Unused nodes of the pool
+    std::vector<uint32_t> freeNodes;
+    //! Number of orders in the book
+    size_t nOrders;
+
+    /** Returns the level of the given rank, where rank 0 is the lowest price. */
+    Level& levelAt(size_t rank) { return levels[levels.size() - 1 - rank]; }
+    const Level& levelAt(size_t rank) const { return levels[levels.size() - 1 - rank]; }
+
+    /** Returns the rank of the first level with a price not less than the given one. */
+    size_t lowerBound(const CMPMetaDExPrice& price) const;
+
+public:
+    /** Iterates over the orders by price, block and position within the block. */
+    template <typename Book, typename Value>
+    class order_iterator
+    {
+    private:
+        friend class CMPMetaDExBook;
+        template <typename OtherBook, typename OtherValue> friend class order_iterator;
+
+        Book* book;
+        size_t level;
+        uint32_t node;
+
+        order_iterator(Book* bookIn, size_t levelIn)
+          : book(bookIn), level(levelIn), node(levelIn < bookIn->levels.size() ? bookIn->levelAt(levelIn).head : NO_NODE) {}
+
+    public:
+        /** Converts an iterator into a const_iterator. */
+        template <typename OtherBook, typename OtherValue>
+        order_iterator(const order_iterator<OtherBook, OtherValue>& other)
+          : book(other.book), level(other.level), node(other.node) {}
+
+        Value& operator*() const { return book->nodes[node].order; }
+        Value* operator->() const { return &(book->nodes[node].order); }
+
+        /** Returns the price of the level of the order. */
+        const CMPMetaDExPrice& price() const { return book->levelAt(level).price; }
+
+        order_iterator& operator++()
+        {
+            node = book->nodes[node].next;
+            if (node == NO_NODE) {
+                ++level;
+                if (level < book->levels.size()) node = book->levelAt(level).head;
+            }
+            return *this;
+        }
+
+        order_iterator operator++(int)
+        {
+            order_iterator it = *this;
+            ++(*this);
+            return it;
+        }
+
+        bool operator==(const order_iterator& rhs) const { return node == rhs.node && level == rhs.level; }
+        bool operator!=(const order_iterator& rhs) const { return !(*this == rhs); }
+    };
+
+    typedef order_iterator<CMPMetaDExBook, CMPMetaDEx> iterator;
+    typedef order_iterator<const CMPMetaDExBook, const CMPMetaDEx> const_iterator;
+
+    CMPMetaDExBook() : nOrders(0) {}
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, levels.size()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, levels.size()); }
+
+    /** Returns the first order at the given price, or end(), if there is none. */
+    iterator find(const CMPMetaDExPrice& price);
+
+    /** Returns the number of orders. */
+    size_t size() const { return nOrders; }
+    /** Returns true, if there are no orders. */
+    bool empty() const { return nOrders == 0; }
+    /** Returns the number of price levels. */
+    size_t getLevelCount() const { return levels.size(); }
+
+    /** Inserts an order, and returns false, if an order of the same block and position exists at the price. */
+    bool insert(const CMPMetaDEx& order);
+
+    /** Removes an order, and returns the iterator to the next order. Other iterators are invalidated. */
+    iterator erase(iterator it);
+
+    /** Removes all orders. */
+    void clear();
+};
+
 namespace mastercore
 {
 struct MetaDEx_compare
@@ -110,19 +294,14 @@ struct MetaDEx_compare
 };
 
 // ---------------
-//! Set of objects sorted by block+idx
-typedef std::set<CMPMetaDEx, MetaDEx_compare> md_Set; 
-//! Map of prices; there is a set of sorted objects for each price
-typedef std::map<rational_t, md_Set> md_PricesMap;
-//! Map of properties; there is a map of prices for each property
-typedef std::map<uint32_t, md_PricesMap> md_PropertiesMap;
+//! Map of properties; there is an order book for each property for sale
+typedef std::map<uint32_t, CMPMetaDExBook> md_PropertiesMap;
 
 //! Global map for price and order data
 extern md_PropertiesMap metadex;
 
 // TODO: explore a property-pair, instead of a single property as map's key........
-md_PricesMap* get_Prices(uint32_t prop);
-md_Set* get_Indexes(md_PricesMap* p, rational_t price);
+CMPMetaDExBook* get_Book(uint32_t prop);
 // ---------------
 
 int MetaDEx_ADD(const std::string& sender_addr, uint32_t, int64_t, int block, uint32_t property_desired, int64_t amount_desired, const uint256& txid, unsigned int idx);
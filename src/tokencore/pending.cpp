@@ -53,6 +53,8 @@ void PendingAdd(const uint256& txid, const std::string& sendingAddress, uint16_t
         LOCK(cs_pending);
         my_pending.insert(std::make_pair(txid, pending));
     }
+    // the reduced available balance is visible to RPC readers right away
+    PublishTallyView();
     // after adding a transaction to pending the available balance may now be reduced, refresh wallet totals
     CheckWalletUpdate(true); // force an update since some outbound pending (eg MetaDEx cancel) may not change balances
     uiInterface.TokenPendingChanged(true);
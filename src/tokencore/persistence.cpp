@@ -6,6 +6,7 @@
 
 #include "tokencore/persistence.h"
 
+#include "tokencore/consensushash.h"
 #include "tokencore/dex.h"
 #include "tokencore/log.h"
 #include "tokencore/mdex.h"
@@ -16,7 +17,12 @@
 #include "tokencore/utilsbitcoin.h"
 
 #include "chain.h"
+#include "clientversion.h"
+#include "crypto/common.h"
+#include "hash.h"
 #include "main.h"
+#include "serialize.h"
+#include "streams.h"
 #include "tinyformat.h"
 #include "uint256.h"
 #include "util.h"
@@ -27,9 +33,20 @@
 
 #include <openssl/sha.h>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
+#include <algorithm>
 #include <fstream>
+#include <iterator>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -63,6 +80,20 @@ static char const * const statePrefix[NUM_FILETYPES] = {
     "mdexorders",
 };
 
+//! Prefix of binary state snapshot files
+static char const * const snapshotPrefix = "snapshot";
+
+//! Magic bytes at the beginning of binary state snapshots
+static const char SNAPSHOT_MAGIC[8] = {'T', 'O', 'K', 'S', 'N', 'A', 'P', 0};
+//! Version of the binary state snapshot format
+static const uint32_t SNAPSHOT_VERSION = 1;
+//! Size of the snapshot header: magic, version and number of sections
+static const size_t SNAPSHOT_HEADER_SIZE = sizeof(SNAPSHOT_MAGIC) + 4 + 4;
+//! Size of a section header: type, length of the payload and checksum
+static const size_t SNAPSHOT_SECTION_HEADER_SIZE = 4 + 8 + 32;
+//! Size of a balance entry: property identifier and four tally amounts
+static const size_t SNAPSHOT_BALANCE_ENTRY_SIZE = 4 + 4 * 8;
+
 static bool is_state_prefix(std::string const &str)
 {
     for (int i = 0; i < NUM_FILETYPES; ++i) {
@@ -74,124 +105,154 @@ static bool is_state_prefix(std::string const &str)
     return false;
 }
 
-static int write_msc_balances(std::ofstream& file, SHA256_CTX* shaCtx)
+/**
+ * Checks, whether the components of a file name, split by "-" and ".", refer
+ * to a text state file or a binary state snapshot.
+ */
+static bool is_state_file(const std::vector<std::string>& vstr)
 {
+    if (vstr.size() != 3) return false;
+    if (is_state_prefix(vstr[0]) && boost::equals(vstr[2], "dat")) return true;
+    if (boost::equals(vstr[0], snapshotPrefix) && boost::equals(vstr[2], "bin")) return true;
+
+    return false;
+}
+
+static boost::filesystem::path get_snapshot_path(const uint256& blockHash)
+{
+    return pathStateFiles / strprintf("%s-%s.bin", snapshotPrefix, blockHash.ToString());
+}
+
+/**
+ * Writes the balances section.
+ *
+ * The section has a fixed little-endian layout, so it can be read directly
+ * from a memory mapped file: the number of addresses, followed by the length
+ * of the address, the address, the number of entries and the entries of each
+ * address. Empty balances are not written.
+ */
+static int write_snapshot_balances(CDataStream& ss)
+{
+    uint32_t nAddresses = 0;
+    ser_writedata32(ss, nAddresses); // updated once all addresses are written
+
     std::unordered_map<std::string, CMPTally>::iterator iter;
     for (iter = mp_tally_map.begin(); iter != mp_tally_map.end(); ++iter) {
-        bool emptyWallet = true;
+        CMPTally& curAddr = iter->second;
+        CDataStream ssEntries(SER_DISK, CLIENT_VERSION);
+        uint32_t nEntries = 0;
 
-        std::string lineOut = (*iter).first;
-        lineOut.append("=");
-        CMPTally& curAddr = (*iter).second;
         curAddr.init();
         uint32_t propertyId = 0;
         while (0 != (propertyId = curAddr.next())) {
-            int64_t balance = (*iter).second.getMoney(propertyId, BALANCE);
-            int64_t sellReserved = (*iter).second.getMoney(propertyId, SELLOFFER_RESERVE);
-            int64_t acceptReserved = (*iter).second.getMoney(propertyId, ACCEPT_RESERVE);
-            int64_t metadexReserved = (*iter).second.getMoney(propertyId, METADEX_RESERVE);
+            int64_t balance = curAddr.getMoney(propertyId, BALANCE);
+            int64_t sellReserved = curAddr.getMoney(propertyId, SELLOFFER_RESERVE);
+            int64_t acceptReserved = curAddr.getMoney(propertyId, ACCEPT_RESERVE);
+            int64_t metadexReserved = curAddr.getMoney(propertyId, METADEX_RESERVE);
 
-            // we don't allow 0 balances to read in, so if we don't write them
-            // it makes things match up better between persisted state and processed state
             if (0 == balance && 0 == sellReserved && 0 == acceptReserved && 0 == metadexReserved) {
                 continue;
             }
 
-            emptyWallet = false;
-
-            lineOut.append(strprintf("%d:%d,%d,%d,%d;",
-                    propertyId,
-                    balance,
-                    sellReserved,
-                    acceptReserved,
-                    metadexReserved));
+            ser_writedata32(ssEntries, propertyId);
+            ser_writedata64(ssEntries, balance);
+            ser_writedata64(ssEntries, sellReserved);
+            ser_writedata64(ssEntries, acceptReserved);
+            ser_writedata64(ssEntries, metadexReserved);
+            ++nEntries;
         }
 
-        if (false == emptyWallet) {
-            // add the line to the hash
-            SHA256_Update(shaCtx, lineOut.c_str(), lineOut.length());
-
-            // write the line
-            file << lineOut << std::endl;
+        if (0 == nEntries) {
+            continue;
         }
+
+        ser_writedata32(ss, iter->first.size());
+        ss.write(iter->first.data(), iter->first.size());
+        ser_writedata32(ss, nEntries);
+        ss.write(&ssEntries[0], ssEntries.size());
+        ++nAddresses;
     }
 
+    WriteLE32((unsigned char*) &ss[0], nAddresses);
+
     return 0;
 }
 
-static int write_mp_offers(std::ofstream& file, SHA256_CTX* shaCtx)
+static int write_snapshot_offers(CDataStream& ss)
 {
-    OfferMap::const_iterator iter;
-    for (iter = my_offers.begin(); iter != my_offers.end(); ++iter) {
+    for (OfferMap::const_iterator iter = my_offers.begin(); iter != my_offers.end(); ++iter) {
         // decompose the key for address
         std::vector<std::string> vstr;
         boost::split(vstr, iter->first, boost::is_any_of("-"), boost::token_compress_on);
-        const CMPOffer& offer = iter->second;
-        offer.saveOffer(file, shaCtx, vstr[0]);
+        ss << vstr[0] << iter->second;
     }
 
     return 0;
 }
 
-static int write_mp_accepts(std::ofstream& file, SHA256_CTX* shaCtx)
+static int write_snapshot_accepts(CDataStream& ss)
 {
-    AcceptMap::const_iterator iter;
-    for (iter = my_accepts.begin(); iter != my_accepts.end(); ++iter) {
+    for (AcceptMap::const_iterator iter = my_accepts.begin(); iter != my_accepts.end(); ++iter) {
         // decompose the key for address
         std::vector<std::string> vstr;
         boost::split(vstr, iter->first, boost::is_any_of("-+"), boost::token_compress_on);
-        const CMPAccept& accept = iter->second;
-        accept.saveAccept(file, shaCtx, vstr[0], vstr[2]);
+        ss << vstr[0] << vstr[2] << iter->second;
     }
 
     return 0;
 }
 
-static int write_globals_state(std::ofstream& file, SHA256_CTX* shaCtx)
+static int write_snapshot_globals(CDataStream& ss)
 {
     uint32_t nextSPID = pDbSpInfo->peekNextSPID(TOKEN_PROPERTY_MSC);
     uint32_t nextTestSPID = pDbSpInfo->peekNextSPID(TOKEN_PROPERTY_TMSC);
-    std::string lineOut = strprintf("%d,%d,%d",
-            exodus_prev,
-            nextSPID,
-            nextTestSPID);
-
-    // add the line to the hash
-    SHA256_Update(shaCtx, lineOut.c_str(), lineOut.length());
-
-    // write the line
-    file << lineOut << std::endl;
+    ss << exodus_prev << nextSPID << nextTestSPID;
 
     return 0;
 }
 
-static int write_mp_crowdsales(std::ofstream& file, SHA256_CTX* shaCtx)
+static int write_snapshot_crowdsales(CDataStream& ss)
 {
     for (CrowdMap::const_iterator it = my_crowds.begin(); it != my_crowds.end(); ++it) {
-        // decompose the key for address
-        const CMPCrowd& crowd = it->second;
-        crowd.saveCrowdSale(file, shaCtx, it->first);
+        ss << it->first << it->second;
     }
 
     return 0;
 }
 
-static int write_mp_metadex(std::ofstream &file, SHA256_CTX* shaCtx)
+static int write_snapshot_metadex(CDataStream& ss)
 {
-    for (md_PropertiesMap::iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-        md_PricesMap& prices = my_it->second;
-        for (md_PricesMap::iterator it = prices.begin(); it != prices.end(); ++it) {
-            md_Set& indexes = (it->second);
-            for (md_Set::iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                const CMPMetaDEx& meta = *it;
-                meta.saveOffer(file, shaCtx);
-            }
+    for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
+        const CMPMetaDExBook& book = my_it->second;
+        for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+            ss << *it;
         }
     }
 
     return 0;
 }
 
+/**
+ * Restores the balances of one property of an address, and updates the holder
+ * index and state hash accordingly.
+ */
+static void restore_tally_entry(const std::string& address, CMPTally& tally, uint32_t propertyId,
+        int64_t balance, int64_t sellReserved, int64_t acceptReserved, int64_t metadexReserved)
+{
+    int64_t ownedBefore = tally.getMoneyOwned(propertyId);
+    std::string strEntryBefore = GenerateConsensusString(tally, address, propertyId);
+
+    if (balance) tally.updateMoney(propertyId, balance, BALANCE);
+    if (sellReserved) tally.updateMoney(propertyId, sellReserved, SELLOFFER_RESERVE);
+    if (acceptReserved) tally.updateMoney(propertyId, acceptReserved, ACCEPT_RESERVE);
+    if (metadexReserved) tally.updateMoney(propertyId, metadexReserved, METADEX_RESERVE);
+
+    int64_t ownedAfter = tally.getMoneyOwned(propertyId);
+    mp_holder_index.update(address, propertyId, ownedAfter - ownedBefore, ownedAfter);
+    mp_state_hash.Remove(CMPStateHash::BALANCES, propertyId, strEntryBefore);
+    mp_state_hash.Add(CMPStateHash::BALANCES, propertyId, GenerateConsensusString(tally, address, propertyId));
+}
+
 static int input_msc_balances_string(const std::string& s)
 {
     // "address=propertybalancedata"
@@ -228,10 +289,7 @@ static int input_msc_balances_string(const std::string& s)
         int64_t acceptReserved = boost::lexical_cast<int64_t>(curBalance[2]);
         int64_t metadexReserved = boost::lexical_cast<int64_t>(curBalance[3]);
 
-        if (balance) update_tally_map(strAddress, propertyId, balance, BALANCE);
-        if (sellReserved) update_tally_map(strAddress, propertyId, sellReserved, SELLOFFER_RESERVE);
-        if (acceptReserved) update_tally_map(strAddress, propertyId, acceptReserved, ACCEPT_RESERVE);
-        if (metadexReserved) update_tally_map(strAddress, propertyId, metadexReserved, METADEX_RESERVE);
+        restore_tally_entry(strAddress, mp_tally_map[strAddress], propertyId, balance, sellReserved, acceptReserved, metadexReserved);
     }
 
     return 0;
@@ -265,6 +323,7 @@ static int input_mp_offers_string(const std::string& s)
     CMPOffer newOffer(offerBlock, amountOriginal, prop, btcDesired, minFee, blocktimelimit, txid);
 
     if (!my_offers.insert(std::make_pair(combo, newOffer)).second) return -1;
+    mp_state_hash.AddOffer(newOffer, sellerAddr);
 
     return 0;
 }
@@ -400,55 +459,249 @@ static int input_mp_mdexorder_string(const std::string& s)
     return 0;
 }
 
-static int write_state_file(const CBlockIndex* pBlockIndex, int what)
+/**
+ * Writes the in-memory state as binary snapshot.
+ *
+ * The snapshot starts with a magic, the format version and the number of
+ * sections. Each section is prefixed by its type, the length of its payload
+ * and the double SHA256 hash of the payload. The file is written to a
+ * temporary location first, so an interrupted write leaves no partial
+ * snapshot behind.
+ */
+int WriteStateSnapshot(const boost::filesystem::path& path)
 {
-    boost::filesystem::path path = pathStateFiles / strprintf("%s-%s.dat", statePrefix[what], pBlockIndex->GetBlockHash().ToString());
-    const std::string strFile = path.string();
-
-    std::ofstream file;
-    file.open(strFile.c_str());
+    boost::filesystem::path pathTmp = path;
+    pathTmp += ".tmp";
 
-    SHA256_CTX shaCtx;
-    SHA256_Init(&shaCtx);
+    CAutoFile file(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        PrintToLog("%s(): ERROR: failed to open %s\n", __func__, pathTmp.string());
+        return -1;
+    }
 
     int result = 0;
 
-    switch (what) {
-        case FILETYPE_BALANCES:
-            result = write_msc_balances(file, &shaCtx);
-            break;
+    try {
+        file.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        file << SNAPSHOT_VERSION << (uint32_t) NUM_FILETYPES;
+
+        for (int what = 0; what < NUM_FILETYPES; ++what) {
+            CDataStream ss(SER_DISK, CLIENT_VERSION);
+
+            switch (what) {
+                case FILETYPE_BALANCES:
+                    result = write_snapshot_balances(ss);
+                    break;
+
+                case FILETYPE_OFFERS:
+                    result = write_snapshot_offers(ss);
+                    break;
 
+                case FILETYPE_ACCEPTS:
+                    result = write_snapshot_accepts(ss);
+                    break;
+
+                case FILETYPE_GLOBALS:
+                    result = write_snapshot_globals(ss);
+                    break;
+
+                case FILETYPE_CROWDSALES:
+                    result = write_snapshot_crowdsales(ss);
+                    break;
+
+                case FILETYPE_MDEXORDERS:
+                    result = write_snapshot_metadex(ss);
+                    break;
+            }
+
+            if (result < 0) break;
+
+            uint256 checksum = Hash(ss.begin(), ss.end());
+            file << (uint32_t) what << (uint64_t) ss.size() << checksum;
+            if (!ss.empty()) file.write(&ss[0], ss.size());
+        }
+
+        FileCommit(file.Get());
+    } catch (const std::exception& e) {
+        PrintToLog("%s(): ERROR: failed to write %s: %s\n", __func__, pathTmp.string(), e.what());
+        result = -1;
+    }
+
+    file.fclose();
+
+    if (result < 0 || !RenameOver(pathTmp, path)) {
+        boost::filesystem::remove(pathTmp);
+        return -1;
+    }
+
+    return result;
+}
+
+/**
+ * A read-only view of a state snapshot.
+ *
+ * The file is memory mapped where supported, so the balances section is read
+ * in place, and otherwise loaded into memory.
+ */
+class CSnapshotFile
+{
+private:
+    const unsigned char* pbegin;
+    size_t nSize;
+#ifdef WIN32
+    std::vector<unsigned char> vchData;
+#else
+    void* pmap;
+#endif
+
+public:
+    CSnapshotFile() : pbegin(NULL), nSize(0)
+#ifndef WIN32
+        , pmap(MAP_FAILED)
+#endif
+    {
+    }
+
+    ~CSnapshotFile()
+    {
+#ifndef WIN32
+        if (pmap != MAP_FAILED) munmap(pmap, nSize);
+#endif
+    }
+
+    bool Open(const std::string& filename)
+    {
+#ifdef WIN32
+        std::ifstream file(filename.c_str(), std::ios::binary);
+        if (!file.is_open()) return false;
+        vchData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        pbegin = vchData.empty() ? NULL : &vchData[0];
+        nSize = vchData.size();
+        return true;
+#else
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            close(fd);
+            return false;
+        }
+        nSize = st.st_size;
+        pmap = mmap(NULL, nSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (pmap == MAP_FAILED) return false;
+        pbegin = static_cast<const unsigned char*>(pmap);
+        return true;
+#endif
+    }
+
+    const unsigned char* begin() const { return pbegin; }
+    const unsigned char* end() const { return pbegin + nSize; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * Restores the balances section in place.
+ *
+ * The tally map is reserved for all addresses upfront.
+ */
+static int restore_snapshot_balances(const unsigned char* p, const unsigned char* pend)
+{
+    if (pend - p < 4) return -1;
+    uint32_t nAddresses = ReadLE32(p);
+    p += 4;
+
+    mp_tally_map.reserve(mp_tally_map.size() + nAddresses);
+
+    for (uint32_t i = 0; i < nAddresses; ++i) {
+        if (pend - p < 4) return -1;
+        uint32_t nLength = ReadLE32(p);
+        p += 4;
+        if ((size_t) (pend - p) < (size_t) nLength + 4) return -1;
+        std::string strAddress((const char*) p, nLength);
+        p += nLength;
+        uint32_t nEntries = ReadLE32(p);
+        p += 4;
+        if ((size_t) (pend - p) / SNAPSHOT_BALANCE_ENTRY_SIZE < nEntries) return -1;
+
+        CMPTally& tally = mp_tally_map[strAddress];
+        for (uint32_t n = 0; n < nEntries; ++n) {
+            uint32_t propertyId = ReadLE32(p);
+            int64_t balance = ReadLE64(p + 4);
+            int64_t sellReserved = ReadLE64(p + 12);
+            int64_t acceptReserved = ReadLE64(p + 20);
+            int64_t metadexReserved = ReadLE64(p + 28);
+            p += SNAPSHOT_BALANCE_ENTRY_SIZE;
+
+            restore_tally_entry(strAddress, tally, propertyId, balance, sellReserved, acceptReserved, metadexReserved);
+        }
+    }
+
+    return (p == pend) ? 0 : -1;
+}
+
+static int restore_snapshot_section(int what, const unsigned char* pbegin, const unsigned char* pend)
+{
+    if (FILETYPE_BALANCES == what) {
+        return restore_snapshot_balances(pbegin, pend);
+    }
+
+    CDataStream ss((const char*) pbegin, (const char*) pend, SER_DISK, CLIENT_VERSION);
+
+    switch (what) {
         case FILETYPE_OFFERS:
-            result = write_mp_offers(file, &shaCtx);
+            while (!ss.empty()) {
+                std::string sellerAddr;
+                CMPOffer offer;
+                ss >> sellerAddr >> offer;
+                const std::string combo = STR_SELLOFFER_ADDR_PROP_COMBO(sellerAddr, offer.getProperty());
+                if (!my_offers.insert(std::make_pair(combo, offer)).second) return -1;
+                mp_state_hash.AddOffer(offer, sellerAddr);
+            }
             break;
 
         case FILETYPE_ACCEPTS:
-            result = write_mp_accepts(file, &shaCtx);
+            while (!ss.empty()) {
+                std::string sellerAddr, buyerAddr;
+                CMPAccept accept;
+                ss >> sellerAddr >> buyerAddr >> accept;
+                const std::string combo = STR_ACCEPT_ADDR_PROP_ADDR_COMBO(sellerAddr, buyerAddr, accept.getProperty());
+                if (!my_accepts.insert(std::make_pair(combo, accept)).second) return -1;
+            }
             break;
 
         case FILETYPE_GLOBALS:
-            result = write_globals_state(file, &shaCtx);
+        {
+            int64_t exodusPrev;
+            uint32_t nextSPID, nextTestSPID;
+            ss >> exodusPrev >> nextSPID >> nextTestSPID;
+            exodus_prev = exodusPrev;
+            pDbSpInfo->init(nextSPID, nextTestSPID);
             break;
+        }
 
         case FILETYPE_CROWDSALES:
-            result = write_mp_crowdsales(file, &shaCtx);
+            while (!ss.empty()) {
+                std::string sellerAddr;
+                CMPCrowd crowdsale;
+                ss >> sellerAddr >> crowdsale;
+                if (!my_crowds.insert(std::make_pair(sellerAddr, crowdsale)).second) return -1;
+            }
             break;
 
         case FILETYPE_MDEXORDERS:
-            result = write_mp_metadex(file, &shaCtx);
+            while (!ss.empty()) {
+                CMPMetaDEx mdexObj;
+                ss >> mdexObj;
+                if (!MetaDEx_INSERT(mdexObj)) return -1;
+            }
             break;
-    }
 
-    // generate and wite the double hash of all the contents written
-    uint256 hash1;
-    SHA256_Final((unsigned char*) &hash1, &shaCtx);
-    uint256 hash2;
-    SHA256((unsigned char*) &hash1, sizeof (hash1), (unsigned char*) &hash2);
-    file << "!" << hash2.ToString() << std::endl;
+        default:
+            return -1;
+    }
 
-    file.flush();
-    file.close();
-    return result;
+    return ss.empty() ? 0 : -1;
 }
 
 static void prune_state_files(const CBlockIndex* topIndex)
@@ -468,9 +721,7 @@ static void prune_state_files(const CBlockIndex* topIndex)
 
         std::vector<std::string> vstr;
         boost::split(vstr, fName, boost::is_any_of("-."), boost::token_compress_on);
-        if (vstr.size() == 3 &&
-                is_state_prefix(vstr[0]) &&
-                boost::equals(vstr[2], "dat")) {
+        if (is_state_file(vstr)) {
             uint256 blockHash;
             blockHash.SetHex(vstr[1]);
             statefulBlockHashes.insert(blockHash);
@@ -502,10 +753,136 @@ static void prune_state_files(const CBlockIndex* topIndex)
                 boost::filesystem::path path = pathStateFiles / strprintf("%s-%s.dat", statePrefix[i], strBlockHash);
                 boost::filesystem::remove(path);
             }
+            boost::filesystem::remove(get_snapshot_path(*iter));
         }
     }
 }
 
+/**
+ * Clears the in-memory state, which is restored from a file of the given type.
+ */
+static void clear_in_memory_state(int what)
+{
+    switch (what) {
+        case FILETYPE_BALANCES:
+            mp_tally_map.clear();
+            mp_holder_index.clear();
+            mp_tally_snapshot.markAllDirty();
+            mp_state_hash.Clear(CMPStateHash::BALANCES);
+            break;
+
+        case FILETYPE_OFFERS:
+            my_offers.clear();
+            mp_state_hash.Clear(CMPStateHash::DEX_OFFERS);
+            break;
+
+        case FILETYPE_ACCEPTS:
+            my_accepts.clear();
+            break;
+
+        case FILETYPE_CROWDSALES:
+            my_crowds.clear();
+            break;
+
+        case FILETYPE_MDEXORDERS:
+            // FIXME
+            // memory leak ... gotta unallocate inner layers first....
+            // TODO
+            // ...
+            metadex.clear();
+            mp_state_hash.Clear(CMPStateHash::METADEX_TRADES);
+            break;
+    }
+}
+
+/**
+ * Loads and restores the state from a binary snapshot.
+ *
+ * The structure and the checksums of all sections are verified before any
+ * state is touched. If a section can't be restored nevertheless, the whole
+ * in-memory state is cleared, so no partial state remains loaded.
+ *
+ * @return 0 on success, or -1, if the snapshot is missing, incomplete or corrupted
+ */
+int RestoreStateSnapshot(const std::string& filename)
+{
+    CSnapshotFile file;
+    if (!file.Open(filename)) {
+        if (msc_debug_persistence) PrintToLog("%s(%s): failed to open file\n", __func__, filename);
+        return -1;
+    }
+
+    const unsigned char* p = file.begin();
+    const unsigned char* pend = file.end();
+
+    if (file.size() < SNAPSHOT_HEADER_SIZE || !std::equal(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC + sizeof(SNAPSHOT_MAGIC), (const char*) p)) {
+        PrintToLog("%s(%s): ERROR: not a state snapshot\n", __func__, filename);
+        return -1;
+    }
+    p += sizeof(SNAPSHOT_MAGIC);
+
+    uint32_t nVersion = ReadLE32(p);
+    uint32_t nSections = ReadLE32(p + 4);
+    p += 8;
+
+    if (nVersion != SNAPSHOT_VERSION || nSections != NUM_FILETYPES) {
+        PrintToLog("%s(%s): ERROR: unsupported snapshot version %d with %d sections\n", __func__, filename, nVersion, nSections);
+        return -1;
+    }
+
+    // locate and verify all sections first
+    std::vector<std::pair<const unsigned char*, const unsigned char*> > vSections;
+
+    for (uint32_t i = 0; i < nSections; ++i) {
+        if ((size_t) (pend - p) < SNAPSHOT_SECTION_HEADER_SIZE) break;
+        uint32_t what = ReadLE32(p);
+        uint64_t nLength = ReadLE64(p + 4);
+        uint256 checksum;
+        memcpy(checksum.begin(), p + 12, 32);
+        p += SNAPSHOT_SECTION_HEADER_SIZE;
+
+        if (what != i || (uint64_t) (pend - p) < nLength) break;
+
+        const unsigned char* pSectionEnd = p + nLength;
+        if (Hash(p, pSectionEnd) != checksum) {
+            PrintToLog("%s(%s): ERROR: checksum mismatch of section %s\n", __func__, filename, statePrefix[what]);
+            break;
+        }
+
+        vSections.push_back(std::make_pair(p, pSectionEnd));
+        p = pSectionEnd;
+    }
+
+    if (vSections.size() != nSections || p != pend) {
+        PrintToLog("%s(%s): ERROR: snapshot is incomplete or corrupted\n", __func__, filename);
+        return -1;
+    }
+
+    int res = 0;
+
+    for (int what = 0; what < NUM_FILETYPES && res == 0; ++what) {
+        clear_in_memory_state(what);
+
+        try {
+            res = restore_snapshot_section(what, vSections[what].first, vSections[what].second);
+        } catch (const std::exception& e) {
+            PrintToLog("%s(%s): ERROR: failed to read section %s: %s\n", __func__, filename, statePrefix[what], e.what());
+            res = -1;
+        }
+    }
+
+    if (res < 0) {
+        for (int what = 0; what < NUM_FILETYPES; ++what) {
+            clear_in_memory_state(what);
+        }
+    }
+
+    PrintToLog("%s(%s), res= %d\n", __FUNCTION__, filename, res);
+    LogPrintf("%s(): file: %s , res= %d\n", __FUNCTION__, filename, res);
+
+    return res;
+}
+
 /**
  * Indicates whether persistence is enabled and the state is stored.
  */
@@ -520,17 +897,12 @@ bool IsPersistenceEnabled(int blockHeight) {
 }
 
 /**
- * Stores the in-memory state in files.
+ * Stores the in-memory state in a binary snapshot.
  */
 int PersistInMemoryState(const CBlockIndex* pBlockIndex)
 {
     // write the new state as of the given block
-    write_state_file(pBlockIndex, FILETYPE_BALANCES);
-    write_state_file(pBlockIndex, FILETYPE_OFFERS);
-    write_state_file(pBlockIndex, FILETYPE_ACCEPTS);
-    write_state_file(pBlockIndex, FILETYPE_GLOBALS);
-    write_state_file(pBlockIndex, FILETYPE_CROWDSALES);
-    write_state_file(pBlockIndex, FILETYPE_MDEXORDERS);
+    WriteStateSnapshot(get_snapshot_path(pBlockIndex->GetBlockHash()));
 
     // clean-up the directory
     prune_state_files(pBlockIndex);
@@ -551,19 +923,22 @@ int RestoreInMemoryState(const std::string& filename, int what, bool verifyHash)
     SHA256_CTX shaCtx;
     SHA256_Init(&shaCtx);
 
+    if (what < 0 || what >= NUM_FILETYPES) {
+        return -1;
+    }
+
+    clear_in_memory_state(what);
+
     switch (what) {
         case FILETYPE_BALANCES:
-            mp_tally_map.clear();
             inputLineFunc = input_msc_balances_string;
             break;
 
         case FILETYPE_OFFERS:
-            my_offers.clear();
             inputLineFunc = input_mp_offers_string;
             break;
 
         case FILETYPE_ACCEPTS:
-            my_accepts.clear();
             inputLineFunc = input_mp_accepts_string;
             break;
 
@@ -572,21 +947,12 @@ int RestoreInMemoryState(const std::string& filename, int what, bool verifyHash)
             break;
 
         case FILETYPE_CROWDSALES:
-            my_crowds.clear();
             inputLineFunc = input_mp_crowdsale_string;
             break;
 
         case FILETYPE_MDEXORDERS:
-            // FIXME
-            // memory leak ... gotta unallocate inner layers first....
-            // TODO
-            // ...
-            metadex.clear();
             inputLineFunc = input_mp_mdexorder_string;
             break;
-
-        default:
-            return -1;
     }
 
     if (msc_debug_persistence) {
@@ -706,8 +1072,7 @@ int LoadMostRelevantInMemoryState()
         std::string fName = (*--dIter->path().end()).string();
         std::vector<std::string> vstr;
         boost::split(vstr, fName, boost::is_any_of("-."), boost::token_compress_on);
-        if (vstr.size() == 3 &&
-                boost::equals(vstr[2], "dat")) {
+        if (is_state_file(vstr)) {
             uint256 blockHash;
             blockHash.SetHex(vstr[1]);
             CBlockIndex *pBlockIndex = GetBlockIndex(blockHash);
@@ -731,15 +1096,24 @@ int LoadMostRelevantInMemoryState()
     while (NULL != curTip && persistedBlocks.size() > 0 && curTip->nHeight > abortRollBackBlock ) {
         if (persistedBlocks.find(curTip->GetBlockHash()) != persistedBlocks.end()) {
             int success = -1;
-            for (int i = 0; i < NUM_FILETYPES; ++i) {
-                boost::filesystem::path path = pathStateFiles / strprintf("%s-%s.dat", statePrefix[i], curTip->GetBlockHash().ToString());
-                const std::string strFile = path.string();
-                success = RestoreInMemoryState(strFile, i, true);
-                if (success < 0) {
-                    PrintToConsole("Found a state inconsistency at block height %d. "
-                            "Reverting up to %d blocks.. this may take a few minutes.\n",
-                            curTip->nHeight, (curTip->nHeight - abortRollBackBlock - 1));
-                    break;
+
+            // prefer the binary snapshot, and fall back to text files of earlier versions
+            boost::filesystem::path pathSnapshot = get_snapshot_path(curTip->GetBlockHash());
+            if (boost::filesystem::exists(pathSnapshot)) {
+                success = RestoreStateSnapshot(pathSnapshot.string());
+            }
+
+            if (success < 0) {
+                for (int i = 0; i < NUM_FILETYPES; ++i) {
+                    boost::filesystem::path path = pathStateFiles / strprintf("%s-%s.dat", statePrefix[i], curTip->GetBlockHash().ToString());
+                    const std::string strFile = path.string();
+                    success = RestoreInMemoryState(strFile, i, true);
+                    if (success < 0) {
+                        PrintToConsole("Found a state inconsistency at block height %d. "
+                                "Reverting up to %d blocks.. this may take a few minutes.\n",
+                                curTip->nHeight, (curTip->nHeight - abortRollBackBlock - 1));
+                        break;
+                    }
                 }
             }
 
@@ -11,6 +11,12 @@ bool IsPersistenceEnabled(int blockHeight);
 /** Stores the in-memory state in files. */
 int PersistInMemoryState(const CBlockIndex* pBlockIndex);
 
+/** Stores the in-memory state in a binary snapshot. */
+int WriteStateSnapshot(const boost::filesystem::path& path);
+
+/** Loads and restores the in-memory state from a binary snapshot. */
+int RestoreStateSnapshot(const std::string& filename);
+
 /** Loads and retrieves state from a file. */
 int RestoreInMemoryState(const std::string& filename, int what, bool verifyHash = false);
 
@@ -54,7 +54,9 @@
 #include <univalue.h>
 
 #include <stdint.h>
+#include <algorithm>
 #include <map>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <tuple>
@@ -146,12 +148,13 @@ void MetaDexObjectsToJSON(std::vector<CMPMetaDEx>& vMetaDexObjs, UniValue& respo
     }
 }
 
-bool BalanceToJSON(const std::string& address, uint32_t property, UniValue& balance_obj, bool divisible)
+/** Adds the balances of an address, as seen by a published tally view, to a JSON object. */
+bool BalanceToJSON(const CMPTallyView& tallyView, const std::string& address, uint32_t property, UniValue& balance_obj, bool divisible)
 {
     // confirmed balance minus unconfirmed, spent amounts
-    int64_t nAvailable = GetAvailableTokenBalance(address, property);
-    int64_t nReserved = GetReservedTokenBalance(address, property);
-    int64_t nFrozen = GetFrozenTokenBalance(address, property);
+    int64_t nAvailable = tallyView.getMoneyAvailable(address, property);
+    int64_t nReserved = tallyView.getMoneyReserved(address, property);
+    int64_t nFrozen = tallyView.getMoneyFrozen(address, property);
 
     if (divisible) {
         balance_obj.pushKV("balance", FormatDivisibleMP(nAvailable));
@@ -621,7 +624,7 @@ static UniValue gettokenbalance(const JSONRPCRequest& request)
     RequireExistingProperty(propertyId);
 
     UniValue balanceObj(UniValue::VOBJ);
-    BalanceToJSON(address, propertyId, balanceObj, isPropertyDivisible(propertyId));
+    BalanceToJSON(*GetTallyView(), address, propertyId, balanceObj, isPropertyDivisible(propertyId));
 
     return balanceObj;
 }
@@ -658,28 +661,23 @@ static UniValue getalltokenbalances(const JSONRPCRequest& request)
     UniValue response(UniValue::VARR);
     bool isDivisible = isPropertyDivisible(propertyId); // we want to check this BEFORE the loop
 
-    LOCK(cs_tally);
+    // balances are read from a published view, without blocking the processing of blocks
+    std::shared_ptr<const CMPTallyView> tallyView = GetTallyView();
 
-    for (std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
-        uint32_t id = 0;
-        bool includeAddress = false;
-        std::string address = it->first;
-        (it->second).init();
-        while (0 != (id = (it->second).next())) {
-            if (id == propertyId) {
-                includeAddress = true;
-                break;
+    for (const std::shared_ptr<const CMPTallyView::Shard>& shard : tallyView->getShards()) {
+        for (CMPTallyView::Shard::const_iterator it = shard->begin(); it != shard->end(); ++it) {
+            const std::string& address = it->first;
+            std::vector<uint32_t> propertyIds = (it->second).getPropertyIds();
+            if (!std::binary_search(propertyIds.begin(), propertyIds.end(), propertyId)) {
+                continue; // ignore this address, has never transacted in this propertyId
             }
-        }
-        if (!includeAddress) {
-            continue; // ignore this address, has never transacted in this propertyId
-        }
-        UniValue balanceObj(UniValue::VOBJ);
-        balanceObj.pushKV("address", address);
-        bool nonEmptyBalance = BalanceToJSON(address, propertyId, balanceObj, isDivisible);
+            UniValue balanceObj(UniValue::VOBJ);
+            balanceObj.pushKV("address", address);
+            bool nonEmptyBalance = BalanceToJSON(*tallyView, address, propertyId, balanceObj, isDivisible);
 
-        if (nonEmptyBalance) {
-            response.push_back(balanceObj);
+            if (nonEmptyBalance) {
+                response.push_back(balanceObj);
+            }
         }
     }
 
@@ -714,18 +712,15 @@ static UniValue getalltokenbalancesforaddress(const JSONRPCRequest& request)
 
     UniValue response(UniValue::VARR);
 
-    LOCK(cs_tally);
+    std::shared_ptr<const CMPTallyView> tallyView = GetTallyView();
 
-    CMPTally* addressTally = getTally(address);
+    const CMPTally* addressTally = tallyView->getTally(address);
 
     if (nullptr == addressTally) { // addressTally object does not exist
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Address not found");
     }
 
-    addressTally->init();
-
-    uint32_t propertyId = 0;
-    while (0 != (propertyId = addressTally->next())) {
+    for (uint32_t propertyId : addressTally->getPropertyIds()) {
         CMPSPInfo::Entry property;
         if (!pDbSpInfo->getSP(propertyId, property)) {
             continue;
@@ -736,7 +731,7 @@ static UniValue getalltokenbalancesforaddress(const JSONRPCRequest& request)
         balanceObj.pushKV("name", property.name);
         balanceObj.pushKV("ticker", property.ticker);
 
-        bool nonEmptyBalance = BalanceToJSON(address, propertyId, balanceObj, property.isDivisible());
+        bool nonEmptyBalance = BalanceToJSON(*tallyView, address, propertyId, balanceObj, property.isDivisible());
 
         if (nonEmptyBalance) {
             response.push_back(balanceObj);
@@ -806,20 +801,17 @@ static UniValue getwallettokenbalances(const JSONRPCRequest& request)
     std::set<std::string> addresses = getWalletAddresses(request, fIncludeWatchOnly);
     std::map<uint32_t, std::tuple<int64_t, int64_t, int64_t>> balances;
 
-    LOCK(cs_tally);
+    std::shared_ptr<const CMPTallyView> tallyView = GetTallyView();
     for (const std::string& address : addresses) {
-        CMPTally* addressTally = getTally(address);
+        const CMPTally* addressTally = tallyView->getTally(address);
         if (nullptr == addressTally) {
             continue; // address doesn't have tokens
         }
 
-        uint32_t propertyId = 0;
-        addressTally->init();
-
-        while (0 != (propertyId = addressTally->next())) {
-            int64_t nAvailable = GetAvailableTokenBalance(address, propertyId);
-            int64_t nReserved = GetReservedTokenBalance(address, propertyId);
-            int64_t nFrozen = GetFrozenTokenBalance(address, propertyId);
+        for (uint32_t propertyId : addressTally->getPropertyIds()) {
+            int64_t nAvailable = tallyView->getMoneyAvailable(address, propertyId);
+            int64_t nReserved = tallyView->getMoneyReserved(address, propertyId);
+            int64_t nFrozen = tallyView->getMoneyFrozen(address, propertyId);
 
             if (!nAvailable && !nReserved && !nFrozen) {
                 continue;
@@ -1021,18 +1013,16 @@ static UniValue getwalletaddresstokenbalances(const JSONRPCRequest& request)
 
     std::set<std::string> addresses = getWalletAddresses(request, fIncludeWatchOnly);
 
-    LOCK(cs_tally);
+    std::shared_ptr<const CMPTallyView> tallyView = GetTallyView();
     for (const std::string& address : addresses) {
-        CMPTally* addressTally = getTally(address);
+        const CMPTally* addressTally = tallyView->getTally(address);
         if (nullptr == addressTally) {
             continue; // address doesn't have tokens
         }
 
         UniValue arrBalances(UniValue::VARR);
-        uint32_t propertyId = 0;
-        addressTally->init();
 
-        while (0 != (propertyId = addressTally->next())) {
+        for (uint32_t propertyId : addressTally->getPropertyIds()) {
             CMPSPInfo::Entry property;
             if (!pDbSpInfo->getSP(propertyId, property)) {
                 continue; // token wasn't found in the DB
@@ -1043,7 +1033,7 @@ static UniValue getwalletaddresstokenbalances(const JSONRPCRequest& request)
             objBalance.pushKV("name", property.name);
             objBalance.pushKV("ticker", property.ticker);
 
-            bool nonEmptyBalance = BalanceToJSON(address, propertyId, objBalance, property.isDivisible());
+            bool nonEmptyBalance = BalanceToJSON(*tallyView, address, propertyId, objBalance, property.isDivisible());
 
             if (nonEmptyBalance) {
                 arrBalances.push_back(objBalance);
@@ -1561,15 +1551,12 @@ static UniValue gettokenorderbook(const JSONRPCRequest& request)
     std::vector<CMPMetaDEx> vecMetaDexObjects;
     {
         LOCK(cs_tally);
-        for (md_PropertiesMap::const_iterator my_it = metadex.begin(); my_it != metadex.end(); ++my_it) {
-            const md_PricesMap& prices = my_it->second;
-            for (md_PricesMap::const_iterator it = prices.begin(); it != prices.end(); ++it) {
-                const md_Set& indexes = it->second;
-                for (md_Set::const_iterator it = indexes.begin(); it != indexes.end(); ++it) {
-                    const CMPMetaDEx& obj = *it;
-                    if (obj.getProperty() != propertyIdForSale) continue;
-                    if (!filterDesired || obj.getDesProperty() == propertyIdDesired) vecMetaDexObjects.push_back(obj);
-                }
+        md_PropertiesMap::const_iterator my_it = metadex.find(propertyIdForSale);
+        if (my_it != metadex.end()) {
+            const CMPMetaDExBook& book = my_it->second;
+            for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+                const CMPMetaDEx& obj = *it;
+                if (!filterDesired || obj.getDesProperty() == propertyIdDesired) vecMetaDexObjects.push_back(obj);
             }
         }
     }
@@ -1895,11 +1882,11 @@ static UniValue listblocktokentransactions(const JSONRPCRequest& request)
 
     LOCK(cs_tally);
 
-    for (const auto tx : block.vtx) {
-        if (pDbTransactionList->exists(tx.GetHash())) {
+    for (const auto& tx : block.vtx) {
+        if (pDbTransactionList->exists(tx->GetHash())) {
             // later we can add a verbose flag to decode here, but for now callers can send returned txids into gettransaction_MP
             // add the txid into the response as it's an MP transaction
-            response.push_back(tx.GetHash().GetHex());
+            response.push_back(tx->GetHash().GetHex());
         }
     }
 
@@ -2301,7 +2288,8 @@ static UniValue gettokenconsensushash(const JSONRPCRequest& request)
             "{\n"
             "  \"block\" : nnnnnn,          (number) the index of the block this consensus hash applies to\n"
             "  \"blockhash\" : \"hash\",      (string) the hash of the corresponding block\n"
-            "  \"consensushash\" : \"hash\"   (string) the consensus hash for the block\n"
+            "  \"consensushash\" : \"hash\",  (string) the consensus hash for the block\n"
+            "  \"statehash\" : \"hash\"       (string) the incrementally maintained state hash for the block\n"
             "}\n"
 
             "\nExamples:\n"
@@ -2317,11 +2305,13 @@ static UniValue gettokenconsensushash(const JSONRPCRequest& request)
     uint256 blockHash = pblockindex->GetBlockHash();
 
     uint256 consensusHash = GetConsensusHash();
+    uint256 stateHash = GetStateHash();
 
     UniValue response(UniValue::VOBJ);
     response.pushKV("block", block);
     response.pushKV("blockhash", blockHash.GetHex());
     response.pushKV("consensushash", consensusHash.GetHex());
+    response.pushKV("statehash", stateHash.GetHex());
 
     return response;
 }
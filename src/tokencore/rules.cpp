@@ -148,6 +148,7 @@ CMainConsensusParams::CMainConsensusParams()
 
     FEES_FEATURE_BLOCK = std::numeric_limits<int>::max();
     FREEZENOTICE_FEATURE_BLOCK = std::numeric_limits<int>::max();
+    USERNAMEHOLDER_FEATURE_BLOCK = std::numeric_limits<int>::max();
 }
 
 /**
@@ -189,6 +190,7 @@ CTestNetConsensusParams::CTestNetConsensusParams()
 
     FEES_FEATURE_BLOCK = std::numeric_limits<int>::max();
     FREEZENOTICE_FEATURE_BLOCK = std::numeric_limits<int>::max();
+    USERNAMEHOLDER_FEATURE_BLOCK = std::numeric_limits<int>::max();
 }
 
 /**
@@ -230,6 +232,7 @@ CRegTestConsensusParams::CRegTestConsensusParams()
 
     FEES_FEATURE_BLOCK = std::numeric_limits<int>::max();
     FREEZENOTICE_FEATURE_BLOCK = std::numeric_limits<int>::max();
+    USERNAMEHOLDER_FEATURE_BLOCK = std::numeric_limits<int>::max();
 }
 
 //! Consensus parameters for mainnet
@@ -409,6 +412,9 @@ bool ActivateFeature(uint16_t featureId, int activationBlock, uint32_t minClient
         case FEATURE_FREEZENOTICE:
             MutableConsensusParams().FREEZENOTICE_FEATURE_BLOCK = activationBlock;
         break;
+        case FEATURE_USERNAMEHOLDER:
+            MutableConsensusParams().USERNAMEHOLDER_FEATURE_BLOCK = activationBlock;
+        break;
         default:
             supported = false;
         break;
@@ -480,6 +486,9 @@ bool DeactivateFeature(uint16_t featureId, int transactionBlock)
         case FEATURE_FREEZENOTICE:
             MutableConsensusParams().FREEZENOTICE_FEATURE_BLOCK = 999999;
         break;
+        case FEATURE_USERNAMEHOLDER:
+            MutableConsensusParams().USERNAMEHOLDER_FEATURE_BLOCK = 999999;
+        break;
         default:
             return false;
         break;
@@ -511,6 +520,7 @@ std::string GetFeatureName(uint16_t featureId)
         case FEATURE_FEES: return "Fee system (inc 0.05% fee from trades of non-Token pairs)";
         case FEATURE_STOV1: return "Cross-property Send To Owners";
         case FEATURE_FREEZENOTICE: return "Activate the waiting period for enabling freezing";
+        case FEATURE_USERNAMEHOLDER: return "Resolve usernames to the current holder";
 
         default: return "Unknown feature";
     }
@@ -558,6 +568,9 @@ bool IsFeatureActivated(uint16_t featureId, int transactionBlock)
         case FEATURE_FREEZENOTICE:
             activationBlock = params.FREEZENOTICE_FEATURE_BLOCK;
         break;
+        case FEATURE_USERNAMEHOLDER:
+            activationBlock = params.USERNAMEHOLDER_FEATURE_BLOCK;
+        break;
         default:
             return false;
     }
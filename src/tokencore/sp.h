@@ -6,6 +6,8 @@
 #include "tokencore/log.h"
 #include "tokencore/tokencore.h"
 
+#include "serialize.h"
+
 class CBlockIndex;
 class uint256;
 
@@ -47,6 +49,21 @@ public:
     CMPCrowd();
     CMPCrowd(uint32_t pid, int64_t nv, uint32_t cd, int64_t dl, uint8_t eb, uint8_t per, int64_t uct, int64_t ict);
 
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(propertyId);
+        READWRITE(nValue);
+        READWRITE(property_desired);
+        READWRITE(deadline);
+        READWRITE(early_bird);
+        READWRITE(percentage);
+        READWRITE(u_created);
+        READWRITE(i_created);
+        READWRITE(txFundraiserData);
+    }
+
     uint32_t getPropertyId() const { return propertyId; }
 
     int64_t getDeadline() const { return deadline; }
@@ -3,8 +3,17 @@
 #include "tokencore/log.h"
 #include "tokencore/tokencore.h"
 
+#include "sync.h"
+
 #include <stdint.h>
+#include <functional>
 #include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 /**
  * Creates an empty tally.
@@ -14,6 +23,29 @@ CMPTally::CMPTally()
     my_it = mp_token.begin();
 }
 
+/**
+ * Creates a copy of another tally.
+ *
+ * The internal iterator of the copy points to the first element of its own
+ * balance records, and not into the records of the other tally.
+ */
+CMPTally::CMPTally(const CMPTally& other) : mp_token(other.mp_token)
+{
+    my_it = mp_token.begin();
+}
+
+/**
+ * Replaces the tally with a copy of another tally.
+ */
+CMPTally& CMPTally::operator=(const CMPTally& other)
+{
+    if (this != &other) {
+        mp_token = other.mp_token;
+        my_it = mp_token.begin();
+    }
+    return *this;
+}
+
 /**
  * Resets the internal iterator.
  *
@@ -166,6 +198,51 @@ int64_t CMPTally::getMoneyReserved(uint32_t propertyId) const
     return money;
 }
 
+/**
+ * Returns the number of owned tokens.
+ *
+ * Owned tokens are the available and all reserved tokens, but pending
+ * balances are not included.
+ *
+ * @param propertyId  The identifier of the tally to lookup
+ * @return The owned balance
+ */
+int64_t CMPTally::getMoneyOwned(uint32_t propertyId) const
+{
+    int64_t money = 0;
+    TokenMap::const_iterator it = mp_token.find(propertyId);
+
+    if (it != mp_token.end()) {
+        const BalanceRecord& record = it->second;
+        money += record.balance[BALANCE];
+        money += record.balance[SELLOFFER_RESERVE];
+        money += record.balance[ACCEPT_RESERVE];
+        money += record.balance[METADEX_RESERVE];
+    }
+
+    return money;
+}
+
+/**
+ * Returns the identifiers of all tally elements.
+ *
+ * Unlike init() and next(), this doesn't modify the tally, and can be used
+ * on tallies, which are shared by a CMPTallyView.
+ *
+ * @return The property identifiers in ascending order
+ */
+std::vector<uint32_t> CMPTally::getPropertyIds() const
+{
+    std::vector<uint32_t> propertyIds;
+    propertyIds.reserve(mp_token.size());
+
+    for (TokenMap::const_iterator it = mp_token.begin(); it != mp_token.end(); ++it) {
+        propertyIds.push_back(it->first);
+    }
+
+    return propertyIds;
+}
+
 /**
  * Compares the tally with another tally and returns true, if they are equal.
  *
@@ -251,3 +328,290 @@ int64_t CMPTally::print(uint32_t propertyId, bool bDivisible) const
 
     return (balance + selloffer_reserve + accept_reserve + metadex_reserve);
 }
+
+/**
+ * Records a change of the number of owned tokens of an address.
+ *
+ * @param address     The address of the updated tally
+ * @param propertyId  The identifier of the updated tally element
+ * @param amount      The amount that was added to the tally
+ * @param owned       The number of owned tokens after the update
+ */
+void CMPHolderIndex::update(const std::string& address, uint32_t propertyId, int64_t amount, int64_t owned)
+{
+    mp_totals[propertyId] += amount;
+
+    if (owned > 0) {
+        mp_holders[propertyId].insert(address);
+        return;
+    }
+
+    std::unordered_map<uint32_t, HolderSet>::iterator it = mp_holders.find(propertyId);
+    if (it != mp_holders.end()) {
+        it->second.erase(address);
+        if (it->second.empty()) {
+            mp_holders.erase(it);
+        }
+    }
+}
+
+/**
+ * Returns the total number of owned tokens of a property.
+ *
+ * @param propertyId  The identifier of the property
+ * @return The sum of all owned tokens
+ */
+int64_t CMPHolderIndex::getTotal(uint32_t propertyId) const
+{
+    std::unordered_map<uint32_t, int64_t>::const_iterator it = mp_totals.find(propertyId);
+    if (it != mp_totals.end()) {
+        return it->second;
+    }
+
+    return 0;
+}
+
+/**
+ * Returns the number of addresses holding tokens of a property.
+ *
+ * @param propertyId  The identifier of the property
+ * @return The number of holders
+ */
+int64_t CMPHolderIndex::getHolderCount(uint32_t propertyId) const
+{
+    const HolderSet* pholders = getHolders(propertyId);
+    if (pholders) {
+        return pholders->size();
+    }
+
+    return 0;
+}
+
+/**
+ * Returns the addresses holding tokens of a property.
+ *
+ * @param propertyId  The identifier of the property
+ * @return The holders, or NULL, if there are none
+ */
+const CMPHolderIndex::HolderSet* CMPHolderIndex::getHolders(uint32_t propertyId) const
+{
+    std::unordered_map<uint32_t, HolderSet>::const_iterator it = mp_holders.find(propertyId);
+    if (it != mp_holders.end()) {
+        return &(it->second);
+    }
+
+    return NULL;
+}
+
+/**
+ * Removes all entries.
+ */
+void CMPHolderIndex::clear()
+{
+    mp_holders.clear();
+    mp_totals.clear();
+}
+
+/**
+ * Creates an empty view.
+ *
+ * All shards of the empty view share a single empty shard.
+ */
+CMPTallyView::CMPTallyView()
+{
+    std::shared_ptr<const Shard> empty = std::make_shared<Shard>();
+    shards.assign(SHARD_COUNT, empty);
+}
+
+/**
+ * Returns the shard, which holds the tally of the given address.
+ *
+ * @param address  The address
+ * @return The index of the shard
+ */
+size_t CMPTallyView::getShardIndex(const std::string& address)
+{
+    return std::hash<std::string>()(address) % SHARD_COUNT;
+}
+
+/**
+ * Returns the tally of an address.
+ *
+ * The tally is owned by the view, and remains valid as long as the view.
+ *
+ * @param address  The address to lookup
+ * @return The tally, or NULL, if the address has none
+ */
+const CMPTally* CMPTallyView::getTally(const std::string& address) const
+{
+    const Shard& shard = *shards[getShardIndex(address)];
+    Shard::const_iterator it = shard.find(address);
+    if (it != shard.end()) {
+        return &(it->second);
+    }
+
+    return NULL;
+}
+
+/**
+ * Returns the number of tokens for the given tally type.
+ */
+int64_t CMPTallyView::getMoney(const std::string& address, uint32_t propertyId, TallyType ttype) const
+{
+    const CMPTally* tally = getTally(address);
+    if (tally == NULL) {
+        return 0;
+    }
+
+    return tally->getMoney(propertyId, ttype);
+}
+
+/**
+ * Returns the number of available tokens.
+ *
+ * Outgoing pending amounts reduce the available balance.
+ */
+int64_t CMPTallyView::getMoneyAvailable(const std::string& address, uint32_t propertyId) const
+{
+    const CMPTally* tally = getTally(address);
+    if (tally == NULL) {
+        return 0;
+    }
+
+    return tally->getMoneyAvailable(propertyId);
+}
+
+/**
+ * Returns the number of reserved tokens.
+ */
+int64_t CMPTallyView::getMoneyReserved(const std::string& address, uint32_t propertyId) const
+{
+    const CMPTally* tally = getTally(address);
+    if (tally == NULL) {
+        return 0;
+    }
+
+    return tally->getMoneyReserved(propertyId);
+}
+
+/**
+ * Returns the balance of an address, if it is frozen for the property.
+ */
+int64_t CMPTallyView::getMoneyFrozen(const std::string& address, uint32_t propertyId) const
+{
+    if (!isFrozen(address, propertyId)) {
+        return 0;
+    }
+
+    return getMoney(address, propertyId, BALANCE);
+}
+
+/**
+ * Checks, whether an address was frozen for the property.
+ */
+bool CMPTallyView::isFrozen(const std::string& address, uint32_t propertyId) const
+{
+    return frozen.count(std::make_pair(address, propertyId)) > 0;
+}
+
+/**
+ * Creates a publisher with an empty view.
+ */
+CMPTallySnapshot::CMPTallySnapshot() : view(std::make_shared<CMPTallyView>()), fAllDirty(false)
+{
+}
+
+/**
+ * Marks the tally of an address as modified.
+ */
+void CMPTallySnapshot::markDirty(const std::string& address)
+{
+    if (!fAllDirty) {
+        dirty.insert(address);
+    }
+}
+
+/**
+ * Marks the whole tally map as modified.
+ */
+void CMPTallySnapshot::markAllDirty()
+{
+    fAllDirty = true;
+    dirty.clear();
+}
+
+/**
+ * Publishes a new view of the tally map.
+ *
+ * Only the shards with modified addresses are copied, all other shards are
+ * shared with the previous view. Readers of the previous view are not
+ * affected.
+ *
+ * @param tallyMap         The tally map, must be guarded by cs_tally
+ * @param frozenAddresses  The frozen addresses, must be guarded by cs_tally
+ */
+void CMPTallySnapshot::publish(const std::unordered_map<std::string, CMPTally>& tallyMap, const CMPTallyView::FrozenSet& frozenAddresses)
+{
+    std::shared_ptr<const CMPTallyView> prev = get();
+
+    if (!fAllDirty && dirty.empty() && prev->frozen == frozenAddresses) {
+        return;
+    }
+
+    std::shared_ptr<CMPTallyView> next = std::make_shared<CMPTallyView>();
+    next->frozen = frozenAddresses;
+
+    if (fAllDirty) {
+        std::vector<std::shared_ptr<CMPTallyView::Shard> > fresh;
+        fresh.reserve(CMPTallyView::SHARD_COUNT);
+        for (size_t i = 0; i < CMPTallyView::SHARD_COUNT; ++i) {
+            fresh.push_back(std::make_shared<CMPTallyView::Shard>());
+        }
+        for (std::unordered_map<std::string, CMPTally>::const_iterator it = tallyMap.begin(); it != tallyMap.end(); ++it) {
+            fresh[CMPTallyView::getShardIndex(it->first)]->insert(*it);
+        }
+        for (size_t i = 0; i < CMPTallyView::SHARD_COUNT; ++i) {
+            next->shards[i] = fresh[i];
+        }
+    } else {
+        next->shards = prev->shards;
+
+        std::map<size_t, std::shared_ptr<CMPTallyView::Shard> > copies;
+        for (std::set<std::string>::const_iterator it = dirty.begin(); it != dirty.end(); ++it) {
+            const std::string& address = *it;
+            size_t index = CMPTallyView::getShardIndex(address);
+
+            std::shared_ptr<CMPTallyView::Shard>& shard = copies[index];
+            if (!shard) {
+                shard = std::make_shared<CMPTallyView::Shard>(*prev->shards[index]);
+            }
+
+            std::unordered_map<std::string, CMPTally>::const_iterator itTally = tallyMap.find(address);
+            if (itTally == tallyMap.end()) {
+                shard->erase(address);
+            } else {
+                (*shard)[address] = itTally->second;
+            }
+        }
+        for (std::map<size_t, std::shared_ptr<CMPTallyView::Shard> >::const_iterator it = copies.begin(); it != copies.end(); ++it) {
+            next->shards[it->first] = it->second;
+        }
+    }
+
+    dirty.clear();
+    fAllDirty = false;
+
+    LOCK(cs_view);
+    view = next;
+}
+
+/**
+ * Returns the latest published view.
+ *
+ * The view is immutable, and can be used without holding cs_tally.
+ */
+std::shared_ptr<const CMPTallyView> CMPTallySnapshot::get() const
+{
+    LOCK(cs_view);
+    return view;
+}
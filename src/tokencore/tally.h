@@ -1,8 +1,16 @@
 #ifndef TOKENCORE_TALLY_H
 #define TOKENCORE_TALLY_H
 
+#include "sync.h"
+
 #include <stdint.h>
 #include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 //! Balance record types
 enum TallyType {
@@ -34,6 +42,12 @@ public:
     /** Creates an empty tally. */
     CMPTally();
 
+    /** Creates a copy of another tally. */
+    CMPTally(const CMPTally& other);
+
+    /** Replaces the tally with a copy of another tally. */
+    CMPTally& operator=(const CMPTally& other);
+
     /** Resets the internal iterator. */
     uint32_t init();
 
@@ -52,6 +66,12 @@ public:
     /** Returns the number of reserved tokens. */
     int64_t getMoneyReserved(uint32_t propertyId) const;
 
+    /** Returns the number of owned tokens, excluding pending balances. */
+    int64_t getMoneyOwned(uint32_t propertyId) const;
+
+    /** Returns the identifiers of all tally elements in ascending order. */
+    std::vector<uint32_t> getPropertyIds() const;
+
     /** Compares the tally with another tally and returns true, if they are equal. */
     bool operator==(const CMPTally& rhs) const;
 
@@ -62,5 +82,129 @@ public:
     int64_t print(uint32_t propertyId = 1, bool bDivisible = true) const;
 };
 
+/** Index of token holders and token totals per property.
+ *
+ * Only tally types, which count towards the number of tokens in
+ * circulation, are tracked, i.e. every type except pending balances.
+ */
+class CMPHolderIndex
+{
+public:
+    //! Set of holders of a single property
+    typedef std::set<std::string> HolderSet;
+
+private:
+    //! Addresses with a positive number of owned tokens per property
+    std::unordered_map<uint32_t, HolderSet> mp_holders;
+    //! Total number of owned tokens per property
+    std::unordered_map<uint32_t, int64_t> mp_totals;
+
+public:
+    /** Records a change of the number of owned tokens of an address. */
+    void update(const std::string& address, uint32_t propertyId, int64_t amount, int64_t owned);
+
+    /** Returns the total number of owned tokens of a property. */
+    int64_t getTotal(uint32_t propertyId) const;
+
+    /** Returns the number of addresses holding tokens of a property. */
+    int64_t getHolderCount(uint32_t propertyId) const;
+
+    /** Returns the addresses holding tokens of a property, or NULL, if there are none. */
+    const HolderSet* getHolders(uint32_t propertyId) const;
+
+    /** Removes all entries. */
+    void clear();
+};
+
+/** Immutable view of all tallies and frozen addresses at a point in time.
+ *
+ * Addresses are partitioned into shards by hash. Shards are never modified
+ * once published, so a new view copies only the shards with changed
+ * addresses, and shares all other shards with the previous view.
+ */
+class CMPTallyView
+{
+public:
+    //! Tallies of the addresses of a single shard
+    typedef std::unordered_map<std::string, CMPTally> Shard;
+    //! Set of frozen addresses and properties
+    typedef std::set<std::pair<std::string, uint32_t> > FrozenSet;
+
+    //! Number of shards
+    static const size_t SHARD_COUNT = 256;
+
+private:
+    friend class CMPTallySnapshot;
+
+    //! Shards, which may be shared with other views
+    std::vector<std::shared_ptr<const Shard> > shards;
+    //! Frozen addresses at the time of the view
+    FrozenSet frozen;
+
+public:
+    /** Creates an empty view. */
+    CMPTallyView();
+
+    /** Returns the shard, which holds the tally of the given address. */
+    static size_t getShardIndex(const std::string& address);
+
+    /** Returns the tally of an address, or NULL, if there is none. */
+    const CMPTally* getTally(const std::string& address) const;
+
+    /** Returns the number of tokens for the given tally type. */
+    int64_t getMoney(const std::string& address, uint32_t propertyId, TallyType ttype) const;
+
+    /** Returns the number of available tokens, reduced by outgoing pending amounts. */
+    int64_t getMoneyAvailable(const std::string& address, uint32_t propertyId) const;
+
+    /** Returns the number of reserved tokens. */
+    int64_t getMoneyReserved(const std::string& address, uint32_t propertyId) const;
+
+    /** Returns the balance of an address, if it is frozen for the property. */
+    int64_t getMoneyFrozen(const std::string& address, uint32_t propertyId) const;
+
+    /** Checks, whether an address is frozen for the property. */
+    bool isFrozen(const std::string& address, uint32_t propertyId) const;
+
+    /** Returns the shards of the view. */
+    const std::vector<std::shared_ptr<const Shard> >& getShards() const { return shards; }
+};
+
+/** Publishes copy-on-write views of the tally map.
+ *
+ * The writer marks the addresses it modifies and publishes a new view
+ * once its changes are complete. Readers obtain the latest view without
+ * acquiring cs_tally, and keep it alive as long as they need it.
+ */
+class CMPTallySnapshot
+{
+private:
+    //! Guards view
+    mutable Mutex cs_view;
+    //! Latest published view
+    std::shared_ptr<const CMPTallyView> view;
+
+    //! Addresses modified since the last publication, guarded by cs_tally
+    std::set<std::string> dirty;
+    //! Whether the whole tally map must be copied, guarded by cs_tally
+    bool fAllDirty;
+
+public:
+    /** Creates a publisher with an empty view. */
+    CMPTallySnapshot();
+
+    /** Marks the tally of an address as modified. */
+    void markDirty(const std::string& address);
+
+    /** Marks the whole tally map as modified, e.g. after it was cleared or restored. */
+    void markAllDirty();
+
+    /** Publishes a new view, if anything has changed since the last one. */
+    void publish(const std::unordered_map<std::string, CMPTally>& tallyMap, const CMPTallyView::FrozenSet& frozenAddresses);
+
+    /** Returns the latest published view. */
+    std::shared_ptr<const CMPTallyView> get() const;
+};
+
 
 #endif // TOKENCORE_TALLY_H
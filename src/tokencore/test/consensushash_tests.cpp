@@ -0,0 +1,89 @@
+#include "tokencore/consensushash.h"
+
+#include "test/test_bitcoin.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+BOOST_FIXTURE_TEST_SUITE(tokencore_consensushash_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(state_hash_empty)
+{
+    CMPStateHash stateHash;
+    BOOST_CHECK(stateHash.GetSectionHash(CMPStateHash::BALANCES) == stateHash.GetSectionHash(CMPStateHash::METADEX_TRADES));
+    BOOST_CHECK(stateHash.GetSectionHash(CMPStateHash::METADEX_TRADES, 3) == stateHash.GetSectionHash(CMPStateHash::METADEX_TRADES));
+
+    // Empty entries are ignored
+    uint256 emptyHash = stateHash.GetHash();
+    stateHash.Add(CMPStateHash::BALANCES, 3, "");
+    BOOST_CHECK(stateHash.GetHash() == emptyHash);
+}
+
+BOOST_AUTO_TEST_CASE(state_hash_order_independent)
+{
+    CMPStateHash stateHash1;
+    stateHash1.Add(CMPStateHash::BALANCES, 3, "alice|3|100|0|0|0");
+    stateHash1.Add(CMPStateHash::BALANCES, 3, "bob|3|50|0|0|0");
+    stateHash1.Add(CMPStateHash::BALANCES, 4, "bob|4|1|0|0|0");
+
+    CMPStateHash stateHash2;
+    stateHash2.Add(CMPStateHash::BALANCES, 4, "bob|4|1|0|0|0");
+    stateHash2.Add(CMPStateHash::BALANCES, 3, "bob|3|50|0|0|0");
+    stateHash2.Add(CMPStateHash::BALANCES, 3, "alice|3|100|0|0|0");
+
+    BOOST_CHECK(stateHash1.GetHash() == stateHash2.GetHash());
+    BOOST_CHECK(stateHash1.GetSectionHash(CMPStateHash::BALANCES, 3) == stateHash2.GetSectionHash(CMPStateHash::BALANCES, 3));
+    BOOST_CHECK(stateHash1.GetSectionHash(CMPStateHash::BALANCES, 3) != stateHash1.GetSectionHash(CMPStateHash::BALANCES, 4));
+
+    // The same entry in another section results in a different hash
+    CMPStateHash stateHash3;
+    stateHash3.Add(CMPStateHash::DEX_OFFERS, 4, "bob|4|1|0|0|0");
+    stateHash3.Add(CMPStateHash::BALANCES, 3, "bob|3|50|0|0|0");
+    stateHash3.Add(CMPStateHash::BALANCES, 3, "alice|3|100|0|0|0");
+    BOOST_CHECK(stateHash1.GetHash() != stateHash3.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(state_hash_update)
+{
+    CMPStateHash stateHash1;
+    stateHash1.Add(CMPStateHash::BALANCES, 3, "alice|3|100|0|0|0");
+    stateHash1.Add(CMPStateHash::BALANCES, 3, "bob|3|50|0|0|0");
+
+    // Move 25 tokens from alice to bob
+    stateHash1.Remove(CMPStateHash::BALANCES, 3, "alice|3|100|0|0|0");
+    stateHash1.Add(CMPStateHash::BALANCES, 3, "alice|3|75|0|0|0");
+    stateHash1.Remove(CMPStateHash::BALANCES, 3, "bob|3|50|0|0|0");
+    stateHash1.Add(CMPStateHash::BALANCES, 3, "bob|3|75|0|0|0");
+
+    CMPStateHash stateHash2;
+    stateHash2.Add(CMPStateHash::BALANCES, 3, "bob|3|75|0|0|0");
+    stateHash2.Add(CMPStateHash::BALANCES, 3, "alice|3|75|0|0|0");
+
+    BOOST_CHECK(stateHash1.GetHash() == stateHash2.GetHash());
+
+    // Removing every entry results in an empty state
+    stateHash1.Remove(CMPStateHash::BALANCES, 3, "alice|3|75|0|0|0");
+    stateHash1.Remove(CMPStateHash::BALANCES, 3, "bob|3|75|0|0|0");
+    BOOST_CHECK(stateHash1.GetHash() == CMPStateHash().GetHash());
+
+    // A property without entries is dropped
+    BOOST_CHECK(stateHash1.GetSectionHash(CMPStateHash::BALANCES, 3) == CMPStateHash().GetSectionHash(CMPStateHash::BALANCES, 3));
+
+    // Removing an entry of a property without entries is ignored, and the property is tracked as usual later
+    stateHash1.Remove(CMPStateHash::BALANCES, 4, "bob|4|1|0|0|0");
+    BOOST_CHECK(stateHash1.GetHash() == CMPStateHash().GetHash());
+    stateHash1.Add(CMPStateHash::BALANCES, 4, "bob|4|1|0|0|0");
+    stateHash1.Remove(CMPStateHash::BALANCES, 4, "bob|4|1|0|0|0");
+    BOOST_CHECK(stateHash1.GetHash() == CMPStateHash().GetHash());
+    BOOST_CHECK(stateHash1.GetSectionHash(CMPStateHash::BALANCES, 4) == CMPStateHash().GetSectionHash(CMPStateHash::BALANCES, 4));
+
+    stateHash2.Clear();
+    BOOST_CHECK(stateHash2.GetHash() == CMPStateHash().GetHash());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
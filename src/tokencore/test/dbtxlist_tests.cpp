@@ -0,0 +1,57 @@
+#include "tokencore/dbtxlist.h"
+
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "tinyformat.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <stdint.h>
+#include <set>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(tokencore_dbtxlist_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(send_all_rollback)
+{
+    boost::filesystem::path path = GetTempPath() / strprintf("test_txlist_%d", GetRand(100000));
+    {
+        CMPTxList txlist(path, true);
+
+        uint256 txidKept = GetRandHash();
+        txlist.recordTX(txidKept, true, 99, 4, 2);
+        txlist.recordSendAllSubRecord(txidKept, 99, 1, 3, 100);
+        txlist.recordSendAllSubRecord(txidKept, 99, 2, 4, 50);
+
+        uint256 txidReorged = GetRandHash();
+        txlist.recordTX(txidReorged, true, 100, 4, 1);
+        txlist.recordSendAllSubRecord(txidReorged, 100, 1, 3, 25);
+
+        uint32_t propertyId = 0;
+        int64_t amount = 0;
+        BOOST_CHECK(txlist.getSendAllDetails(txidReorged, 1, propertyId, amount));
+        BOOST_CHECK_EQUAL(propertyId, 3U);
+        BOOST_CHECK_EQUAL(amount, 25);
+
+        // Roll back block 100
+        BOOST_CHECK(txlist.isMPinBlockRange(100, 999999, true));
+
+        BOOST_CHECK(!txlist.exists(txidReorged));
+        BOOST_CHECK(!txlist.getSendAllDetails(txidReorged, 1, propertyId, amount));
+        BOOST_CHECK(!txlist.isMPinBlockRange(100, 999999, false));
+
+        // Records of earlier blocks are not affected
+        BOOST_CHECK(txlist.exists(txidKept));
+        BOOST_CHECK(txlist.getSendAllDetails(txidKept, 1, propertyId, amount));
+        BOOST_CHECK_EQUAL(propertyId, 3U);
+        BOOST_CHECK_EQUAL(amount, 100);
+        BOOST_CHECK(txlist.getSendAllDetails(txidKept, 2, propertyId, amount));
+        BOOST_CHECK_EQUAL(propertyId, 4U);
+        BOOST_CHECK_EQUAL(amount, 50);
+    }
+    boost::filesystem::remove_all(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,146 @@
+#include "tokencore/mdex.h"
+
+#include "arith_uint256.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+//! Order book structure, which was used before CMPMetaDExBook
+typedef std::map<rational_t, std::set<CMPMetaDEx, MetaDEx_compare> > LegacyBook;
+
+static CMPMetaDEx CreateOrder(int block, unsigned int idx, int64_t amountForSale, int64_t amountDesired)
+{
+    arith_uint256 txid = arith_uint256(block) * 10000 + idx;
+    return CMPMetaDEx("1PxejjeWZc9ZHph7A3SYDo2sk2Up4AcysH", block, 31, amountForSale, 1, amountDesired,
+            ArithToUint256(txid), idx, CMPTransaction::ADD);
+}
+
+BOOST_FIXTURE_TEST_SUITE(tokencore_mdex_book_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(price_key_normalized)
+{
+    BOOST_CHECK(CMPMetaDExPrice(2, 4) == CMPMetaDExPrice(1, 2));
+    BOOST_CHECK_EQUAL(CMPMetaDExPrice(2, 4).getNumerator(), 1);
+    BOOST_CHECK_EQUAL(CMPMetaDExPrice(2, 4).getDenominator(), 2);
+    BOOST_CHECK(CMPMetaDExPrice(0, 7) == CMPMetaDExPrice());
+    BOOST_CHECK(CMPMetaDExPrice(7, 0) == CMPMetaDExPrice());
+    BOOST_CHECK(CMPMetaDExPrice(3, 9).toRational() == rational_t(1, 3));
+}
+
+BOOST_AUTO_TEST_CASE(price_key_order)
+{
+    const int64_t nMax = std::numeric_limits<int64_t>::max();
+    std::vector<CMPMetaDExPrice> vPrices;
+    std::vector<rational_t> vRationals;
+
+    int64_t values[] = {1, 2, 3, 7, 100000000, 4294967296LL, 4294967297LL, nMax - 1, nMax};
+    for (int64_t num : values) {
+        for (int64_t den : values) {
+            vPrices.push_back(CMPMetaDExPrice(num, den));
+            vRationals.push_back(rational_t(num, den));
+        }
+    }
+
+    for (size_t i = 0; i < vPrices.size(); ++i) {
+        for (size_t j = 0; j < vPrices.size(); ++j) {
+            BOOST_CHECK_EQUAL(vPrices[i] < vPrices[j], vRationals[i] < vRationals[j]);
+            BOOST_CHECK_EQUAL(vPrices[i] == vPrices[j], vRationals[i] == vRationals[j]);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(book_order_matches_legacy)
+{
+    FastRandomContext rng(true);
+    CMPMetaDExBook book;
+    LegacyBook legacy;
+
+    // insert orders out of block order, at a few distinct prices
+    for (int i = 0; i < 500; ++i) {
+        int block = 1000 + rng.randrange(50);
+        unsigned int idx = rng.randrange(20);
+        int64_t amountForSale = 1 + rng.randrange(8);
+        int64_t amountDesired = 1 + rng.randrange(8);
+        CMPMetaDEx order = CreateOrder(block, idx, amountForSale, amountDesired);
+
+        bool fInserted = legacy[order.unitPrice()].insert(order).second;
+        BOOST_CHECK_EQUAL(book.insert(order), fInserted);
+    }
+
+    std::vector<uint256> vExpected;
+    for (LegacyBook::const_iterator it = legacy.begin(); it != legacy.end(); ++it) {
+        for (std::set<CMPMetaDEx, MetaDEx_compare>::const_iterator itOrder = it->second.begin(); itOrder != it->second.end(); ++itOrder) {
+            vExpected.push_back(itOrder->getHash());
+        }
+    }
+
+    std::vector<uint256> vActual;
+    for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+        BOOST_CHECK(it.price() == it->unitPriceKey());
+        vActual.push_back(it->getHash());
+    }
+
+    BOOST_CHECK_EQUAL(book.size(), vExpected.size());
+    BOOST_CHECK(vActual == vExpected);
+
+    // erase every other order, and the remaining ones keep their order
+    std::vector<uint256> vRemaining;
+    bool fErase = true;
+    for (CMPMetaDExBook::iterator it = book.begin(); it != book.end();) {
+        if (fErase) {
+            it = book.erase(it);
+        } else {
+            vRemaining.push_back(it->getHash());
+            ++it;
+        }
+        fErase = !fErase;
+    }
+
+    vActual.clear();
+    for (CMPMetaDExBook::const_iterator it = book.begin(); it != book.end(); ++it) {
+        vActual.push_back(it->getHash());
+    }
+    BOOST_CHECK(vActual == vRemaining);
+
+    for (CMPMetaDExBook::iterator it = book.begin(); it != book.end();) {
+        it = book.erase(it);
+    }
+    BOOST_CHECK(book.empty());
+    BOOST_CHECK_EQUAL(book.getLevelCount(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(book_find_price)
+{
+    CMPMetaDExBook book;
+    BOOST_CHECK(book.insert(CreateOrder(10, 1, 100, 50)));
+    BOOST_CHECK(book.insert(CreateOrder(10, 2, 100, 200)));
+    BOOST_CHECK(book.insert(CreateOrder(9, 1, 2, 1)));
+    BOOST_CHECK(!book.insert(CreateOrder(10, 1, 2, 1)));
+    BOOST_CHECK(book.insert(CreateOrder(10, 1, 1, 1)));
+
+    BOOST_CHECK_EQUAL(book.size(), 4);
+    BOOST_CHECK_EQUAL(book.getLevelCount(), 3);
+
+    CMPMetaDExBook::iterator it = book.find(CMPMetaDExPrice(1, 2));
+    BOOST_CHECK(it != book.end());
+    BOOST_CHECK_EQUAL(it->getBlock(), 9);
+    ++it;
+    BOOST_CHECK_EQUAL(it->getBlock(), 10);
+    BOOST_CHECK_EQUAL(it->getIdx(), 1);
+    BOOST_CHECK(it.price() == CMPMetaDExPrice(1, 2));
+
+    BOOST_CHECK(book.find(CMPMetaDExPrice(3, 1)) == book.end());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,174 @@
+#include "tokencore/persistence.h"
+
+#include "tokencore/consensushash.h"
+#include "tokencore/dex.h"
+#include "tokencore/mdex.h"
+#include "tokencore/sp.h"
+#include "tokencore/tally.h"
+#include "tokencore/tokencore.h"
+
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "tinyformat.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+namespace
+{
+const std::string addressA = "RbsD2aPDyaN4WdYWHUj6Ms8mRmAT3qDgNz";
+const std::string addressB = "RqBfD9k8JWmgvQLYGbx6e47NrReP7x5dw2";
+
+/** Creates a temporary SP database, which is required to persist the globals. */
+struct PersistenceTestingSetup : public BasicTestingSetup
+{
+    boost::filesystem::path pathTest;
+
+    PersistenceTestingSetup()
+    {
+        pathTest = GetTempPath() / strprintf("test_persistence_%d", GetRand(100000));
+        boost::filesystem::create_directories(pathTest);
+        pDbSpInfo = new CMPSPInfo(pathTest / "spinfo", true);
+        ClearState();
+    }
+
+    ~PersistenceTestingSetup()
+    {
+        ClearState();
+        delete pDbSpInfo;
+        pDbSpInfo = NULL;
+        boost::filesystem::remove_all(pathTest);
+    }
+
+    void ClearState()
+    {
+        LOCK(cs_tally);
+        mp_tally_map.clear();
+        mp_holder_index.clear();
+        my_offers.clear();
+        my_accepts.clear();
+        my_crowds.clear();
+        metadex.clear();
+        mp_state_hash.Clear();
+    }
+
+    void CreateState()
+    {
+        BOOST_CHECK(update_tally_map(addressA, 3, 1000, BALANCE));
+        BOOST_CHECK(update_tally_map(addressA, 4, 50, METADEX_RESERVE));
+        BOOST_CHECK(update_tally_map(addressB, 3, 200, SELLOFFER_RESERVE));
+        BOOST_CHECK(update_tally_map(addressB, 4, 7, BALANCE));
+
+        LOCK(cs_tally);
+        CMPOffer offer(10, 200, 3, 1000, 1, 10, GetRandHash());
+        my_offers.insert(std::make_pair(STR_SELLOFFER_ADDR_PROP_COMBO(addressB, 3), offer));
+        mp_state_hash.AddOffer(offer, addressB);
+
+        BOOST_CHECK(MetaDEx_INSERT(CMPMetaDEx(addressA, 11, 4, 50, 3, 100, GetRandHash(), 1, CMPTransaction::ADD)));
+    }
+
+    unsigned int CountMetaDEx()
+    {
+        unsigned int n = 0;
+        for (md_PropertiesMap::const_iterator it = metadex.begin(); it != metadex.end(); ++it) {
+            const CMPMetaDExBook& book = it->second;
+            for (CMPMetaDExBook::const_iterator it_obj = book.begin(); it_obj != book.end(); ++it_obj) {
+                ++n;
+            }
+        }
+        return n;
+    }
+
+    bool IsStateEmpty()
+    {
+        LOCK(cs_tally);
+        return mp_tally_map.empty() && my_offers.empty() && my_accepts.empty() && my_crowds.empty() && 0 == CountMetaDEx();
+    }
+};
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(tokencore_persistence_tests, PersistenceTestingSetup)
+
+BOOST_AUTO_TEST_CASE(snapshot_roundtrip)
+{
+    CreateState();
+    uint256 stateHash = GetStateHash();
+    uint256 metadexHash = mp_state_hash.GetSectionHash(CMPStateHash::METADEX_TRADES);
+    uint256 offersHash = mp_state_hash.GetSectionHash(CMPStateHash::DEX_OFFERS);
+
+    boost::filesystem::path path = pathTest / "snapshot.bin";
+    BOOST_CHECK_EQUAL(WriteStateSnapshot(path), 0);
+
+    ClearState();
+    BOOST_CHECK(IsStateEmpty());
+    BOOST_CHECK(GetStateHash() != stateHash);
+
+    BOOST_CHECK_EQUAL(RestoreStateSnapshot(path.string()), 0);
+
+    BOOST_CHECK_EQUAL(GetTokenBalance(addressA, 3, BALANCE), 1000);
+    BOOST_CHECK_EQUAL(GetTokenBalance(addressA, 4, METADEX_RESERVE), 50);
+    BOOST_CHECK_EQUAL(GetTokenBalance(addressB, 3, SELLOFFER_RESERVE), 200);
+    BOOST_CHECK_EQUAL(GetTokenBalance(addressB, 4, BALANCE), 7);
+    BOOST_CHECK_EQUAL(mp_tally_map.size(), 2U);
+
+    BOOST_CHECK_EQUAL(my_offers.size(), 1U);
+    BOOST_CHECK(my_offers.count(STR_SELLOFFER_ADDR_PROP_COMBO(addressB, 3)));
+    BOOST_CHECK(mp_state_hash.GetSectionHash(CMPStateHash::DEX_OFFERS) == offersHash);
+
+    BOOST_CHECK_EQUAL(CountMetaDEx(), 1U);
+    BOOST_CHECK(mp_state_hash.GetSectionHash(CMPStateHash::METADEX_TRADES) == metadexHash);
+
+    BOOST_CHECK(GetStateHash() == stateHash);
+    BOOST_CHECK(RebuildStateHash().GetHash() == mp_state_hash.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_truncated)
+{
+    CreateState();
+    boost::filesystem::path path = pathTest / "snapshot.bin";
+    BOOST_CHECK_EQUAL(WriteStateSnapshot(path), 0);
+    ClearState();
+
+    // The last section is cut off
+    boost::filesystem::resize_file(path, boost::filesystem::file_size(path) - 1);
+    BOOST_CHECK_EQUAL(RestoreStateSnapshot(path.string()), -1);
+    BOOST_CHECK(IsStateEmpty());
+
+    // Only the header is left
+    boost::filesystem::resize_file(path, 16);
+    BOOST_CHECK_EQUAL(RestoreStateSnapshot(path.string()), -1);
+    BOOST_CHECK(IsStateEmpty());
+
+    BOOST_CHECK_EQUAL(RestoreStateSnapshot((pathTest / "missing.bin").string()), -1);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_corrupted)
+{
+    CreateState();
+    boost::filesystem::path path = pathTest / "snapshot.bin";
+    BOOST_CHECK_EQUAL(WriteStateSnapshot(path), 0);
+
+    // A byte of the last section is flipped, which is detected before any state is loaded
+    uintmax_t nSize = boost::filesystem::file_size(path);
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file != NULL);
+    BOOST_CHECK_EQUAL(fseek(file, nSize - 1, SEEK_SET), 0);
+    int ch = fgetc(file);
+    BOOST_CHECK_EQUAL(fseek(file, nSize - 1, SEEK_SET), 0);
+    fputc(ch ^ 0xff, file);
+    fclose(file);
+
+    ClearState();
+    BOOST_CHECK_EQUAL(RestoreStateSnapshot(path.string()), -1);
+    BOOST_CHECK(IsStateEmpty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
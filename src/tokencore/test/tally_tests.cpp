@@ -3,6 +3,10 @@
 #include "test/test_bitcoin.h"
 
 #include <stdint.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
 
 #include <boost/test/unit_test.hpp>
 
@@ -319,4 +323,108 @@ BOOST_AUTO_TEST_CASE(tally_overflow)
 }
 
 
+BOOST_AUTO_TEST_CASE(tally_money_owned)
+{
+    CMPTally tally;
+    BOOST_CHECK_EQUAL(0, tally.getMoneyOwned(3));
+
+    BOOST_CHECK(tally.updateMoney(3, 5, BALANCE));
+    BOOST_CHECK(tally.updateMoney(3, 7, SELLOFFER_RESERVE));
+    BOOST_CHECK(tally.updateMoney(3, 11, ACCEPT_RESERVE));
+    BOOST_CHECK(tally.updateMoney(3, 13, METADEX_RESERVE));
+    BOOST_CHECK(tally.updateMoney(3, -17, PENDING));
+
+    BOOST_CHECK_EQUAL(36, tally.getMoneyOwned(3));
+    BOOST_CHECK_EQUAL(0, tally.getMoneyOwned(4));
+}
+
+BOOST_AUTO_TEST_CASE(holder_index)
+{
+    CMPHolderIndex index;
+    BOOST_CHECK_EQUAL(0, index.getTotal(3));
+    BOOST_CHECK_EQUAL(0, index.getHolderCount(3));
+    BOOST_CHECK(index.getHolders(3) == NULL);
+
+    index.update("alice", 3, 100, 100);
+    index.update("bob", 3, 50, 50);
+    index.update("alice", 4, 1, 1);
+
+    BOOST_CHECK_EQUAL(150, index.getTotal(3));
+    BOOST_CHECK_EQUAL(2, index.getHolderCount(3));
+    BOOST_CHECK_EQUAL(1, index.getTotal(4));
+    BOOST_CHECK_EQUAL(1, index.getHolderCount(4));
+
+    // Moving tokens into a reserve doesn't change the holders
+    index.update("bob", 3, -50, 0);
+    index.update("bob", 3, 50, 50);
+    BOOST_CHECK_EQUAL(150, index.getTotal(3));
+    BOOST_CHECK_EQUAL(2, index.getHolderCount(3));
+
+    index.update("alice", 3, -100, 0);
+    BOOST_CHECK_EQUAL(50, index.getTotal(3));
+    BOOST_CHECK_EQUAL(1, index.getHolderCount(3));
+    BOOST_CHECK(index.getHolders(3)->count("bob"));
+    BOOST_CHECK(!index.getHolders(3)->count("alice"));
+
+    index.update("bob", 3, -50, 0);
+    BOOST_CHECK_EQUAL(0, index.getTotal(3));
+    BOOST_CHECK(index.getHolders(3) == NULL);
+
+    index.clear();
+    BOOST_CHECK_EQUAL(0, index.getTotal(4));
+    BOOST_CHECK_EQUAL(0, index.getHolderCount(4));
+}
+
+BOOST_AUTO_TEST_CASE(tally_view_copy_on_write)
+{
+    std::unordered_map<std::string, CMPTally> tallyMap;
+    CMPTallyView::FrozenSet frozen;
+    CMPTallySnapshot snapshot;
+
+    BOOST_CHECK(snapshot.get()->getTally("alice") == NULL);
+
+    BOOST_CHECK(tallyMap["alice"].updateMoney(3, 100, BALANCE));
+    BOOST_CHECK(tallyMap["bob"].updateMoney(3, 50, METADEX_RESERVE));
+    snapshot.markAllDirty();
+    snapshot.publish(tallyMap, frozen);
+
+    std::shared_ptr<const CMPTallyView> first = snapshot.get();
+    BOOST_CHECK_EQUAL(100, first->getMoneyAvailable("alice", 3));
+    BOOST_CHECK_EQUAL(50, first->getMoneyReserved("bob", 3));
+    BOOST_CHECK_EQUAL(0, first->getMoneyFrozen("alice", 3));
+
+    // Changes are not visible until they are published
+    BOOST_CHECK(tallyMap["alice"].updateMoney(3, -40, PENDING));
+    snapshot.markDirty("alice");
+    BOOST_CHECK_EQUAL(100, snapshot.get()->getMoneyAvailable("alice", 3));
+
+    frozen.insert(std::make_pair(std::string("bob"), 3));
+    snapshot.publish(tallyMap, frozen);
+
+    std::shared_ptr<const CMPTallyView> second = snapshot.get();
+    BOOST_CHECK_EQUAL(60, second->getMoneyAvailable("alice", 3));
+    BOOST_CHECK(second->isFrozen("bob", 3));
+
+    // The previous view is unchanged, and unmodified shards are shared
+    BOOST_CHECK_EQUAL(100, first->getMoneyAvailable("alice", 3));
+    BOOST_CHECK(!first->isFrozen("bob", 3));
+    size_t aliceShard = CMPTallyView::getShardIndex("alice");
+    for (size_t i = 0; i < CMPTallyView::SHARD_COUNT; ++i) {
+        if (i != aliceShard) {
+            BOOST_CHECK(first->getShards()[i] == second->getShards()[i]);
+        }
+    }
+    BOOST_CHECK(first->getShards()[aliceShard] != second->getShards()[aliceShard]);
+
+    // Nothing changed, so the view is kept
+    snapshot.publish(tallyMap, frozen);
+    BOOST_CHECK(second == snapshot.get());
+
+    tallyMap.erase("alice");
+    snapshot.markDirty("alice");
+    snapshot.publish(tallyMap, frozen);
+    BOOST_CHECK(snapshot.get()->getTally("alice") == NULL);
+    BOOST_CHECK_EQUAL(50, snapshot.get()->getMoneyReserved("bob", 3));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,73 @@
+#include "tokencore/consensushash.h"
+#include "tokencore/rules.h"
+#include "tokencore/tally.h"
+#include "tokencore/tokencore.h"
+
+#include "sync.h"
+#include "test/test_bitcoin.h"
+
+#include <stdint.h>
+#include <limits>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace mastercore;
+
+namespace
+{
+const uint32_t propertyId = 7;
+const std::string addressA = "RbsD2aPDyaN4WdYWHUj6Ms8mRmAT3qDgNz";
+const std::string addressB = "RqBfD9k8JWmgvQLYGbx6e47NrReP7x5dw2";
+
+void ClearTally()
+{
+    LOCK(cs_tally);
+    mp_tally_map.clear();
+    mp_holder_index.clear();
+    mp_state_hash.Clear();
+}
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(tokencore_username_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(username_holder_single)
+{
+    ClearTally();
+    BOOST_CHECK(update_tally_map(addressB, 3, 500, BALANCE));
+    BOOST_CHECK(update_tally_map(addressA, propertyId, 1, BALANCE));
+
+    // With a single address, which ever held the token, both rules select the same address
+    BOOST_CHECK_EQUAL(GetUsernameHolderLegacy(propertyId), addressA);
+    BOOST_CHECK_EQUAL(GetUsernameHolder(propertyId), addressA);
+    BOOST_CHECK_EQUAL(SelectUsernameHolder(propertyId, 0), addressA);
+    BOOST_CHECK_EQUAL(SelectUsernameHolder(propertyId, std::numeric_limits<int>::max() - 1), addressA);
+
+    ClearTally();
+}
+
+BOOST_AUTO_TEST_CASE(username_holder_activation)
+{
+    ClearTally();
+    BOOST_CHECK(update_tally_map(addressA, propertyId, 1, BALANCE));
+    // Move the token from A to B, A keeps an empty tally entry
+    BOOST_CHECK(update_tally_map(addressA, propertyId, -1, BALANCE));
+    BOOST_CHECK(update_tally_map(addressB, propertyId, 1, BALANCE));
+
+    const std::string legacyHolder = GetUsernameHolderLegacy(propertyId);
+    BOOST_CHECK(legacyHolder == addressA || legacyHolder == addressB);
+    BOOST_CHECK_EQUAL(GetUsernameHolder(propertyId), addressB);
+
+    const int activationBlock = ConsensusParams().USERNAMEHOLDER_FEATURE_BLOCK;
+    MutableConsensusParams().USERNAMEHOLDER_FEATURE_BLOCK = 100;
+
+    // Before the activation the legacy selection applies
+    BOOST_CHECK_EQUAL(SelectUsernameHolder(propertyId, 99), legacyHolder);
+    // Afterwards the current holder is selected
+    BOOST_CHECK_EQUAL(SelectUsernameHolder(propertyId, 100), addressB);
+
+    MutableConsensusParams().USERNAMEHOLDER_FEATURE_BLOCK = activationBlock;
+    ClearTally();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -69,9 +69,15 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -149,6 +155,10 @@ std::set<std::pair<std::string,uint32_t> > setFrozenAddresses;
 
 //! In-memory collection of all amounts for all addresses for all properties
 std::unordered_map<std::string, CMPTally> mastercore::mp_tally_map;
+//! In-memory index of token holders and totals, derived from mp_tally_map
+CMPHolderIndex mastercore::mp_holder_index;
+//! Copy-on-write views of mp_tally_map for readers, which don't hold cs_tally
+CMPTallySnapshot mastercore::mp_tally_snapshot;
 
 // Only needed for GUI:
 
@@ -164,33 +174,105 @@ std::map<uint32_t, std::list<std::string>> global_token_addresses;
 //! Vector containing a list of properties relative to the wallet
 std::set<uint32_t> global_wallet_property_list;
 
-std::string GetUsernameAddress(std::string username) {
-    uint32_t propertyId = pDbSpInfo->findSPByTicker(username);
-    std::string address = "";
+/**
+ * Selects the holder of a username token, as done before FEATURE_USERNAMEHOLDER.
+ *
+ * The first address with a tally entry for the property is returned, in the
+ * iteration order of the tally map. This may be a previous owner with an
+ * empty balance. If there is none, the last address of the tally map is
+ * returned. The selection must not be changed, as it's consensus relevant.
+ */
+std::string mastercore::GetUsernameHolderLegacy(uint32_t propertyId)
+{
+    LOCK(cs_tally);
 
-    if (IsUsernameValid(username) && propertyId) {
-        for (std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
-            uint32_t id = 0;
-            bool includeAddress = false;
-            address = it->first;
-            (it->second).init();
-            while (0 != (id = (it->second).next())) {
-                if (id == propertyId) {
-                    includeAddress = true;
-                    break;
-                }
-            }
-            if (!includeAddress) {
-                continue; // ignore this address, has never transacted in this propertyId
+    std::string address = "";
+    for (std::unordered_map<std::string, CMPTally>::iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
+        uint32_t id = 0;
+        bool includeAddress = false;
+        address = it->first;
+        (it->second).init();
+        while (0 != (id = (it->second).next())) {
+            if (id == propertyId) {
+                includeAddress = true;
+                break;
             }
-
-            break;
         }
+        if (!includeAddress) {
+            continue; // ignore this address, has never transacted in this propertyId
+        }
+
+        break;
     }
 
     return address;
 }
 
+/**
+ * Selects the current holder of a username token from the holder index.
+ *
+ * If there is more than one holder, the first address in lexicographical
+ * order is returned.
+ */
+std::string mastercore::GetUsernameHolder(uint32_t propertyId)
+{
+    LOCK(cs_tally);
+
+    const CMPHolderIndex::HolderSet* holders = mp_holder_index.getHolders(propertyId);
+    if (holders == NULL || holders->empty()) return "";
+
+    return *holders->begin();
+}
+
+/**
+ * Selects the holder of a username token according to the rules at the given block.
+ */
+std::string mastercore::SelectUsernameHolder(uint32_t propertyId, int block)
+{
+    if (IsFeatureActivated(FEATURE_USERNAMEHOLDER, block)) {
+        return GetUsernameHolder(propertyId);
+    }
+
+    return GetUsernameHolderLegacy(propertyId);
+}
+
+/**
+ * Resolves a username to the address holding the username token, for
+ * consensus relevant uses, such as the royalties receiver of DEx payments.
+ *
+ * The ticker is resolved through the cached ticker index. The holder is
+ * selected by the rules at the given block: after FEATURE_USERNAMEHOLDER it's
+ * obtained from the holder index, before it's selected by the legacy scan.
+ *
+ * @return The address of the holder, or an empty string, if there is none
+ */
+std::string GetUsernameAddress(std::string username, int block) {
+    if (!IsUsernameValid(username)) return "";
+
+    uint32_t propertyId = pDbSpInfo->findSPByTicker(username);
+    if (!propertyId) return "";
+
+    return SelectUsernameHolder(propertyId, block);
+}
+
+/**
+ * Resolves a username to the address currently holding the username token,
+ * for the RPCs, the wallet and the UI.
+ *
+ * The holder is obtained from the holder index, regardless of
+ * FEATURE_USERNAMEHOLDER, as the result isn't consensus relevant.
+ *
+ * @return The address of the holder, or an empty string, if there is none
+ */
+std::string GetUsernameAddress(std::string username) {
+    if (!IsUsernameValid(username)) return "";
+
+    uint32_t propertyId = pDbSpInfo->findSPByTicker(username);
+    if (!propertyId) return "";
+
+    return GetUsernameHolder(propertyId);
+}
+
 std::string mastercore::strMPProperty(uint32_t propertyId)
 {
     std::string str = "*unknown*";
@@ -290,6 +372,29 @@ CMPTally* mastercore::getTally(const std::string& address)
     return (CMPTally *) NULL;
 }
 
+/**
+ * Publishes the current balances and frozen addresses as new view.
+ *
+ * Called by the writer, once the state of a block or a pending transaction
+ * is complete, so readers never observe a partially processed block.
+ */
+void mastercore::PublishTallyView()
+{
+    LOCK(cs_tally);
+    mp_tally_snapshot.publish(mp_tally_map, setFrozenAddresses);
+}
+
+/**
+ * Returns the latest published balances.
+ *
+ * Balance queries, which don't need the live state, should use the view
+ * instead of holding cs_tally, which blocks the processing of blocks.
+ */
+std::shared_ptr<const CMPTallyView> mastercore::GetTallyView()
+{
+    return mp_tally_snapshot.get();
+}
+
 // look at balance for an address
 int64_t GetTokenBalance(const std::string& address, uint32_t propertyId, TallyType ttype)
 {
@@ -462,7 +567,6 @@ std::string mastercore::getTokenLabel(uint32_t propertyId)
 // optionally counts the number of addresses who own that property: n_owners_total
 int64_t mastercore::getTotalTokens(uint32_t propertyId, int64_t* n_owners_total)
 {
-    int64_t prev = 0;
     int64_t owners = 0;
     int64_t totalTokens = 0;
 
@@ -474,19 +578,9 @@ int64_t mastercore::getTotalTokens(uint32_t propertyId, int64_t* n_owners_total)
     }
 
     if (!property.fixed || n_owners_total) {
-        for (std::unordered_map<std::string, CMPTally>::const_iterator it = mp_tally_map.begin(); it != mp_tally_map.end(); ++it) {
-            const CMPTally& tally = it->second;
-
-            totalTokens += tally.getMoney(propertyId, BALANCE);
-            totalTokens += tally.getMoney(propertyId, SELLOFFER_RESERVE);
-            totalTokens += tally.getMoney(propertyId, ACCEPT_RESERVE);
-            totalTokens += tally.getMoney(propertyId, METADEX_RESERVE);
+        totalTokens = mp_holder_index.getTotal(propertyId);
+        owners = mp_holder_index.getHolderCount(propertyId);
 
-            if (prev != totalTokens) {
-                prev = totalTokens;
-                owners++;
-            }
-        }
         int64_t cachedFee = pDbFeeCache->GetCachedAmount(propertyId);
         totalTokens += cachedFee;
     }
@@ -531,8 +625,23 @@ bool mastercore::update_tally_map(const std::string& who, uint32_t propertyId, i
     }
 
     CMPTally& tally = my_it->second;
+    std::string strEntryBefore;
+    if (ttype != PENDING) {
+        strEntryBefore = GenerateConsensusString(tally, who, propertyId);
+    }
+
     bRet = tally.updateMoney(propertyId, amount, ttype);
 
+    if (bRet) {
+        mp_tally_snapshot.markDirty(who);
+    }
+
+    if (bRet && ttype != PENDING) {
+        mp_holder_index.update(who, propertyId, amount, tally.getMoneyOwned(propertyId));
+        mp_state_hash.Remove(CMPStateHash::BALANCES, propertyId, strEntryBefore);
+        mp_state_hash.Add(CMPStateHash::BALANCES, propertyId, GenerateConsensusString(tally, who, propertyId));
+    }
+
     after = GetTokenBalance(who, propertyId, ttype);
     if (!bRet) {
         assert(before == after);
@@ -756,46 +865,53 @@ bool IsInMarkerCache(const uint256& txHash)
 }
 
 /**
- * Returns the encoding class, used to embed a payload.
+ * Performs a fast search for a marker candidate.
  *
- *   0 None
- *   1 Class A (p2pkh)
- *   2 Class B (multisig)
- *   3 Class C (op-return)
+ * Transactions without candidate can't be Token transactions, and are dropped
+ * with less work. The search only depends on the transaction itself and not on
+ * the state, so it's safe to use ahead of the processing of a block.
  */
-int mastercore::GetEncodingClass(const CTransaction& tx, int nBlock)
+static bool MayHaveMarker(const CTransaction& tx)
 {
-    bool hasExodus = false;
-    bool hasMultisig = false;
-    bool hasOpReturn = false;
+    // Examine everything when not on mainnet
+    if (isNonMainNet()) {
+        return true;
+    }
 
     /* Fast Search
      * Perform a string comparison on hex for each scriptPubKey & look directly for Exodus hash160 bytes or token marker bytes
-     * This allows to drop non-Token transactions with less work
      */
     std::string strClassC = "6f6d6e69";
     std::string strClassAB = "76a9149957bf08adabda094dfee3ee7b89c5fc4ca422a688ac";
-    bool examineClosely = false;
     for (unsigned int n = 0; n < tx.vout.size(); ++n) {
         const CTxOut& output = tx.vout[n];
         std::string strSPB = HexStr(output.scriptPubKey.begin(), output.scriptPubKey.end());
-        if (strSPB != strClassAB) { // not an exodus marker
-            if (strSPB.find(strClassC) != std::string::npos) {
-                examineClosely = true;
-                break;
-            }
-        } else {
-            examineClosely = true;
-            break;
+        if (strSPB == strClassAB) { // exodus marker
+            return true;
+        }
+        if (strSPB.find(strClassC) != std::string::npos) {
+            return true;
         }
     }
 
-    // Examine everything when not on mainnet
-    if (isNonMainNet()) {
-        examineClosely = true;
-    }
+    return false;
+}
+
+/**
+ * Returns the encoding class, used to embed a payload.
+ *
+ *   0 None
+ *   1 Class A (p2pkh)
+ *   2 Class B (multisig)
+ *   3 Class C (op-return)
+ */
+int mastercore::GetEncodingClass(const CTransaction& tx, int nBlock)
+{
+    bool hasExodus = false;
+    bool hasMultisig = false;
+    bool hasOpReturn = false;
 
-    if (!examineClosely) return NO_MARKER;
+    if (!MayHaveMarker(tx)) return NO_MARKER;
 
     for (unsigned int n = 0; n < tx.vout.size(); ++n) {
         const CTxOut& output = tx.vout[n];
@@ -1532,6 +1648,160 @@ public:
     }
 };
 
+/** A block, which is read and pre-parsed ahead of the scan. */
+struct CScanBlock
+{
+    //! The block index of the block
+    const CBlockIndex* pindex;
+    //! Whether the block was read from disk
+    bool fRead;
+    //! The block
+    CBlock block;
+    //! Whether the transaction at the given position may have a marker
+    std::vector<bool> vMayHaveMarker;
+
+    CScanBlock() : pindex(NULL), fRead(false) {}
+};
+
+/**
+ * Reads a block from disk and runs the consensus independent marker search for
+ * every transaction.
+ */
+static std::shared_ptr<CScanBlock> ReadScanBlock(const CBlockIndex* pindex)
+{
+    std::shared_ptr<CScanBlock> pblock = std::make_shared<CScanBlock>();
+    pblock->pindex = pindex;
+    pblock->fRead = ReadBlockFromDisk(pblock->block, pindex);
+    if (pblock->fRead) {
+        pblock->vMayHaveMarker.reserve(pblock->block.vtx.size());
+        BOOST_FOREACH(const CTransactionRef& tx, pblock->block.vtx) {
+            pblock->vMayHaveMarker.push_back(MayHaveMarker(*tx));
+        }
+    }
+    return pblock;
+}
+
+/**
+ * Reads and pre-parses blocks ahead of the initial scan.
+ *
+ * A pool of reader threads deserializes the upcoming blocks and searches for
+ * marker candidates, while the blocks are handed out strictly in order, so the
+ * state changing part of the scan stays sequential and deterministic. At most
+ * nWindow blocks are read ahead of the block, which is currently processed.
+ */
+class CScanBlockPrefetcher
+{
+private:
+    //! The block indexes of the blocks to read
+    std::vector<const CBlockIndex*> vIndexes;
+    //! The height of the first block to read
+    const int nFirstBlock;
+    //! The maximum number of blocks to read ahead
+    const int nWindow;
+    //! Whether blocks without Token transactions are skipped
+    const bool fSeedBlockFilter;
+
+    std::mutex mutex;
+    //! Signaled, when a block was requested or the prefetcher is stopped
+    std::condition_variable condRead;
+    //! Signaled, when a block was read
+    std::condition_variable condReady;
+    //! The height of the next block to read
+    int nNextRead;
+    //! The height of the block, which was requested last
+    int nRequested;
+    bool fStop;
+    //! Blocks, which were read, but not yet requested
+    std::map<int, std::shared_ptr<CScanBlock> > mapReady;
+
+    std::vector<std::thread> vThreads;
+
+    void ThreadRead()
+    {
+        while (true) {
+            int nBlock;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condRead.wait(lock, [this] { return fStop || nNextRead < nRequested + nWindow; });
+                if (fStop || nNextRead >= nFirstBlock + (int) vIndexes.size()) return;
+                nBlock = nNextRead++;
+            }
+
+            if (fSeedBlockFilter && SkipBlock(nBlock)) continue;
+
+            std::shared_ptr<CScanBlock> pblock = ReadScanBlock(vIndexes[nBlock - nFirstBlock]);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (nBlock >= nRequested) mapReady[nBlock] = pblock;
+            }
+            condReady.notify_all();
+        }
+    }
+
+public:
+    /**
+     * Starts the reader threads.
+     *
+     * The block indexes are collected by the caller, which holds cs_main, so
+     * the prefetcher never acquires cs_main while cs_tally is held.
+     *
+     * @param vIndexesIn        The block indexes of the blocks to read, in ascending order
+     * @param nThreads          The number of reader threads
+     * @param nWindowIn         The maximum number of blocks to read ahead
+     * @param fSeedBlockFilterIn  Whether blocks without Token transactions are skipped
+     */
+    CScanBlockPrefetcher(const std::vector<const CBlockIndex*>& vIndexesIn, int nThreads, int nWindowIn, bool fSeedBlockFilterIn)
+        : vIndexes(vIndexesIn), nFirstBlock(vIndexesIn.empty() ? 0 : vIndexesIn.front()->nHeight),
+          nWindow(nWindowIn), fSeedBlockFilter(fSeedBlockFilterIn),
+          nNextRead(nFirstBlock), nRequested(nFirstBlock), fStop(false)
+    {
+        for (int i = 0; i < nThreads; ++i) {
+            vThreads.push_back(std::thread(&TraceThread<std::function<void()> >, "tokenscan",
+                    std::function<void()>(std::bind(&CScanBlockPrefetcher::ThreadRead, this))));
+        }
+    }
+
+    /** Stops and joins the reader threads. */
+    ~CScanBlockPrefetcher()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            fStop = true;
+        }
+        condRead.notify_all();
+        BOOST_FOREACH(std::thread& thread, vThreads) {
+            thread.join();
+        }
+    }
+
+    /**
+     * Waits for a block and hands it out.
+     *
+     * Blocks must be requested in ascending order. Blocks below the requested
+     * one are no longer read.
+     *
+     * @param nBlock  The height of the block
+     * @return The block, or NULL, if the block is out of the range of the prefetcher
+     */
+    std::shared_ptr<CScanBlock> Get(int nBlock)
+    {
+        if (nBlock < nFirstBlock || nBlock >= nFirstBlock + (int) vIndexes.size()) {
+            return std::shared_ptr<CScanBlock>();
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        nRequested = nBlock;
+        if (nNextRead < nBlock) nNextRead = nBlock;
+        mapReady.erase(mapReady.begin(), mapReady.lower_bound(nBlock));
+        condRead.notify_all();
+
+        condReady.wait(lock, [this, nBlock] { return mapReady.count(nBlock) > 0; });
+        std::shared_ptr<CScanBlock> pblock = mapReady[nBlock];
+        mapReady.erase(nBlock);
+        return pblock;
+    }
+};
+
 /**
  * Scans the blockchain for meta transactions.
  *
@@ -1548,11 +1818,20 @@ public:
  * @see mastercore_handler_tx()
  * @see mastercore_handler_block_end()
  *
+ * The caller must hold cs_main, which is acquired before cs_tally.
+ *
  * @param nFirstBlock[in]  The index of the first block to scan
  * @return An exit code, indicating success or failure
  */
 static int msc_initial_scan(int nFirstBlock)
 {
+    AssertLockHeld(cs_main);
+
+    //! Maximum number of reader threads used by default
+    static const int MAX_SCAN_THREADS = 8;
+    //! Number of blocks each reader thread may read ahead
+    static const int SCAN_PREFETCH_BLOCKS_PER_THREAD = 16;
+
     int nTimeBetweenProgressReports = GetArg("-tokenprogressfrequency", 30);  // seconds
     int64_t nNow = GetTime();
     unsigned int nTxsTotal = 0;
@@ -1570,6 +1849,18 @@ static int msc_initial_scan(int nFirstBlock)
     // check if using seed block filter should be disabled
     bool seedBlockFilterEnabled = GetBoolArg("-tokenseedblockfilter", true);
 
+    // blocks are read and pre-parsed ahead by a pool of reader threads, if enabled
+    int nScanThreads = GetArg("-tokenscanthreads", std::min(GetNumCores(), MAX_SCAN_THREADS));
+    std::unique_ptr<CScanBlockPrefetcher> prefetcher;
+    if (nScanThreads > 0) {
+        std::vector<const CBlockIndex*> vIndexes;
+        for (int nHeight = nFirstBlock; nHeight <= nLastBlock; ++nHeight) {
+            vIndexes.push_back(chainActive[nHeight]);
+        }
+        int nWindow = SCAN_PREFETCH_BLOCKS_PER_THREAD * nScanThreads;
+        prefetcher.reset(new CScanBlockPrefetcher(vIndexes, nScanThreads, nWindow, seedBlockFilterEnabled));
+    }
+
     for (nBlock = nFirstBlock; nBlock <= nLastBlock; ++nBlock)
     {
         if (ShutdownRequested()) {
@@ -1594,11 +1885,20 @@ static int msc_initial_scan(int nFirstBlock)
         mastercore_handler_block_begin(nBlock, pblockindex);
 
         if (!seedBlockFilterEnabled || !SkipBlock(nBlock)) {
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pblockindex)) break;
-
-            BOOST_FOREACH(const CTransaction&tx, block.vtx) {
-                if (mastercore_handler_tx(tx, nBlock, nTxNum, pblockindex)) ++nTxsFoundInBlock;
+            std::shared_ptr<CScanBlock> pblock;
+            if (prefetcher) pblock = prefetcher->Get(nBlock);
+            // read the block here, if the active chain changed since it was prefetched
+            if (!pblock || pblock->pindex != pblockindex) pblock = ReadScanBlock(pblockindex);
+            if (!pblock->fRead) break;
+
+            BOOST_FOREACH(const CTransactionRef& tx, pblock->block.vtx) {
+                if (pblock->vMayHaveMarker[nTxNum]) {
+                    if (mastercore_handler_tx(*tx, nBlock, nTxNum, pblockindex)) ++nTxsFoundInBlock;
+                } else {
+                    // without marker candidate, the transaction only clears pending amounts
+                    LOCK(cs_tally);
+                    PendingDelete(tx->GetHash());
+                }
                 ++nTxNum;
             }
         }
@@ -1627,6 +1927,9 @@ void clear_all_state()
 
     // Memory based storage
     mp_tally_map.clear();
+    mp_holder_index.clear();
+    mp_tally_snapshot.markAllDirty();
+    mp_state_hash.Clear();
     my_offers.clear();
     my_accepts.clear();
     my_crowds.clear();
@@ -1688,6 +1991,32 @@ void RewindDBsAndState(int nHeight, int nBlockPrev = 0, bool fInitialParse = fal
     }
 }
 
+/**
+ * Upgrades the databases of previous versions in place.
+ *
+ * Version 7 lacks the block index of the tx meta-info database, version 8
+ * lacks the address, pair and block indexes of the trade database, and version
+ * 9 lacks the property and block indexes of the fee cache and fee history
+ * databases. Databases of older versions are not upgraded, which forces a
+ * reparse.
+ *
+ * @return True, if the databases were upgraded
+ */
+static bool UpgradeDBVersion()
+{
+    int nVersion = pDbTransactionList->getDBVersion();
+    if (nVersion < 7 || nVersion >= DB_VERSION) return false;
+
+    PrintToConsole("Upgrading databases from version %d to %d..\n", nVersion, DB_VERSION);
+
+    if (nVersion < 8 && !pDbTransactionList->buildBlockIndex()) return false;
+    if (nVersion < 9 && !pDbTradeList->buildIndexes()) return false;
+    if (nVersion < 10 && !pDbFeeCache->buildIndexes()) return false;
+    if (nVersion < 10 && !pDbFeeHistory->buildIndexes()) return false;
+
+    return (pDbTransactionList->setDBVersion() == DB_VERSION);
+}
+
 /**
  * Global handler to initialize Token Core.
  *
@@ -1695,7 +2024,8 @@ void RewindDBsAndState(int nHeight, int nBlockPrev = 0, bool fInitialParse = fal
  */
 int mastercore_init()
 {
-    LOCK(cs_tally);
+    // cs_main is required by the initial scan and must be acquired before cs_tally
+    LOCK2(cs_main, cs_tally);
 
     if (mastercoreInitialized) {
         // nothing to do
@@ -1764,6 +2094,9 @@ int mastercore_init()
     pathStateFiles = GetDataDir() / "tokens" / "persist";
     TryCreateDirectory(pathStateFiles);
 
+    // databases of previous versions can be upgraded in place
+    if (!startClean) UpgradeDBVersion();
+
     bool wrongDBVersion = (pDbTransactionList->getDBVersion() != DB_VERSION);
 
     ++mastercoreInitialized;
@@ -1851,6 +2184,9 @@ int mastercore_init()
     // initial scan
     msc_initial_scan(nWaterlineBlock);
 
+    // make the restored and scanned balances visible to RPC readers
+    PublishTallyView();
+
     // display Exodus balance
     int64_t exodus_balance = GetTokenBalance(exodus_address, TOKEN_PROPERTY_MSC, BALANCE);
     PrintToLog("Exodus balance after initialization: %s\n", FormatDivisibleMP(exodus_balance));
@@ -2050,6 +2386,18 @@ int mastercore_handler_block_end(int nBlockNow, CBlockIndex const * pBlockIndex,
     if (ShouldConsensusHashBlock(nBlockNow)) {
         uint256 consensusHash = GetConsensusHash();
         PrintToLog("Consensus hash for block %d: %s\n", nBlockNow, consensusHash.GetHex());
+        uint256 stateHash = GetStateHash();
+        PrintToLog("State hash for block %d: %s\n", nBlockNow, stateHash.GetHex());
+
+        // the maintained state hash is only rebuilt from the tally when explicitly requested
+        if (msc_debug_consensus_hash_crosscheck) {
+            LOCK(cs_tally);
+            uint256 rebuiltHash = RebuildStateHash().GetHash();
+            if (rebuiltHash != mp_state_hash.GetHash()) {
+                PrintToLog("%s(): ERROR: state hash mismatch for block %d: maintained %s, rebuilt %s\n",
+                        __func__, nBlockNow, mp_state_hash.GetHash().GetHex(), rebuiltHash.GetHex());
+            }
+        }
     }
 
     // save out the state after this block
@@ -2057,6 +2405,9 @@ int mastercore_handler_block_end(int nBlockNow, CBlockIndex const * pBlockIndex,
         PersistInMemoryState(pBlockIndex);
     }
 
+    // make the balances after this block visible to RPC readers
+    PublishTallyView();
+
     return 0;
 }
 
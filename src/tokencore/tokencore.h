@@ -34,7 +34,7 @@ int const STORE_EVERY_N_BLOCK = 10000;
 #define RPD_PROPERTY_ID 0
 
 // increment this value to force a refresh of the state (similar to --startclean)
-#define DB_VERSION 7
+#define DB_VERSION 10
 
 // could probably also use: int64_t maxInt64 = std::numeric_limits<int64_t>::max();
 // maximum numeric values from the spec:
@@ -186,6 +186,10 @@ namespace mastercore
 {
 //! In-memory collection of all amounts for all addresses for all properties
 extern std::unordered_map<std::string, CMPTally> mp_tally_map;
+//! In-memory index of token holders and totals, derived from mp_tally_map
+extern CMPHolderIndex mp_holder_index;
+//! Copy-on-write views of mp_tally_map for readers, which don't hold cs_tally
+extern CMPTallySnapshot mp_tally_snapshot;
 
 // TODO: move, rename
 extern CCoinsView viewDummy;
@@ -204,6 +208,10 @@ bool isMainEcosystemProperty(uint32_t propertyId);
 uint32_t GetNextPropertyId(bool maineco); // maybe move into sp
 
 CMPTally* getTally(const std::string& address);
+/** Publishes the current balances to readers of GetTallyView(). */
+void PublishTallyView();
+/** Returns the latest published balances, without acquiring cs_tally. */
+std::shared_ptr<const CMPTallyView> GetTallyView();
 bool update_tally_map(const std::string& who, uint32_t propertyId, int64_t amount, TallyType ttype);
 int64_t getTotalTokens(uint32_t propertyId, int64_t* n_owners_total = NULL);
 
@@ -232,8 +240,18 @@ void ClearFreezeState();
 /** Prints the freeze state **/
 void PrintFreezeState();
 
+/** Selects the holder of a username token, as done before FEATURE_USERNAMEHOLDER. */
+std::string GetUsernameHolderLegacy(uint32_t propertyId);
+/** Selects the current holder of a username token from the holder index. */
+std::string GetUsernameHolder(uint32_t propertyId);
+/** Selects the holder of a username token according to the rules at the given block. */
+std::string SelectUsernameHolder(uint32_t propertyId, int block);
+
 }
 
+/** Resolves a username to the address holding the username token at the given block, as selected by consensus. */
+std::string GetUsernameAddress(std::string username, int block);
+/** Resolves a username to the address currently holding the username token, for non-consensus uses. */
 std::string GetUsernameAddress(std::string username);
 
 #endif // TOKENCORE_TOKENCORE_H
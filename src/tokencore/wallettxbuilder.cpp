@@ -8,6 +8,7 @@
 #include "tokencore/script.h"
 #include "tokencore/walletutils.h"
 #include "tokencore/tx.h"
+#include "tokencore/utilsbitcoin.h"
 
 #include "amount.h"
 #include "base58.h"
@@ -430,7 +431,7 @@ int CreateFundedTransaction(
 
     {
         LOCK(cs_main);
-        if (!AcceptToMemoryPool(mempool, state, tx, false, NULL, false, DEFAULT_TRANSACTION_MAXFEE)) {
+        if (!AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), false, NULL, false, DEFAULT_TRANSACTION_MAXFEE)) {
             PrintToLog("%s: ERROR: failed to broadcast transaction: %s\n", __func__, state.GetRejectReason());
             return MP_ERR_COMMIT_TX;
         }
@@ -494,7 +495,7 @@ int CreateDExTransaction(const std::string& buyerAddress, const std::string& sel
 
     // Add royalties output
     if (royaltiesAmount > 0) {
-        std::string royaltiesAddress = IsUsernameValid(royaltiesReceiver) ? GetUsernameAddress(royaltiesReceiver) : royaltiesReceiver;
+        std::string royaltiesAddress = IsUsernameValid(royaltiesReceiver) ? GetUsernameAddress(royaltiesReceiver, mastercore::GetHeight() + 1) : royaltiesReceiver;
 
         CScript royaltiesDestScript = GetScriptForDestination(DecodeDestination(royaltiesAddress));
         vecRecipients.push_back({royaltiesDestScript, royaltiesAmount, false}); // Royalties
@@ -9,8 +9,10 @@
 #include "main.h"
 #include "pow.h"
 #include "uint256.h"
+#include "verifydb.h"
 
 #include <stdint.h>
+#include <tuple>
 
 #include <boost/thread.hpp>
 
@@ -33,6 +35,14 @@ static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_ADDRESSSUMMARY = 'e';
+static const char DB_VERIFYJOBS = 'V';
+
+//! Name of the highest block height of the stored address index entries
+static const std::string ADDRESS_INDEX_HEIGHT = "addrindexheight";
+
+//! Number of block index entries, whose headers are hashed at once while loading
+static const size_t LOAD_INDEX_BATCH_SIZE = 4096;
 
 namespace {
 
@@ -122,6 +132,15 @@ bool CBlockTreeDB::WriteBlockIndex(const CDiskBlockIndex& blockindex)
     return Write(std::make_pair(DB_BLOCK_INDEX, blockindex.GetBlockHash()), blockindex);
 }
 
+bool CBlockTreeDB::WriteBlockIndexes(const std::vector<const CBlockIndex*>& vIndexes)
+{
+    CDBBatch batch;
+    for (const CBlockIndex* pindex : vIndexes) {
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, pindex->GetBlockHash()), CDiskBlockIndex(pindex));
+    }
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo& info)
 {
     return Read(std::make_pair(DB_BLOCK_FILES, nFile), info);
@@ -211,6 +230,18 @@ bool CBlockTreeDB::ReadMoneySupply(int64_t& nSupply) const
     return Read(DB_MONEY_SUPPLY, nSupply);
 }
 
+bool CBlockTreeDB::WriteVerifyJobs(const std::vector<CVerifyJob>& vJobs)
+{
+    if (vJobs.empty())
+        return Erase(DB_VERIFYJOBS);
+    return Write(DB_VERIFYJOBS, vJobs);
+}
+
+bool CBlockTreeDB::ReadVerifyJobs(std::vector<CVerifyJob>& vJobs) const
+{
+    return Read(DB_VERIFYJOBS, vJobs);
+}
+
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
     CDBBatch batch;
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
@@ -268,46 +299,59 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
 
     const int last_pow_block = Params().GetConsensus().height_last_PoW;
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //zerocoin
-                pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
-
-                //Proof Of Stake
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->vStakeModifier = diskindex.vStakeModifier;
-
-                if (pindexNew->nHeight < last_pow_block) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
-
-                pcursor->Next();
-            } else {
+    // Load mapBlockIndex, the headers of a batch of entries are hashed at once on all cores
+    std::vector<CDiskBlockIndex> vDiskIndexes;
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<uint256> vHashes;
+    bool fEnd = false;
+    while (!fEnd) {
+        vDiskIndexes.clear();
+        while (vDiskIndexes.size() < LOAD_INDEX_BATCH_SIZE) {
+            boost::this_thread::interruption_point();
+            std::pair<char, uint256> key;
+            if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+                fEnd = true;
+                break;
+            }
+            vDiskIndexes.emplace_back();
+            if (!pcursor->GetValue(vDiskIndexes.back()))
                 return error("%s : failed to read value", __func__);
+            pcursor->Next();
+        }
+
+        vHeaders.clear();
+        for (const CDiskBlockIndex& diskindex : vDiskIndexes)
+            vHeaders.push_back(diskindex.GetBlockHeader());
+        HashBlockHeaders(vHeaders, vHashes);
+
+        for (size_t i = 0; i < vDiskIndexes.size(); i++) {
+            const CDiskBlockIndex& diskindex = vDiskIndexes[i];
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(vHashes[i]);
+            pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+
+            //zerocoin
+            pindexNew->nAccumulatorCheckpoint = diskindex.nAccumulatorCheckpoint;
+
+            //Proof Of Stake
+            pindexNew->nFlags = diskindex.nFlags;
+            pindexNew->vStakeModifier = diskindex.vStakeModifier;
+
+            if (pindexNew->nHeight < last_pow_block) {
+                if (!CheckProofOfWork(vHashes[i], pindexNew->nBits))
+                    return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
             }
-        } else {
-            break;
         }
     }
 
@@ -371,6 +415,18 @@ bool CZerocoinDB::WriteCoinSpendBatch(const std::vector<std::pair<libzerocoin::C
     return WriteBatch(batch, true);
 }
 
+bool CZerocoinDB::WriteCoinHashBatch(const std::vector<std::pair<uint256, uint256> >& vSpends, const std::vector<std::pair<uint256, uint256> >& vMints)
+{
+    CDBBatch batch;
+    for (const auto& spend : vSpends)
+        batch.Write(std::make_pair('s', spend.first), spend.second);
+    for (const auto& mint : vMints)
+        batch.Write(std::make_pair('m', mint.first), mint.second);
+
+    LogPrint(BCLog::COINDB, "Writing %u coin spends and %u coin mints to db.\n", (unsigned int)vSpends.size(), (unsigned int)vMints.size());
+    return WriteBatch(batch, true);
+}
+
 bool CZerocoinDB::ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash)
 {
     CDataStream ss(SER_GETHASH, 0);
@@ -620,18 +676,25 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
 
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+    return ReadAddressUnspentIndex(CAddressUnspentKey(type, addressHash, UINT256_ZERO, 0), 0, unspentOutputs);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const CAddressUnspentKey &keyStart, size_t nLimit,
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, keyStart));
 
-    while (pcursor->Valid()) {
+    size_t nRead = 0;
+    while (pcursor->Valid() && (nLimit == 0 || nRead < nLimit)) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressUnspentKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.type == keyStart.type && key.second.hashBytes == keyStart.hashBytes) {
             CAddressUnspentValue nValue;
             if (pcursor->GetValue(nValue)) {
                 unspentOutputs.push_back(std::make_pair(key.second, nValue));
+                nRead++;
                 pcursor->Next();
             } else {
                 return error("failed to get address unspent value");
@@ -661,25 +724,29 @@ bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKe
 bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
+    const int nStartHeight = (start > 0 && end > 0) ? start : 0;
+    return ReadAddressIndex(CAddressIndexKey(type, addressHash, nStartHeight, 0, UINT256_ZERO, 0, false), end, 0, addressIndex);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const CAddressIndexKey &keyStart, int end, size_t nLimit,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
-    }
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, keyStart));
 
-    while (pcursor->Valid()) {
+    size_t nRead = 0;
+    while (pcursor->Valid() && (nLimit == 0 || nRead < nLimit)) {
         boost::this_thread::interruption_point();
         std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.type == keyStart.type && key.second.hashBytes == keyStart.hashBytes) {
             if (end > 0 && key.second.blockHeight > end) {
                 break;
             }
             CAmount nValue;
             if (pcursor->GetValue(nValue)) {
                 addressIndex.push_back(std::make_pair(key.second, nValue));
+                nRead++;
                 pcursor->Next();
             } else {
                 return error("failed to get address index value");
@@ -692,6 +759,79 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
+bool CBlockTreeDB::ReadAddressSummary(uint160 addressHash, int type, CAddressSummary &summary) {
+    summary.SetNull();
+    if (!Exists(std::make_pair(DB_ADDRESSSUMMARY, CAddressIndexIteratorKey(type, addressHash))))
+        return true;
+    return Read(std::make_pair(DB_ADDRESSSUMMARY, CAddressIndexIteratorKey(type, addressHash)), summary);
+}
+
+bool CBlockTreeDB::ReadAddressIndexHeight(int& nHeight) {
+    return ReadInt(ADDRESS_INDEX_HEIGHT, nHeight);
+}
+
+bool CBlockTreeDB::BuildAddressSummaries() {
+    const size_t batch_size = 1 << 24;
+    CDBBatch batch;
+
+    // Wipe summaries of a previous, interrupted run
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(DB_ADDRESSSUMMARY);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexIteratorKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSSUMMARY)
+            break;
+        batch.Erase(key);
+        if (batch.SizeEstimate() > batch_size) {
+            WriteBatch(batch);
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+
+    // The entries of an address are contiguous, and so are those of a transaction
+    CAddressIndexIteratorKey keyAddress;
+    CAddressSummary summary;
+    uint256 hashLastTx;
+    int nMaxHeight = -1;
+    pcursor->Seek(DB_ADDRESSINDEX);
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexKey> key;
+        const bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX;
+        if (!fValid || key.second.type != keyAddress.type || key.second.hashBytes != keyAddress.hashBytes) {
+            if (!summary.IsNull()) {
+                batch.Write(std::make_pair(DB_ADDRESSSUMMARY, keyAddress), summary);
+                if (batch.SizeEstimate() > batch_size) {
+                    WriteBatch(batch);
+                    batch.Clear();
+                }
+            }
+            if (!fValid)
+                break;
+            keyAddress = CAddressIndexIteratorKey(key.second.type, key.second.hashBytes);
+            summary.SetNull();
+            hashLastTx.SetNull();
+        }
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("%s : failed to read address index value", __func__);
+        summary.nBalance += nValue;
+        if (nValue > 0)
+            summary.nReceived += nValue;
+        if (key.second.txhash != hashLastTx) {
+            summary.nTxCount++;
+            hashLastTx = key.second.txhash;
+        }
+        nMaxHeight = std::max(nMaxHeight, key.second.blockHeight);
+        pcursor->Next();
+    }
+    if (nMaxHeight >= 0)
+        batch.Write(std::make_pair('I', ADDRESS_INDEX_HEIGHT), nMaxHeight);
+    return WriteBatch(batch, true);
+}
+
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
     CDBBatch batch;
     batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
@@ -740,3 +880,263 @@ bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &lt
     ltimestamp = lts.ltimestamp;
     return true;
 }
+
+CAddressIndexCache::CAddressIndexCache(CBlockTreeDB* dbIn) : db(dbIn), nFlushedHeight(-1), fFlushedHeightLoaded(false), cachedScriptsUsage(0) {}
+
+bool CAddressIndexCache::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
+    LOCK(cs);
+    SpentIndexMap::const_iterator it = cacheSpentIndex.find(key);
+    if (it != cacheSpentIndex.end()) {
+        if (it->second.IsNull())
+            return false;
+        value = it->second;
+        return true;
+    }
+    return db->ReadSpentIndex(key, value);
+}
+
+bool CAddressIndexCache::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+    LOCK(cs);
+    for (const auto& entry : vect)
+        cacheSpentIndex[entry.first] = entry.second;
+    return true;
+}
+
+bool CAddressIndexCache::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+    LOCK(cs);
+    for (const auto& entry : vect) {
+        CAddressUnspentValue& value = cacheAddressUnspent[entry.first];
+        cachedScriptsUsage -= memusage::DynamicUsage(value.script);
+        value = entry.second;
+        cachedScriptsUsage += memusage::DynamicUsage(value.script);
+    }
+    return true;
+}
+
+bool CAddressIndexCache::ReadAddressUnspentIndex(uint160 addressHash, int type,
+                                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+    return ReadAddressUnspentIndex(CAddressUnspentKey(type, addressHash, UINT256_ZERO, 0), 0, unspentOutputs);
+}
+
+bool CAddressIndexCache::ReadAddressUnspentIndex(const CAddressUnspentKey &keyStart, size_t nLimit,
+                                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+    LOCK(cs);
+    AddressUnspentMap::const_iterator itBegin = cacheAddressUnspent.lower_bound(keyStart);
+    AddressUnspentMap::const_iterator itEnd = itBegin;
+    size_t nErased = 0;
+    while (itEnd != cacheAddressUnspent.end() && itEnd->first.type == keyStart.type && itEnd->first.hashBytes == keyStart.hashBytes) {
+        if (itEnd->second.IsNull())
+            nErased++;
+        itEnd++;
+    }
+
+    if (itBegin == itEnd)
+        return db->ReadAddressUnspentIndex(keyStart, nLimit, unspentOutputs);
+
+    // Read enough stored entries to fill the page, even if the cache erased some of them
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vStored;
+    if (!db->ReadAddressUnspentIndex(keyStart, nLimit > 0 ? nLimit + nErased : 0, vStored))
+        return false;
+    const bool fComplete = nLimit == 0 || vStored.size() < nLimit + nErased;
+
+    // Merge the pending changes into the stored entries, in the order of the database.
+    // If the stored entries were cut off, entries after the last one are unknown.
+    AddressUnspentMap mapMerged(vStored.begin(), vStored.end());
+    for (AddressUnspentMap::const_iterator it = itBegin; it != itEnd; it++) {
+        if (!fComplete && CAddressUnspentKeyCompare()(vStored.back().first, it->first))
+            break;
+        if (it->second.IsNull())
+            mapMerged.erase(it->first);
+        else
+            mapMerged[it->first] = it->second;
+    }
+    size_t nAdded = 0;
+    for (AddressUnspentMap::const_iterator it = mapMerged.begin(); it != mapMerged.end() && (nLimit == 0 || nAdded < nLimit); it++, nAdded++)
+        unspentOutputs.push_back(*it);
+    return true;
+}
+
+void CAddressIndexCache::LoadFlushedHeight() {
+    AssertLockHeld(cs);
+    // loaded on first use, as building the summaries of an older index at startup writes it
+    if (!fFlushedHeightLoaded) {
+        if (!db->ReadAddressIndexHeight(nFlushedHeight))
+            nFlushedHeight = -1;
+        fFlushedHeightLoaded = true;
+    }
+}
+
+bool CAddressIndexCache::HaveAddressIndex(const CAddressIndexKey &key) {
+    AssertLockHeld(cs);
+    AddressIndexMap::const_iterator it = cacheAddressIndex.find(key);
+    if (it != cacheAddressIndex.end())
+        return !it->second.fErased;
+    LoadFlushedHeight();
+    if (key.blockHeight > nFlushedHeight)
+        return false;
+    return db->Exists(std::make_pair(DB_ADDRESSINDEX, key));
+}
+
+void CAddressIndexCache::UpdateAddressSummaries(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, int nSign) {
+    AssertLockHeld(cs);
+    // Transactions, which were counted for an address
+    std::set<std::tuple<unsigned int, uint160, uint256> > setCounted;
+    for (const auto& entry : vect) {
+        // Entries already in (or already missing from) the index were counted before, e.g. when
+        // blocks are connected again after a crash, which flushed the index but not the chainstate
+        if (HaveAddressIndex(entry.first) == (nSign > 0))
+            continue;
+        // only the changes are kept, they are added to the stored summaries by reads and flushes
+        CAddressSummary& summary = cacheAddressSummary[CAddressIndexIteratorKey(entry.first.type, entry.first.hashBytes)];
+        summary.nBalance += nSign * entry.second;
+        if (entry.second > 0)
+            summary.nReceived += nSign * entry.second;
+        if (setCounted.emplace(entry.first.type, entry.first.hashBytes, entry.first.txhash).second)
+            summary.nTxCount += nSign;
+    }
+}
+
+bool CAddressIndexCache::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect) {
+    LOCK(cs);
+    UpdateAddressSummaries(vect, 1);
+    for (const auto& entry : vect)
+        cacheAddressIndex[entry.first] = CAddressIndexEntry(entry.second, false);
+    return true;
+}
+
+bool CAddressIndexCache::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect) {
+    LOCK(cs);
+    UpdateAddressSummaries(vect, -1);
+    for (const auto& entry : vect)
+        cacheAddressIndex[entry.first] = CAddressIndexEntry(0, true);
+    return true;
+}
+
+bool CAddressIndexCache::ReadAddressIndex(uint160 addressHash, int type,
+                                          std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                          int start, int end) {
+    const int nStartHeight = (start > 0 && end > 0) ? start : 0;
+    return ReadAddressIndex(CAddressIndexKey(type, addressHash, nStartHeight, 0, UINT256_ZERO, 0, false), end, 0, addressIndex);
+}
+
+bool CAddressIndexCache::ReadAddressIndex(const CAddressIndexKey &keyStart, int end, size_t nLimit,
+                                          std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex) {
+    LOCK(cs);
+    AddressIndexMap::const_iterator itBegin = cacheAddressIndex.lower_bound(keyStart);
+    AddressIndexMap::const_iterator itEnd = itBegin;
+    size_t nErased = 0;
+    while (itEnd != cacheAddressIndex.end() && itEnd->first.type == keyStart.type && itEnd->first.hashBytes == keyStart.hashBytes &&
+            (end <= 0 || itEnd->first.blockHeight <= end)) {
+        if (itEnd->second.fErased)
+            nErased++;
+        itEnd++;
+    }
+
+    if (itBegin == itEnd)
+        return db->ReadAddressIndex(keyStart, end, nLimit, addressIndex);
+
+    // Read enough stored entries to fill the page, even if the cache erased some of them
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vStored;
+    if (!db->ReadAddressIndex(keyStart, end, nLimit > 0 ? nLimit + nErased : 0, vStored))
+        return false;
+    const bool fComplete = nLimit == 0 || vStored.size() < nLimit + nErased;
+
+    // Merge the pending changes into the stored entries, in the order of the database.
+    // If the stored entries were cut off, entries after the last one are unknown.
+    std::map<CAddressIndexKey, CAmount, CAddressIndexKeyCompare> mapMerged(vStored.begin(), vStored.end());
+    for (AddressIndexMap::const_iterator it = itBegin; it != itEnd; it++) {
+        if (!fComplete && CAddressIndexKeyCompare()(vStored.back().first, it->first))
+            break;
+        if (it->second.fErased)
+            mapMerged.erase(it->first);
+        else
+            mapMerged[it->first] = it->second.nValue;
+    }
+    size_t nAdded = 0;
+    for (auto it = mapMerged.begin(); it != mapMerged.end() && (nLimit == 0 || nAdded < nLimit); it++, nAdded++)
+        addressIndex.push_back(*it);
+    return true;
+}
+
+bool CAddressIndexCache::ReadAddressSummary(uint160 addressHash, int type, CAddressSummary &summary) {
+    LOCK(cs);
+    if (!db->ReadAddressSummary(addressHash, type, summary))
+        return false;
+    AddressSummaryMap::const_iterator it = cacheAddressSummary.find(CAddressIndexIteratorKey(type, addressHash));
+    if (it != cacheAddressSummary.end()) {
+        summary.nBalance += it->second.nBalance;
+        summary.nReceived += it->second.nReceived;
+        summary.nTxCount += it->second.nTxCount;
+    }
+    return true;
+}
+
+bool CAddressIndexCache::Flush() {
+    LOCK(cs);
+    CDBBatch batch;
+    int nMaxHeight = -1;
+    for (const auto& entry : cacheAddressIndex) {
+        if (entry.second.fErased) {
+            batch.Erase(std::make_pair(DB_ADDRESSINDEX, entry.first));
+        } else {
+            batch.Write(std::make_pair(DB_ADDRESSINDEX, entry.first), entry.second.nValue);
+            nMaxHeight = std::max(nMaxHeight, entry.first.blockHeight);
+        }
+    }
+    // the height only grows, so that it covers all stored entries
+    LoadFlushedHeight();
+    if (nMaxHeight > nFlushedHeight) {
+        nFlushedHeight = nMaxHeight;
+        batch.Write(std::make_pair('I', ADDRESS_INDEX_HEIGHT), nFlushedHeight);
+    }
+    for (const auto& entry : cacheAddressUnspent) {
+        if (entry.second.IsNull())
+            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, entry.first));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, entry.first), entry.second);
+    }
+    for (const auto& entry : cacheSpentIndex) {
+        if (entry.second.IsNull())
+            batch.Erase(std::make_pair(DB_SPENTINDEX, entry.first));
+        else
+            batch.Write(std::make_pair(DB_SPENTINDEX, entry.first), entry.second);
+    }
+    for (const auto& entry : cacheAddressSummary) {
+        if (entry.second.IsNull())
+            continue;
+        CAddressSummary summary;
+        if (!db->ReadAddressSummary(entry.first.hashBytes, entry.first.type, summary))
+            return false;
+        summary.nBalance += entry.second.nBalance;
+        summary.nReceived += entry.second.nReceived;
+        summary.nTxCount += entry.second.nTxCount;
+        if (summary.IsNull())
+            batch.Erase(std::make_pair(DB_ADDRESSSUMMARY, entry.first));
+        else
+            batch.Write(std::make_pair(DB_ADDRESSSUMMARY, entry.first), summary);
+    }
+    LogPrint(BCLog::COINDB, "Writing %u address and spent index changes to the block tree database...\n", (unsigned int)GetCacheSize());
+    if (!db->WriteBatch(batch))
+        return false;
+
+    cacheAddressIndex.clear();
+    cacheAddressUnspent.clear();
+    cacheSpentIndex.clear();
+    cacheAddressSummary.clear();
+    cachedScriptsUsage = 0;
+    return true;
+}
+
+size_t CAddressIndexCache::GetCacheSize() const {
+    LOCK(cs);
+    return cacheAddressIndex.size() + cacheAddressUnspent.size() + cacheSpentIndex.size() + cacheAddressSummary.size();
+}
+
+size_t CAddressIndexCache::DynamicMemoryUsage() const {
+    LOCK(cs);
+    return memusage::DynamicUsage(cacheAddressIndex) +
+           memusage::DynamicUsage(cacheAddressUnspent) +
+           memusage::DynamicUsage(cacheSpentIndex) +
+           memusage::DynamicUsage(cacheAddressSummary) +
+           cachedScriptsUsage;
+}
@@ -12,6 +12,7 @@
 #include "dbwrapper.h"
 #include "libzerocoin/Coin.h"
 #include "libzerocoin/CoinSpend.h"
+#include "sync.h"
 
 #include <map>
 #include <string>
@@ -26,6 +27,7 @@
 
 class CCoinsViewDBCursor;
 class uint256;
+struct CVerifyJob;
 
 //! Compensate for extra memory peak (x1.5-x1.9) at flush time.
 static constexpr int DB_PEAK_USAGE_FACTOR = 2;
@@ -122,6 +124,8 @@ private:
 
 public:
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
+    /** Rewrites the indexes in one batch */
+    bool WriteBlockIndexes(const std::vector<const CBlockIndex*>& vIndexes);
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo& fileinfo);
     bool ReadLastBlockFile(int& nFile);
@@ -137,21 +141,119 @@ public:
     bool ReadLegacyBlockIndex(const uint256& blockHash, CLegacyBlockIndex& biRet);
     bool WriteMoneySupply(const int64_t& nSupply);
     bool ReadMoneySupply(int64_t& nSupply) const;
+    /** Background verification jobs, see CBlockVerifier, an empty list is erased */
+    bool WriteVerifyJobs(const std::vector<CVerifyJob>& vJobs);
+    bool ReadVerifyJobs(std::vector<CVerifyJob>& vJobs) const;
 
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    /** Reads at most nLimit (0 = all) unspent outputs of the address of keyStart, beginning at keyStart */
+    bool ReadAddressUnspentIndex(const CAddressUnspentKey &keyStart, size_t nLimit,
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                           int start = 0, int end = 0);
+    /** Reads at most nLimit (0 = all) entries of the address of keyStart up to height end (0 = tip), beginning at keyStart */
+    bool ReadAddressIndex(const CAddressIndexKey &keyStart, int end, size_t nLimit,
+                          std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
+    bool ReadAddressSummary(uint160 addressHash, int type, CAddressSummary &summary);
+    /** Writes the summaries of all addresses in the address index, replacing existing ones */
+    bool BuildAddressSummaries();
+    /** Reads the highest block height of the stored address index entries, false if none were stored */
+    bool ReadAddressIndexHeight(int& nHeight);
+};
+
+/**
+ * Write-back cache of the address, address unspent and spent indexes in the
+ * block tree database.
+ *
+ * Connected and disconnected blocks change the indexes in memory, and reads
+ * merge the pending changes with the database. The changes are written in a
+ * single batch by Flush(), together with the coins cache, and their memory is
+ * counted against the coins cache limit (-dbcache).
+ */
+class CAddressIndexCache
+{
+private:
+    struct CAddressIndexEntry {
+        CAmount nValue;
+        bool fErased;
+
+        CAddressIndexEntry() : nValue(0), fErased(false) {}
+        CAddressIndexEntry(CAmount nValueIn, bool fErasedIn) : nValue(nValueIn), fErased(fErasedIn) {}
+    };
+
+    typedef std::map<CAddressIndexKey, CAddressIndexEntry, CAddressIndexKeyCompare> AddressIndexMap;
+    typedef std::map<CAddressUnspentKey, CAddressUnspentValue, CAddressUnspentKeyCompare> AddressUnspentMap;
+    typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> SpentIndexMap;
+    typedef std::map<CAddressIndexIteratorKey, CAddressSummary, CAddressIndexIteratorKeyCompare> AddressSummaryMap;
+
+    /**
+     * Whether the entry is in the index, with the pending changes. The database is only read
+     * for entries of blocks up to the highest flushed one, which may be connected again after
+     * a crash, which flushed the index but not the chainstate.
+     */
+    bool HaveAddressIndex(const CAddressIndexKey &key);
+    //! Loads nFlushedHeight from the database, once
+    void LoadFlushedHeight();
+    /**
+     * Adds (or with nSign -1 subtracts) the entries of a block to the summaries of their addresses.
+     * Entries, which are already in (or missing from) the index, are skipped, so that the
+     * summaries always match the stored index, even if blocks are connected or disconnected twice.
+     */
+    void UpdateAddressSummaries(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, int nSign);
+
+    CBlockTreeDB* db;
+    mutable RecursiveMutex cs;
+    AddressIndexMap cacheAddressIndex;
+    //! Null values are erased entries
+    AddressUnspentMap cacheAddressUnspent;
+    //! Null values are erased entries
+    SpentIndexMap cacheSpentIndex;
+    //! Changes of the summaries of the addresses, by the cached entries
+    AddressSummaryMap cacheAddressSummary;
+    //! Highest block height of the entries in the database, loaded on first use (-1 = none)
+    int nFlushedHeight;
+    bool fFlushedHeightLoaded;
+    //! Memory used by the scripts in cacheAddressUnspent
+    size_t cachedScriptsUsage;
+
+public:
+    explicit CAddressIndexCache(CBlockTreeDB* dbIn);
+
+    bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
+    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
+    bool ReadAddressUnspentIndex(uint160 addressHash, int type,
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    /** Reads at most nLimit (0 = all) unspent outputs of the address of keyStart, beginning at keyStart */
+    bool ReadAddressUnspentIndex(const CAddressUnspentKey &keyStart, size_t nLimit,
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    bool ReadAddressIndex(uint160 addressHash, int type,
+                          std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                          int start = 0, int end = 0);
+    /** Reads at most nLimit (0 = all) entries of the address of keyStart up to height end (0 = tip), beginning at keyStart */
+    bool ReadAddressIndex(const CAddressIndexKey &keyStart, int end, size_t nLimit,
+                          std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
+    bool ReadAddressSummary(uint160 addressHash, int type, CAddressSummary &summary);
+
+    /** Writes the pending changes to the database, and empties the cache */
+    bool Flush();
+    //! Number of pending changes
+    size_t GetCacheSize() const;
+    //! Memory used by the pending changes
+    size_t DynamicMemoryUsage() const;
 };
 
 /** Zerocoin database (zerocoin/) */
@@ -173,6 +275,8 @@ public:
     bool WriteCoinSpendBatch(const std::vector<std::pair<libzerocoin::CoinSpend, uint256> >& spendInfo);
     bool ReadCoinSpend(const CBigNum& bnSerial, uint256& txHash);
     bool ReadCoinSpend(const uint256& hashSerial, uint256 &txHash);
+    /** Write hashed zPIV spends (serial hash, tx) and mints (pubcoin hash, tx) in one batch */
+    bool WriteCoinHashBatch(const std::vector<std::pair<uint256, uint256> >& vSpends, const std::vector<std::pair<uint256, uint256> >& vMints);
     bool EraseCoinMint(const CBigNum& bnPubcoin);
     bool EraseCoinSpend(const CBigNum& bnSerial);
     bool WipeCoins(std::string strType);
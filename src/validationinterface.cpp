@@ -28,7 +28,7 @@ struct MainSignalsInstance {
     /** A posInBlock value for SyncTransaction which indicates the transaction was conflicted, disconnected, or not in a block */
     static const int SYNC_TRANSACTION_NOT_IN_BLOCK = -1;
     /** Notifies listeners of updated transaction data (transaction, and optionally the block it is found in. */
-    boost::signals2::signal<void (const CTransaction &, const CBlockIndex *pindex, int posInBlock)> SyncTransaction;
+    boost::signals2::signal<void (const CTransactionRef&, const CBlockIndex *pindex, int posInBlock)> SyncTransaction;
     /** Notifies listeners of an updated transaction lock without new data. */
     boost::signals2::signal<void (const CTransaction &)> NotifyTransactionLock;
     /** Notifies listeners of an updated transaction without new data (for now: a coinbase potentially becoming visible). */
@@ -85,7 +85,7 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex* pindex) {
     m_internals->UpdatedBlockTip(pindex);
 }
 
-void CMainSignals::SyncTransaction(const CTransaction& tx, const CBlockIndex* pindex, int posInBlock) {
+void CMainSignals::SyncTransaction(const CTransactionRef& tx, const CBlockIndex* pindex, int posInBlock) {
     m_internals->SyncTransaction(tx, pindex, posInBlock);
 }
 
@@ -0,0 +1,197 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "verifydb.h"
+
+#include "guiinterface.h"
+#include "init.h"
+#include "main.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <algorithm>
+#include <functional>
+
+CBlockVerifier g_blockverifier;
+
+void CBlockVerifier::Start(bool fWipe)
+{
+    std::vector<CVerifyJob> vJobs;
+    if (fWipe) {
+        pblocktree->WriteVerifyJobs(vJobs);
+    } else {
+        pblocktree->ReadVerifyJobs(vJobs);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (const CVerifyJob& job : vJobs) {
+            LogPrintf("%s: resuming verification of blocks %d to %d at level %d from block %d\n", __func__,
+                job.nStartHeight, job.nEndHeight, job.nCheckLevel, job.nNextHeight);
+            queueJobs.push_back(job);
+        }
+        fStop = false;
+    }
+
+    thread = std::thread(&TraceThread<std::function<void()> >, "verifydb",
+            std::function<void()>(std::bind(&CBlockVerifier::ThreadVerify, this)));
+}
+
+void CBlockVerifier::Stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fStop = true;
+    }
+    condWork.notify_all();
+    if (thread.joinable())
+        thread.join();
+}
+
+void CBlockVerifier::SaveJobs()
+{
+    if (pblocktree)
+        pblocktree->WriteVerifyJobs(std::vector<CVerifyJob>(queueJobs.begin(), queueJobs.end()));
+}
+
+bool CBlockVerifier::Queue(int nStartHeight, int nEndHeight, int nCheckLevel, std::string& strError)
+{
+    int nTipHeight;
+    {
+        LOCK(cs_main);
+        nTipHeight = chainActive.Height();
+    }
+
+    if (nEndHeight < 0 || nEndHeight > nTipHeight)
+        nEndHeight = nTipHeight;
+    // the genesis block has nothing to verify
+    nStartHeight = std::max(1, nStartHeight);
+    if (nStartHeight > nEndHeight) {
+        strError = strprintf("No blocks to verify from %d to %d", nStartHeight, nEndHeight);
+        return false;
+    }
+    if (nCheckLevel < 0 || nCheckLevel > 4) {
+        strError = "Check level must be between 0 and 4";
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!thread.joinable()) {
+        strError = "Background verification is not running";
+        return false;
+    }
+    queueJobs.emplace_back(nStartHeight, nEndHeight, nCheckLevel, nEndHeight == nTipHeight);
+    SaveJobs();
+    LogPrintf("%s: queued verification of blocks %d to %d at level %d\n", __func__, nStartHeight, nEndHeight, nCheckLevel);
+    condWork.notify_all();
+    return true;
+}
+
+CVerifyStatus CBlockVerifier::GetStatus()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    CVerifyStatus ret = status;
+    ret.vJobs.assign(queueJobs.begin(), queueJobs.end());
+    return ret;
+}
+
+void CBlockVerifier::ThreadVerify()
+{
+    SetThreadPriority(THREAD_PRIORITY_LOWEST);
+
+    while (true) {
+        CVerifyJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condWork.wait(lock, [this] { return fStop || !queueJobs.empty(); });
+            if (fStop) return;
+            job = queueJobs.front();
+        }
+
+        std::string strError;
+        const bool fVerified = RunJob(job, strError);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (fStop || ShutdownRequested()) {
+            // resume the job after a restart
+            queueJobs.front() = job;
+            SaveJobs();
+            return;
+        }
+        queueJobs.pop_front();
+        SaveJobs();
+
+        status.nFinished++;
+        status.lastJob = job;
+        status.fLastFailed = !fVerified;
+        status.strLastError = strError;
+        if (fVerified) {
+            LogPrintf("%s: verified blocks %d to %d at level %d\n", __func__, job.nStartHeight, job.nEndHeight, job.nCheckLevel);
+        } else {
+            LogPrintf("%s: *** verification of blocks %d to %d failed: %s\n", __func__, job.nStartHeight, job.nEndHeight, strError);
+            uiInterface.ThreadSafeMessageBox(
+                strprintf(_("Corrupted block database detected: %s. Restart with -reindex to rebuild the block database."), strError),
+                "", CClientUIInterface::MSG_ERROR);
+        }
+    }
+}
+
+bool CBlockVerifier::RunJob(CVerifyJob& job, std::string& strError)
+{
+    while (true) {
+        // levels 0 to 2, without cs_main
+        while (job.nNextHeight <= job.nEndHeight) {
+            std::vector<const CBlockIndex*> vIndexes;
+            {
+                LOCK(cs_main);
+                const int nLast = std::min(std::min(job.nEndHeight, chainActive.Height()), job.nNextHeight + VERIFY_BATCH_SIZE - 1);
+                for (int nHeight = job.nNextHeight; nHeight <= nLast; nHeight++) {
+                    vIndexes.push_back(chainActive[nHeight]);
+                }
+            }
+            if (vIndexes.empty()) {
+                // the chain got shorter than the range
+                job.nEndHeight = job.nNextHeight - 1;
+                break;
+            }
+
+            for (const CBlockIndex* pindex : vIndexes) {
+                if (fStop || ShutdownRequested())
+                    return true;
+                CBlock block;
+                if (!VerifyBlockData(block, pindex, job.nCheckLevel, strError)) {
+                    strError = strprintf("%s at %d, hash=%s", strError, pindex->nHeight, pindex->GetBlockHash().ToString());
+                    return false;
+                }
+                job.nNextHeight = pindex->nHeight + 1;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            queueJobs.front() = job;
+            SaveJobs();
+        }
+
+        if (job.nCheckLevel < 3 || !job.fTip || fStop || ShutdownRequested())
+            return true;
+
+        // levels 3 and 4, on a copy of the coins cache of the current tip, for the blocks
+        // checked above only. Blocks connected meanwhile are checked at levels 0 to 2 first.
+        LOCK(cs_main);
+        if (chainActive.Height() > job.nEndHeight) {
+            job.nEndHeight = chainActive.Height();
+            continue;
+        }
+
+        int nCheckDepth = GetArg("-checkblocks", DEFAULT_CHECKBLOCKS);
+        if (nCheckDepth <= 0 || nCheckDepth > job.nEndHeight - job.nStartHeight + 1)
+            nCheckDepth = job.nEndHeight - job.nStartHeight + 1;
+
+        fVerifyingBlocks = true;
+        const bool fVerified = VerifyBlockCoins(pcoinsTip, job.nCheckLevel, nCheckDepth, strError);
+        fVerifyingBlocks = false;
+        if (!fVerified)
+            strError = strprintf("coin database inconsistencies found in the last %d blocks: %s", nCheckDepth, strError);
+        return fVerified;
+    }
+}
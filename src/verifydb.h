@@ -0,0 +1,114 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_VERIFYDB_H
+#define PIVX_VERIFYDB_H
+
+#include "serialize.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! Default for -verifybackground
+static const bool DEFAULT_VERIFY_BACKGROUND = false;
+//! Number of blocks checked per cs_main lock, and between saves of the progress
+static const int VERIFY_BATCH_SIZE = 128;
+
+/**
+ * Range of blocks of the active chain to verify, and how far it got.
+ *
+ * Levels 0 to 2 of VerifyDB are checked for every block of the range. Levels
+ * 3 and 4 disconnect and reconnect blocks in a memory only copy of the coins
+ * cache, so they are only checked for the last -checkblocks blocks, and only
+ * if the range ended at the tip when it was queued.
+ */
+struct CVerifyJob
+{
+    int nStartHeight;
+    int nEndHeight;
+    int nCheckLevel;
+    //! The range ended at the tip
+    bool fTip;
+    //! Next block to check at levels 0 to 2
+    int nNextHeight;
+
+    CVerifyJob() : nStartHeight(0), nEndHeight(0), nCheckLevel(0), fTip(false), nNextHeight(0) {}
+    CVerifyJob(int nStartHeightIn, int nEndHeightIn, int nCheckLevelIn, bool fTipIn) :
+        nStartHeight(nStartHeightIn), nEndHeight(nEndHeightIn), nCheckLevel(nCheckLevelIn), fTip(fTipIn), nNextHeight(nStartHeightIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(VARINT(nStartHeight));
+        READWRITE(VARINT(nEndHeight));
+        READWRITE(VARINT(nCheckLevel));
+        READWRITE(fTip);
+        READWRITE(VARINT(nNextHeight));
+    }
+};
+
+struct CVerifyStatus
+{
+    //! Jobs not finished yet, the first is the running one
+    std::vector<CVerifyJob> vJobs;
+    //! Number of finished jobs since startup
+    int nFinished;
+    //! The last finished job, and whether it failed
+    CVerifyJob lastJob;
+    bool fLastFailed;
+    std::string strLastError;
+
+    CVerifyStatus() : nFinished(0), fLastFailed(false) {}
+};
+
+/**
+ * Verifies ranges of the active chain on a low priority background thread,
+ * while the node runs.
+ *
+ * Blocks are read and checked without cs_main, which is only held to look up
+ * the next batch of blocks, and for the disconnect and reconnect of levels 3
+ * and 4. The queued jobs and their progress are saved in the block tree
+ * database, so that they resume after a restart.
+ */
+class CBlockVerifier
+{
+private:
+    std::thread thread;
+    std::mutex mutex;
+    //! Signaled, when a job is queued, or the thread is stopped
+    std::condition_variable condWork;
+    std::atomic<bool> fStop;
+    std::deque<CVerifyJob> queueJobs;
+    CVerifyStatus status;
+
+    void ThreadVerify();
+    bool RunJob(CVerifyJob& job, std::string& strError);
+    //! Saves the queued jobs, requires mutex
+    void SaveJobs();
+
+public:
+    CBlockVerifier() : fStop(false) {}
+    ~CBlockVerifier() { Stop(); }
+
+    /** Loads the saved jobs (unless fWipe), and starts the thread. Requires the block tree database. */
+    void Start(bool fWipe);
+    /** Stops the thread, the progress of the running job is saved. */
+    void Stop();
+
+    /** Queues the verification of the blocks from nStartHeight to nEndHeight (-1 = tip). */
+    bool Queue(int nStartHeight, int nEndHeight, int nCheckLevel, std::string& strError);
+
+    CVerifyStatus GetStatus();
+};
+
+extern CBlockVerifier g_blockverifier;
+
+#endif // PIVX_VERIFYDB_H
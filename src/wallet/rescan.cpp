@@ -0,0 +1,131 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/rescan.h"
+
+#include "main.h"
+#include "util.h"
+
+#include <functional>
+
+bool CRescanFilter::IsRelevant(const CScript& scriptPubKey) const
+{
+    if (setWatchOnly.count(scriptPubKey)) return true;
+
+    std::vector<std::vector<unsigned char> > vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions)) return false;
+
+    switch (whichType) {
+    case TX_ZEROCOINMINT:
+    case TX_PUBKEY:
+        return setKeyIDs.count(CPubKey(vSolutions[0]).GetID()) > 0;
+    case TX_PUBKEYHASH:
+        return setKeyIDs.count(CKeyID(uint160(vSolutions[0]))) > 0;
+    case TX_SCRIPTHASH:
+        return setScriptIDs.count(CScriptID(uint160(vSolutions[0]))) > 0;
+    case TX_COLDSTAKE:
+        return setKeyIDs.count(CKeyID(uint160(vSolutions[0]))) > 0 ||
+               setKeyIDs.count(CKeyID(uint160(vSolutions[1]))) > 0;
+    case TX_MULTISIG:
+        for (size_t i = 1; i + 1 < vSolutions.size(); i++) {
+            if (setKeyIDs.count(CPubKey(vSolutions[i]).GetID())) return true;
+        }
+        return false;
+    default:
+        return false;
+    }
+}
+
+bool CRescanFilter::IsRelevant(const CTransaction& tx) const
+{
+    for (const CTxOut& txout : tx.vout) {
+        if (IsRelevant(txout.scriptPubKey)) return true;
+    }
+    return false;
+}
+
+CRescanPrefetcher::CRescanPrefetcher(int nThreads) :
+    nBatch(0),
+    nWorking(0),
+    fStop(false),
+    nNext(0)
+{
+    for (int i = 0; i < nThreads; ++i) {
+        vThreads.push_back(std::thread(&TraceThread<std::function<void()> >, "rescan",
+                std::function<void()>(std::bind(&CRescanPrefetcher::ThreadWorker, this))));
+    }
+}
+
+CRescanPrefetcher::~CRescanPrefetcher()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fStop = true;
+    }
+    condWork.notify_all();
+    for (std::thread& thread : vThreads) {
+        thread.join();
+    }
+}
+
+void CRescanPrefetcher::ThreadWorker()
+{
+    uint64_t nLastBatch = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condWork.wait(lock, [this, nLastBatch] { return fStop || nBatch != nLastBatch; });
+            if (fStop) return;
+            nLastBatch = nBatch;
+        }
+
+        ReadBlocks();
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (--nWorking == 0) condDone.notify_all();
+        }
+    }
+}
+
+void CRescanPrefetcher::ReadBlocks()
+{
+    while (!fStop) {
+        const size_t nPos = nNext++;
+        if (nPos >= vBlocks.size()) break;
+
+        Block& block = vBlocks[nPos];
+        block.fRead = ReadBlockFromDisk(block.block, block.pindex);
+        block.filter = filter;
+        block.vRelevant.resize(block.block.vtx.size());
+        for (size_t i = 0; i < block.block.vtx.size(); i++) {
+            block.vRelevant[i] = filter->IsRelevant(*block.block.vtx[i]);
+        }
+    }
+}
+
+void CRescanPrefetcher::Start(const std::vector<const CBlockIndex*>& vIndexes, const std::shared_ptr<const CRescanFilter>& filterIn)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    assert(nWorking == 0);
+    vBlocks.clear();
+    vBlocks.reserve(vIndexes.size());
+    for (const CBlockIndex* pindex : vIndexes) {
+        vBlocks.emplace_back(pindex);
+    }
+    filter = filterIn;
+    nNext = 0;
+    nWorking = (int)vThreads.size();
+    ++nBatch;
+    condWork.notify_all();
+}
+
+void CRescanPrefetcher::Wait(std::vector<Block>& vBlocksOut)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    condDone.wait(lock, [this] { return nWorking == 0; });
+    vBlocksOut.swap(vBlocks);
+    vBlocks.clear();
+}
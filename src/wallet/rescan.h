@@ -0,0 +1,105 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_WALLET_RESCAN_H
+#define PIVX_WALLET_RESCAN_H
+
+#include "primitives/block.h"
+#include "pubkey.h"
+#include "script/script.h"
+#include "script/standard.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+class CBlockIndex;
+
+//! Default for -rescanthreads, 0 = one thread per core
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of threads reading blocks for a rescan
+static const int MAX_RESCAN_THREADS = 8;
+//! Number of blocks applied to the wallet per cs_main lock during a rescan
+static const size_t RESCAN_BATCH_SIZE = 128;
+
+/**
+ * Keys and scripts of a wallet, against which a rescan tests transaction
+ * outputs without holding the wallet lock.
+ *
+ * The test may pass outputs, which aren't mine, like a multisig with a single
+ * key of the wallet, but it never rejects an output, which is mine.
+ */
+class CRescanFilter
+{
+public:
+    std::set<CKeyID> setKeyIDs;
+    std::set<CScriptID> setScriptIDs;
+    std::set<CScript> setWatchOnly;
+    //! Size of the key store, when the filter was made
+    size_t nKeyStoreSize;
+
+    CRescanFilter() : nKeyStoreSize(0) {}
+
+    bool IsRelevant(const CScript& scriptPubKey) const;
+    bool IsRelevant(const CTransaction& tx) const;
+};
+
+/**
+ * Reads the blocks of a rescan ahead on a pool of threads, and tests their
+ * transactions against a CRescanFilter, while the previous batch of blocks is
+ * applied to the wallet.
+ */
+class CRescanPrefetcher
+{
+public:
+    struct Block {
+        const CBlockIndex* pindex;
+        CBlock block;
+        bool fRead;
+        //! Filter, which was used for vRelevant
+        std::shared_ptr<const CRescanFilter> filter;
+        //! Whether the outputs of a transaction passed the filter
+        std::vector<bool> vRelevant;
+
+        explicit Block(const CBlockIndex* pindexIn) : pindex(pindexIn), fRead(false) {}
+    };
+
+private:
+    std::vector<std::thread> vThreads;
+    std::mutex mutex;
+    //! Signaled, when a batch is started, or the threads are stopped
+    std::condition_variable condWork;
+    //! Signaled, when a worker thread finished its part of a batch
+    std::condition_variable condDone;
+    //! Incremented for every batch
+    uint64_t nBatch;
+    //! Number of worker threads, which didn't finish the current batch yet
+    int nWorking;
+    std::atomic<bool> fStop;
+
+    std::vector<Block> vBlocks;
+    std::shared_ptr<const CRescanFilter> filter;
+    //! Position of the next block to read
+    std::atomic<size_t> nNext;
+
+    void ThreadWorker();
+    void ReadBlocks();
+
+public:
+    /** Starts the worker threads. */
+    explicit CRescanPrefetcher(int nThreads);
+    /** Stops and joins the worker threads. */
+    ~CRescanPrefetcher();
+
+    /** Starts reading and filtering a batch of blocks. */
+    void Start(const std::vector<const CBlockIndex*>& vIndexes, const std::shared_ptr<const CRescanFilter>& filterIn);
+    /** Waits for the current batch, and moves its blocks to vBlocksOut. */
+    void Wait(std::vector<Block>& vBlocksOut);
+};
+
+#endif // PIVX_WALLET_RESCAN_H
@@ -0,0 +1,148 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/stakesearch.h"
+
+#include "main.h"
+#include "stakeinput.h"
+#include "timedata.h"
+#include "util.h"
+#include "wallet/wallet.h"
+
+#include <algorithm>
+#include <functional>
+
+CStakeSearch::CStakeSearch(int nThreads) :
+    nPreparedBits(0),
+    nSearch(0),
+    nWorking(0),
+    fStop(false),
+    nSearchTime(0),
+    nNext(0)
+{
+    for (int i = 1; i < nThreads; ++i) {
+        vThreads.push_back(std::thread(&TraceThread<std::function<void()> >, "stakesearch",
+                std::function<void()>(std::bind(&CStakeSearch::ThreadWorker, this))));
+    }
+}
+
+CStakeSearch::~CStakeSearch()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fStop = true;
+    }
+    condWork.notify_all();
+    for (std::thread& thread : vThreads) {
+        thread.join();
+    }
+}
+
+void CStakeSearch::ThreadWorker()
+{
+    uint64_t nLastSearch = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condWork.wait(lock, [this, nLastSearch] { return fStop || nSearch != nLastSearch; });
+            if (fStop) return;
+            nLastSearch = nSearch;
+        }
+
+        CheckCandidates();
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (--nWorking == 0) condDone.notify_all();
+        }
+    }
+}
+
+void CStakeSearch::CheckCandidates()
+{
+    std::vector<size_t> vFoundHere;
+    while (true) {
+        const size_t nBegin = nNext.fetch_add(SEARCH_CHUNK_SIZE);
+        if (nBegin >= vCandidates.size()) break;
+        const size_t nEnd = std::min(nBegin + SEARCH_CHUNK_SIZE, vCandidates.size());
+        for (size_t i = nBegin; i < nEnd; ++i) {
+            if (vCandidates[i].kernel.CheckKernelHash(nSearchTime)) {
+                vFoundHere.push_back(vCandidates[i].nCoin);
+            }
+        }
+    }
+
+    if (!vFoundHere.empty()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        vFound.insert(vFound.end(), vFoundHere.begin(), vFoundHere.end());
+    }
+}
+
+int CStakeSearch::Prepare(const CBlockIndex* pindexPrev, unsigned int nBits, const std::vector<COutput>& vCoins)
+{
+    AssertLockHeld(cs_main);
+
+    std::vector<COutPoint> vCoinOutPoints;
+    vCoinOutPoints.reserve(vCoins.size());
+    for (const COutput& out : vCoins) {
+        vCoinOutPoints.emplace_back(out.tx->GetHash(), out.i);
+    }
+
+    if (pindexPrev->GetBlockHash() == hashPreparedBlock && nBits == nPreparedBits && vCoinOutPoints == vPreparedCoins) {
+        return (int)vCandidates.size();
+    }
+
+    vCandidates.clear();
+    vCandidates.reserve(vCoins.size());
+    const int nHeightTx = pindexPrev->nHeight + 1;
+
+    for (size_t i = 0; i < vCoins.size(); ++i) {
+        const COutput& out = vCoins[i];
+        CPivStake stakeInput;
+        stakeInput.SetPrevout((CTransaction) *out.tx, out.i);
+
+        // The wallet knows the block of the coin, which spares the transaction lookup of GetIndexFrom()
+        BlockMap::const_iterator mi = mapBlockIndex.find(out.tx->hashBlock);
+        if (mi != mapBlockIndex.end() && mi->second && chainActive.Contains(mi->second)) {
+            stakeInput.SetIndexFrom(mi->second);
+        }
+
+        if (!stakeInput.ContextCheck(nHeightTx, pindexPrev->nTime)) continue;
+
+        CStakeKernel stakeKernel(pindexPrev, &stakeInput, nBits, 0);
+        vCandidates.emplace_back(i, CStakeKernelPrefix(stakeKernel));
+    }
+
+    hashPreparedBlock = pindexPrev->GetBlockHash();
+    nPreparedBits = nBits;
+    vPreparedCoins.swap(vCoinOutPoints);
+
+    return (int)vCandidates.size();
+}
+
+std::vector<size_t> CStakeSearch::Search(int nTimeTx)
+{
+    vFound.clear();
+    nSearchTime = nTimeTx;
+    nNext = 0;
+
+    if (vThreads.empty() || vCandidates.size() < MIN_PARALLEL_SEARCH) {
+        CheckCandidates();
+    } else {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            nWorking = (int)vThreads.size();
+            ++nSearch;
+        }
+        condWork.notify_all();
+
+        CheckCandidates();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        condDone.wait(lock, [this] { return nWorking == 0; });
+    }
+
+    std::sort(vFound.begin(), vFound.end());
+    return vFound;
+}
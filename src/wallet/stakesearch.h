@@ -0,0 +1,104 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PIVX_STAKESEARCH_H
+#define PIVX_STAKESEARCH_H
+
+#include "kernel.h"
+#include "primitives/transaction.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class CBlockIndex;
+class COutput;
+
+//! Default for -stakingthreads, 0 = one thread per core
+static const int DEFAULT_STAKING_THREADS = 0;
+//! Maximum number of threads used by the stake kernel search
+static const int MAX_STAKING_THREADS = 16;
+
+/**
+ * Stake kernel search over the stakeable coins of a wallet.
+ *
+ * The kernels of the coins are prepared once per parent block, with everything
+ * but the time slot hashed, and the time slot is checked for all coins on a
+ * pool of worker threads, together with the calling thread.
+ */
+class CStakeSearch
+{
+private:
+    //! Coins checked at once by a thread
+    static const size_t SEARCH_CHUNK_SIZE = 64;
+    //! Minimum number of coins to use the worker threads
+    static const size_t MIN_PARALLEL_SEARCH = 256;
+
+    struct Candidate {
+        //! Position of the coin in the coins given to Prepare()
+        size_t nCoin;
+        CStakeKernelPrefix kernel;
+
+        Candidate(size_t nCoinIn, const CStakeKernelPrefix& kernelIn) : nCoin(nCoinIn), kernel(kernelIn) {}
+    };
+
+    //! Prepared kernels, and what they were prepared for
+    std::vector<Candidate> vCandidates;
+    uint256 hashPreparedBlock;
+    unsigned int nPreparedBits;
+    std::vector<COutPoint> vPreparedCoins;
+
+    std::vector<std::thread> vThreads;
+    std::mutex mutex;
+    //! Signaled, when a search is started, or the threads are stopped
+    std::condition_variable condWork;
+    //! Signaled, when a worker thread finished its part of the search
+    std::condition_variable condDone;
+    //! Incremented for every search, which uses the worker threads
+    uint64_t nSearch;
+    //! Number of worker threads, which didn't finish the current search yet
+    int nWorking;
+    bool fStop;
+
+    //! Time slot of the current search
+    int nSearchTime;
+    //! Position of the next candidate to check
+    std::atomic<size_t> nNext;
+    //! Coins, whose kernel meets the target
+    std::vector<size_t> vFound;
+
+    void ThreadWorker();
+    void CheckCandidates();
+
+public:
+    /** Starts the worker threads, nThreads includes the calling thread. */
+    explicit CStakeSearch(int nThreads);
+    /** Stops and joins the worker threads. */
+    ~CStakeSearch();
+
+    /**
+     * Prepares the kernels of the coins for staking on top of pindexPrev.
+     *
+     * Kernels are kept, as long as the parent block, the target and the coins
+     * don't change. Requires cs_main.
+     *
+     * @return The number of coins, whose kernel could be prepared
+     */
+    int Prepare(const CBlockIndex* pindexPrev, unsigned int nBits, const std::vector<COutput>& vCoins);
+
+    /**
+     * Checks the prepared kernels for a time slot.
+     *
+     * @return The positions of the coins, whose kernel meets the target, in ascending order
+     */
+    std::vector<size_t> Search(int nTimeTx);
+
+    /** Returns the number of threads used by a search, including the calling thread. */
+    int GetThreadCount() const { return (int)vThreads.size() + 1; }
+};
+
+#endif // PIVX_STAKESEARCH_H
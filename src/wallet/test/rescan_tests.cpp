@@ -0,0 +1,95 @@
+// Copyright (c) 2020 The Rapids developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/rescan.h"
+
+#include "key.h"
+#include "script/standard.h"
+#include "wallet/test/wallet_test_fixture.h"
+#include "wallet/wallet.h"
+
+#include <boost/test/unit_test.hpp>
+
+static CKey MakeKey()
+{
+    CKey key;
+    key.MakeNewKey(true);
+    return key;
+}
+
+static CTransaction MakeTx(const CScript& scriptPubKey)
+{
+    CMutableTransaction tx;
+    tx.vout.resize(2);
+    tx.vout[0].scriptPubKey = GetScriptForDestination(MakeKey().GetPubKey().GetID());
+    tx.vout[0].nValue = 1 * COIN;
+    tx.vout[1].scriptPubKey = scriptPubKey;
+    tx.vout[1].nValue = 2 * COIN;
+    return CTransaction(tx);
+}
+
+BOOST_FIXTURE_TEST_SUITE(rescan_tests, WalletTestingSetup)
+
+BOOST_AUTO_TEST_CASE(rescan_filter_match)
+{
+    CKey key = MakeKey();
+    CPubKey pubkey = key.GetPubKey();
+    CScript redeemScript = GetScriptForMultisig(1, std::vector<CPubKey>(1, MakeKey().GetPubKey()));
+    CScript watchOnly = GetScriptForDestination(MakeKey().GetPubKey().GetID());
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_CHECK(pwalletMain->AddKeyPubKey(key, pubkey));
+        BOOST_CHECK(pwalletMain->AddCScript(redeemScript));
+        BOOST_CHECK(pwalletMain->AddWatchOnly(watchOnly));
+    }
+
+    CRescanFilter filter;
+    pwalletMain->GetRescanFilter(filter);
+    BOOST_CHECK_EQUAL(filter.nKeyStoreSize, pwalletMain->GetKeyStoreSize());
+
+    BOOST_CHECK(filter.IsRelevant(GetScriptForDestination(pubkey.GetID())));
+    BOOST_CHECK(filter.IsRelevant(GetScriptForRawPubKey(pubkey)));
+    BOOST_CHECK(filter.IsRelevant(GetScriptForDestination(CScriptID(redeemScript))));
+    BOOST_CHECK(filter.IsRelevant(watchOnly));
+    BOOST_CHECK(filter.IsRelevant(MakeTx(GetScriptForDestination(pubkey.GetID()))));
+}
+
+BOOST_AUTO_TEST_CASE(rescan_filter_no_match)
+{
+    CRescanFilter filter;
+    pwalletMain->GetRescanFilter(filter);
+
+    CPubKey pubkey = MakeKey().GetPubKey();
+    BOOST_CHECK(!filter.IsRelevant(GetScriptForDestination(pubkey.GetID())));
+    BOOST_CHECK(!filter.IsRelevant(GetScriptForRawPubKey(pubkey)));
+    BOOST_CHECK(!filter.IsRelevant(CScript() << OP_RETURN));
+    BOOST_CHECK(!filter.IsRelevant(MakeTx(GetScriptForDestination(pubkey.GetID()))));
+}
+
+BOOST_AUTO_TEST_CASE(rescan_filter_outdated)
+{
+    CRescanFilter filter;
+    pwalletMain->GetRescanFilter(filter);
+
+    // A key is added while a batch is applied, e.g. from the keypool
+    CKey key = MakeKey();
+    CPubKey pubkey = key.GetPubKey();
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_CHECK(pwalletMain->AddKeyPubKey(key, pubkey));
+    }
+    CTransaction tx = MakeTx(GetScriptForDestination(pubkey.GetID()));
+
+    // The filter made before doesn't know the key, but is detected as outdated
+    BOOST_CHECK(!filter.IsRelevant(tx));
+    BOOST_CHECK(filter.nKeyStoreSize != pwalletMain->GetKeyStoreSize());
+
+    // A new filter matches outputs to the added key
+    CRescanFilter filterNew;
+    pwalletMain->GetRescanFilter(filterNew);
+    BOOST_CHECK_EQUAL(filterNew.nKeyStoreSize, pwalletMain->GetKeyStoreSize());
+    BOOST_CHECK(filterNew.IsRelevant(tx));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
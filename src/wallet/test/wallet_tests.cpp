@@ -320,7 +320,7 @@ void removeTxFromMempool(CWalletTx& wtx)
 CBlockIndex* SimpleFakeMine(CWalletTx& wtx, CBlockIndex* pprev = nullptr)
 {
     CBlock block;
-    block.vtx.push_back(wtx);
+    block.vtx.push_back(MakeTransactionRef(wtx));
     block.hashMerkleRoot = BlockMerkleRoot(block);
     if (pprev) block.hashPrevBlock = pprev->GetBlockHash();
     CBlockIndex* fakeIndex = new CBlockIndex(block);
@@ -336,7 +336,7 @@ CBlockIndex* SimpleFakeMine(CWalletTx& wtx, CBlockIndex* pprev = nullptr)
 
 void fakeMempoolInsertion(const CWalletTx& wtxCredit)
 {
-    CTxMemPoolEntry entry(wtxCredit, 0, 0, 0, 0, false, 0, false, 0);
+    CTxMemPoolEntry entry(MakeTransactionRef(wtxCredit), 0, 0, 0, 0, false, 0, false, 0);
     LOCK(mempool.cs);
     mempool.mapTx.insert(entry);
 }
@@ -470,4 +470,46 @@ BOOST_AUTO_TEST_CASE(cached_balances_tests)
 
 }
 
+/**
+ * Validates, that CWallet::AvailableCoins follows the wallet outputs, which are
+ * mine, as they are received, confirmed and spent.
+ */
+BOOST_AUTO_TEST_CASE(available_coins_tests)
+{
+    CWallet &wallet = *pwalletMain;
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.SetMinVersion(FEATURE_PRE_SPLIT_KEYPOOL);
+    wallet.SetupSPKM(false);
+
+    CTxDestination receivingAddr;
+    BOOST_ASSERT(wallet.getNewAddress(receivingAddr, "receiving_address").result);
+    CKey key;
+    key.MakeNewKey(true);
+    CTxOut ownOut(10 * COIN, GetScriptForDestination(receivingAddr));
+    CTxOut otherOut(10 * COIN, GetScriptForDestination(key.GetPubKey().GetID()));
+
+    // Receive two outputs, and one for someone else
+    CWalletTx& wtxCredit = ReceiveBalanceWith({ownOut, otherOut, ownOut}, wallet);
+    fakeMempoolInsertion(wtxCredit);
+
+    std::vector<COutput> vCoins;
+    BOOST_CHECK(!wallet.AvailableCoins(&vCoins));
+    BOOST_CHECK(wallet.AvailableCoins(&vCoins, nullptr, true, false, ALL_COINS, false));
+    BOOST_CHECK_EQUAL(vCoins.size(), 2);
+
+    // Confirm them
+    SimpleFakeMine(wtxCredit);
+    BOOST_CHECK(wallet.AvailableCoins(&vCoins));
+    BOOST_CHECK_EQUAL(vCoins.size(), 2);
+    BOOST_CHECK_EQUAL(vCoins[0].i, 0);
+    BOOST_CHECK_EQUAL(vCoins[1].i, 2);
+
+    // Spend the first one
+    CWalletTx& wtxDebit = BuildAndLoadTxToWallet({CTxIn(COutPoint(wtxCredit.GetHash(), 0))}, {otherOut}, wallet);
+    fakeMempoolInsertion(wtxDebit);
+    BOOST_CHECK(wallet.AvailableCoins(&vCoins));
+    BOOST_CHECK_EQUAL(vCoins.size(), 1);
+    BOOST_CHECK_EQUAL(vCoins[0].i, 2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -18,6 +18,8 @@
 #include "swifttx.h"    // mapTxLockReq
 #include "util.h"
 #include "utilmoneystr.h"
+#include "wallet/rescan.h"
+#include "wallet/stakesearch.h"
 #include "zpivchain.h"
 
 #include <boost/algorithm/string/replace.hpp>
@@ -677,6 +679,36 @@ void CWallet::AddToSpends(const uint256& wtxid)
         AddToSpends(txin.prevout, wtxid);
 }
 
+void CWallet::AddToUnspentCoins(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    const uint256& wtxid = wtx.GetHash();
+    for (unsigned int i = 0; i < wtx.vout.size(); i++) {
+        if (IsMine(wtx.vout[i]) != ISMINE_NO)
+            setUnspentCoins.insert(COutPoint(wtxid, i));
+    }
+}
+
+void CWallet::RebuildUnspentCoins()
+{
+    AssertLockHeld(cs_wallet);
+    setUnspentCoins.clear();
+    for (const auto& item : mapWallet) {
+        AddToUnspentCoins(item.second);
+    }
+}
+
+bool CWallet::IsSpentFinally(const COutPoint& outpoint, int nMinDepth) const
+{
+    std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(outpoint);
+    for (TxSpends::const_iterator it = range.first; it != range.second; ++it) {
+        std::map<uint256, CWalletTx>::const_iterator mit = mapWallet.find(it->second);
+        if (mit != mapWallet.end() && mit->second.GetDepthInMainChain(false) >= nMinDepth)
+            return true;
+    }
+    return false;
+}
+
 bool CWallet::GetVinAndKeysFromOutput(COutput out, CTxIn& txinRet, CPubKey& pubKeyRet, CKey& keyRet, bool fColdStake)
 {
     // wait for reindex and/or import to finish
@@ -858,6 +890,8 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         for (PAIRTYPE(const uint256, CWalletTx) & item : mapWallet)
             item.second.MarkDirty();
+        // Imported keys and scripts can make outputs of known transactions mine
+        RebuildUnspentCoins();
     }
 }
 
@@ -879,6 +913,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
         wtx.UpdateTimeSmart();
         AddToSpends(hash);
     }
+    AddToUnspentCoins(wtx);
 
     bool fUpdated = false;
     if (!fInsertedNew) {
@@ -937,6 +972,7 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
     wtx.BindWallet(this);
     wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, (CAccountingEntry*)0)));
     AddToSpends(hash);
+    AddToUnspentCoins(wtx);
     for (const CTxIn& txin : wtx.vin) {
         if (mapWallet.count(txin.prevout.hash)) {
             CWalletTx& prevtx = mapWallet[txin.prevout.hash];
@@ -1114,8 +1150,9 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
     }
 }
 
-void CWallet::SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock)
+void CWallet::SyncTransaction(const CTransactionRef& ptx, const CBlockIndex *pindex, int posInBlock)
 {
+    const CTransaction& tx = *ptx;
     LOCK(cs_wallet);
     if (!AddToWalletIfInvolvingMe(tx, pindex, posInBlock, true))
         return; // Not one of ours
@@ -1137,6 +1174,9 @@ void CWallet::EraseFromWallet(const uint256& hash)
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
             CWalletDB(strWalletFile).EraseTx(hash);
+        std::set<COutPoint>::iterator it = setUnspentCoins.lower_bound(COutPoint(hash, 0));
+        while (it != setUnspentCoins.end() && it->hash == hash)
+            it = setUnspentCoins.erase(it);
         LogPrintf("%s: Erased wtx %s from wallet\n", __func__, hash.GetHex());
     }
     return;
@@ -1494,10 +1534,41 @@ bool CWallet::Upgrade(std::string& error, const int& prevVersion)
     return true;
 }
 
+void CWallet::GetRescanFilter(CRescanFilter& filter) const
+{
+    LOCK(cs_KeyStore);
+    GetKeys(filter.setKeyIDs);
+    for (const auto& entry : mapScripts)
+        filter.setScriptIDs.insert(entry.first);
+    filter.setWatchOnly = setWatchOnly;
+    filter.nKeyStoreSize = GetKeyStoreSize();
+}
+
+size_t CWallet::GetKeyStoreSize() const
+{
+    LOCK(cs_KeyStore);
+    return mapKeys.size() + mapCryptedKeys.size() + mapScripts.size() + setWatchOnly.size();
+}
+
+/** Collects the next blocks of the active chain to rescan, starting with pindex, in vIndexes */
+static void GetRescanBatch(const CBlockIndex* pindex, std::vector<const CBlockIndex*>& vIndexes)
+{
+    AssertLockHeld(cs_main);
+    vIndexes.clear();
+    while (pindex && vIndexes.size() < RESCAN_BATCH_SIZE) {
+        vIndexes.push_back(pindex);
+        pindex = chainActive.Next(pindex);
+    }
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and tested against the keys and scripts of the wallet
+ * ahead, on -rescanthreads threads, and cs_main and cs_wallet are only
+ * taken to apply a batch of blocks, so the node keeps validating.
  * @returns -1 if process was cancelled or the number of tx added to the wallet.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, bool fromStartup)
@@ -1510,9 +1581,12 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
 
     const Consensus::Params& consensus = Params().GetConsensus();
 
-    CBlockIndex* pindex = pindexStart;
+    const CBlockIndex* pindex = pindexStart;
+    double dProgressStart;
+    double dProgressTip;
+    std::vector<const CBlockIndex*> vNext;
     {
-        LOCK2(cs_main, cs_wallet);
+        LOCK(cs_main);
 
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
@@ -1520,37 +1594,94 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, b
                 (pindex->nHeight < 1 || !consensus.NetworkUpgradeActive(pindex->nHeight - 1, Consensus::UPGRADE_ZC)))
             pindex = chainActive.Next(pindex);
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
-        std::set<uint256> setAddedToWallet;
-        while (pindex) {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+        dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+        GetRescanBatch(pindex, vNext);
+    }
 
-            if (fromStartup && ShutdownRequested()) {
-                return -1;
-            }
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            int posInBlock;
-            for (posInBlock = 0; posInBlock < (int)block.vtx.size(); posInBlock++) {
-                if (AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate))
-                    ret++;
-            }
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0) nThreads = GetNumCores();
+    CRescanPrefetcher prefetcher(std::max(1, std::min(nThreads, MAX_RESCAN_THREADS)));
 
-            // Will try to rescan it if zPIV upgrade is active.
-            doZPivRescan(pindex, block, setAddedToWallet, consensus, fCheckZPIV);
+    std::shared_ptr<CRescanFilter> filter = std::make_shared<CRescanFilter>();
+    GetRescanFilter(*filter);
+    prefetcher.Start(vNext, filter);
 
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+    std::set<uint256> setAddedToWallet;
+    std::vector<CRescanPrefetcher::Block> vBlocks;
+    while (!vNext.empty()) {
+        prefetcher.Wait(vBlocks);
+
+        // Read the next batch, while this one is applied
+        {
+            LOCK(cs_main);
+            GetRescanBatch(chainActive.Next(vBlocks.back().pindex), vNext);
+        }
+        prefetcher.Start(vNext, filter);
+
+        const CBlockIndex* pindexFork = nullptr;
+        {
+            LOCK2(cs_main, cs_wallet);
+            for (CRescanPrefetcher::Block& item : vBlocks) {
+                pindex = item.pindex;
+
+                // The rest was disconnected meanwhile, continue on the active chain
+                if (!chainActive.Contains(pindex)) {
+                    pindexFork = chainActive.FindFork(pindex);
+                    break;
+                }
+
+                if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+
+                if (fromStartup && ShutdownRequested()) {
+                    return -1;
+                }
+
+                // Keys added by the transactions found so far, e.g. from the keypool, need a new filter
+                if (filter->nKeyStoreSize != GetKeyStoreSize()) {
+                    filter = std::make_shared<CRescanFilter>();
+                    GetRescanFilter(*filter);
+                }
+                if (item.filter != filter) {
+                    for (size_t i = 0; i < item.block.vtx.size(); i++)
+                        item.vRelevant[i] = filter->IsRelevant(*item.block.vtx[i]);
+                }
+
+                const CBlock& block = item.block;
+                for (int posInBlock = 0; posInBlock < (int)block.vtx.size(); posInBlock++) {
+                    const CTransaction& tx = *block.vtx[posInBlock];
+                    // Transactions, which neither pay to the wallet, nor are in it, nor spend or
+                    // conflict with its transactions, are skipped by AddToWalletIfInvolvingMe anyway
+                    bool fInvolved = item.vRelevant[posInBlock] || mapWallet.count(tx.GetHash());
+                    for (unsigned int i = 0; !fInvolved && i < tx.vin.size(); i++) {
+                        const COutPoint& prevout = tx.vin[i].prevout;
+                        fInvolved = mapWallet.count(prevout.hash) || mapTxSpends.count(prevout);
+                    }
+                    if (fInvolved && AddToWalletIfInvolvingMe(tx, pindex, posInBlock, fUpdate))
+                        ret++;
+                }
+
+                // Will try to rescan it if zPIV upgrade is active.
+                doZPivRescan(pindex, block, setAddedToWallet, consensus, fCheckZPIV);
+
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+                }
+            }
+
+            if (pindexFork) {
+                // Drop the blocks read ahead, and continue after the fork
+                prefetcher.Wait(vBlocks);
+                GetRescanBatch(chainActive.Next(pindexFork), vNext);
+                prefetcher.Start(vNext, filter);
             }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     return ret;
 }
 
@@ -2048,19 +2179,40 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
-            const uint256& wtxid = it->first;
-            const CWalletTx* pcoin = &(*it).second;
+        // Outputs spent deeper than any reorg can reach won't become available again
+        const int nMinFinalDepth = GetArg("-maxreorg", DEFAULT_MAX_REORG_DEPTH) + 1;
+
+        std::set<COutPoint>::iterator it = setUnspentCoins.begin();
+        while (it != setUnspentCoins.end()) {
+            const uint256 wtxid = it->hash;
+            std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(wtxid);
+            if (mi == mapWallet.end()) {
+                while (it != setUnspentCoins.end() && it->hash == wtxid)
+                    it = setUnspentCoins.erase(it);
+                continue;
+            }
+            const CWalletTx* pcoin = &(*mi).second;
 
             // Check if the tx is selectable
             int nDepth;
-            if (!CheckTXAvailability(pcoin, fOnlyConfirmed, fUseIX, nDepth))
+            if (!CheckTXAvailability(pcoin, fOnlyConfirmed, fUseIX, nDepth) ||
+                // Check min depth requirement for stake inputs
+                (nCoinType == STAKEABLE_COINS && nDepth < 1)) {
+                while (it != setUnspentCoins.end() && it->hash == wtxid)
+                    ++it;
                 continue;
+            }
 
-            // Check min depth requirement for stake inputs
-            if (nCoinType == STAKEABLE_COINS && nDepth < 1) continue;
+            while (it != setUnspentCoins.end() && it->hash == wtxid) {
+                const std::set<COutPoint>::iterator itOut = it++;
+                const unsigned int i = itOut->n;
 
-            for (unsigned int i = 0; i < pcoin->vout.size(); i++) {
+                // Check if the utxo was spent.
+                if (IsSpent(wtxid, i)) {
+                    if (IsSpentFinally(*itOut, nMinFinalDepth))
+                        setUnspentCoins.erase(itOut);
+                    continue;
+                }
 
                 // Check for only 10k utxo
                 if (nCoinType == ONLY_10000 && pcoin->vout[i].GetValue() != Params().Collateral(nHeight)) continue;
@@ -2068,24 +2220,24 @@ bool CWallet::AvailableCoins(std::vector<COutput>* pCoins,      // --> populates
                 // Check for stakeable utxo
                 if (nCoinType == STAKEABLE_COINS && pcoin->vout[i].IsZerocoinMint()) continue;
 
-                // Check if the utxo was spent.
-                if (IsSpent(wtxid, i)) continue;
-
                 isminetype mine = IsMine(pcoin->vout[i]);
 
                 // Check If not mine
-                if (mine == ISMINE_NO) continue;
+                if (mine == ISMINE_NO) {
+                    setUnspentCoins.erase(itOut);
+                    continue;
+                }
 
                 // Check if watch only utxo are allowed
                 if (mine == ISMINE_WATCH_ONLY && coinControl && !coinControl->fAllowWatchOnly) continue;
 
                 // Skip locked utxo
-                if (IsLockedCoin((*it).first, i) && nCoinType != ONLY_10000) continue;
+                if (IsLockedCoin(wtxid, i) && nCoinType != ONLY_10000) continue;
 
                 // Check if we should include zero value utxo
                 if (pcoin->vout[i].nValue <= 0) continue;
 
-                if (fCoinsSelected && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint((*it).first, i)))
+                if (fCoinsSelected && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(wtxid, i)))
                     continue;
 
                 // --Skip P2CS outputs
@@ -2729,37 +2881,56 @@ bool CWallet::CreateCoinStake(
     // P2PKH block signatures were not accepted before v5 update.
     bool onlyP2PK = !consensus.NetworkUpgradeActive(pindexPrev->nHeight + 1, Consensus::UPGRADE_V5_DUMMY);
 
-    // Kernel Search
-    CAmount nCredit;
-    CScript scriptPubKeyKernel;
-    bool fKernelFound = false;
-    int nAttempts = 0;
-    for (const COutput &out : *availableCoins) {
-        CPivStake stakeInput;
-        stakeInput.SetPrevout((CTransaction) *out.tx, out.i);
-
-        //new block came in, move on
-        if (WITH_LOCK(cs_main, return chainActive.Height()) != pindexPrev->nHeight) return false;
+    // Get the new time slot (and verify it's not the same as previous block)
+    const bool fRegTest = Params().IsRegTestNet();
+    nTxNewTime = (fRegTest ? GetAdjustedTime() : GetCurrentTimeSlot());
+    pStakerStatus->SetLastTime(nTxNewTime);
+    if (nTxNewTime <= pindexPrev->nTime && !fRegTest) return false;
 
-        // Make sure the wallet is unlocked and shutdown hasn't been requested
-        if (IsLocked() || ShutdownRequested()) return false;
+    // Make sure the wallet is unlocked and shutdown hasn't been requested
+    if (IsLocked() || ShutdownRequested()) return false;
 
-        // This should never happen
-        if (stakeInput.IsZPIV()) {
-            LogPrintf("%s: ERROR - zPOS is disabled\n", __func__);
-            continue;
+    // Kernel Search: prepare the kernels of all coins, and check the time slot in parallel
+    int nAttempts;
+    int nSearchThreads;
+    std::vector<size_t> vFound;
+    const int64_t nSearchStart = GetTimeMicros();
+    {
+        LOCK(cs_stake_search);
+        if (!pStakeSearch) {
+            int nThreads = GetArg("-stakingthreads", DEFAULT_STAKING_THREADS);
+            if (nThreads <= 0) nThreads = GetNumCores();
+            pStakeSearch = new CStakeSearch(std::max(1, std::min(nThreads, MAX_STAKING_THREADS)));
         }
 
-        nCredit = 0;
+        nAttempts = WITH_LOCK(cs_main, return pStakeSearch->Prepare(pindexPrev, nBits, *availableCoins));
+        vFound = pStakeSearch->Search(nTxNewTime);
+        nSearchThreads = pStakeSearch->GetThreadCount();
+    }
+    const int64_t nSearchMicros = GetTimeMicros() - nSearchStart;
+
+    // update staker status (attempts, search statistics)
+    pStakerStatus->SetLastTries(nAttempts);
+    pStakerStatus->AddSearch(nAttempts, nSearchMicros, !fRegTest && GetCurrentTimeSlot() != nTxNewTime);
+    LogPrint(BCLog::STAKING, "%s: checked %d kernels in %.2fms on %d threads\n", __func__,
+            nAttempts, nSearchMicros * 0.001, nSearchThreads);
 
-        nAttempts++;
-        fKernelFound = Stake(pindexPrev, &stakeInput, nBits, nTxNewTime);
+    //new block came in, move on
+    if (WITH_LOCK(cs_main, return chainActive.Height()) != pindexPrev->nHeight) return false;
+
+    CAmount nCredit;
+    bool fKernelFound = false;
+    for (const size_t nCoin : vFound) {
+        const COutput& out = (*availableCoins)[nCoin];
+        CPivStake stakeInput;
+        stakeInput.SetPrevout((CTransaction) *out.tx, out.i);
 
-        // update staker status (time, attempts)
-        pStakerStatus->SetLastTime(nTxNewTime);
-        pStakerStatus->SetLastTries(nAttempts);
+        // Double check the kernel found by the search
+        if (!stakeInput.ContextCheck(nHeight, nTxNewTime)) continue;
+        CStakeKernel stakeKernel(pindexPrev, &stakeInput, nBits, nTxNewTime);
+        if (!stakeKernel.CheckKernelHash(true)) continue;
 
-        if (!fKernelFound) continue;
+        nCredit = 0;
 
         // Found a kernel
         LogPrintf("CreateCoinStake : kernel found\n");
@@ -2815,6 +2986,7 @@ bool CWallet::CreateCoinStake(
         }
         txNew.vin.emplace_back(in);
 
+        fKernelFound = true;
         break;
     }
     LogPrint(BCLog::STAKING, "%s: attempted staking %d times\n", __func__, nAttempts);
@@ -2891,7 +3063,7 @@ CWallet::CommitResult CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey&
 
         // Try ATMP. This must not fail. The transaction has already been signed and recorded.
         CValidationState state;
-        if (!AcceptToMemoryPool(mempool, state, wtxNew, false, nullptr, false, true, false)) {
+        if (!AcceptToMemoryPool(mempool, state, MakeTransactionRef(wtxNew), false, nullptr, false, true, false)) {
             res.state = state;
             // Abandon the transaction
             if (AbandonTransaction(res.hashTx)) {
@@ -2975,6 +3147,9 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
     if (nLoadWalletRet != DB_LOAD_OK)
         return nLoadWalletRet;
 
+    // Watch-only scripts are loaded after the transactions
+    RebuildUnspentCoins();
+
     uiInterface.LoadWallet(this);
 
     return DB_LOAD_OK;
@@ -3745,6 +3920,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-mintxfee=<amt>", strprintf(_("Fees (in %s/Kb) smaller than this are considered zero fee for transaction creation (default: %s)"), CURRENCY_UNIT, FormatMoney(CWallet::minTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"), CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions") + " " + _("on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Set the number of threads reading blocks for a rescan (0 = all cores, max: %d, default: %d)"), MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet file") + " " + _("on startup"));
     strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), DEFAULT_SEND_FREE_TRANSACTIONS));
     strUsage += HelpMessageOpt("-spendzeroconfchange", strprintf(_("Spend unconfirmed change when sending transactions (default: %u)"), DEFAULT_SPEND_ZEROCONF_CHANGE));
@@ -3760,6 +3936,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-genproclimit=<n>", strprintf(_("Set the number of threads for coin generation if enabled (-1 = all cores, default: %d)"), DEFAULT_GENERATE_PROCLIMIT));
     strUsage += HelpMessageOpt("-minstakesplit=<amt>", strprintf(_("Minimum positive amount (in PIV) allowed by GUI and RPC for the stake split threshold (default: %s)"), FormatMoney(DEFAULT_MIN_STAKE_SPLIT_THRESHOLD)));
     strUsage += HelpMessageOpt("-staking=<n>", strprintf(_("Enable staking functionality (0-1, default: %u)"), DEFAULT_STAKING));
+    strUsage += HelpMessageOpt("-stakingthreads=<n>", strprintf(_("Set the number of threads for the stake kernel search (0 = all cores, max: %d, default: %d)"), MAX_STAKING_THREADS, DEFAULT_STAKING_THREADS));
     if (showDebug) {
         strUsage += HelpMessageGroup(_("Wallet debugging/testing options:"));
         strUsage += HelpMessageOpt("-dblogsize=<n>", strprintf(_("Flush database activity from memory pool to disk log every <n> megabytes (default: %u)"), DEFAULT_WALLET_DBLOGSIZE));
@@ -4084,7 +4261,7 @@ bool CMerkleTx::IsInMainChainImmature() const
 bool CMerkleTx::AcceptToMemoryPool(bool fLimitFree, bool fRejectInsaneFee, bool ignoreFees)
 {
     CValidationState state;
-    bool fAccepted = ::AcceptToMemoryPool(mempool, state, *this, fLimitFree, nullptr, false, fRejectInsaneFee, ignoreFees);
+    bool fAccepted = ::AcceptToMemoryPool(mempool, state, MakeTransactionRef(*this), fLimitFree, nullptr, false, fRejectInsaneFee, ignoreFees);
     if (!fAccepted)
         LogPrintf("%s : %s\n", __func__, state.GetRejectReason());
     return fAccepted;
@@ -4141,6 +4318,7 @@ CWallet::~CWallet()
     delete zwallet;
     delete pwalletdbEncryption;
     delete pStakerStatus;
+    delete pStakeSearch;
 }
 
 void CWallet::SetNull()
@@ -94,6 +94,8 @@ class CCoinControl;
 class COutput;
 class CReserveKey;
 class CScript;
+class CRescanFilter;
+class CStakeSearch;
 class CWalletTx;
 class ScriptPubKeyMan;
 class SaplingScriptPubKeyMan;
@@ -205,6 +207,12 @@ private:
     int64_t nTime{0};
     int nTries{0};
     int nCoins{0};
+    // kernel search statistics
+    int64_t nSearches{0};
+    int64_t nMissedSlots{0};
+    int64_t nHashes{0};
+    int64_t nSearchMicros{0};
+    int64_t nLastSearchMicros{0};
 
 public:
     // Get
@@ -214,17 +222,31 @@ public:
     int GetLastCoins() const { return nCoins; }
     int GetLastTries() const { return nTries; }
     int64_t GetLastTime() const { return nTime; }
+    int64_t GetLastSearchMicros() const { return nLastSearchMicros; }
+    int64_t GetSearches() const { return nSearches; }
+    int64_t GetMissedSlots() const { return nMissedSlots; }
+    int64_t GetHashesPerSecond() const { return (nSearchMicros > 0 ? nHashes * 1000000 / nSearchMicros : 0); }
     // Set
     void SetLastCoins(const int coins) { nCoins = coins; }
     void SetLastTries(const int tries) { nTries = tries; }
     void SetLastTip(const CBlockIndex* lastTip) { tipBlock = lastTip; }
     void SetLastTime(const uint64_t lastTime) { nTime = lastTime; }
+    // Record a kernel search (hashes checked, duration, whether it ended after its time slot)
+    void AddSearch(const int hashes, const int64_t micros, const bool fMissedSlot)
+    {
+        nSearches++;
+        nHashes += hashes;
+        nSearchMicros += micros;
+        nLastSearchMicros = micros;
+        if (fMissedSlot) nMissedSlots++;
+    }
     void SetNull()
     {
         SetLastCoins(0);
         SetLastTries(0);
         SetLastTip(nullptr);
         SetLastTime(0);
+        nSearches = nMissedSlots = nHashes = nSearchMicros = nLastSearchMicros = 0;
     }
     // Check whether staking status is active (last attempt earlier than 30 seconds ago)
     bool IsActive() const { return (nTime + 30) >= GetTime(); }
@@ -284,6 +306,17 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /**
+     * Outputs of wallet transactions, which are mine, and which are not spent
+     * by a transaction buried deeper than the maximum reorg depth.
+     * AvailableCoins() checks these, instead of every output in mapWallet,
+     * and drops the ones, which it finds finally spent.
+     */
+    mutable std::set<COutPoint> setUnspentCoins;
+    void AddToUnspentCoins(const CWalletTx& wtx);
+    void RebuildUnspentCoins();
+    bool IsSpentFinally(const COutPoint& outpoint, int nMinDepth) const;
+
     bool IsKeyUsed(const CPubKey& vchPubKey);
 
     // Zerocoin wallet
@@ -335,6 +368,10 @@ public:
     static CAmount minStakeSplitThreshold;
     // Staker status (last hashed block and time)
     CStakerStatus* pStakerStatus = nullptr;
+    // Serializes stake kernel searches of the staker thread and the generate RPC, acquired before cs_main
+    Mutex cs_stake_search;
+    // Stake kernel search, created on the first stake attempt
+    CStakeSearch* pStakeSearch = nullptr;
 
     // User-defined fee PIV/kb
     bool fUseCustomFee;
@@ -507,7 +544,7 @@ public:
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose = true);
     bool LoadToWallet(const CWalletTx& wtxIn);
-    void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock);
+    void SyncTransaction(const CTransactionRef& ptx, const CBlockIndex *pindex, int posInBlock);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
 
@@ -518,6 +555,10 @@ public:
     bool ActivateSaplingWallet();
 
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false, bool fromStartup = false);
+    /** Fills the filter, which the rescan tests outputs against, with the keys and scripts of the wallet */
+    void GetRescanFilter(CRescanFilter& filter) const;
+    /** Returns the number of keys and scripts in the wallet, which tells if a rescan filter is outdated */
+    size_t GetKeyStoreSize() const;
     void ReacceptWalletTransactions(bool fFirstLoad = false);
     void ResendWalletTransactions(CConnman* connman);
 
@@ -111,7 +111,7 @@ void CWallet::doZPivRescan(const CBlockIndex* pindex, const CBlock& block,
                 // Add the transaction to the wallet
                 posInBlock = 0;
                 for (posInBlock = 0; posInBlock < (int)block.vtx.size(); posInBlock++) {
-                    auto& tx = block.vtx[posInBlock];
+                    const CTransaction& tx = *block.vtx[posInBlock];
                     uint256 txid = tx.GetHash();
                     if (setAddedToWallet.count(txid) || mapWallet.count(txid))
                         continue;
@@ -138,7 +138,7 @@ void CWallet::doZPivRescan(const CBlockIndex* pindex, const CBlock& block,
                     if (ReadBlockFromDisk(blockSpend, pindexSpend)) {
                         posInBlock = 0;
                         for (posInBlock = 0; posInBlock < (int)blockSpend.vtx.size(); posInBlock++) {
-                            auto &tx = blockSpend.vtx[posInBlock];
+                            const CTransaction& tx = *blockSpend.vtx[posInBlock];
                             if (tx.GetHash() == txidSpend)
                                 wtx.SetMerkleBranch(pindexSpend, posInBlock);
                         }
@@ -4,6 +4,7 @@
 
 #include "zpivchain.h"
 
+#include "blockprefetch.h"
 #include "guiinterface.h"
 #include "invalid.h"
 #include "main.h"
@@ -20,7 +21,8 @@ std::map<libzerocoin::CoinDenomination, int64_t> mapZerocoinSupply;
 
 bool BlockToMintValueVector(const CBlock& block, const libzerocoin::CoinDenomination denom, std::vector<CBigNum>& vValues)
 {
-    for (const CTransaction& tx : block.vtx) {
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
         if(!tx.HasZerocoinMintOutputs())
             continue;
 
@@ -45,7 +47,8 @@ bool BlockToMintValueVector(const CBlock& block, const libzerocoin::CoinDenomina
 
 bool BlockToPubcoinList(const CBlock& block, std::list<libzerocoin::PublicCoin>& listPubcoins, bool fFilterInvalid)
 {
-    for (const CTransaction& tx : block.vtx) {
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
         if(!tx.HasZerocoinMintOutputs())
             continue;
 
@@ -87,7 +90,8 @@ bool BlockToPubcoinList(const CBlock& block, std::list<libzerocoin::PublicCoin>&
 //return a list of zerocoin mints contained in a specific block
 bool BlockToZerocoinMintList(const CBlock& block, std::list<CZerocoinMint>& vMints, bool fFilterInvalid)
 {
-    for (const CTransaction& tx : block.vtx) {
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
         if(!tx.HasZerocoinMintOutputs())
             continue;
 
@@ -247,6 +251,64 @@ bool IsSerialInBlockchain(const uint256& hashSerial, int& nHeightTx, uint256& tx
     return IsTransactionInChain(txidSpend, nHeightTx, tx);
 }
 
+namespace {
+
+/** Serial hashes of the zerocoin spends, and pubcoin hashes of the mints of a block, with their txids */
+struct CZerocoinBlockHashes
+{
+    std::vector<std::pair<uint256, uint256> > vSpends;
+    std::vector<std::pair<uint256, uint256> > vMints;
+    std::string strError;
+};
+
+//! Number of spends and mints written to the zerocoinDB per batch by ReindexZerocoinDB
+const size_t ZEROCOIN_REINDEX_BATCH_SIZE = 100000;
+
+/** Parses the zerocoin spends and mints of a block. It doesn't depend on other blocks, nor on cs_main. */
+void ParseZerocoinBlock(const CBlock& block, CZerocoinBlockHashes& hashes)
+{
+    try {
+        for (const CTransactionRef& ptx : block.vtx) {
+            const CTransaction& tx = *ptx;
+            if (tx.IsCoinBase() || !tx.ContainsZerocoins())
+                continue;
+
+            const uint256& txid = tx.GetHash();
+            //Record Serials
+            if (tx.HasZerocoinSpendInputs()) {
+                for (const CTxIn& in : tx.vin) {
+                    // only the serial is recorded, so the spent mint isn't looked up
+                    if (in.IsZerocoinPublicSpend()) {
+                        hashes.vSpends.emplace_back(GetSerialHash(ZPIVModule::parseCoinSpend(in).getCoinSerialNumber()), txid);
+                    } else if (in.IsZerocoinSpend()) {
+                        hashes.vSpends.emplace_back(GetSerialHash(TxInToZerocoinSpend(in).getCoinSerialNumber()), txid);
+                    }
+                }
+            }
+
+            //Record mints
+            if (tx.HasZerocoinMintOutputs()) {
+                for (const CTxOut& out : tx.vout) {
+                    if (!out.IsZerocoinMint())
+                        continue;
+
+                    CValidationState state;
+                    libzerocoin::PublicCoin coin(Params().GetConsensus().Zerocoin_Params(false));
+                    if (!TxOutToPublicCoin(out, coin, state)) {
+                        hashes.strError = strprintf("invalid mint in tx %s", txid.GetHex());
+                        return;
+                    }
+                    hashes.vMints.emplace_back(GetPubCoinHash(coin.getValue()), txid);
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        hashes.strError = e.what();
+    }
+}
+
+} // anon namespace
+
 std::string ReindexZerocoinDB()
 {
     AssertLockHeld(cs_main);
@@ -263,81 +325,75 @@ std::string ReindexZerocoinDB()
 
     const Consensus::Params& consensus = Params().GetConsensus();
     const int zc_start_height = consensus.vUpgrades[Consensus::UPGRADE_ZC].nActivationHeight;
-    CBlockIndex* pindex = chainActive[zc_start_height];
-    std::vector<std::pair<libzerocoin::CoinSpend, uint256> > vSpendInfo;
-    std::vector<std::pair<libzerocoin::PublicCoin, uint256> > vMintInfo;
-    while (pindex) {
-        uiInterface.ShowProgress(_("Reindexing zerocoin database..."), std::max(1, std::min(99, (int)((double)(pindex->nHeight - zc_start_height) / (double)(chainActive.Height() - zc_start_height) * 100))));
-
-        if (pindex->nHeight % 1000 == 0)
-            LogPrintf("Reindexing zerocoin : block %d...\n", pindex->nHeight);
-
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex)) {
-            return _("Reindexing zerocoin failed");
-        }
-        // update supply
-        UpdateZPIVSupplyConnect(block, pindex, true);
-
-        for (const CTransaction& tx : block.vtx) {
-            for (unsigned int i = 0; i < tx.vin.size(); i++) {
-                if (tx.IsCoinBase())
-                    break;
-
-                if (tx.ContainsZerocoins()) {
-                    uint256 txid = tx.GetHash();
-                    //Record Serials
-                    if (tx.HasZerocoinSpendInputs()) {
-                        for (auto& in : tx.vin) {
-                            bool isPublicSpend = in.IsZerocoinPublicSpend();
-                            if (!in.IsZerocoinSpend() && !isPublicSpend)
-                                continue;
-                            if (isPublicSpend) {
-                                libzerocoin::ZerocoinParams* params = consensus.Zerocoin_Params(false);
-                                PublicCoinSpend publicSpend(params);
-                                CValidationState state;
-                                if (!ZPIVModule::ParseZerocoinPublicSpend(in, tx, state, publicSpend)){
-                                    return _("Failed to parse public spend");
-                                }
-                                vSpendInfo.push_back(std::make_pair(publicSpend, txid));
-                            } else {
-                                libzerocoin::CoinSpend spend = TxInToZerocoinSpend(in);
-                                vSpendInfo.push_back(std::make_pair(spend, txid));
-                            }
-                        }
-                    }
-
-                    //Record mints
-                    if (tx.HasZerocoinMintOutputs()) {
-                        for (auto& out : tx.vout) {
-                            if (!out.IsZerocoinMint())
-                                continue;
-
-                            CValidationState state;
-                            const bool v1params = !consensus.NetworkUpgradeActive(pindex->nHeight, Consensus::UPGRADE_ZC_V2);
-                            libzerocoin::PublicCoin coin(consensus.Zerocoin_Params(v1params));
-                            TxOutToPublicCoin(out, coin, state);
-                            vMintInfo.push_back(std::make_pair(coin, txid));
-                        }
-                    }
-                }
+    const int chainHeight = chainActive.Height();
+
+    // Blocks are read and parsed ahead on a pool of threads, while the
+    // supply of the previous batch is updated in chain order. The parse
+    // results outlive the prefetcher, whose workers write to them.
+    std::vector<CZerocoinBlockHashes> vHashes;
+    std::vector<CZerocoinBlockHashes> vNextHashes;
+    const CBlockPrefetcher::ProcessFn fnParse = [&vNextHashes](size_t nPos, const CBlockPrefetcher::Block& item) {
+        ParseZerocoinBlock(item.block, vNextHashes[nPos]);
+    };
+    CBlockPrefetcher prefetcher(std::max(1, std::min(GetNumCores(), MAX_PREFETCH_THREADS)), false);
+    int nNextHeight = zc_start_height;
+    std::vector<const CBlockIndex*> vNext;
+    auto startNext = [&]() {
+        vNext.clear();
+        while (vNext.size() < PREFETCH_BATCH_SIZE && nNextHeight <= chainHeight)
+            vNext.push_back(chainActive[nNextHeight++]);
+        vNextHashes.assign(vNext.size(), CZerocoinBlockHashes());
+        prefetcher.Start(vNext, fnParse);
+    };
+    startNext();
+
+    std::vector<std::pair<uint256, uint256> > vSpendHashes;
+    std::vector<std::pair<uint256, uint256> > vMintHashes;
+    std::vector<CBlockPrefetcher::Block> vBlocks;
+    while (true) {
+        prefetcher.Wait(vBlocks);
+        if (vBlocks.empty())
+            break;
+        vHashes.swap(vNextHashes);
+        startNext();
+
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            CBlockIndex* pindex = chainActive[vBlocks[i].pindex->nHeight];
+            if (pindex->nHeight % 1000 == 0)
+                LogPrintf("Reindexing zerocoin : block %d...\n", pindex->nHeight);
+
+            if (!vBlocks[i].fRead) {
+                return _("Reindexing zerocoin failed");
+            }
+            const CZerocoinBlockHashes& hashes = vHashes[i];
+            if (!hashes.strError.empty()) {
+                LogPrintf("%s : failed to parse block %d: %s\n", __func__, pindex->nHeight, hashes.strError);
+                return _("Reindexing zerocoin failed");
             }
+            // update supply
+            UpdateZPIVSupplyConnect(vBlocks[i].block, pindex, true);
+
+            vSpendHashes.insert(vSpendHashes.end(), hashes.vSpends.begin(), hashes.vSpends.end());
+            vMintHashes.insert(vMintHashes.end(), hashes.vMints.begin(), hashes.vMints.end());
         }
 
-        // Flush the zerocoinDB to disk every 100 blocks
-        if (pindex->nHeight % 100 == 0) {
-            if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
+        // The progress is shown in the RPC warm-up status as well
+        const int nHeight = vBlocks.back().pindex->nHeight;
+        const int percent = std::max(1, std::min(99, (int)((double)(nHeight - zc_start_height) / (double)(chainHeight - zc_start_height) * 100)));
+        uiInterface.ShowProgress(_("Reindexing zerocoin database..."), percent);
+        uiInterface.InitMessage(strprintf(_("Reindexing zerocoin database... (block %d of %d, %d%%)"), nHeight, chainHeight, percent));
+
+        // Flush the zerocoinDB to disk in large batches
+        if (vSpendHashes.size() + vMintHashes.size() >= ZEROCOIN_REINDEX_BATCH_SIZE) {
+            if (!zerocoinDB->WriteCoinHashBatch(vSpendHashes, vMintHashes))
                 return _("Error writing zerocoinDB to disk");
-            vSpendInfo.clear();
-            vMintInfo.clear();
+            vSpendHashes.clear();
+            vMintHashes.clear();
         }
-
-        pindex = chainActive.Next(pindex);
     }
-    uiInterface.ShowProgress("", 100);
 
     // Final flush to disk in case any remaining information exists
-    if ((!vSpendInfo.empty() && !zerocoinDB->WriteCoinSpendBatch(vSpendInfo)) || (!vMintInfo.empty() && !zerocoinDB->WriteCoinMintBatch(vMintInfo)))
+    if ((!vSpendHashes.empty() || !vMintHashes.empty()) && !zerocoinDB->WriteCoinHashBatch(vSpendHashes, vMintHashes))
         return _("Error writing zerocoinDB to disk");
 
     uiInterface.ShowProgress("", 100);
@@ -379,7 +435,8 @@ bool TxOutToPublicCoin(const CTxOut& txout, libzerocoin::PublicCoin& pubCoin, CV
 std::list<libzerocoin::CoinDenomination> ZerocoinSpendListFromBlock(const CBlock& block, bool fFilterInvalid)
 {
     std::list<libzerocoin::CoinDenomination> vSpends;
-    for (const CTransaction& tx : block.vtx) {
+    for (const CTransactionRef& ptx : block.vtx) {
+        const CTransaction& tx = *ptx;
         if (!tx.HasZerocoinSpendInputs())
             continue;
 
@@ -437,7 +494,7 @@ bool UpdateZPIVSupplyConnect(const CBlock& block, CBlockIndex* pindex, bool fJus
                     // Add the transaction to the wallet
                     int posInBlock = 0;
                     for (posInBlock = 0; posInBlock < (int)block.vtx.size(); posInBlock++) {
-                        auto& tx = block.vtx[posInBlock];
+                        const CTransaction& tx = *block.vtx[posInBlock];
                         uint256 txid = tx.GetHash();
                         if (setAddedToWallet.count(txid))
                             continue;
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Rapids developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+'''
+Tests that -reindexzerocoin, which parses the blocks on a pool of threads,
+rebuilds the same zerocoin spends, mints and zPIV supply, which the blocks
+recorded when they were connected.
+'''
+
+from test_framework.test_framework import PivxTestFramework
+from test_framework.util import (
+    sync_blocks,
+    sync_mempools,
+    assert_equal,
+    set_node_times,
+)
+
+
+class ReindexZerocoinTest(PivxTestFramework):
+
+    def set_test_params(self):
+        self.num_nodes = 3
+        # node 0 and node 1 move the chain, node 2 does the spends and is reindexed
+        self.extra_args = [[]]*self.num_nodes
+
+    def setup_chain(self):
+        # Start with PoS cache: 330 blocks
+        self._initialize_chain(toPosPhase=True)
+        self.enable_mocktime()
+
+    def log_title(self):
+        title = "*** Starting %s ***" % self.__class__.__name__
+        underline = "-" * len(title)
+        description = "Tests the zerocoin database after -reindexzerocoin."
+        self.log.info("\n\n%s\n%s\n%s\n", title, underline, description)
+
+    def stake_blocks(self, block_time, n):
+        sync_mempools(self.nodes)
+        for peer in range(2):
+            for i in range(n):
+                block_time = self.generate_pos(peer, block_time)
+            sync_blocks(self.nodes)
+        return block_time
+
+    def get_zerocoin_state(self, serials):
+        node = self.nodes[2]
+        return {
+            "blocks": node.getblockcount(),
+            "zPIVsupply": node.getinfo()["zPIVsupply"],
+            "spends": [node.findserial(serial) for serial in serials],
+        }
+
+    def run_test(self):
+        self.log_title()
+        block_time = self.mocktime
+        set_node_times(self.nodes, block_time)
+
+        # The cache has the mints of node 2
+        listmints = self.nodes[2].listmintedzerocoins(True, True)
+        serial_ids = [mint["serial hash"] for mint in listmints]
+        exported_zerocoins = [x for x in self.nodes[2].exportzerocoins(False) if x["id"] in serial_ids]
+        exported_zerocoins.sort(key=lambda x: x["d"], reverse=False)
+        assert_equal(8, len(exported_zerocoins))
+
+        self.log.info("Staking 70 blocks to get to public spend activation")
+        for j in range(5):
+            block_time = self.stake_blocks(block_time, 7)
+
+        # Spend a few of the mints, in separate blocks
+        spent = exported_zerocoins[1:4]
+        for coin in spent:
+            self.log.info("Spending the minted coin with serial %s..." % coin["s"][:16])
+            txid = self.nodes[2].spendzerocoinmints([coin["id"]])['txid']
+            block_time = self.stake_blocks(block_time, 2)
+            self.check_tx_in_chain(0, txid)
+
+        # The state recorded while connecting the blocks, with the wallet in sync with it
+        self.nodes[2].resetmintzerocoin()
+        serials = [coin["s"] for coin in exported_zerocoins]
+        state = self.get_zerocoin_state(serials)
+        for coin, spend in zip(exported_zerocoins, state["spends"]):
+            assert_equal(spend["success"], coin in spent)
+
+        self.log.info("Restarting node 2 with -reindexzerocoin...")
+        self.restart_node(2, ["-reindexzerocoin"])
+        set_node_times(self.nodes, block_time)
+
+        # The same spends ('s' keys) and supply are rebuilt, and the wallet finds
+        # all of its mints ('m' keys) and spends in the rebuilt database
+        assert_equal(self.get_zerocoin_state(serials), state)
+        res = self.nodes[2].resetmintzerocoin()
+        assert_equal(res["updated"], [])
+        assert_equal(res["archived"], [])
+        self.log.info("--> ZEROCOIN REINDEX PASSED")
+
+
+if __name__ == '__main__':
+    ReindexZerocoinTest().main()